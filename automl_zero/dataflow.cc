@@ -0,0 +1,727 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dataflow.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace automl_zero {
+
+using ::std::find;  // NOLINT
+using ::std::make_shared;  // NOLINT
+using ::std::max;  // NOLINT
+using ::std::shared_ptr;  // NOLINT
+using ::std::vector;  // NOLINT
+
+namespace {
+
+constexpr OperandType kNo = kNoOperand;
+constexpr OperandType kS = kScalarOperand;
+constexpr OperandType kV = kVectorOperand;
+constexpr OperandType kM = kMatrixOperand;
+
+OpSignature Signature(const OperandType in1, const OperandType in2,
+                      const OperandType out) {
+  OpSignature signature;
+  signature.in1 = in1;
+  signature.in2 = in2;
+  signature.out = out;
+  signature.partial_out = false;
+  signature.random = false;
+  return signature;
+}
+
+OpSignature PartialOutSignature(const OperandType out) {
+  OpSignature signature = Signature(kNo, kNo, out);
+  signature.partial_out = true;
+  return signature;
+}
+
+OpSignature RandomSignature(const OperandType out) {
+  OpSignature signature = Signature(kNo, kNo, out);
+  signature.random = true;
+  return signature;
+}
+
+// Propagates liveness backwards through a component function. `live` holds the
+// addresses live after the component function and is updated to hold those
+// live before it. If `is_live` is not nullptr, it is filled with the liveness
+// of each instruction.
+void PropagateBackward(
+    const vector<shared_ptr<const Instruction>>& component_function,
+    AddressSet* live, vector<bool>* is_live) {
+  if (is_live != nullptr) {
+    is_live->assign(component_function.size(), false);
+  }
+  for (IntegerT position = component_function.size() - 1; position >= 0;
+       --position) {
+    const Instruction& instruction = *component_function[position];
+    const OpSignature signature = GetOpSignature(instruction.op_);
+    const bool writes_live = signature.out != kNoOperand &&
+        live->Contains(signature.out, instruction.out_);
+    if (!signature.random && !writes_live) continue;
+    if (is_live != nullptr) (*is_live)[position] = true;
+    if (signature.out != kNoOperand && !signature.partial_out) {
+      live->Erase(signature.out, instruction.out_);
+    }
+    if (signature.in1 != kNoOperand) {
+      live->Insert(signature.in1, instruction.in1_);
+    }
+    if (signature.in2 != kNoOperand) {
+      live->Insert(signature.in2, instruction.in2_);
+    }
+  }
+}
+
+// Adds the addresses a component function writes to `written`. Returns whether
+// it draws random numbers.
+bool CollectWrites(
+    const vector<shared_ptr<const Instruction>>& component_function,
+    AddressSet* written) {
+  bool random = false;
+  for (const shared_ptr<const Instruction>& instruction : component_function) {
+    const OpSignature signature = GetOpSignature(instruction->op_);
+    if (signature.random) random = true;
+    if (signature.out != kNoOperand) {
+      written->Insert(signature.out, instruction->out_);
+    }
+  }
+  return random;
+}
+
+// Adds the addresses an instruction reads to `read`.
+void ReadAddresses(const Instruction& instruction,
+                   const OpSignature& signature, AddressSet* read) {
+  if (signature.in1 != kNoOperand) {
+    read->Insert(signature.in1, instruction.in1_);
+  }
+  if (signature.in2 != kNoOperand) {
+    read->Insert(signature.in2, instruction.in2_);
+  }
+  if (signature.partial_out) {
+    read->Insert(signature.out, instruction.out_);
+  }
+}
+
+// The addresses the Executor assigns before running predict or learn.
+AddressSet AssignedAddresses() {
+  AddressSet assigned;
+  assigned.Insert(kScalarOperand, kLabelsScalarAddress);
+  assigned.Insert(kVectorOperand, kFeaturesVectorAddress);
+  return assigned;
+}
+
+// The Executor assigns the labels and reads the predictions at the scalar
+// addresses below this, and assigns the features at the vector addresses below
+// this.
+constexpr AddressT kNumFixedScalarAddresses =
+    (kLabelsScalarAddress > kPredictionsScalarAddress ?
+     kLabelsScalarAddress : kPredictionsScalarAddress) + 1;
+constexpr AddressT kNumFixedVectorAddresses = kFeaturesVectorAddress + 1;
+
+// Updates the usage to include the given address.
+void UseAddress(const OperandType type, const AddressT address,
+                AddressUsage* usage) {
+  switch (type) {
+    case kNoOperand:
+      return;
+    case kScalarOperand:
+      usage->num_scalars = max<AddressT>(usage->num_scalars, address + 1);
+      return;
+    case kVectorOperand:
+      usage->num_vectors = max<AddressT>(usage->num_vectors, address + 1);
+      return;
+    case kMatrixOperand:
+      usage->num_matrices = max<AddressT>(usage->num_matrices, address + 1);
+      return;
+  }
+}
+
+void UseAddresses(
+    const vector<shared_ptr<const Instruction>>& component_function,
+    AddressUsage* usage) {
+  for (const shared_ptr<const Instruction>& instruction : component_function) {
+    const OpSignature signature = GetOpSignature(instruction->op_);
+    UseAddress(signature.in1, instruction->in1_, usage);
+    UseAddress(signature.in2, instruction->in2_, usage);
+    UseAddress(signature.out, instruction->out_, usage);
+  }
+}
+
+// Maps the addresses of one memory space to their compact numbers.
+class AddressRenumbering {
+ public:
+  // The addresses below `num_fixed` keep their numbers.
+  AddressRenumbering(const AddressT num_fixed, const IntegerT num_addresses)
+      : new_addresses_(num_addresses, kUnassigned), num_assigned_(num_fixed) {
+    for (AddressT address = 0; address < num_fixed; ++address) {
+      new_addresses_[address] = address;
+    }
+  }
+
+  // Returns the compact number of the address, assigning the next free one
+  // on first use.
+  AddressT Renumber(const AddressT address) {
+    if (new_addresses_[address] == kUnassigned) {
+      new_addresses_[address] = num_assigned_;
+      ++num_assigned_;
+    }
+    return new_addresses_[address];
+  }
+
+ private:
+  static constexpr IntegerT kUnassigned = -1;
+  vector<IntegerT> new_addresses_;
+  AddressT num_assigned_;
+};
+
+class Renumbering {
+ public:
+  Renumbering()
+      : scalars_(kNumFixedScalarAddresses, kMaxScalarAddresses),
+        vectors_(kNumFixedVectorAddresses, kMaxVectorAddresses),
+        matrices_(0, kMaxMatrixAddresses) {}
+
+  AddressT Renumber(const OperandType type, const AddressT address) {
+    switch (type) {
+      case kScalarOperand:
+        return scalars_.Renumber(address);
+      case kVectorOperand:
+        return vectors_.Renumber(address);
+      case kMatrixOperand:
+        return matrices_.Renumber(address);
+      case kNoOperand:
+        LOG(FATAL) << "No address space." << std::endl;
+    }
+  }
+
+  // Returns the instruction with its operands renumbered. Shares it if none
+  // changes.
+  shared_ptr<const Instruction> Renumber(
+      const shared_ptr<const Instruction>& instruction) {
+    const OpSignature signature = GetOpSignature(instruction->op_);
+    Instruction renumbered = *instruction;
+    if (signature.in1 != kNoOperand) {
+      renumbered.in1_ = Renumber(signature.in1, instruction->in1_);
+    }
+    if (signature.in2 != kNoOperand) {
+      renumbered.in2_ = Renumber(signature.in2, instruction->in2_);
+    }
+    if (signature.out != kNoOperand) {
+      renumbered.out_ = Renumber(signature.out, instruction->out_);
+    }
+    if (renumbered.in1_ == instruction->in1_ &&
+        renumbered.in2_ == instruction->in2_ &&
+        renumbered.out_ == instruction->out_) {
+      return instruction;
+    }
+    return make_shared<const Instruction>(renumbered);
+  }
+
+  void Renumber(
+      const vector<shared_ptr<const Instruction>>& component_function,
+      vector<shared_ptr<const Instruction>>* renumbered) {
+    renumbered->clear();
+    renumbered->reserve(component_function.size());
+    for (const shared_ptr<const Instruction>& instruction :
+         component_function) {
+      renumbered->push_back(Renumber(instruction));
+    }
+  }
+
+ private:
+  AddressRenumbering scalars_;
+  AddressRenumbering vectors_;
+  AddressRenumbering matrices_;
+};
+
+// Whether a NaN anywhere in an input of the op makes some coordinate of its
+// output NaN, whatever the other inputs. Not the case for the comparisons
+// (heaviside, min and max), which may drop a NaN, nor for the ops that set
+// their output regardless of the inputs.
+bool PropagatesNans(const Op op) {
+  switch (op) {
+    case SCALAR_SUM_OP:
+    case SCALAR_DIFF_OP:
+    case SCALAR_PRODUCT_OP:
+    case SCALAR_DIVISION_OP:
+    case SCALAR_ABS_OP:
+    case SCALAR_RECIPROCAL_OP:
+    case SCALAR_SIN_OP:
+    case SCALAR_COS_OP:
+    case SCALAR_TAN_OP:
+    case SCALAR_ARCSIN_OP:
+    case SCALAR_ARCCOS_OP:
+    case SCALAR_ARCTAN_OP:
+    case SCALAR_EXP_OP:
+    case SCALAR_LOG_OP:
+    case SCALAR_VECTOR_PRODUCT_OP:
+    case SCALAR_BROADCAST_OP:
+    case VECTOR_RECIPROCAL_OP:
+    case VECTOR_NORM_OP:
+    case VECTOR_ABS_OP:
+    case VECTOR_SUM_OP:
+    case VECTOR_DIFF_OP:
+    case VECTOR_PRODUCT_OP:
+    case VECTOR_DIVISION_OP:
+    case VECTOR_INNER_PRODUCT_OP:
+    case VECTOR_OUTER_PRODUCT_OP:
+    case SCALAR_MATRIX_PRODUCT_OP:
+    case MATRIX_RECIPROCAL_OP:
+    case MATRIX_VECTOR_PRODUCT_OP:
+    case VECTOR_COLUMN_BROADCAST_OP:
+    case VECTOR_ROW_BROADCAST_OP:
+    case MATRIX_NORM_OP:
+    case MATRIX_COLUMN_NORM_OP:
+    case MATRIX_ROW_NORM_OP:
+    case MATRIX_TRANSPOSE_OP:
+    case MATRIX_ABS_OP:
+    case MATRIX_SUM_OP:
+    case MATRIX_DIFF_OP:
+    case MATRIX_PRODUCT_OP:
+    case MATRIX_DIVISION_OP:
+    case MATRIX_MATRIX_PRODUCT_OP:
+    case VECTOR_MEAN_OP:
+    case MATRIX_MEAN_OP:
+    case MATRIX_ROW_MEAN_OP:
+    case MATRIX_ROW_ST_DEV_OP:
+    case VECTOR_ST_DEV_OP:
+    case MATRIX_ST_DEV_OP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Propagates forward through a component function the addresses that
+// certainly hold a NaN in some coordinate.
+void PropagateNans(
+    const vector<shared_ptr<const Instruction>>& component_function,
+    AddressSet* nans) {
+  for (const shared_ptr<const Instruction>& instruction : component_function) {
+    const OpSignature signature = GetOpSignature(instruction->op_);
+    if (signature.out == kNoOperand) continue;
+    // Writing part of the output may overwrite the NaN it held.
+    const bool writes_nan =
+        !signature.partial_out && PropagatesNans(instruction->op_) &&
+        ((signature.in1 != kNoOperand &&
+          nans->Contains(signature.in1, instruction->in1_)) ||
+         (signature.in2 != kNoOperand &&
+          nans->Contains(signature.in2, instruction->in2_)));
+    if (writes_nan) {
+      nans->Insert(signature.out, instruction->out_);
+    } else {
+      nans->Erase(signature.out, instruction->out_);
+    }
+  }
+}
+
+// The number of training examples GetFatalNanAddresses follows a NaN for.
+constexpr IntegerT kMaxFatalNanExamples = 64;
+
+}  // namespace
+
+OpSignature GetOpSignature(const Op op) {
+  switch (op) {
+    case NO_OP:
+      return Signature(kNo, kNo, kNo);
+    case SCALAR_SUM_OP:
+    case SCALAR_DIFF_OP:
+    case SCALAR_PRODUCT_OP:
+    case SCALAR_DIVISION_OP:
+    case SCALAR_MIN_OP:
+    case SCALAR_MAX_OP:
+      return Signature(kS, kS, kS);
+    case SCALAR_ABS_OP:
+    case SCALAR_RECIPROCAL_OP:
+    case SCALAR_SIN_OP:
+    case SCALAR_COS_OP:
+    case SCALAR_TAN_OP:
+    case SCALAR_ARCSIN_OP:
+    case SCALAR_ARCCOS_OP:
+    case SCALAR_ARCTAN_OP:
+    case SCALAR_EXP_OP:
+    case SCALAR_LOG_OP:
+    case SCALAR_HEAVYSIDE_OP:
+      return Signature(kS, kNo, kS);
+    case VECTOR_HEAVYSIDE_OP:
+    case VECTOR_RECIPROCAL_OP:
+    case VECTOR_ABS_OP:
+      return Signature(kV, kNo, kV);
+    case MATRIX_HEAVYSIDE_OP:
+    case MATRIX_RECIPROCAL_OP:
+    case MATRIX_TRANSPOSE_OP:
+    case MATRIX_ABS_OP:
+      return Signature(kM, kNo, kM);
+    case SCALAR_VECTOR_PRODUCT_OP:
+      return Signature(kS, kV, kV);
+    case SCALAR_BROADCAST_OP:
+      return Signature(kS, kNo, kV);
+    case VECTOR_NORM_OP:
+    case VECTOR_MEAN_OP:
+    case VECTOR_ST_DEV_OP:
+      return Signature(kV, kNo, kS);
+    case VECTOR_SUM_OP:
+    case VECTOR_DIFF_OP:
+    case VECTOR_PRODUCT_OP:
+    case VECTOR_DIVISION_OP:
+    case VECTOR_MIN_OP:
+    case VECTOR_MAX_OP:
+      return Signature(kV, kV, kV);
+    case VECTOR_INNER_PRODUCT_OP:
+      return Signature(kV, kV, kS);
+    case VECTOR_OUTER_PRODUCT_OP:
+      return Signature(kV, kV, kM);
+    case SCALAR_MATRIX_PRODUCT_OP:
+      return Signature(kS, kM, kM);
+    case MATRIX_VECTOR_PRODUCT_OP:
+      return Signature(kM, kV, kV);
+    case VECTOR_COLUMN_BROADCAST_OP:
+    case VECTOR_ROW_BROADCAST_OP:
+      return Signature(kV, kNo, kM);
+    case MATRIX_NORM_OP:
+    case MATRIX_MEAN_OP:
+    case MATRIX_ST_DEV_OP:
+      return Signature(kM, kNo, kS);
+    case MATRIX_COLUMN_NORM_OP:
+    case MATRIX_ROW_NORM_OP:
+    case MATRIX_ROW_MEAN_OP:
+    case MATRIX_ROW_ST_DEV_OP:
+      return Signature(kM, kNo, kV);
+    case MATRIX_SUM_OP:
+    case MATRIX_DIFF_OP:
+    case MATRIX_PRODUCT_OP:
+    case MATRIX_DIVISION_OP:
+    case MATRIX_MIN_OP:
+    case MATRIX_MAX_OP:
+    case MATRIX_MATRIX_PRODUCT_OP:
+      return Signature(kM, kM, kM);
+    case SCALAR_CONST_SET_OP:
+      return Signature(kNo, kNo, kS);
+    case VECTOR_CONST_SET_OP:
+      return PartialOutSignature(kV);
+    case MATRIX_CONST_SET_OP:
+      return PartialOutSignature(kM);
+    case SCALAR_UNIFORM_SET_OP:
+    case SCALAR_GAUSSIAN_SET_OP:
+      return RandomSignature(kS);
+    case VECTOR_UNIFORM_SET_OP:
+    case VECTOR_GAUSSIAN_SET_OP:
+      return RandomSignature(kV);
+    case MATRIX_UNIFORM_SET_OP:
+    case MATRIX_GAUSSIAN_SET_OP:
+      return RandomSignature(kM);
+    default:
+      return RandomSignature(kNo);
+  }
+}
+
+bool AddressSet::Contains(
+    const OperandType type, const AddressT address) const {
+  switch (type) {
+    case kScalarOperand:
+      return scalars_.test(address);
+    case kVectorOperand:
+      return vectors_.test(address);
+    case kMatrixOperand:
+      return matrices_.test(address);
+    case kNoOperand:
+      LOG(FATAL) << "No address space." << std::endl;
+  }
+}
+
+void AddressSet::Insert(const OperandType type, const AddressT address) {
+  switch (type) {
+    case kScalarOperand:
+      scalars_.set(address);
+      return;
+    case kVectorOperand:
+      vectors_.set(address);
+      return;
+    case kMatrixOperand:
+      matrices_.set(address);
+      return;
+    case kNoOperand:
+      LOG(FATAL) << "No address space." << std::endl;
+  }
+}
+
+void AddressSet::Erase(const OperandType type, const AddressT address) {
+  switch (type) {
+    case kScalarOperand:
+      scalars_.reset(address);
+      return;
+    case kVectorOperand:
+      vectors_.reset(address);
+      return;
+    case kMatrixOperand:
+      matrices_.reset(address);
+      return;
+    case kNoOperand:
+      LOG(FATAL) << "No address space." << std::endl;
+  }
+}
+
+void AddressSet::InsertAll(const AddressSet& other) {
+  scalars_ |= other.scalars_;
+  vectors_ |= other.vectors_;
+  matrices_ |= other.matrices_;
+}
+
+void AddressSet::EraseAll(const AddressSet& other) {
+  scalars_ &= ~other.scalars_;
+  vectors_ &= ~other.vectors_;
+  matrices_ &= ~other.matrices_;
+}
+
+bool AddressSet::operator==(const AddressSet& other) const {
+  return scalars_ == other.scalars_ && vectors_ == other.vectors_ &&
+      matrices_ == other.matrices_;
+}
+
+Liveness ComputeLiveness(const Algorithm& algorithm) {
+  const AddressSet assigned = AssignedAddresses();
+
+  // The addresses live on entry to predict and learn, right after the Executor
+  // assigns the features and the labels. They grow monotonically until they
+  // reach the fixed point.
+  AddressSet predict_in;
+  AddressSet learn_in;
+  AddressSet predict_out;
+  AddressSet learn_out;
+  while (true) {
+    // Predict is followed by learn (training), by another predict (validation)
+    // or by the end of the execution. Its prediction is always observed.
+    predict_out = AddressSet();
+    predict_out.Insert(kScalarOperand, kPredictionsScalarAddress);
+    predict_out.InsertAll(learn_in);
+    predict_out.InsertAll(predict_in);
+    predict_out.EraseAll(assigned);
+    // Learn is followed by predict or by the end of the execution.
+    learn_out = predict_in;
+    learn_out.EraseAll(assigned);
+
+    AddressSet new_predict_in = predict_out;
+    PropagateBackward(algorithm.predict_, &new_predict_in, nullptr);
+    AddressSet new_learn_in = learn_out;
+    PropagateBackward(algorithm.learn_, &new_learn_in, nullptr);
+    new_predict_in.InsertAll(predict_in);
+    new_learn_in.InsertAll(learn_in);
+    if (new_predict_in == predict_in && new_learn_in == learn_in) break;
+    predict_in = new_predict_in;
+    learn_in = new_learn_in;
+  }
+
+  Liveness liveness;
+  PropagateBackward(algorithm.predict_, &predict_out, &liveness.predict);
+  PropagateBackward(algorithm.learn_, &learn_out, &liveness.learn);
+  // Setup is followed by predict.
+  AddressSet setup_out = predict_in;
+  setup_out.EraseAll(assigned);
+  PropagateBackward(algorithm.setup_, &setup_out, &liveness.setup);
+  return liveness;
+}
+
+Algorithm PruneDeadInstructions(const Algorithm& algorithm) {
+  const Liveness liveness = ComputeLiveness(algorithm);
+  Algorithm pruned;
+  for (IntegerT i = 0; i < algorithm.setup_.size(); ++i) {
+    if (liveness.setup[i]) pruned.setup_.push_back(algorithm.setup_[i]);
+  }
+  for (IntegerT i = 0; i < algorithm.predict_.size(); ++i) {
+    if (liveness.predict[i]) pruned.predict_.push_back(algorithm.predict_[i]);
+  }
+  for (IntegerT i = 0; i < algorithm.learn_.size(); ++i) {
+    if (liveness.learn[i]) pruned.learn_.push_back(algorithm.learn_[i]);
+  }
+  return pruned;
+}
+
+Algorithm HoistInvariantInstructions(const Algorithm& algorithm) {
+  // The addresses written by at least one and by more than one instruction of
+  // predict or learn.
+  AddressSet written;
+  AddressSet written_repeatedly;
+  AddressSet predict_reads;
+  for (const vector<shared_ptr<const Instruction>>* component_function :
+       {&algorithm.predict_, &algorithm.learn_}) {
+    for (const shared_ptr<const Instruction>& instruction :
+         *component_function) {
+      const OpSignature signature = GetOpSignature(instruction->op_);
+      if (component_function == &algorithm.predict_) {
+        ReadAddresses(*instruction, signature, &predict_reads);
+      }
+      if (signature.out == kNoOperand) continue;
+      if (written.Contains(signature.out, instruction->out_)) {
+        written_repeatedly.Insert(signature.out, instruction->out_);
+      }
+      written.Insert(signature.out, instruction->out_);
+    }
+  }
+
+  // The addresses whose value may change from example to example. The
+  // Executor assigns the features and labels, and converts the predictions.
+  AddressSet executor_addresses = AssignedAddresses();
+  executor_addresses.Insert(kScalarOperand, kPredictionsScalarAddress);
+  AddressSet variable = written;
+  variable.InsertAll(executor_addresses);
+
+  Algorithm hoisted;
+  hoisted.setup_ = algorithm.setup_;
+  // Predict first, as on the first example, so that the instructions moved
+  // keep their relative order.
+  for (const bool is_learn : {false, true}) {
+    const vector<shared_ptr<const Instruction>>& component_function =
+        is_learn ? algorithm.learn_ : algorithm.predict_;
+    vector<shared_ptr<const Instruction>>* kept =
+        is_learn ? &hoisted.learn_ : &hoisted.predict_;
+    AddressSet read_before;
+    for (const shared_ptr<const Instruction>& instruction :
+         component_function) {
+      const OpSignature signature = GetOpSignature(instruction->op_);
+      const bool invariant =
+          !signature.random && !signature.partial_out &&
+          signature.out != kNoOperand &&
+          !executor_addresses.Contains(signature.out, instruction->out_) &&
+          !written_repeatedly.Contains(signature.out, instruction->out_) &&
+          !read_before.Contains(signature.out, instruction->out_) &&
+          // Predict runs before learn on the first example.
+          !(is_learn &&
+            predict_reads.Contains(signature.out, instruction->out_)) &&
+          (signature.in1 == kNoOperand ||
+           !variable.Contains(signature.in1, instruction->in1_)) &&
+          (signature.in2 == kNoOperand ||
+           !variable.Contains(signature.in2, instruction->in2_));
+      ReadAddresses(*instruction, signature, &read_before);
+      if (invariant) {
+        hoisted.setup_.push_back(instruction);
+        variable.Erase(signature.out, instruction->out_);
+      } else {
+        kept->push_back(instruction);
+      }
+    }
+  }
+  return hoisted;
+}
+
+bool LearnIsLive(const Algorithm& algorithm) {
+  const Liveness liveness = ComputeLiveness(algorithm);
+  for (const bool is_live : liveness.learn) {
+    if (is_live) return true;
+  }
+  return false;
+}
+
+AddressUsage GetAddressUsage(const Algorithm& algorithm) {
+  AddressUsage usage;
+  usage.num_scalars = kNumFixedScalarAddresses;
+  usage.num_vectors = kNumFixedVectorAddresses;
+  usage.num_matrices = 0;
+  UseAddresses(algorithm.setup_, &usage);
+  UseAddresses(algorithm.predict_, &usage);
+  UseAddresses(algorithm.learn_, &usage);
+  return usage;
+}
+
+Algorithm CompactAddresses(const Algorithm& algorithm) {
+  Renumbering renumbering;
+  Algorithm compacted;
+  renumbering.Renumber(algorithm.setup_, &compacted.setup_);
+  renumbering.Renumber(algorithm.predict_, &compacted.predict_);
+  renumbering.Renumber(algorithm.learn_, &compacted.learn_);
+  return compacted;
+}
+
+PredictionDependence GetPredictionDependence(const Algorithm& algorithm) {
+  AddressSet written;
+  if (CollectWrites(algorithm.predict_, &written) ||
+      CollectWrites(algorithm.learn_, &written)) {
+    return kVariablePredictions;
+  }
+  if (!written.Contains(kScalarOperand, kPredictionsScalarAddress)) {
+    return kUnwrittenPredictions;
+  }
+
+  // Propagates forward through predict which addresses may hold a value that
+  // changes from example to example. Initially, these are the features and
+  // everything that predict or learn write, whose value depends on the previous
+  // examples. The labels are always zero in predict.
+  AddressSet variable = written;
+  variable.Insert(kVectorOperand, kFeaturesVectorAddress);
+  variable.Erase(kScalarOperand, kLabelsScalarAddress);
+  for (const shared_ptr<const Instruction>& instruction : algorithm.predict_) {
+    const OpSignature signature = GetOpSignature(instruction->op_);
+    if (signature.out == kNoOperand) continue;
+    const bool reads_variable =
+        (signature.in1 != kNoOperand &&
+         variable.Contains(signature.in1, instruction->in1_)) ||
+        (signature.in2 != kNoOperand &&
+         variable.Contains(signature.in2, instruction->in2_)) ||
+        (signature.partial_out &&
+         variable.Contains(signature.out, instruction->out_));
+    if (reads_variable) {
+      variable.Insert(signature.out, instruction->out_);
+    } else {
+      variable.Erase(signature.out, instruction->out_);
+    }
+  }
+  return variable.Contains(kScalarOperand, kPredictionsScalarAddress) ?
+      kVariablePredictions : kConstantPredictions;
+}
+
+vector<FatalNanAddress> GetFatalNanAddresses(const Algorithm& algorithm) {
+  AddressSet written;
+  if (CollectWrites(algorithm.predict_, &written) ||
+      CollectWrites(algorithm.learn_, &written)) {
+    return {};
+  }
+  const AddressSet assigned = AssignedAddresses();
+  const AddressSet none;
+  vector<FatalNanAddress> fatal_addresses;
+  for (const OperandType type :
+       {kScalarOperand, kVectorOperand, kMatrixOperand}) {
+    const IntegerT num_addresses =
+        type == kScalarOperand ? kMaxScalarAddresses :
+        type == kVectorOperand ? kMaxVectorAddresses : kMaxMatrixAddresses;
+    for (AddressT address = 0; address < num_addresses; ++address) {
+      if (!written.Contains(type, address)) continue;
+      // Follows the NaN through the examples, until it reaches the
+      // predictions, is lost, or the addresses holding it repeat.
+      AddressSet nans;
+      nans.Insert(type, address);
+      vector<AddressSet> seen;
+      for (IntegerT num_examples = 1; num_examples <= kMaxFatalNanExamples;
+           ++num_examples) {
+        nans.EraseAll(assigned);
+        PropagateNans(algorithm.predict_, &nans);
+        // The probability conversion of the Executor keeps NaNs.
+        if (nans.Contains(kScalarOperand, kPredictionsScalarAddress)) {
+          fatal_addresses.push_back({type, address, num_examples});
+          break;
+        }
+        nans.EraseAll(assigned);
+        PropagateNans(algorithm.learn_, &nans);
+        if (nans == none ||
+            find(seen.begin(), seen.end(), nans) != seen.end()) {
+          break;
+        }
+        seen.push_back(nans);
+      }
+    }
+  }
+  return fatal_addresses;
+}
+
+}  // namespace automl_zero
@@ -0,0 +1,177 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Data-flow analyses over Algorithms.
+
+#ifndef AUTOML_ZERO_DATAFLOW_H_
+#define AUTOML_ZERO_DATAFLOW_H_
+
+#include <bitset>
+#include <vector>
+
+#include "algorithm.h"
+#include "definitions.h"
+#include "instruction.pb.h"
+#include "instruction.h"
+
+namespace automl_zero {
+
+// The memory space an instruction operand lives in.
+enum OperandType : IntegerT {
+  kNoOperand = 0,
+  kScalarOperand = 1,
+  kVectorOperand = 2,
+  kMatrixOperand = 3
+};
+
+// Which memory the kernel of an op reads and writes.
+struct OpSignature {
+  OperandType in1;
+  OperandType in2;
+  OperandType out;
+  // Whether the op only writes part of the output (e.g. one coordinate of a
+  // vector), so that the previous value of the output is read too.
+  bool partial_out;
+  // Whether the op draws from the RandomGenerator.
+  bool random;
+};
+
+// Returns the signature of an op. Ops that are not known to the Executor have
+// no operands and are marked as random, so that analyses keep them.
+OpSignature GetOpSignature(Op op);
+
+// A set of memory addresses, for each memory space.
+class AddressSet {
+ public:
+  AddressSet() {}
+
+  bool Contains(OperandType type, AddressT address) const;
+  void Insert(OperandType type, AddressT address);
+  void Erase(OperandType type, AddressT address);
+
+  // Set union and difference.
+  void InsertAll(const AddressSet& other);
+  void EraseAll(const AddressSet& other);
+
+  bool operator==(const AddressSet& other) const;
+  bool operator!=(const AddressSet& other) const {return !(*this == other);}
+
+ private:
+  std::bitset<kMaxScalarAddresses> scalars_;
+  std::bitset<kMaxVectorAddresses> vectors_;
+  std::bitset<kMaxMatrixAddresses> matrices_;
+};
+
+// For each instruction in each component function, whether it is live. An
+// instruction is live if it may affect a prediction, either directly or through
+// the memory carried over to later examples, or if it draws random numbers.
+// Removing all the instructions that are not live does not change any
+// prediction or the sequence of random draws.
+struct Liveness {
+  std::vector<bool> setup;
+  std::vector<bool> predict;
+  std::vector<bool> learn;
+};
+
+// Analyzes the Algorithm as the Executor runs it: the setup once, then predict
+// and learn for each training example, and predict alone for each validation
+// example, with epochs alternating between the two. The Executor assigns the
+// features vector before every predict and learn, and the labels scalar before
+// every predict (zero) and learn (the label), so their previous values are
+// never observed. The liveness of the memory carried across examples is
+// computed as a fixed point.
+Liveness ComputeLiveness(const Algorithm& algorithm);
+
+// Returns a copy of the Algorithm with only the live instructions. The
+// instructions are shared with the original Algorithm.
+Algorithm PruneDeadInstructions(const Algorithm& algorithm);
+
+// Returns a copy of the Algorithm where the instructions of predict and learn
+// that compute the same value for every example are moved to the end of the
+// setup, which the Executor runs once before the first example. An instruction
+// is moved if it draws no random numbers, reads neither the features, the
+// labels nor the predictions, and only reads memory that predict and learn do
+// not write or that is written by instructions already moved. Its output must
+// not be written by any other instruction of predict or learn, nor read before
+// it on the first example. Executing the copy produces the same predictions
+// and random draws. The instructions are shared with the original Algorithm.
+Algorithm HoistInvariantInstructions(const Algorithm& algorithm);
+
+// Whether any instruction of learn is live, i.e. whether anything learn writes
+// can reach what predict reads, directly or through the memory carried across
+// examples, or whether learn draws random numbers. If not, training is only
+// needed for its early stopping checks and learn can be skipped.
+bool LearnIsLive(const Algorithm& algorithm);
+
+// The number of addresses in each memory space that an Algorithm needs,
+// counting from zero: one past the largest address any instruction reads or
+// writes. The addresses the Executor uses itself (labels, predictions and
+// features) are always included.
+struct AddressUsage {
+  AddressT num_scalars;
+  AddressT num_vectors;
+  AddressT num_matrices;
+};
+AddressUsage GetAddressUsage(const Algorithm& algorithm);
+
+// Returns a copy of the Algorithm where the addresses used in each memory space
+// are renumbered consecutively in order of first use, so that the memory it
+// needs is as small and dense as possible. The labels, predictions and
+// features addresses are not renumbered. Renumbering is one-to-one, so
+// executing the copy produces the same predictions. Instructions that keep
+// their addresses are shared with the original Algorithm.
+Algorithm CompactAddresses(const Algorithm& algorithm);
+
+// How the predictions of an Algorithm depend on the examples.
+enum PredictionDependence : IntegerT {
+  // The predictions may change from example to example.
+  kVariablePredictions = 0,
+  // Every predict computes the same prediction, only from the zero label and
+  // from memory that the setup leaves and that predict and learn never write.
+  kConstantPredictions = 1,
+  // Neither predict nor learn write the predictions, which keep the value the
+  // setup leaves (up to the conversions the Executor itself applies).
+  kUnwrittenPredictions = 2
+};
+
+// Analyzes the Algorithm as ComputeLiveness does. Only returns something other
+// than kVariablePredictions if predict and learn do not draw random numbers
+// either, so that not running them at all changes neither the predictions nor
+// the sequence of random draws.
+PredictionDependence GetPredictionDependence(const Algorithm& algorithm);
+
+// An address where a NaN at the end of learn is certain to make a prediction
+// NaN after a few more training examples, whatever the examples and the random
+// draws, so that the Executor will stop training early.
+struct FatalNanAddress {
+  OperandType type;
+  AddressT address;
+  // The number of further training examples until the prediction is NaN: 1 if
+  // it is the prediction of the next example.
+  IntegerT num_examples;
+};
+
+// Analyzes the Algorithm as ComputeLiveness does, for the addresses that
+// predict or learn write, and returns those where a NaN is fatal. A NaN
+// anywhere in a vector or matrix counts. NaNs are followed through the
+// arithmetic ops, but not through the heaviside, min and max ops, which may
+// drop them, nor through ops that write only part of their output. Infinities
+// are not followed, as they may become finite again (e.g. through the
+// reciprocal). Returns none if predict or learn draw random numbers, as
+// stopping early would change the random draws of what is executed next.
+std::vector<FatalNanAddress> GetFatalNanAddresses(const Algorithm& algorithm);
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_DATAFLOW_H_
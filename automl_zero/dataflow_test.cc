@@ -0,0 +1,514 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dataflow.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "task.h"
+#include "task_util.h"
+#include "definitions.h"
+#include "instruction.pb.h"
+#include "algorithm.h"
+#include "executor.h"
+#include "generator.h"
+#include "instruction.h"
+#include "random_generator.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+
+namespace automl_zero {
+
+using ::absl::StrCat;  // NOLINT
+using ::std::make_shared;  // NOLINT
+using ::std::mt19937;  // NOLINT
+using ::std::shared_ptr;  // NOLINT
+using ::std::vector;  // NOLINT
+using test_only::GenerateTask;
+
+constexpr IntegerT kNumTrainExamples = 100;
+constexpr IntegerT kNumValidExamples = 20;
+constexpr double kMaxAbsError = 100.0;
+constexpr IntegerT kNumAlgorithms = 200;
+
+// The number of instructions that are not NO_OPs.
+IntegerT NumOps(
+    const vector<shared_ptr<const Instruction>>& component_function) {
+  IntegerT num_ops = 0;
+  for (const shared_ptr<const Instruction>& instruction : component_function) {
+    if (instruction->op_ != NO_OP) ++num_ops;
+  }
+  return num_ops;
+}
+
+TEST(DataflowTest, RemovesInstructionsThatDoNotReachThePrediction) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2,
+      ActivationDataSetter(1.0)));
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 3,
+      ActivationDataSetter(2.0)));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 3, 3, 4));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_PRODUCT_OP, 2, 2, kPredictionsScalarAddress));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(VECTOR_SUM_OP, 0, 0, 1));
+
+  const Liveness liveness = ComputeLiveness(algorithm);
+  EXPECT_EQ(liveness.setup, vector<bool>({true, false}));
+  EXPECT_EQ(liveness.predict, vector<bool>({false, true, false}));
+  EXPECT_TRUE(liveness.learn.empty());
+
+  const Algorithm pruned = PruneDeadInstructions(algorithm);
+  ASSERT_EQ(pruned.setup_.size(), 1);
+  EXPECT_EQ(pruned.setup_[0], algorithm.setup_[0]);
+  ASSERT_EQ(pruned.predict_.size(), 1);
+  EXPECT_EQ(pruned.predict_[0], algorithm.predict_[1]);
+}
+
+TEST(DataflowTest, KeepsStateCarriedAcrossExamples) {
+  // The learn component function updates the weights that predict reads on
+  // the next example.
+  Generator generator;
+  const Algorithm algorithm = generator.LinearModel(kDefaultLearningRate);
+  const Algorithm pruned = PruneDeadInstructions(algorithm);
+  // Only the padding is removed.
+  EXPECT_EQ(pruned.setup_.size(), NumOps(algorithm.setup_));
+  EXPECT_EQ(pruned.predict_.size(), NumOps(algorithm.predict_));
+  EXPECT_EQ(pruned.learn_.size(), NumOps(algorithm.learn_));
+  EXPECT_EQ(pruned.learn_.size(), 4);
+}
+
+TEST(DataflowTest, KeepsStateCarriedFromPredictToPredict) {
+  Algorithm algorithm;
+  // s2 counts the predictions and s3 is only carried until the next learn,
+  // which does not read it.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 4,
+      ActivationDataSetter(1.0)));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 2, 4, 2));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 2, 2,
+                                     kPredictionsScalarAddress));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 2, 2, 3));
+  const Liveness liveness = ComputeLiveness(algorithm);
+  EXPECT_EQ(liveness.predict, vector<bool>({true, true, true, false}));
+}
+
+TEST(DataflowTest, AssignedFeaturesAndLabelsAreNotCarried) {
+  Algorithm algorithm;
+  // Writes to the features and the labels are overwritten by the Executor
+  // before predict and learn read them.
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, kLabelsScalarAddress,
+      ActivationDataSetter(1.0)));
+  algorithm.setup_.emplace_back(
+      make_shared<const Instruction>(SCALAR_BROADCAST_OP, 2,
+                                     kFeaturesVectorAddress));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(VECTOR_INNER_PRODUCT_OP,
+                                     kFeaturesVectorAddress,
+                                     kFeaturesVectorAddress,
+                                     kPredictionsScalarAddress));
+  algorithm.learn_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, kLabelsScalarAddress,
+                                     kLabelsScalarAddress,
+                                     kLabelsScalarAddress));
+  const Liveness liveness = ComputeLiveness(algorithm);
+  EXPECT_EQ(liveness.setup, vector<bool>({false, false}));
+  EXPECT_EQ(liveness.predict, vector<bool>({true}));
+  EXPECT_EQ(liveness.learn, vector<bool>({false}));
+}
+
+TEST(DataflowTest, KeepsRandomOps) {
+  RandomGenerator rand_gen;
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(
+      make_shared<const Instruction>(VECTOR_GAUSSIAN_SET_OP, &rand_gen));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_UNIFORM_SET_OP, &rand_gen));
+  algorithm.learn_.emplace_back(
+      make_shared<const Instruction>(MATRIX_GAUSSIAN_SET_OP, &rand_gen));
+  const Liveness liveness = ComputeLiveness(algorithm);
+  EXPECT_EQ(liveness.setup, vector<bool>({true}));
+  EXPECT_EQ(liveness.predict, vector<bool>({true}));
+  EXPECT_EQ(liveness.learn, vector<bool>({true}));
+}
+
+TEST(DataflowTest, PartialWritesKeepTheEarlierWrite) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(
+      make_shared<const Instruction>(SCALAR_BROADCAST_OP, 2, 1));
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      VECTOR_CONST_SET_OP, 1,
+      FloatDataSetter(IndexToFloat(2, 4)),
+      FloatDataSetter(3.0)));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(VECTOR_INNER_PRODUCT_OP, 0, 1,
+                                     kPredictionsScalarAddress));
+  const Liveness liveness = ComputeLiveness(algorithm);
+  EXPECT_EQ(liveness.setup, vector<bool>({true, true}));
+}
+
+TEST(DataflowTest, CompactsAddresses) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 7,
+      ActivationDataSetter(1.0)));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(VECTOR_OUTER_PRODUCT_OP, 0, 5, 3));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(MATRIX_VECTOR_PRODUCT_OP, 3, 5, 9));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(VECTOR_INNER_PRODUCT_OP, 9, 0, 4));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 4, 7,
+                                     kPredictionsScalarAddress));
+  const AddressUsage usage = GetAddressUsage(algorithm);
+  EXPECT_EQ(usage.num_scalars, 8);
+  EXPECT_EQ(usage.num_vectors, 10);
+  EXPECT_EQ(usage.num_matrices, 4);
+
+  const Algorithm compacted = CompactAddresses(algorithm);
+  ASSERT_EQ(compacted.setup_.size(), 1);
+  EXPECT_EQ(compacted.setup_[0]->out_, 2);
+  ASSERT_EQ(compacted.predict_.size(), 4);
+  EXPECT_EQ(compacted.predict_[0]->in1_, kFeaturesVectorAddress);
+  EXPECT_EQ(compacted.predict_[0]->in2_, 1);
+  EXPECT_EQ(compacted.predict_[0]->out_, 0);
+  EXPECT_EQ(compacted.predict_[1]->in1_, 0);
+  EXPECT_EQ(compacted.predict_[1]->in2_, 1);
+  EXPECT_EQ(compacted.predict_[1]->out_, 2);
+  EXPECT_EQ(compacted.predict_[2]->in1_, 2);
+  EXPECT_EQ(compacted.predict_[2]->in2_, kFeaturesVectorAddress);
+  EXPECT_EQ(compacted.predict_[2]->out_, 3);
+  EXPECT_EQ(compacted.predict_[3]->in1_, 3);
+  EXPECT_EQ(compacted.predict_[3]->in2_, 2);
+  EXPECT_EQ(compacted.predict_[3]->out_, kPredictionsScalarAddress);
+  const AddressUsage compacted_usage = GetAddressUsage(compacted);
+  EXPECT_EQ(compacted_usage.num_scalars, 4);
+  EXPECT_EQ(compacted_usage.num_vectors, 3);
+  EXPECT_EQ(compacted_usage.num_matrices, 1);
+}
+
+TEST(DataflowTest, HoistsInvariantInstructions) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      MATRIX_GAUSSIAN_SET_OP, 1,
+      FloatDataSetter(0.0), FloatDataSetter(1.0)));
+  // Invariant: only reads the setup.
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(MATRIX_TRANSPOSE_OP, 1, 2));
+  // Invariant: only reads what is moved.
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(MATRIX_NORM_OP, 2, 3));
+  // Reads the features.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      MATRIX_VECTOR_PRODUCT_OP, 2, kFeaturesVectorAddress, 1));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_INNER_PRODUCT_OP, 1, 1, kPredictionsScalarAddress));
+  // Invariant.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 4, ActivationDataSetter(0.1)));
+  // Reads the labels.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_PRODUCT_OP, kLabelsScalarAddress, 4, 5));
+
+  const Algorithm hoisted = HoistInvariantInstructions(algorithm);
+  ASSERT_EQ(hoisted.setup_.size(), 4);
+  EXPECT_EQ(hoisted.setup_[0], algorithm.setup_[0]);
+  EXPECT_EQ(hoisted.setup_[1], algorithm.predict_[0]);
+  EXPECT_EQ(hoisted.setup_[2], algorithm.predict_[1]);
+  EXPECT_EQ(hoisted.setup_[3], algorithm.learn_[0]);
+  ASSERT_EQ(hoisted.predict_.size(), 2);
+  EXPECT_EQ(hoisted.predict_[0], algorithm.predict_[2]);
+  EXPECT_EQ(hoisted.predict_[1], algorithm.predict_[3]);
+  ASSERT_EQ(hoisted.learn_.size(), 1);
+  EXPECT_EQ(hoisted.learn_[0], algorithm.learn_[1]);
+}
+
+TEST(DataflowTest, DoesNotHoistWhatIsObservedBeforeItIsWritten) {
+  Algorithm algorithm;
+  // Reads s2 before it is written, so the first example sees the old value.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, 2, kPredictionsScalarAddress));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2, ActivationDataSetter(1.0)));
+  // Read by predict, which runs before learn.
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 3, 3, 4));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 3, ActivationDataSetter(1.0)));
+  // Written twice.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 5, ActivationDataSetter(1.0)));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, kLabelsScalarAddress, kLabelsScalarAddress, 5));
+  // Draws random numbers.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_GAUSSIAN_SET_OP, 6,
+      FloatDataSetter(0.0), FloatDataSetter(1.0)));
+
+  const Algorithm hoisted = HoistInvariantInstructions(algorithm);
+  EXPECT_TRUE(hoisted.setup_.empty());
+  EXPECT_EQ(hoisted.predict_, algorithm.predict_);
+  EXPECT_EQ(hoisted.learn_, algorithm.learn_);
+}
+
+TEST(DataflowTest, LearnIsLiveIfItReachesPredict) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, 3, kPredictionsScalarAddress));
+  // Reaches predict through the memory carried to the next example.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, kLabelsScalarAddress, 4, 3));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, kLabelsScalarAddress, 4, 4));
+  EXPECT_TRUE(LearnIsLive(algorithm));
+}
+
+TEST(DataflowTest, LearnIsNotLiveIfPredictOverwritesIt) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 3, ActivationDataSetter(1.0)));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, 3, kPredictionsScalarAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, kLabelsScalarAddress, 4, 3));
+  EXPECT_FALSE(LearnIsLive(algorithm));
+}
+
+TEST(DataflowTest, LearnIsLiveIfItDrawsRandomNumbers) {
+  Algorithm algorithm;
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_GAUSSIAN_SET_OP, 2,
+      FloatDataSetter(0.0), FloatDataSetter(1.0)));
+  EXPECT_TRUE(LearnIsLive(algorithm));
+}
+
+TEST(DataflowTest, DetectsUnwrittenPredictions) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, kPredictionsScalarAddress,
+      ActivationDataSetter(1.0)));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(VECTOR_SUM_OP, 0, 0, 1));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, kLabelsScalarAddress, 2, 2));
+  EXPECT_EQ(GetPredictionDependence(algorithm), kUnwrittenPredictions);
+}
+
+TEST(DataflowTest, DetectsConstantPredictions) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2, ActivationDataSetter(1.0)));
+  // Reads the zero label and memory that does not change.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, kLabelsScalarAddress, 3));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_PRODUCT_OP, 3, 3, kPredictionsScalarAddress));
+  // Writes, but only to memory predict does not read.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, kLabelsScalarAddress, 4, 4));
+  EXPECT_EQ(GetPredictionDependence(algorithm), kConstantPredictions);
+}
+
+TEST(DataflowTest, DetectsPredictionsThatDependOnTheFeatures) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_NORM_OP, kFeaturesVectorAddress, kPredictionsScalarAddress));
+  EXPECT_EQ(GetPredictionDependence(algorithm), kVariablePredictions);
+}
+
+TEST(DataflowTest, DetectsPredictionsThatDependOnLearn) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, 2, kPredictionsScalarAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, kLabelsScalarAddress, kLabelsScalarAddress, 2));
+  EXPECT_EQ(GetPredictionDependence(algorithm), kVariablePredictions);
+}
+
+TEST(DataflowTest, DetectsPredictionsCarriedAcrossExamples) {
+  Algorithm algorithm;
+  // Reads the previous value before writing it.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, 3, 3));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 3, 3, kPredictionsScalarAddress));
+  EXPECT_EQ(GetPredictionDependence(algorithm), kVariablePredictions);
+}
+
+TEST(DataflowTest, RandomOpsMakePredictionsVariable) {
+  Algorithm algorithm;
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_GAUSSIAN_SET_OP, 2,
+      FloatDataSetter(0.0), FloatDataSetter(1.0)));
+  EXPECT_EQ(GetPredictionDependence(algorithm), kVariablePredictions);
+}
+
+// The fatal NaN addresses, each as {type, address, num_examples}.
+vector<vector<IntegerT>> FatalNans(const Algorithm& algorithm) {
+  vector<vector<IntegerT>> fatal_nans;
+  for (const FatalNanAddress& fatal : GetFatalNanAddresses(algorithm)) {
+    fatal_nans.push_back({fatal.type, fatal.address, fatal.num_examples});
+  }
+  return fatal_nans;
+}
+
+TEST(DataflowTest, FollowsNansAcrossExamples) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, kLabelsScalarAddress, kPredictionsScalarAddress));
+  // Each example moves the NaN one address closer to the prediction. The NaN
+  // in 4 stays there.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 3, kLabelsScalarAddress, 2));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 4, kLabelsScalarAddress, 3));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_PRODUCT_OP, 4, kLabelsScalarAddress, 4));
+  // The predictions are overwritten by predict.
+  EXPECT_EQ(FatalNans(algorithm),
+            vector<vector<IntegerT>>({{kScalarOperand, 2, 1},
+                                      {kScalarOperand, 3, 2},
+                                      {kScalarOperand, 4, 3}}));
+}
+
+TEST(DataflowTest, ComparisonsMayDropNans) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_HEAVYSIDE_OP, 2, 3));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_MAX_OP, 3, 4, kPredictionsScalarAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, kLabelsScalarAddress, 2));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 4, kLabelsScalarAddress, 4));
+  EXPECT_TRUE(FatalNans(algorithm).empty());
+}
+
+TEST(DataflowTest, NansAnywhereInVectorsAreFollowed) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_INNER_PRODUCT_OP, kFeaturesVectorAddress, 1,
+      kPredictionsScalarAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_VECTOR_PRODUCT_OP, kLabelsScalarAddress, 2, 1));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      VECTOR_SUM_OP, 2, 2, 2));
+  EXPECT_EQ(FatalNans(algorithm),
+            vector<vector<IntegerT>>({{kVectorOperand, 1, 1},
+                                      {kVectorOperand, 2, 2}}));
+
+  // A partial write may overwrite the NaN.
+  algorithm.learn_.emplace(
+      algorithm.learn_.begin() + 1,
+      make_shared<const Instruction>(
+          VECTOR_CONST_SET_OP, 1,
+          FloatDataSetter(IndexToFloat(2, 4)), FloatDataSetter(3.0)));
+  EXPECT_EQ(FatalNans(algorithm),
+            vector<vector<IntegerT>>({{kVectorOperand, 1, 1}}));
+}
+
+TEST(DataflowTest, NansInAssignedAddressesAreNotFatal) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_NORM_OP, kFeaturesVectorAddress, 2));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, kLabelsScalarAddress, kPredictionsScalarAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_RECIPROCAL_OP, 2, kLabelsScalarAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_VECTOR_PRODUCT_OP, 2, kFeaturesVectorAddress,
+      kFeaturesVectorAddress));
+  EXPECT_TRUE(FatalNans(algorithm).empty());
+}
+
+// Checks that executing the transformed random Algorithms gives the same
+// fitness and random draws as executing the original ones.
+void ExpectSameExecution(Algorithm (*transform)(const Algorithm&),
+                         const bool wipe_used_memory_only) {
+  const Task<4> task = GenerateTask<4>(StrCat(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: ", kNumTrainExamples, " "
+      "num_valid_examples: ", kNumValidExamples, " "
+      "num_train_epochs: 2 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 "));
+  vector<Op> all_ops;
+  for (IntegerT op = 0; op < Op_ARRAYSIZE; ++op) {
+    if (Op_IsValid(op)) all_ops.push_back(static_cast<Op>(op));
+  }
+  mt19937 bit_gen(10000);
+  RandomGenerator rand_gen(&bit_gen);
+  Generator generator(NO_OP_ALGORITHM, 8, 10, 10, all_ops, all_ops, all_ops,
+                      &bit_gen, &rand_gen);
+  for (IntegerT i = 0; i < kNumAlgorithms; ++i) {
+    const Algorithm algorithm = generator.Random();
+    const Algorithm transformed = transform(algorithm);
+
+    mt19937 expected_bit_gen(i);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> expected_executor(algorithm, task, kNumTrainExamples,
+                                  kNumValidExamples, &expected_rand_gen,
+                                  kMaxAbsError);
+    const double expected_fitness = expected_executor.Execute();
+
+    mt19937 actual_bit_gen(i);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    Executor<4> actual_executor(transformed, task, kNumTrainExamples,
+                                kNumValidExamples, &actual_rand_gen,
+                                kMaxAbsError,
+                                false,  // use_jit
+                                wipe_used_memory_only);
+    const double actual_fitness = actual_executor.Execute();
+
+    EXPECT_EQ(actual_fitness, expected_fitness);
+    EXPECT_EQ(actual_executor.GetNumTrainStepsCompleted(),
+              expected_executor.GetNumTrainStepsCompleted());
+    // The random draws happen in the same order.
+    EXPECT_EQ(actual_bit_gen(), expected_bit_gen());
+  }
+}
+
+TEST(DataflowTest, PruningDoesNotChangeTheFitness) {
+  ExpectSameExecution(PruneDeadInstructions, false);
+}
+
+TEST(DataflowTest, CompactingDoesNotChangeTheFitness) {
+  ExpectSameExecution(CompactAddresses, true);
+}
+
+TEST(DataflowTest, HoistingDoesNotChangeTheFitness) {
+  ExpectSameExecution(HoistInvariantInstructions, false);
+}
+
+TEST(DataflowTest, PruningHoistingAndCompactingDoNotChangeTheFitness) {
+  ExpectSameExecution(
+      [](const Algorithm& algorithm) {
+        return CompactAddresses(HoistInvariantInstructions(
+            PruneDeadInstructions(algorithm)));
+      },
+      true);
+}
+
+}  // namespace automl_zero
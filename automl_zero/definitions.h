@@ -47,9 +47,11 @@
 // Preprocessor directives.
 ////////////////////////////////////////////////////////////////////////////////
 
-// These allow defining compile-time flags. They can be used to evolve larger
-// component functions without forcing the evolution of small component
-// functions to be slow.
+// These allow defining compile-time flags. They set how many addresses the
+// Memory has room for. The addresses the search actually uses are set at run
+// time with the num_*_addresses fields of the SearchExperimentSpec, up to
+// these, so they only need to be raised to evolve component functions that
+// need more addresses than the defaults.
 
 // NOTE: if you specify any of these in the command line and you want to analyze
 // the results in Colab, you must specify the same values when you use
@@ -65,6 +67,18 @@
   #define MAX_MATRIX_ADDRESSES 20
 #endif
 
+// The features sizes that tasks can have. Applies X to each one, to
+// instantiate the templates and dispatch on the size of a task at run time.
+// Each size adds to the build time and the binary size. Sizes need not be
+// powers of two; sizes above 32 use cache-blocked kernels (see
+// simd_kernels.h). With double precision, the size must be at most 128, as
+// Eigen does not allow larger fixed-size matrices. To change the list, define
+// e.g. -D'AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(X)=X(4) X(12)'.
+#ifndef AUTOML_ZERO_FOR_EACH_FEATURES_SIZE
+  #define AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(X) \
+    X(2) X(4) X(8) X(10) X(16) X(20) X(32) X(64) X(128)
+#endif
+
 namespace automl_zero {
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -88,13 +102,28 @@ typedef uint32_t RandomSeedT;
 // Index for the coordinates of the activations for any rank > 0.
 typedef int FeatureIndexT;
 
+// The floating-point type of the memory and of the task data. Building with
+// --copt=-DSINGLE_PRECISION selects float, which doubles the number of
+// elements each SIMD instruction of the op kernels processes. Fitnesses and
+// losses are always accumulated in double.
+//
+// This is a build variant, not an experiment setting: it cannot be chosen in
+// the SearchExperimentSpec, and every binary uses one precision for all its
+// experiments. Fitnesses from the two variants differ (by less than 1e-6 in
+// the precision tests, which print the deltas), so do not compare them across
+// variants or mix them through checkpoints or migration. The JIT is not
+// available in this variant.
+#ifdef SINGLE_PRECISION
+typedef float Scalar;
+#else
 typedef double Scalar;
+#endif
 
 template <FeatureIndexT F>
-using Vector = ::Eigen::Matrix<double, F, 1>;
+using Vector = ::Eigen::Matrix<Scalar, F, 1>;
 
 template <FeatureIndexT F>
-using Matrix = ::Eigen::Matrix<double, F, F, ::Eigen::RowMajor>;
+using Matrix = ::Eigen::Matrix<Scalar, F, F, ::Eigen::RowMajor>;
 
 enum Choice2T : IntegerT {
   kChoice0of2 = 0,
@@ -155,6 +184,19 @@ constexpr AddressT kMaxVectorAddresses = MAX_VECTOR_ADDRESSES;
 constexpr AddressT kFirstOutMatrixAddress = 0;
 constexpr AddressT kMaxMatrixAddresses = MAX_MATRIX_ADDRESSES;
 
+// Mini-batch addresses. For tasks with a batch size larger than 1, predict and
+// learn see a whole mini-batch of n examples at a time, instead of the
+// features vector and the labels scalar above:
+// -Row i < n of the batch features matrix holds the features of example i.
+//  The other rows are zero.
+// -Element i < n of the labels vector holds the label of example i during
+//  learn. The vector is zero during predict, and beyond n.
+// -Predict writes the prediction for example i to element i of the
+//  predictions vector. For ACCURACY tasks, learn sees the probabilities, as
+//  with the predictions scalar.
+constexpr AddressT kBatchFeaturesMatrixAddress = 0;
+// kLabelsVectorAddress and kPredictionsVectorAddress above.
+
 template <FeatureIndexT F>
 std::string VectorToString(const Vector<F>& value) {
   std::ostringstream message;
@@ -0,0 +1,173 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "evaluation_ladder.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+
+namespace automl_zero {
+
+using ::std::endl;  // NOLINT
+using ::std::fixed;  // NOLINT
+using ::std::min;  // NOLINT
+using ::std::ostream;  // NOLINT
+using ::std::set;  // NOLINT
+using ::std::setprecision;  // NOLINT
+using ::std::upper_bound;  // NOLINT
+using ::std::vector;  // NOLINT
+using internal::PromotionThreshold;
+
+namespace {
+
+vector<EvaluationRung> RungsOrDefault(const vector<EvaluationRung>& rungs) {
+  return rungs.empty() ? DefaultEvaluationRungs() : rungs;
+}
+
+}  // namespace
+
+EvaluationLadder::EvaluationLadder(const vector<EvaluationRung>& rungs,
+                                   Evaluator* evaluator)
+    : rungs_(RungsOrDefault(rungs)),
+      evaluator_(evaluator),
+      rung_stats_(rungs_.size()),
+      has_promotion_threshold_(rungs_.size(), false),
+      promotion_thresholds_(rungs_.size(), kMinFitness),
+      generation_fitnesses_(rungs_.size()),
+      generation_estimates_(rungs_.size()) {
+  for (const EvaluationRung& rung : rungs_) {
+    CHECK_GE(rung.promotion_quantile(), 0.0);
+    CHECK_LE(rung.promotion_quantile(), 1.0);
+  }
+}
+
+double EvaluationLadder::Evaluate(const Algorithm& algorithm,
+                                  double* first_rung_fitness,
+                                  bool* first_rung_fitness_is_estimate) {
+  double fitness = kMinFitness;
+  for (IntegerT rung = 0; rung < rungs_.size(); ++rung) {
+    if (rung > 0) {
+      if (!has_promotion_threshold_[rung - 1] ||
+          fitness <= promotion_thresholds_[rung - 1]) {
+        break;
+      }
+      ++rung_stats_[rung - 1].num_promoted;
+    }
+    const IntegerT start_train_steps = evaluator_->GetNumTrainStepsCompleted();
+    const bool can_promote =
+        rung + 1 < rungs_.size() && has_promotion_threshold_[rung];
+    bool fitness_is_estimate;
+    fitness = evaluator_->Evaluate(
+        algorithm, rungs_[rung],
+        can_promote ? promotion_thresholds_[rung] : kMinFitness,
+        &fitness_is_estimate);
+    ++rung_stats_[rung].num_evaluated;
+    rung_stats_[rung].num_train_steps +=
+        evaluator_->GetNumTrainStepsCompleted() - start_train_steps;
+    if (fitness_is_estimate) {
+      ++rung_stats_[rung].num_estimated;
+      generation_estimates_[rung].push_back(fitness);
+    } else {
+      generation_fitnesses_[rung].push_back(fitness);
+    }
+    if (rung == 0 && first_rung_fitness != nullptr) {
+      *first_rung_fitness = fitness;
+    }
+    if (rung == 0 && first_rung_fitness_is_estimate != nullptr) {
+      *first_rung_fitness_is_estimate = fitness_is_estimate;
+    }
+  }
+  return fitness;
+}
+
+void EvaluationLadder::EndGeneration() {
+  for (IntegerT rung = 0; rung < rungs_.size(); ++rung) {
+    if (!generation_fitnesses_[rung].empty() ||
+        !generation_estimates_[rung].empty()) {
+      // The fitnesses were only estimated against the current threshold.
+      promotion_thresholds_[rung] = PromotionThreshold(
+          generation_fitnesses_[rung], rungs_[rung].promotion_quantile(),
+          generation_estimates_[rung], promotion_thresholds_[rung]);
+      has_promotion_threshold_[rung] = true;
+      generation_fitnesses_[rung].clear();
+      generation_estimates_[rung].clear();
+    }
+  }
+}
+
+IntegerT EvaluationLadder::NumTrainStepsSaved() const {
+  IntegerT nominal_train_steps = 0;
+  for (IntegerT rung = 0; rung < rungs_.size(); ++rung) {
+    nominal_train_steps += rung_stats_[rung].num_evaluated *
+        evaluator_->NominalTrainSteps(rungs_[rung]);
+  }
+  return rung_stats_[0].num_evaluated *
+      evaluator_->NominalTrainSteps(rungs_.back()) - nominal_train_steps;
+}
+
+void EvaluationLadder::PrintStats(ostream* stream) const {
+  for (IntegerT rung = 0; rung < rungs_.size(); ++rung) {
+    const EvaluationRungStats& stats = rung_stats_[rung];
+    *stream << "Rung " << rung << ": evaluated=" << stats.num_evaluated
+            << ", promoted=" << stats.num_promoted
+            << ", estimated=" << stats.num_estimated
+            << ", train_steps=" << stats.num_train_steps;
+    if (has_promotion_threshold_[rung] && rung + 1 < rungs_.size()) {
+      *stream << ", threshold=" << setprecision(6) << fixed
+              << promotion_thresholds_[rung];
+    }
+    *stream << endl;
+  }
+  *stream << "Train steps saved by the rungs = " << NumTrainStepsSaved()
+          << endl;
+}
+
+vector<EvaluationRung> DefaultEvaluationRungs() {
+  vector<EvaluationRung> rungs(2);
+  rungs[0].set_train_examples_fraction(0.01);
+  rungs[0].set_promotion_quantile(0.75);
+  rungs[1].set_train_examples_fraction(1.0);
+  return rungs;
+}
+
+namespace internal {
+
+double PromotionThreshold(const vector<double>& fitnesses,
+                          const double quantile,
+                          const vector<double>& estimates,
+                          const double estimate_bound) {
+  CHECK(!fitnesses.empty() || !estimates.empty());
+  const set<double> distinct_fitnesses(fitnesses.begin(), fitnesses.end());
+  const vector<double> sorted_fitnesses(
+      distinct_fitnesses.begin(), distinct_fitnesses.end());
+  const IntegerT num_estimates =
+      set<double>(estimates.begin(), estimates.end()).size();
+  const IntegerT num_all = sorted_fitnesses.size() + num_estimates;
+  const IntegerT index = min<IntegerT>(
+      static_cast<IntegerT>(num_all * quantile), num_all - 1);
+  if (num_estimates == 0) return sorted_fitnesses[index];
+  // Only the ranks of the fitnesses above the bound are known: all the
+  // estimates are below them.
+  const IntegerT num_not_above = num_all - (
+      sorted_fitnesses.end() - upper_bound(sorted_fitnesses.begin(),
+                                           sorted_fitnesses.end(),
+                                           estimate_bound));
+  if (index < num_not_above) return estimate_bound;
+  return sorted_fitnesses[index - num_estimates];
+}
+
+}  // namespace internal
+
+}  // namespace automl_zero
@@ -0,0 +1,129 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef AUTOML_ZERO_EVALUATION_LADDER_H_
+#define AUTOML_ZERO_EVALUATION_LADDER_H_
+
+#include <ostream>
+#include <vector>
+
+#include "algorithm.h"
+#include "definitions.h"
+#include "evaluator.h"
+#include "experiment.pb.h"
+
+namespace automl_zero {
+
+// What happened on one rung of an EvaluationLadder.
+struct EvaluationRungStats {
+  // The evaluations on this rung.
+  IntegerT num_evaluated = 0;
+  // The Algorithms promoted from this rung to the next one.
+  IntegerT num_promoted = 0;
+  // The evaluations on this rung that only estimated the fitness, as it could
+  // not exceed the promotion threshold (see Evaluator::Evaluate).
+  IntegerT num_estimated = 0;
+  // The train steps the evaluations on this rung took, as counted by the
+  // Evaluator.
+  IntegerT num_train_steps = 0;
+};
+
+// Evaluates Algorithms on a ladder of rungs of increasing cost, such as
+// training on more examples or on more tasks (successive halving). Each
+// Algorithm starts on the first rung and is promoted to the next rung while
+// its fitness is above the promotion threshold of the rung it is on. The
+// threshold of a rung is a quantile of the distinct fitnesses obtained on the
+// rung by the previous generation, so nothing is promoted from a rung before a
+// generation has been evaluated on it. The estimated fitnesses only count as
+// being no larger than the threshold they were estimated against, so that they
+// cannot move it up.
+class EvaluationLadder {
+ public:
+  // If `rungs` is empty, uses DefaultEvaluationRungs().
+  // The evaluations on the rungs with a promotion threshold are against it,
+  // so the fitnesses of the Algorithms not promoted can be estimates (see
+  // Evaluator::Evaluate).
+  EvaluationLadder(const std::vector<EvaluationRung>& rungs,
+                   Evaluator* evaluator);
+
+  EvaluationLadder(const EvaluationLadder& other) = delete;
+  EvaluationLadder& operator=(const EvaluationLadder& other) = delete;
+
+  // Evaluates the Algorithm and returns its fitness on the last rung it
+  // reached, or an estimate of it if it was not promoted from that rung. If
+  // `first_rung_fitness` is not nullptr, also sets it to the fitness on the
+  // first rung, and `first_rung_fitness_is_estimate`, if not nullptr, to
+  // whether that is an estimate.
+  double Evaluate(const Algorithm& algorithm,
+                  double* first_rung_fitness = nullptr,
+                  bool* first_rung_fitness_is_estimate = nullptr);
+
+  // Sets the promotion thresholds from the fitnesses obtained on each rung
+  // since the previous call. Rungs without any keep their threshold. To be
+  // called at the end of each generation.
+  void EndGeneration();
+
+  IntegerT NumRungs() const {return rungs_.size();}
+  bool HasPromotionThreshold(IntegerT rung) const {
+    return has_promotion_threshold_[rung];
+  }
+  double GetPromotionThreshold(IntegerT rung) const {
+    return promotion_thresholds_[rung];
+  }
+  const std::vector<EvaluationRungStats>& GetRungStats() const {
+    return rung_stats_;
+  }
+
+  // The train steps saved so far compared with evaluating every Algorithm on
+  // the last rung only, from the nominal cost of the rungs (see
+  // Evaluator::NominalTrainSteps). Negative if the lower rungs cost more than
+  // they saved.
+  IntegerT NumTrainStepsSaved() const;
+
+  // Prints one line per rung with its stats.
+  void PrintStats(std::ostream* stream) const;
+
+ private:
+  const std::vector<EvaluationRung> rungs_;
+  Evaluator* evaluator_;
+  std::vector<EvaluationRungStats> rung_stats_;
+  // Whether the rung has a threshold yet, and the threshold.
+  std::vector<bool> has_promotion_threshold_;
+  std::vector<double> promotion_thresholds_;
+  // The fitnesses obtained on each rung since the last EndGeneration, and the
+  // estimated ones.
+  std::vector<std::vector<double>> generation_fitnesses_;
+  std::vector<std::vector<double>> generation_estimates_;
+};
+
+// The ladder of the original hurdle: a first rung on 1% of the train examples
+// promotes the Algorithms above the 75th percentile to a full evaluation.
+std::vector<EvaluationRung> DefaultEvaluationRungs();
+
+namespace internal {
+
+// The given quantile of the distinct fitnesses and estimates, where the
+// estimates are only known to be of fitnesses no larger than estimate_bound.
+// If the quantile is not above estimate_bound, returns estimate_bound, an
+// upper bound on it.
+double PromotionThreshold(const std::vector<double>& fitnesses,
+                          double quantile,
+                          const std::vector<double>& estimates = {},
+                          double estimate_bound = kMinFitness);
+
+}  // namespace internal
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_EVALUATION_LADDER_H_
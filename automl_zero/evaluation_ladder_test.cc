@@ -0,0 +1,277 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "evaluation_ladder.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "algorithm.h"
+#include "definitions.h"
+#include "evaluator.h"
+#include "experiment.pb.h"
+#include "generator.h"
+#include "random_generator.h"
+#include "task.pb.h"
+#include "test_util.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+
+namespace automl_zero {
+
+using ::absl::StrCat;  // NOLINT
+using ::std::mt19937;  // NOLINT
+using ::std::vector;  // NOLINT
+using internal::PromotionThreshold;
+
+constexpr double kMaxAbsError = 100.0;
+
+// Linear regression tasks of 100 train examples each.
+TaskCollection LinearTasks(const IntegerT num_tasks) {
+  return ParseTextFormat<TaskCollection>(StrCat(
+      "tasks { "
+      "  scalar_linear_regression_task {} "
+      "  features_size: 4 "
+      "  num_train_examples: 100 "
+      "  num_valid_examples: 100 "
+      "  num_tasks: ", num_tasks, " "
+      "  eval_type: RMS_ERROR "
+      "} "));
+}
+
+TaskCollection TwoTasks() {return LinearTasks(2);}
+
+// A cheap rung promoting above the median to a full evaluation.
+vector<EvaluationRung> TwoRungs() {
+  vector<EvaluationRung> rungs(2);
+  rungs[0] = ParseTextFormat<EvaluationRung>(
+      "train_examples_fraction: 0.1 "
+      "promotion_quantile: 0.5 ");
+  return rungs;
+}
+
+// Linear models of different quality.
+vector<Algorithm> LinearModels() {
+  Generator generator;
+  vector<Algorithm> algorithms;
+  for (const double learning_rate : {0.0, 0.0001, 0.001, 0.003, 0.01, 0.03}) {
+    algorithms.push_back(generator.LinearModel(learning_rate));
+  }
+  return algorithms;
+}
+
+TEST(PromotionThresholdTest, TakesQuantileOfDistinctFitnesses) {
+  EXPECT_EQ(PromotionThreshold({0.4, 0.1, 0.3, 0.2}, 0.75), 0.4);
+  EXPECT_EQ(PromotionThreshold({0.4, 0.1, 0.3, 0.2}, 0.5), 0.3);
+  EXPECT_EQ(PromotionThreshold({0.4, 0.1, 0.3, 0.2}, 0.0), 0.1);
+  EXPECT_EQ(PromotionThreshold({0.4, 0.1, 0.3, 0.2}, 1.0), 0.4);
+  EXPECT_EQ(PromotionThreshold({0.1, 0.1, 0.1, 0.2}, 0.5), 0.2);
+  EXPECT_EQ(PromotionThreshold({0.1}, 0.75), 0.1);
+}
+
+TEST(PromotionThresholdTest, OnlyRanksEstimatesBelowTheirBound) {
+  // The estimates count as distinct fitnesses no larger than 0.25.
+  EXPECT_EQ(PromotionThreshold({0.4, 0.1, 0.3}, 1.0, {0.05, 0.2}, 0.25), 0.4);
+  EXPECT_EQ(PromotionThreshold({0.4, 0.1, 0.3}, 0.75, {0.05, 0.2}, 0.25), 0.3);
+  // The order of 0.1 and the estimates is unknown.
+  EXPECT_EQ(PromotionThreshold({0.4, 0.1, 0.3}, 0.5, {0.05, 0.2}, 0.25), 0.25);
+  EXPECT_EQ(PromotionThreshold({0.4, 0.3}, 0.5, {0.2, 0.2, 0.2}, 0.25), 0.3);
+  EXPECT_EQ(PromotionThreshold({}, 0.75, {0.05, 0.2}, 0.25), 0.25);
+}
+
+TEST(EvaluationLadderTest, DefaultsToOriginalHurdle) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  Evaluator evaluator(MEAN_FITNESS_COMBINATION, TwoTasks(), &rand_gen,
+                      nullptr,  // functional_cache
+                      nullptr,  // train_budget
+                      kMaxAbsError);
+  EvaluationLadder ladder({}, &evaluator);
+  EXPECT_EQ(ladder.NumRungs(), 2);
+  const vector<EvaluationRung> rungs = DefaultEvaluationRungs();
+  EXPECT_EQ(evaluator.NominalTrainSteps(rungs[0]), 2);
+  EXPECT_EQ(evaluator.NominalTrainSteps(rungs[1]), 200);
+}
+
+TEST(EvaluationLadderTest, PromotesAboveThresholdOfPreviousGeneration) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  Evaluator evaluator(MEAN_FITNESS_COMBINATION, TwoTasks(), &rand_gen,
+                      nullptr,  // functional_cache
+                      nullptr,  // train_budget
+                      kMaxAbsError);
+  const vector<EvaluationRung> rungs = TwoRungs();
+  const vector<Algorithm> algorithms = LinearModels();
+
+  // Without random ops, the fitnesses do not depend on the random generator.
+  vector<double> cheap_fitnesses;
+  vector<double> full_fitnesses;
+  for (const Algorithm& algorithm : algorithms) {
+    cheap_fitnesses.push_back(evaluator.Evaluate(algorithm, rungs[0]));
+    full_fitnesses.push_back(evaluator.Evaluate(algorithm));
+  }
+  const double threshold = PromotionThreshold(cheap_fitnesses, 0.5);
+
+  EvaluationLadder ladder(rungs, &evaluator);
+  // Nothing is promoted before the first generation ended.
+  for (IntegerT i = 0; i < algorithms.size(); ++i) {
+    EXPECT_EQ(ladder.Evaluate(algorithms[i]), cheap_fitnesses[i]);
+  }
+  EXPECT_EQ(ladder.GetRungStats()[0].num_evaluated, algorithms.size());
+  EXPECT_EQ(ladder.GetRungStats()[0].num_promoted, 0);
+  EXPECT_EQ(ladder.GetRungStats()[1].num_evaluated, 0);
+  EXPECT_FALSE(ladder.HasPromotionThreshold(0));
+  ladder.EndGeneration();
+  EXPECT_TRUE(ladder.HasPromotionThreshold(0));
+  EXPECT_EQ(ladder.GetPromotionThreshold(0), threshold);
+
+  IntegerT num_promoted = 0;
+  for (IntegerT i = 0; i < algorithms.size(); ++i) {
+    double first_rung_fitness = kMinFitness;
+    if (cheap_fitnesses[i] > threshold) {
+      EXPECT_EQ(ladder.Evaluate(algorithms[i], &first_rung_fitness),
+                full_fitnesses[i]);
+      ++num_promoted;
+    } else {
+      EXPECT_EQ(ladder.Evaluate(algorithms[i], &first_rung_fitness),
+                cheap_fitnesses[i]);
+    }
+    EXPECT_EQ(first_rung_fitness, cheap_fitnesses[i]);
+  }
+  EXPECT_GT(num_promoted, 0);
+  EXPECT_LT(num_promoted, algorithms.size());
+  EXPECT_EQ(ladder.GetRungStats()[0].num_evaluated, 2 * algorithms.size());
+  EXPECT_EQ(ladder.GetRungStats()[0].num_promoted, num_promoted);
+  EXPECT_EQ(ladder.GetRungStats()[1].num_evaluated, num_promoted);
+}
+
+// Evaluates the same Algorithms over several generations on two ladders, one
+// of which evaluates against the thresholds with the given options, and checks
+// that both promote the same Algorithms at the same thresholds.
+void ExpectEstimatesKeepPromotions(const FitnessCombinationMode mode,
+                                   const TaskCollection& task_collection,
+                                   const vector<EvaluationRung>& rungs,
+                                   const EvaluatorOptions& options) {
+  const vector<Algorithm> algorithms = LinearModels();
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  Evaluator evaluator(mode, task_collection, &rand_gen,
+                      nullptr,  // functional_cache
+                      nullptr,  // train_budget
+                      kMaxAbsError);
+  mt19937 bounded_bit_gen(100000);
+  RandomGenerator bounded_rand_gen(&bounded_bit_gen);
+  Evaluator bounded_evaluator(
+      mode, task_collection, &bounded_rand_gen,
+      nullptr,  // functional_cache
+      nullptr,  // train_budget
+      kMaxAbsError, options);
+
+  EvaluationLadder ladder(rungs, &evaluator);
+  EvaluationLadder bounded_ladder(rungs, &bounded_evaluator);
+  for (const Algorithm& algorithm : algorithms) {
+    EXPECT_FLOAT_EQ(bounded_ladder.Evaluate(algorithm),
+                    ladder.Evaluate(algorithm));
+  }
+  ladder.EndGeneration();
+  bounded_ladder.EndGeneration();
+  // The estimates neither move the threshold up from one generation to the
+  // next nor collapse onto it.
+  for (IntegerT generation = 0; generation < 4; ++generation) {
+    const double threshold = ladder.GetPromotionThreshold(0);
+    EXPECT_FLOAT_EQ(bounded_ladder.GetPromotionThreshold(0), threshold);
+    vector<double> estimates;
+    for (const Algorithm& algorithm : algorithms) {
+      const double fitness = ladder.Evaluate(algorithm);
+      const IntegerT num_promoted = ladder.GetRungStats()[0].num_promoted;
+      const IntegerT num_estimated =
+          bounded_ladder.GetRungStats()[0].num_estimated;
+      double first_rung_fitness;
+      bool first_rung_fitness_is_estimate;
+      const double bounded_fitness = bounded_ladder.Evaluate(
+          algorithm, &first_rung_fitness, &first_rung_fitness_is_estimate);
+      EXPECT_EQ(bounded_ladder.GetRungStats()[0].num_promoted, num_promoted);
+      EXPECT_EQ(first_rung_fitness_is_estimate,
+                bounded_ladder.GetRungStats()[0].num_estimated >
+                    num_estimated);
+      if (first_rung_fitness_is_estimate) {
+        EXPECT_LE(bounded_fitness, threshold);
+        estimates.push_back(bounded_fitness);
+      } else {
+        EXPECT_FLOAT_EQ(bounded_fitness, fitness);
+      }
+    }
+    EXPECT_GT(estimates.size(), 1);
+    EXPECT_LT(*std::min_element(estimates.begin(), estimates.end()),
+              *std::max_element(estimates.begin(), estimates.end()));
+    ladder.EndGeneration();
+    bounded_ladder.EndGeneration();
+  }
+  EXPECT_EQ(ladder.GetRungStats()[0].num_estimated, 0);
+}
+
+TEST(EvaluationLadderTest, BoundingValidationKeepsPromotions) {
+  vector<EvaluationRung> rungs = TwoRungs();
+  // Only a single task can have a threshold high enough to stop at.
+  rungs[0].set_num_tasks(1);
+  EvaluatorOptions options;
+  options.bound_validation = true;
+  ExpectEstimatesKeepPromotions(MEAN_FITNESS_COMBINATION, LinearTasks(2),
+                                rungs, options);
+}
+
+TEST(EvaluationLadderTest, RacingTasksKeepsPromotions) {
+  // The median can fall below the threshold before the last tasks.
+  EvaluatorOptions options;
+  options.race_tasks = true;
+  ExpectEstimatesKeepPromotions(MEDIAN_FITNESS_COMBINATION, LinearTasks(5),
+                                TwoRungs(), options);
+}
+
+TEST(EvaluationLadderTest, CountsTrainSteps) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  Evaluator evaluator(MEAN_FITNESS_COMBINATION, TwoTasks(), &rand_gen,
+                      nullptr,  // functional_cache
+                      nullptr,  // train_budget
+                      kMaxAbsError);
+  vector<EvaluationRung> rungs = TwoRungs();
+  // The first rung only trains on one task.
+  rungs[0].set_num_tasks(1);
+  const vector<Algorithm> algorithms = LinearModels();
+
+  EvaluationLadder ladder(rungs, &evaluator);
+  for (const Algorithm& algorithm : algorithms) ladder.Evaluate(algorithm);
+  ladder.EndGeneration();
+  for (const Algorithm& algorithm : algorithms) ladder.Evaluate(algorithm);
+
+  const vector<EvaluationRungStats>& stats = ladder.GetRungStats();
+  EXPECT_EQ(stats[0].num_train_steps, 2 * algorithms.size() * 10);
+  EXPECT_EQ(stats[1].num_train_steps, stats[1].num_evaluated * 200);
+  EXPECT_EQ(evaluator.GetNumTrainStepsCompleted(),
+            stats[0].num_train_steps + stats[1].num_train_steps);
+  EXPECT_EQ(ladder.NumTrainStepsSaved(),
+            2 * algorithms.size() * 200 -
+                evaluator.GetNumTrainStepsCompleted());
+
+  std::ostringstream printed;
+  ladder.PrintStats(&printed);
+  EXPECT_NE(printed.str().find("Rung 1: evaluated="), std::string::npos);
+  EXPECT_NE(printed.str().find("Train steps saved by the rungs = "),
+            std::string::npos);
+}
+
+}  // namespace automl_zero
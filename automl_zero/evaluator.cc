@@ -15,18 +15,24 @@
 #include "evaluator.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iomanip>
 #include <ios>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <string>
 
 #include "task.h"
 #include "task_util.h"
 #include "task.pb.h"
+#include "dataflow.h"
 #include "definitions.h"
 #include "executor.h"
+#include "lane_executor.h"
+#include "optimizer.h"
 #include "random_generator.h"
+#include "thread_pool.h"
 #include "train_budget.h"
 #include "google/protobuf/text_format.h"
 #include "absl/algorithm/container.h"
@@ -41,27 +47,60 @@ using ::absl::GetFlag;  // NOLINT
 using ::absl::make_unique;  // NOLINT
 using ::std::cout;  // NOLINT
 using ::std::endl;  // NOLINT
+using ::std::find;  // NOLINT
 using ::std::fixed;  // NOLINT
+using ::std::iota;  // NOLINT
 using ::std::make_shared;  // NOLINT
+using ::std::max;  // NOLINT
 using ::std::min;  // NOLINT
 using ::std::mt19937;  // NOLINT
 using ::std::nth_element;  // NOLINT
 using ::std::pair;  // NOLINT
+using ::std::seed_seq;  // NOLINT
 using ::std::setprecision;  // NOLINT
+using ::std::shuffle;  // NOLINT
 using ::std::vector;  // NOLINT
 using ::std::unique_ptr;  // NOLINT
 using internal::CombineFitnesses;
 
 constexpr IntegerT kMinNumTrainExamples = 10;
-constexpr RandomSeedT kFunctionalCacheRandomSeed = 235732282;
-constexpr IntegerT kReductionFactor = 100;
+
+namespace {
+
+// Mixes the key of the evaluation and the index of the task into a seed.
+uint32_t TaskSeed(const RandomSeedT evaluation_key,
+                  const IntegerT task_index) {
+  seed_seq sequence({static_cast<uint32_t>(evaluation_key),
+                     static_cast<uint32_t>(task_index)});
+  uint32_t seed;
+  sequence.generate(&seed, &seed + 1);
+  return seed;
+}
+
+// The random generators of a task executing in parallel with the others.
+struct TaskRandomGenerators {
+  TaskRandomGenerators(const RandomSeedT evaluation_key,
+                       const IntegerT task_index)
+      : bit_gen(TaskSeed(evaluation_key, task_index)),
+        rand_gen(&bit_gen),
+        probe_bit_gen(kFunctionalCacheRandomSeed),
+        probe_rand_gen(&probe_bit_gen) {}
+
+  mt19937 bit_gen;
+  RandomGenerator rand_gen;
+  mt19937 probe_bit_gen;
+  RandomGenerator probe_rand_gen;
+};
+
+}  // namespace
 
 Evaluator::Evaluator(const FitnessCombinationMode fitness_combination_mode,
                      const TaskCollection& task_collection,
                      RandomGenerator* rand_gen,
                      FECCache* functional_cache,
                      TrainBudget* train_budget,
-                     const double max_abs_error)
+                     const double max_abs_error,
+                     const EvaluatorOptions& options)
     : fitness_combination_mode_(fitness_combination_mode),
       task_collection_(task_collection),
       train_budget_(train_budget),
@@ -74,128 +113,405 @@ Evaluator::Evaluator(const FitnessCombinationMode fitness_combination_mode,
       functional_cache_rand_gen_(functional_cache_rand_gen_owned_.get()),
       best_fitness_(-1.0),
       max_abs_error_(max_abs_error),
-      num_train_steps_completed_(0) {
+      use_jit_(options.use_jit),
+      use_task_lanes_(options.use_task_lanes),
+      use_counter_based_rng_(options.use_counter_based_rng),
+      resume_functional_cache_probes_(
+          options.resume_functional_cache_probes &&
+          functional_cache != nullptr),
+      use_fast_math_(options.use_fast_math),
+      bound_validation_(options.bound_validation),
+      validation_bound_num_stdevs_(options.validation_bound_num_stdevs),
+      race_tasks_(options.race_tasks),
+      thread_pool_(options.num_threads > 0 ?
+                   make_unique<ThreadPool>(options.num_threads) : nullptr),
+      evaluation_key_(0),
+      task_fitness_threshold_(kMinFitness) {
+  CHECK_GE(options.num_threads, 0);
+  CHECK_GE(options.validation_bound_num_stdevs, 0.0);
   FillTasks(task_collection_, &tasks_);
   CHECK_GT(tasks_.size(), 0);
 }
 
 double Evaluator::Evaluate(const Algorithm& algorithm) {
-  // Compute the mean fitness across all tasks.
-  vector<double> task_fitnesses;
-  task_fitnesses.reserve(tasks_.size());
-  vector<double> debug_fitnesses;
-  vector<IntegerT> debug_num_train_examples;
-  vector<IntegerT> task_indexes;  // Tasks to use.
-  // Use all the tasks.
-  for (IntegerT i = 0; i < tasks_.size(); ++i) {
-    task_indexes.push_back(i);
-  }
-  for (IntegerT task_index : task_indexes) {
-    const unique_ptr<TaskInterface>& task = tasks_[task_index];
-    CHECK_GE(task->MaxTrainExamples(), kMinNumTrainExamples);
-    const IntegerT num_train_examples =
+  return Evaluate(algorithm, EvaluationRung());
+}
+
+double Evaluator::Evaluate(const Algorithm& algorithm,
+                           const EvaluationRung& rung,
+                           const double fitness_threshold,
+                           bool* fitness_is_estimate) {
+  const IntegerT num_estimated_fitnesses = counts_.num_estimated_fitnesses;
+  const IntegerT num_tasks_skipped_by_racing =
+      counts_.num_tasks_skipped_by_racing;
+  // Compute the mean fitness across the tasks of the rung.
+  const IntegerT num_tasks = NumRungTasks(rung);
+  vector<IntegerT> num_train_examples;
+  num_train_examples.reserve(num_tasks);
+  for (IntegerT task_index = 0; task_index < num_tasks; ++task_index) {
+    const TaskInterface& task = *tasks_[task_index];
+    CHECK_GE(task.MaxTrainExamples(), kMinNumTrainExamples);
+    const IntegerT max_train_examples = RungTrainExamples(task, rung);
+    num_train_examples.push_back(
         train_budget_ == nullptr ?
-        task->MaxTrainExamples() :
-        train_budget_->TrainExamples(algorithm, task->MaxTrainExamples());
-    double curr_fitness = -1.0;
-    curr_fitness = Execute(*task, num_train_examples, algorithm);
-    task_fitnesses.push_back(curr_fitness);
+        max_train_examples :
+        train_budget_->TrainExamples(algorithm, max_train_examples));
+  }
+  double combined_fitness;
+  if (race_tasks_ && fitness_threshold > kMinFitness) {
+    combined_fitness =
+        RaceTasks(algorithm, num_train_examples, fitness_threshold);
+  } else {
+    task_fitness_threshold_ = TaskFitnessThreshold(
+        fitness_threshold, vector<double>(num_tasks, kMaxFitness));
+    const vector<double> task_fitnesses =
+        ExecuteTasks(algorithm, num_train_examples);
+    combined_fitness =
+        CombineFitnesses(task_fitnesses, fitness_combination_mode_);
   }
-  double combined_fitness =
-      CombineFitnesses(task_fitnesses, fitness_combination_mode_);
 
   CHECK_GE(combined_fitness, kMinFitness);
   CHECK_LE(combined_fitness, kMaxFitness);
+  if (fitness_is_estimate != nullptr) {
+    *fitness_is_estimate =
+        counts_.num_estimated_fitnesses > num_estimated_fitnesses ||
+        counts_.num_tasks_skipped_by_racing > num_tasks_skipped_by_racing;
+  }
 
   return combined_fitness;
 }
 
-// TODO: (jdonovan) write early evaluation function for hurdle
-double Evaluator::EarlyEvaluate(const Algorithm& algorithm) {
-  vector<double> task_fitnesses;
-  task_fitnesses.reserve(tasks_.size());
-  vector<double> debug_fitnesses;
-  vector<IntegerT> debug_num_train_examples;
-  vector<IntegerT> task_indexes;
+IntegerT Evaluator::NominalTrainSteps(const EvaluationRung& rung) const {
+  IntegerT num_train_steps = 0;
+  for (IntegerT task_index = 0; task_index < NumRungTasks(rung);
+       ++task_index) {
+    num_train_steps += RungTrainExamples(*tasks_[task_index], rung);
+  }
+  return num_train_steps;
+}
+
+IntegerT Evaluator::NumRungTasks(const EvaluationRung& rung) const {
+  CHECK_GE(rung.num_tasks(), 0);
+  CHECK_LE(rung.num_tasks(), tasks_.size());
+  return rung.num_tasks() == 0 ? tasks_.size() : rung.num_tasks();
+}
 
-  for (IntegerT i=0;i<tasks_.size(); ++i){
-    task_indexes.push_back(i);
+double Evaluator::TaskFitnessThreshold(
+    const double fitness_threshold,
+    const vector<double>& task_fitnesses) const {
+  if (!bound_validation_ || fitness_threshold <= kMinFitness) {
+    return kMinFitness;
   }
-  for (IntegerT task_index : task_indexes) {
-    const unique_ptr<TaskInterface>& task = tasks_[task_index];
-    CHECK_GE(task->MaxTrainExamples(), kMinNumTrainExamples);
-    const IntegerT num_train_examples =
-        train_budget_ == nullptr ?
-        task->MaxTrainExamples() / kReductionFactor :
-        train_budget_->TrainExamples(algorithm, task->MaxTrainExamples()/kReductionFactor);
-    double curr_fitness = -1.0;
-    curr_fitness = Execute(*task, num_train_examples, algorithm);
-    task_fitnesses.push_back(curr_fitness);
+  switch (fitness_combination_mode_) {
+    case MEAN_FITNESS_COMBINATION: {
+      // The tasks not executed yet add at most kMaxFitness each to the sum.
+      double sum_of_others = -kMaxFitness;
+      for (const double fitness : task_fitnesses) sum_of_others += fitness;
+      return max(kMinFitness,
+                 task_fitnesses.size() * fitness_threshold - sum_of_others);
+    }
+    case MEDIAN_FITNESS_COMBINATION: {
+      // The median grows with each fitness, so the threshold is either the
+      // combined one or nothing.
+      vector<double> bounded_fitnesses = task_fitnesses;
+      *find(bounded_fitnesses.begin(), bounded_fitnesses.end(),
+            kMaxFitness) = fitness_threshold;
+      return internal::Median(bounded_fitnesses) <= fitness_threshold ?
+          fitness_threshold : kMinFitness;
+    }
+    default:
+      LOG(FATAL) << "Unsupported fitness combination." << endl;
   }
-  double combined_fitness =
-      CombineFitnesses(task_fitnesses, fitness_combination_mode_);
+}
 
-  CHECK_GE(combined_fitness, kMinFitness);
-  CHECK_LE(combined_fitness, kMaxFitness);
+IntegerT Evaluator::RungTrainExamples(const TaskInterface& task,
+                                      const EvaluationRung& rung) const {
+  CHECK_GT(rung.train_examples_fraction(), 0.0);
+  CHECK_LE(rung.train_examples_fraction(), 1.0);
+  return max<IntegerT>(
+      1, static_cast<IntegerT>(std::round(
+             static_cast<double>(task.MaxTrainExamples()) *
+             rung.train_examples_fraction())));
+}
 
-  return combined_fitness;
+vector<double> Evaluator::ExecuteTasks(
+    const Algorithm& full_algorithm,
+    const vector<IntegerT>& num_train_examples) {
+  const IntegerT num_tasks = num_train_examples.size();
+  CHECK_LE(num_tasks, tasks_.size());
+  vector<double> task_fitnesses(num_tasks, kMinFitness);
+  // Only an equivalent, cheaper copy of the Algorithm is executed. This does
+  // not change the fitness or the functional cache hashes.
+  const Algorithm algorithm =
+      OptimizeAlgorithm(full_algorithm, &optimization_stats_);
+  jit_algorithms_.clear();
+  // Algorithms whose predictions do not depend on the examples are cheaper to
+  // short-circuit one task at a time than to run on lanes.
+  // Lanes cannot continue from the functional cache probes and share one
+  // random generator.
+  const bool use_lanes = use_task_lanes_ && !resume_functional_cache_probes_ &&
+      thread_pool_ == nullptr &&
+      GetPredictionDependence(algorithm) == kVariablePredictions &&
+      LaneExecutorSupports(algorithm);
+  if (use_counter_based_rng_ || thread_pool_ != nullptr) {
+    evaluation_key_ = rand_gen_->UniformRandomSeed();
+  }
+  if (thread_pool_ != nullptr) {
+    vector<IntegerT> task_indexes(num_tasks);
+    iota(task_indexes.begin(), task_indexes.end(), 0);
+    ExecuteInParallel(algorithm, full_algorithm, task_indexes,
+                      num_train_examples, &task_fitnesses);
+    return task_fitnesses;
+  }
+  IntegerT begin = 0;
+  while (begin < num_tasks) {
+    // Group consecutive tasks that can share the lanes.
+    IntegerT end = begin + 1;
+    while (use_lanes && end < num_tasks && end - begin < kNumTaskLanes &&
+           num_train_examples[end] == num_train_examples[begin] &&
+           LaneCompatible(*tasks_[begin], *tasks_[end])) {
+      ++end;
+    }
+    if (end - begin == 1) {
+      // The optimizations assume that predict and learn see one example at a
+      // time, so tasks with mini-batches run the Algorithm as it is.
+      task_fitnesses[begin] = Execute(
+          *tasks_[begin], num_train_examples[begin],
+          tasks_[begin]->BatchSize() == 1 ? algorithm : full_algorithm);
+    } else {
+      ExecuteOnLanes(begin, end, num_train_examples[begin], algorithm,
+                     &task_fitnesses);
+    }
+    begin = end;
+  }
+  return task_fitnesses;
 }
 
+double Evaluator::RaceTasks(const Algorithm& full_algorithm,
+                            const vector<IntegerT>& num_train_examples,
+                            const double fitness_threshold) {
+  const IntegerT num_tasks = num_train_examples.size();
+  CHECK_LE(num_tasks, tasks_.size());
+  // See ExecuteTasks. Task lanes are not used, as the tasks execute one at a
+  // time.
+  const Algorithm algorithm =
+      OptimizeAlgorithm(full_algorithm, &optimization_stats_);
+  jit_algorithms_.clear();
+  if (use_counter_based_rng_ || thread_pool_ != nullptr) {
+    evaluation_key_ = rand_gen_->UniformRandomSeed();
+  }
+  // A random order avoids always spending the most on the first tasks.
+  vector<IntegerT> task_order(num_tasks);
+  iota(task_order.begin(), task_order.end(), 0);
+  shuffle(task_order.begin(), task_order.end(), *rand_gen_->BitGen());
+
+  // The tasks not executed yet count as kMaxFitness, so that the combined
+  // fitness is an upper bound. The estimated task fitnesses are no larger
+  // than theirs, which are small enough to end the race.
+  vector<double> task_fitnesses(num_tasks, kMaxFitness);
+  const IntegerT round_size =
+      thread_pool_ == nullptr ? 1 : thread_pool_->NumThreads();
+  IntegerT num_executed = 0;
+  while (num_executed < num_tasks) {
+    const vector<IntegerT> round_task_indexes(
+        task_order.begin() + num_executed,
+        task_order.begin() + min(num_executed + round_size, num_tasks));
+    task_fitness_threshold_ =
+        TaskFitnessThreshold(fitness_threshold, task_fitnesses);
+    if (thread_pool_ != nullptr) {
+      ExecuteInParallel(algorithm, full_algorithm, round_task_indexes,
+                        num_train_examples, &task_fitnesses);
+    } else {
+      const IntegerT task_index = round_task_indexes[0];
+      const TaskInterface& task = *tasks_[task_index];
+      task_fitnesses[task_index] = Execute(
+          task, num_train_examples[task_index],
+          task.BatchSize() == 1 ? algorithm : full_algorithm);
+    }
+    num_executed += round_task_indexes.size();
+
+    const double fitness_bound =
+        CombineFitnesses(task_fitnesses, fitness_combination_mode_);
+    if (num_executed < num_tasks && fitness_bound <= fitness_threshold) {
+      counts_.num_tasks_skipped_by_racing += num_tasks - num_executed;
+      // Like the upper bound, no larger than the threshold.
+      vector<double> executed_fitnesses;
+      executed_fitnesses.reserve(num_executed);
+      for (IntegerT i = 0; i < num_executed; ++i) {
+        executed_fitnesses.push_back(task_fitnesses[task_order[i]]);
+      }
+      return min(fitness_bound,
+                 CombineFitnesses(executed_fitnesses,
+                                  fitness_combination_mode_));
+    }
+  }
+  return CombineFitnesses(task_fitnesses, fitness_combination_mode_);
+}
 
 double Evaluator::Execute(const TaskInterface& task,
                           const IntegerT num_train_examples,
                           const Algorithm& algorithm) {
   switch (task.FeaturesSize()) {
-    case 2: {
-      const Task<2>& downcasted_task = *SafeDowncast<2>(&task);
-      return ExecuteImpl<2>(downcasted_task, num_train_examples, algorithm);
-    }
-    case 4: {
-      const Task<4>& downcasted_task = *SafeDowncast<4>(&task);
-      return ExecuteImpl<4>(downcasted_task, num_train_examples, algorithm);
-    }
-    case 8: {
-      const Task<8>& downcasted_task = *SafeDowncast<8>(&task);
-      return ExecuteImpl<8>(downcasted_task, num_train_examples, algorithm);
-    }
-    case 16: {
-      const Task<16>& downcasted_task = *SafeDowncast<16>(&task);
-      return ExecuteImpl<16>(downcasted_task, num_train_examples, algorithm);
-    }
-    case 32: {
-      const Task<32>& downcasted_task = *SafeDowncast<32>(&task);
-      return ExecuteImpl<32>(downcasted_task, num_train_examples, algorithm);
-    }
+#define AUTOML_ZERO_EXECUTE_CASE(F) \
+    case F: \
+      return ExecuteImpl<F>( \
+          *SafeDowncast<F>(&task), num_train_examples, algorithm);
+    AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(AUTOML_ZERO_EXECUTE_CASE)
+#undef AUTOML_ZERO_EXECUTE_CASE
     default:
       LOG(FATAL) << "Unsupported features size." << endl;
   }
 }
 
-//TODO: (jdonovan) write early execute function for hurdle (may not need if I can tell it how many train examples to look at in execute)
+void Evaluator::ExecuteOnLanes(
+    const IntegerT begin, const IntegerT end,
+    const IntegerT num_train_examples, const Algorithm& algorithm,
+    vector<double>* task_fitnesses) {
+  switch (tasks_[begin]->FeaturesSize()) {
+#define AUTOML_ZERO_EXECUTE_ON_LANES_CASE(F) \
+    case F: \
+      return ExecuteOnLanesImpl<F>( \
+          begin, end, num_train_examples, algorithm, task_fitnesses);
+    AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(AUTOML_ZERO_EXECUTE_ON_LANES_CASE)
+#undef AUTOML_ZERO_EXECUTE_ON_LANES_CASE
+    default:
+      LOG(FATAL) << "Unsupported features size." << endl;
+  }
+}
+
+void Evaluator::ExecuteInParallel(const Algorithm& algorithm,
+                                  const Algorithm& full_algorithm,
+                                  const vector<IntegerT>& task_indexes,
+                                  const vector<IntegerT>& num_train_examples,
+                                  vector<double>* task_fitnesses) {
+  vector<FeatureIndexT> features_sizes;
+  for (const IntegerT task_index : task_indexes) {
+    const FeatureIndexT features_size = tasks_[task_index]->FeaturesSize();
+    if (!c_linear_search(features_sizes, features_size)) {
+      features_sizes.push_back(features_size);
+    }
+  }
+  for (const FeatureIndexT features_size : features_sizes) {
+    vector<IntegerT> features_size_task_indexes;
+    for (const IntegerT task_index : task_indexes) {
+      if (tasks_[task_index]->FeaturesSize() == features_size) {
+        features_size_task_indexes.push_back(task_index);
+      }
+    }
+    switch (features_size) {
+#define AUTOML_ZERO_EXECUTE_IN_PARALLEL_CASE(F) \
+      case F: \
+        ExecuteInParallelImpl<F>(features_size_task_indexes, algorithm, \
+                                 full_algorithm, num_train_examples, \
+                                 task_fitnesses); \
+        break;
+      AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(AUTOML_ZERO_EXECUTE_IN_PARALLEL_CASE)
+#undef AUTOML_ZERO_EXECUTE_IN_PARALLEL_CASE
+      default:
+        LOG(FATAL) << "Unsupported features size." << endl;
+    }
+  }
+}
 
 IntegerT Evaluator::GetNumTrainStepsCompleted() const {
-  return num_train_steps_completed_;
+  return counts_.num_train_steps_completed;
+}
+
+const OptimizationStats& Evaluator::GetOptimizationStats() const {
+  return optimization_stats_;
+}
+
+IntegerT Evaluator::GetNumExecutions() const {
+  return counts_.num_executions;
+}
+
+IntegerT Evaluator::GetNumExecutionsSkippingLearn() const {
+  return counts_.num_executions_skipping_learn;
+}
+
+IntegerT Evaluator::GetNumTrainStepsSavedOnNans() const {
+  return counts_.num_train_steps_saved_on_nans;
+}
+
+IntegerT Evaluator::GetNumValidStepsSaved() const {
+  return counts_.num_valid_steps_saved;
+}
+
+IntegerT Evaluator::GetNumEstimatedFitnesses() const {
+  return counts_.num_estimated_fitnesses;
+}
+
+IntegerT Evaluator::GetNumTasksSkippedByRacing() const {
+  return counts_.num_tasks_skipped_by_racing;
+}
+
+void Evaluator::ExecutionCounts::Add(const ExecutionCounts& other) {
+  num_train_steps_completed += other.num_train_steps_completed;
+  num_executions += other.num_executions;
+  num_executions_skipping_learn += other.num_executions_skipping_learn;
+  num_train_steps_saved_on_nans += other.num_train_steps_saved_on_nans;
+  num_valid_steps_saved += other.num_valid_steps_saved;
+  num_estimated_fitnesses += other.num_estimated_fitnesses;
+  num_tasks_skipped_by_racing += other.num_tasks_skipped_by_racing;
+}
+
+template <FeatureIndexT F>
+size_t Evaluator::FunctionalCacheHash(const Task<F>& task,
+                                      const IntegerT num_train_examples,
+                                      const Algorithm& algorithm,
+                                      RandomGenerator* probe_rand_gen,
+                                      ExecutionCounts* counts,
+                                      ExecutorState<F>* probe_state) const {
+  CHECK_LE(functional_cache_->NumTrainExamples(), task.MaxTrainExamples());
+  CHECK_LE(functional_cache_->NumValidExamples(), task.ValidSteps());
+  ResetFunctionalCacheRandomGenerator(probe_rand_gen);
+  Executor<F> functional_cache_executor(
+      algorithm, task, functional_cache_->NumTrainExamples(),
+      functional_cache_->NumValidExamples(), probe_rand_gen,
+      max_abs_error_, use_jit_,
+      true,  // wipe_used_memory_only
+      true,  // short_circuit_constant_predictions
+      nullptr,  // initial_state
+      false,  // stop_on_fatal_nans
+      use_fast_math_,
+      ValidationBound(),
+      JitAlgorithmFor(F));
+  vector<double> train_errors;
+  vector<double> valid_errors;
+  functional_cache_executor.Execute(
+      &train_errors, &valid_errors, probe_state);
+  counts->num_train_steps_completed +=
+      functional_cache_executor.GetNumTrainStepsCompleted();
+  return functional_cache_->Hash(
+      train_errors, valid_errors, task.index_, num_train_examples);
+}
+
+template <FeatureIndexT F>
+void Evaluator::CompileJitAlgorithmOnce(const Algorithm& algorithm) {
+  if (!use_jit_ || jit_algorithms_.count(F) > 0) return;
+  jit_algorithms_[F] = CompileJitAlgorithm<F>(algorithm);
+}
+
+const JitAlgorithm* Evaluator::JitAlgorithmFor(
+    const FeatureIndexT features_size) const {
+  const auto jit_algorithm_it = jit_algorithms_.find(features_size);
+  return jit_algorithm_it == jit_algorithms_.end() ?
+      nullptr : jit_algorithm_it->second.get();
 }
 
 template <FeatureIndexT F>
 double Evaluator::ExecuteImpl(const Task<F>& task,
                               const IntegerT num_train_examples,
                               const Algorithm& algorithm) {
+  // Tasks with mini-batches execute the full Algorithm, and without the JIT.
+  if (task.BatchSize() == 1) CompileJitAlgorithmOnce<F>(algorithm);
   if (functional_cache_ != nullptr) {
-    CHECK_LE(functional_cache_->NumTrainExamples(), task.MaxTrainExamples());
-    CHECK_LE(functional_cache_->NumValidExamples(), task.ValidSteps());
-    functional_cache_bit_gen_owned_->seed(kFunctionalCacheRandomSeed);
-    Executor<F> functional_cache_executor(
-        algorithm, task, functional_cache_->NumTrainExamples(),
-        functional_cache_->NumValidExamples(), functional_cache_rand_gen_,
-        max_abs_error_);
-    vector<double> train_errors;
-    vector<double> valid_errors;
-    functional_cache_executor.Execute(&train_errors, &valid_errors);
-    num_train_steps_completed_ +=
-        functional_cache_executor.GetNumTrainStepsCompleted();
-    const size_t hash = functional_cache_->Hash(
-        train_errors, valid_errors, task.index_, num_train_examples);
+    // On the heap, as it is too large for the stack with large features sizes.
+    const unique_ptr<ExecutorState<F>> probe_state(
+        resume_functional_cache_probes_ ? new ExecutorState<F>() : nullptr);
+    const size_t hash = FunctionalCacheHash(
+        task, num_train_examples, algorithm, functional_cache_rand_gen_,
+        &counts_, probe_state.get());
     pair<double, bool> fitness_and_found = functional_cache_->Find(hash);
     if (fitness_and_found.second) {
       // Cache hit.
@@ -203,20 +519,209 @@ double Evaluator::ExecuteImpl(const Task<F>& task,
       return fitness_and_found.first;
     } else {
       // Cache miss.
-      Executor<F> executor(algorithm, task, num_train_examples,
-                           task.ValidSteps(), rand_gen_, max_abs_error_);
-      double fitness = executor.Execute();
-      num_train_steps_completed_ += executor.GetNumTrainStepsCompleted();
-      functional_cache_->InsertOrDie(hash, fitness);
+      const IntegerT num_estimated_fitnesses =
+          counts_.num_estimated_fitnesses;
+      const double fitness = ExecuteAfterProbe(
+          task, num_train_examples, algorithm, rand_gen_,
+          functional_cache_rand_gen_, probe_state.get(), &counts_);
+      if (counts_.num_estimated_fitnesses == num_estimated_fitnesses) {
+        functional_cache_->InsertOrDie(hash, fitness);
+      }
       return fitness;
     }
   } else {
-    Executor<F> executor(
-        algorithm, task, num_train_examples, task.ValidSteps(),
-        rand_gen_, max_abs_error_);
-    const double fitness = executor.Execute();
-    num_train_steps_completed_ += executor.GetNumTrainStepsCompleted();
-    return fitness;
+    UseTaskRandomStream(task.index_, rand_gen_);
+    return RunExecutor<F>(task, num_train_examples, algorithm, rand_gen_,
+                          nullptr,  // initial_state
+                          &counts_);
+  }
+}
+
+template <FeatureIndexT F>
+double Evaluator::ExecuteAfterProbe(const Task<F>& task,
+                                    const IntegerT num_train_examples,
+                                    const Algorithm& algorithm,
+                                    RandomGenerator* rand_gen,
+                                    RandomGenerator* probe_rand_gen,
+                                    const ExecutorState<F>* probe_state,
+                                    ExecutionCounts* counts) const {
+  const ExecutorState<F>* initial_state = nullptr;
+  if (resume_functional_cache_probes_) {
+    // Continue the probe, if it trained on a prefix of the first epoch
+    // made of whole mini-batches. Otherwise start over with the probe's
+    // random generator, which draws the same numbers as continuing would
+    // have.
+    ResetFunctionalCacheRandomGenerator(probe_rand_gen);
+    rand_gen = probe_rand_gen;
+    if (probe_state->saved &&
+        probe_state->num_train_examples <=
+            min(num_train_examples, task.TrainExamplesPerEpoch()) &&
+        probe_state->num_train_examples % task.BatchSize() == 0) {
+      initial_state = probe_state;
+    }
+  } else {
+    UseTaskRandomStream(task.index_, rand_gen);
+  }
+  return RunExecutor(task, num_train_examples, algorithm, rand_gen,
+                     initial_state, counts);
+}
+
+template <FeatureIndexT F>
+double Evaluator::RunExecutor(const Task<F>& task,
+                              const IntegerT num_train_examples,
+                              const Algorithm& algorithm,
+                              RandomGenerator* rand_gen,
+                              const ExecutorState<F>* initial_state,
+                              ExecutionCounts* counts) const {
+  Executor<F> executor(algorithm, task, num_train_examples, task.ValidSteps(),
+                       rand_gen, max_abs_error_, use_jit_,
+                       true,  // wipe_used_memory_only
+                       true,  // short_circuit_constant_predictions
+                       initial_state,
+                       true,  // stop_on_fatal_nans
+                       use_fast_math_,
+                       ValidationBound{task_fitness_threshold_,
+                                       validation_bound_num_stdevs_},
+                       JitAlgorithmFor(F));
+  const double fitness = executor.Execute();
+  counts->num_train_steps_completed += executor.GetNumTrainStepsCompleted();
+  counts->num_train_steps_saved_on_nans += executor.GetNumTrainStepsSaved();
+  ++counts->num_executions;
+  if (executor.SkippedLearn()) ++counts->num_executions_skipping_learn;
+  counts->num_valid_steps_saved += executor.GetNumValidStepsSaved();
+  if (executor.FitnessIsEstimate()) ++counts->num_estimated_fitnesses;
+  return fitness;
+}
+
+template <FeatureIndexT F>
+void Evaluator::ExecuteInParallelImpl(
+    const vector<IntegerT>& task_indexes, const Algorithm& algorithm,
+    const Algorithm& full_algorithm, const vector<IntegerT>& num_train_examples,
+    vector<double>* task_fitnesses) {
+  // The threads only write to the entries of their tasks. The functional cache
+  // is only used between the parallel steps, in the order of the tasks, so
+  // that it evolves the same way for any number of threads. The threads share
+  // the code compiled here.
+  CompileJitAlgorithmOnce<F>(algorithm);
+  const IntegerT num_tasks = task_indexes.size();
+  vector<ExecutionCounts> task_counts(num_tasks);
+  vector<unique_ptr<ExecutorState<F>>> probe_states(num_tasks);
+  vector<size_t> hashes(num_tasks);
+  vector<bool> found(num_tasks, false);
+  auto task_at = [&](const IntegerT i) -> const Task<F>& {
+    return *SafeDowncast<F>(tasks_[task_indexes[i]].get());
+  };
+  // See ExecuteTasks.
+  auto algorithm_for = [&](const Task<F>& task) -> const Algorithm& {
+    return task.BatchSize() == 1 ? algorithm : full_algorithm;
+  };
+
+  if (functional_cache_ != nullptr) {
+    thread_pool_->ParallelFor(num_tasks, [&](const IntegerT i) {
+      const Task<F>& task = task_at(i);
+      TaskRandomGenerators rand_gens(evaluation_key_, task.index_);
+      if (resume_functional_cache_probes_) {
+        probe_states[i].reset(new ExecutorState<F>());
+      }
+      hashes[i] = FunctionalCacheHash(
+          task, num_train_examples[task_indexes[i]], algorithm_for(task),
+          &rand_gens.probe_rand_gen, &task_counts[i], probe_states[i].get());
+    });
+    for (IntegerT i = 0; i < num_tasks; ++i) {
+      pair<double, bool> fitness_and_found = functional_cache_->Find(hashes[i]);
+      if (fitness_and_found.second) {
+        // Cache hit.
+        functional_cache_->UpdateOrDie(hashes[i], fitness_and_found.first);
+        (*task_fitnesses)[task_indexes[i]] = fitness_and_found.first;
+        found[i] = true;
+      }
+    }
+  }
+
+  thread_pool_->ParallelFor(num_tasks, [&](const IntegerT i) {
+    if (found[i]) return;
+    const Task<F>& task = task_at(i);
+    TaskRandomGenerators rand_gens(evaluation_key_, task.index_);
+    (*task_fitnesses)[task_indexes[i]] = ExecuteAfterProbe(
+        task, num_train_examples[task_indexes[i]], algorithm_for(task),
+        &rand_gens.rand_gen, &rand_gens.probe_rand_gen, probe_states[i].get(),
+        &task_counts[i]);
+  });
+
+  for (IntegerT i = 0; i < num_tasks; ++i) {
+    if (functional_cache_ != nullptr && !found[i] &&
+        task_counts[i].num_estimated_fitnesses == 0) {
+      functional_cache_->InsertOrDie(
+          hashes[i], (*task_fitnesses)[task_indexes[i]]);
+    }
+    counts_.Add(task_counts[i]);
+  }
+}
+
+template <FeatureIndexT F>
+void Evaluator::ExecuteOnLanesImpl(const IntegerT begin, const IntegerT end,
+                                   const IntegerT num_train_examples,
+                                   const Algorithm& algorithm,
+                                   vector<double>* task_fitnesses) {
+  // Functional cache hits are resolved first; only the misses use the lanes.
+  // The misses are inserted into the cache after all the lookups. Only the
+  // probes use the JIT.
+  if (functional_cache_ != nullptr) CompileJitAlgorithmOnce<F>(algorithm);
+  vector<const Task<F>*> lane_tasks;
+  vector<IntegerT> lane_task_indexes;
+  vector<size_t> lane_hashes;
+  for (IntegerT task_index = begin; task_index < end; ++task_index) {
+    const Task<F>& task = *SafeDowncast<F>(tasks_[task_index].get());
+    if (functional_cache_ != nullptr) {
+      const size_t hash = FunctionalCacheHash(
+          task, num_train_examples, algorithm, functional_cache_rand_gen_,
+          &counts_);
+      pair<double, bool> fitness_and_found = functional_cache_->Find(hash);
+      if (fitness_and_found.second) {
+        // Cache hit.
+        functional_cache_->UpdateOrDie(hash, fitness_and_found.first);
+        (*task_fitnesses)[task_index] = fitness_and_found.first;
+        continue;
+      }
+      lane_hashes.push_back(hash);
+    }
+    lane_tasks.push_back(&task);
+    lane_task_indexes.push_back(task_index);
+  }
+  if (lane_tasks.empty()) return;
+
+  // Each lane runs its setup on the random stream of its task, as the
+  // sequential execution would.
+  LaneExecutor<F, kNumTaskLanes> executor(
+      algorithm, lane_tasks, num_train_examples, lane_tasks[0]->ValidSteps(),
+      rand_gen_, max_abs_error_, [this](const Task<F>& task) {
+        UseTaskRandomStream(task.index_, rand_gen_);
+      });
+  const vector<double> fitnesses = executor.Execute();
+  counts_.num_train_steps_completed += executor.GetNumTrainStepsCompleted();
+  counts_.num_executions += lane_tasks.size();
+  for (IntegerT lane = 0; lane < lane_tasks.size(); ++lane) {
+    (*task_fitnesses)[lane_task_indexes[lane]] = fitnesses[lane];
+    if (functional_cache_ != nullptr) {
+      functional_cache_->InsertOrDie(lane_hashes[lane], fitnesses[lane]);
+    }
+  }
+}
+
+void Evaluator::ResetFunctionalCacheRandomGenerator(
+    RandomGenerator* rand_gen) const {
+  rand_gen->BitGen()->seed(kFunctionalCacheRandomSeed);
+  if (use_counter_based_rng_) {
+    rand_gen->UseCounterBasedFills(kFunctionalCacheRandomSeed);
+  }
+}
+
+void Evaluator::UseTaskRandomStream(const IntegerT task_index,
+                                    RandomGenerator* rand_gen) const {
+  if (use_counter_based_rng_) {
+    rand_gen->UseCounterBasedFills(
+        (static_cast<uint64_t>(evaluation_key_) << 32) |
+        static_cast<uint32_t>(task_index));
   }
 }
 
@@ -16,6 +16,7 @@
 #define AUTOML_ZERO_EVALUATOR_H_
 
 #include <cstdio>
+#include <map>
 #include <memory>
 #include <random>
 #include <vector>
@@ -24,15 +25,65 @@
 #include "task.h"
 #include "task.pb.h"
 #include "definitions.h"
+#include "executor.h"
 #include "experiment.pb.h"
 #include "fec_cache.h"
+#include "optimizer.h"
 #include "random_generator.h"
+#include "thread_pool.h"
 #include "train_budget.h"
 
 namespace automl_zero {
 
 class Algorithm;
 
+// The seed of the random generator of the functional cache probes. The
+// evaluations that resume a probe (see resume_functional_cache_probes) also
+// draw from this generator.
+constexpr RandomSeedT kFunctionalCacheRandomSeed = 235732282;
+
+// How an Evaluator executes the tasks. The defaults execute them one after the
+// other, with the interpreter, drawing from the Evaluator's rand_gen.
+struct EvaluatorOptions {
+  // Whether the Executors should JIT-compile the component functions.
+  bool use_jit = false;
+  // Whether to execute groups of compatible tasks together, one per lane
+  // of a LaneExecutor, when the Algorithm allows it.
+  bool use_task_lanes = false;
+  // Whether the random vector and matrix ops draw from a counter-based
+  // generator keyed per evaluation (see
+  // RandomGenerator::UseCounterBasedFills) instead of from rand_gen.
+  bool use_counter_based_rng = false;
+  // Whether, on a functional cache miss, to continue training from the
+  // state of the functional cache probe instead of starting over. The
+  // Executor then draws from the probe's random generator instead of from
+  // rand_gen, which makes the result the same as if the probe had kept
+  // going. Task lanes are not used.
+  bool resume_functional_cache_probes = false;
+  // Whether the Executors use the approximation in fast_math.h for the
+  // sigmoid of the mini-batch predictions.
+  bool use_fast_math = false;
+  // If positive, the tasks execute in parallel on a pool of this many
+  // threads. Each task then draws from its own random generator, seeded
+  // from rand_gen once per evaluation, so the results are the same for
+  // any number of threads, but differ from those of executing the tasks
+  // one after the other (num_threads = 0). Task lanes are not used.
+  IntegerT num_threads = 0;
+  // Whether, when evaluating against a fitness threshold, the Executors
+  // stop validating once the fitness of their task cannot make the
+  // combined fitness exceed it (see ValidationBound).
+  bool bound_validation = false;
+  // If bound_validation, also stop validating once exceeding the
+  // threshold is this many standard deviations away (see
+  // ValidationBound::num_stdevs). 0 only stops once it is impossible.
+  double validation_bound_num_stdevs = 0.0;
+  // Whether, when evaluating against a fitness threshold, to execute the
+  // tasks in a random order and stop once the combined fitness cannot
+  // exceed the threshold, whatever the fitnesses of the remaining tasks.
+  // With threads, the tasks execute in rounds of one task per thread.
+  bool race_tasks = false;
+};
+
 // See base class.
 class Evaluator {
  public:
@@ -51,7 +102,9 @@ class Evaluator {
       TrainBudget* train_budget,
       // Errors larger than this trigger early stopping, as they signal
       // models that likely have runnaway behavior.
-      double max_abs_error);
+      double max_abs_error,
+      // How to execute the tasks. See EvaluatorOptions.
+      const EvaluatorOptions& options = EvaluatorOptions());
       // If false, suppresses all logging output. Finer grain control
       // available through logging flags.
 
@@ -61,13 +114,57 @@ class Evaluator {
   // Evaluates a Algorithm by executing it on the tasks. Returns the mean
   // fitness.
   double Evaluate(const Algorithm& algorithm);
-  // Evaluates a Algorithm by executing it on the tasks with a limited 
-  // number of steps. Returns the mean fitness 
-  double EarlyEvaluate(const Algorithm& algorithm);
+  // Evaluates a Algorithm by executing it on the tasks and with the number of
+  // train examples of the rung. If fitness_threshold is above kMinFitness,
+  // only whether the fitness exceeds it matters: with bound_validation or
+  // race_tasks (see EvaluatorOptions), the evaluation may then stop early, and
+  // a fitness no larger than the threshold can be an estimate instead of the
+  // fitness (see Executor::FitnessIsEstimate). If not null,
+  // *fitness_is_estimate is set to whether it is. Estimated task fitnesses are
+  // not added to the functional cache. Task lanes are not bounded.
+  double Evaluate(const Algorithm& algorithm, const EvaluationRung& rung,
+                  double fitness_threshold = kMinFitness,
+                  bool* fitness_is_estimate = nullptr);
+  // The number of train steps of an evaluation on the rung, without the train
+  // budget, the functional cache probes and early stopping.
+  IntegerT NominalTrainSteps(const EvaluationRung& rung) const;
   // Get the number of train steps this evaluator has performed.
   IntegerT GetNumTrainStepsCompleted() const;
+  // Get the number of executions of an Algorithm on a task this evaluator has
+  // performed, not counting functional cache probes, and how many of them
+  // skipped learn (see Executor::SkippedLearn).
+  IntegerT GetNumExecutions() const;
+  IntegerT GetNumExecutionsSkippingLearn() const;
+  // Get the number of train steps the Executors did not run because they
+  // stopped training at a NaN that would have stopped it later anyway (see
+  // Executor::GetNumTrainStepsSaved).
+  IntegerT GetNumTrainStepsSavedOnNans() const;
+  // Get the number of validation steps the Executors did not run because the
+  // fitness could not exceed the threshold (see Executor::FitnessIsEstimate),
+  // and the number of task fitnesses replaced by estimates.
+  IntegerT GetNumValidStepsSaved() const;
+  IntegerT GetNumEstimatedFitnesses() const;
+  // Get the number of tasks not executed because the race stopped before
+  // them (see race_tasks).
+  IntegerT GetNumTasksSkippedByRacing() const;
+  // What the optimizer did to the Algorithms before executing them.
+  const OptimizationStats& GetOptimizationStats() const;
 
  private:
+  // Returns the fitness of the Algorithm on each of the first tasks in
+  // tasks_, training on the given number of examples for each task.
+  std::vector<double> ExecuteTasks(
+      const Algorithm& algorithm,
+      const std::vector<IntegerT>& num_train_examples);
+
+  // Executes the first tasks in tasks_ in a random order until the combined
+  // fitness cannot exceed fitness_threshold, and returns it. If the race
+  // stopped early (see race_tasks), returns an estimate of it instead, the
+  // combined fitness of the tasks executed, and counts the tasks skipped.
+  double RaceTasks(const Algorithm& algorithm,
+                   const std::vector<IntegerT>& num_train_examples,
+                   double fitness_threshold);
+
   double Execute(const TaskInterface& task, IntegerT num_train_examples,
                  const Algorithm& algorithm);
 
@@ -75,6 +172,108 @@ class Evaluator {
   double ExecuteImpl(const Task<F>& task, IntegerT num_train_examples,
                      const Algorithm& algorithm);
 
+  // Executes tasks_[begin] to tasks_[end - 1] with a LaneExecutor. The tasks
+  // must be LaneCompatible and fit in the lanes. Fills their fitnesses.
+  void ExecuteOnLanes(IntegerT begin, IntegerT end,
+                      IntegerT num_train_examples, const Algorithm& algorithm,
+                      std::vector<double>* task_fitnesses);
+
+  template <FeatureIndexT F>
+  void ExecuteOnLanesImpl(IntegerT begin, IntegerT end,
+                          IntegerT num_train_examples,
+                          const Algorithm& algorithm,
+                          std::vector<double>* task_fitnesses);
+
+  // Executes the given tasks on thread_pool_, one features size at a time.
+  // Fills their fitnesses.
+  void ExecuteInParallel(const Algorithm& algorithm,
+                         const Algorithm& full_algorithm,
+                         const std::vector<IntegerT>& task_indexes,
+                         const std::vector<IntegerT>& num_train_examples,
+                         std::vector<double>* task_fitnesses);
+
+  template <FeatureIndexT F>
+  void ExecuteInParallelImpl(const std::vector<IntegerT>& task_indexes,
+                             const Algorithm& algorithm,
+                             const Algorithm& full_algorithm,
+                             const std::vector<IntegerT>& num_train_examples,
+                             std::vector<double>* task_fitnesses);
+
+  // The counters of the executions, kept per task when tasks execute in
+  // parallel and added up afterwards.
+  struct ExecutionCounts {
+    void Add(const ExecutionCounts& other);
+
+    IntegerT num_train_steps_completed = 0;
+    IntegerT num_executions = 0;
+    IntegerT num_executions_skipping_learn = 0;
+    IntegerT num_train_steps_saved_on_nans = 0;
+    IntegerT num_valid_steps_saved = 0;
+    IntegerT num_estimated_fitnesses = 0;
+    IntegerT num_tasks_skipped_by_racing = 0;
+  };
+
+  // Runs the functional cache probe of the Algorithm on the task and returns
+  // the hash of its errors. The probe restarts and draws from
+  // probe_rand_gen.
+  // If probe_state is not nullptr, saves the state of the probe at the end of
+  // its training into it.
+  template <FeatureIndexT F>
+  size_t FunctionalCacheHash(const Task<F>& task, IntegerT num_train_examples,
+                             const Algorithm& algorithm,
+                             RandomGenerator* probe_rand_gen,
+                             ExecutionCounts* counts,
+                             ExecutorState<F>* probe_state = nullptr) const;
+
+  // Executes the Algorithm on the task after a functional cache miss, drawing
+  // from rand_gen, or continuing from the probe if
+  // resume_functional_cache_probes_ (see EvaluatorOptions).
+  template <FeatureIndexT F>
+  double ExecuteAfterProbe(const Task<F>& task, IntegerT num_train_examples,
+                           const Algorithm& algorithm,
+                           RandomGenerator* rand_gen,
+                           RandomGenerator* probe_rand_gen,
+                           const ExecutorState<F>* probe_state,
+                           ExecutionCounts* counts) const;
+
+  template <FeatureIndexT F>
+  double RunExecutor(const Task<F>& task, IntegerT num_train_examples,
+                     const Algorithm& algorithm, RandomGenerator* rand_gen,
+                     const ExecutorState<F>* initial_state,
+                     ExecutionCounts* counts) const;
+
+  // Compiles the Algorithm for tasks with features size F, unless it already
+  // was in this evaluation or the JIT is not used. All the Executors of these
+  // tasks then share the code (see JitAlgorithmFor). Must be given the
+  // Algorithm the tasks without mini-batches execute.
+  template <FeatureIndexT F>
+  void CompileJitAlgorithmOnce(const Algorithm& algorithm);
+
+  // The code compiled for tasks with this features size in this evaluation,
+  // or nullptr if there is none.
+  const JitAlgorithm* JitAlgorithmFor(FeatureIndexT features_size) const;
+
+  // Restarts the given random generator of the functional cache probes.
+  void ResetFunctionalCacheRandomGenerator(RandomGenerator* rand_gen) const;
+
+  // Makes the random vector and matrix ops of rand_gen draw from the stream
+  // of the given task, if using the counter-based generator.
+  void UseTaskRandomStream(IntegerT task_index,
+                           RandomGenerator* rand_gen) const;
+
+  // The tasks of an evaluation on the rung are the first ones in tasks_.
+  IntegerT NumRungTasks(const EvaluationRung& rung) const;
+  IntegerT RungTrainExamples(const TaskInterface& task,
+                             const EvaluationRung& rung) const;
+
+  // The fitness threshold of a task not executed yet below which the combined
+  // fitness cannot exceed fitness_threshold, whatever the fitnesses of the
+  // other tasks not executed yet, or kMinFitness if there is none or if not
+  // bounding the validation. task_fitnesses holds kMaxFitness for the tasks
+  // not executed yet.
+  double TaskFitnessThreshold(double fitness_threshold,
+                              const std::vector<double>& task_fitnesses) const;
+
   double CapFitness(double fitness);
 
   const FitnessCombinationMode fitness_combination_mode_;
@@ -96,11 +295,34 @@ class Evaluator {
   std::shared_ptr<Algorithm> best_algorithm_;
 
   const double max_abs_error_;
-  IntegerT num_train_steps_completed_;
+  const bool use_jit_;
+  const bool use_task_lanes_;
+  const bool use_counter_based_rng_;
+  const bool resume_functional_cache_probes_;
+  const bool use_fast_math_;
+  const bool bound_validation_;
+  const double validation_bound_num_stdevs_;
+  const bool race_tasks_;
+  // Only set if executing the tasks in parallel.
+  std::unique_ptr<ThreadPool> thread_pool_;
+  // The key of the counter-based generator, and of the random generators of
+  // the tasks executing in parallel, for the current evaluation. Each task
+  // uses its own stream of this key.
+  RandomSeedT evaluation_key_;
+  // The threshold of the task fitnesses for the current evaluation (see
+  // TaskFitnessThreshold).
+  double task_fitness_threshold_;
+  // The code compiled by the JIT for the current evaluation, by features size.
+  std::map<FeatureIndexT, std::unique_ptr<JitAlgorithm>> jit_algorithms_;
+  ExecutionCounts counts_;
+  OptimizationStats optimization_stats_;
 };
 
 namespace internal {
 
+// The upper median of the values.
+double Median(std::vector<double> values);
+
 double CombineFitnesses(
     const std::vector<double>& task_fitnesses,
     const FitnessCombinationMode mode);
@@ -15,7 +15,9 @@
 #include "evaluator.h"
 
 #include <functional>
+#include <memory>
 #include <random>
+#include <string>
 
 #include "algorithm.h"
 #include "task.h"
@@ -23,20 +25,27 @@
 #include "task.pb.h"
 #include "definitions.h"
 #include "executor.h"
+#include "fec_cache.h"
+#include "fec_cache.pb.h"
 #include "generator.h"
 #include "generator_test_util.h"
+#include "instruction.h"
+#include "optimizer.h"
 #include "random_generator.h"
 #include "test_util.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 
 namespace automl_zero {
 
 using ::absl::StrCat;  // NOLINT
 using ::std::function;  // NOLINT
+using ::std::make_shared;  // NOLINT
 using ::std::min;  // NOLINT
 using ::std::mt19937;  // NOLINT
+using ::std::vector;  // NOLINT
 using test_only::GenerateTask;
 
 constexpr IntegerT kNumTrainExamples = 1000;
@@ -44,6 +53,64 @@ constexpr IntegerT kNumValidExamples = 100;
 constexpr IntegerT kNumTasks = 2;
 constexpr double kNumericTolerance = 0.0000001;
 constexpr double kMaxAbsError = 100.0;
+constexpr IntegerT kNumRandomAlgorithms = 20;
+
+// Linear regression tasks with features size 4.
+std::string LinearTaskSpec(
+    const IntegerT num_tasks, const IntegerT num_train_examples = 100,
+    const IntegerT num_valid_examples = kNumValidExamples) {
+  return StrCat("scalar_linear_regression_task {} "
+                "features_size: 4 "
+                "num_train_examples: ", num_train_examples, " "
+                "num_valid_examples: ", num_valid_examples, " "
+                "num_tasks: ", num_tasks, " "
+                "eval_type: RMS_ERROR ");
+}
+
+TaskCollection LinearTasks(
+    const IntegerT num_tasks, const IntegerT num_train_examples = 100,
+    const IntegerT num_valid_examples = kNumValidExamples) {
+  return ParseTextFormat<TaskCollection>(StrCat(
+      "tasks { ",
+      LinearTaskSpec(num_tasks, num_train_examples, num_valid_examples),
+      "} "));
+}
+
+// Functional cache probes on 10 train and 10 validation examples.
+FECSpec SmallFECSpec() {
+  return ParseTextFormat<FECSpec>(
+      "num_train_examples: 10 "
+      "num_valid_examples: 10 ");
+}
+
+// Ops without randomness. With only these, the random generators do not
+// matter.
+vector<Op> DeterministicOps() {
+  return {SCALAR_SUM_OP, SCALAR_DIFF_OP, SCALAR_PRODUCT_OP, SCALAR_DIVISION_OP,
+          SCALAR_EXP_OP, SCALAR_CONST_SET_OP, VECTOR_SUM_OP, VECTOR_PRODUCT_OP,
+          SCALAR_VECTOR_PRODUCT_OP, VECTOR_INNER_PRODUCT_OP};
+}
+
+// An Algorithm of 3 setup, 4 predict and 4 learn no-op instructions, the
+// sizes of those of RandomAlgorithms.
+Algorithm NoOpAlgorithm() {
+  return Generator(NO_OP_ALGORITHM, 3, 4, 4, {}, {}, {}, nullptr, nullptr)
+      .NoOp();
+}
+
+// Random Algorithms drawn from the given ops, the same on every call.
+vector<Algorithm> RandomAlgorithms(const vector<Op>& setup_ops,
+                                   const vector<Op>& ops) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  Generator generator(NO_OP_ALGORITHM, 3, 4, 4, setup_ops, ops, ops, &bit_gen,
+                      &rand_gen);
+  vector<Algorithm> algorithms;
+  for (IntegerT i = 0; i < kNumRandomAlgorithms; ++i) {
+    algorithms.push_back(generator.Random());
+  }
+  return algorithms;
+}
 
 TEST(EvaluatorTest, AveragesOverTasks) {
   Task<4> task_one =
@@ -137,6 +204,489 @@ TEST(EvaluatorTest, GrTildeGrWithBiasHasHighFitness) {
   EXPECT_FLOAT_EQ(fitness, 0.99652964);
 }
 
+// Evaluates models on the search tasks of the integration tests (see
+// run_integration_test_*.sh) and compares the fitnesses with those computed in
+// double precision. The projected binary tasks are left out, as they read
+// their datasets from disk.
+TEST(EvaluatorTest, IntegrationTaskFitnessesMatchDoublePrecision) {
+  const auto linear_tasks = ParseTextFormat<TaskCollection>(
+      "tasks { "
+      "  scalar_linear_regression_task {} "
+      "  features_size: 4 "
+      "  num_train_examples: 100 "
+      "  num_valid_examples: 100 "
+      "  num_tasks: 10 "
+      "  eval_type: RMS_ERROR "
+      "} ");
+  const auto nonlinear_tasks = ParseTextFormat<TaskCollection>(
+      "tasks { "
+      "  scalar_2layer_nn_regression_task {} "
+      "  features_size: 4 "
+      "  num_train_examples: 1000 "
+      "  num_valid_examples: 100 "
+      "  num_tasks: 1 "
+      "  eval_type: RMS_ERROR "
+      "} ");
+  struct Case {
+    const TaskCollection* tasks;
+    HardcodedAlgorithmID model;
+    double double_precision_fitness;
+  };
+  const vector<Case> cases = {
+      {&linear_tasks, LINEAR_ALGORITHM, 0.565311333507475},
+      {&nonlinear_tasks, NEURAL_NET_ALGORITHM, 0.848358991659124},
+      {&nonlinear_tasks, INTEGRATION_TEST_DAMAGED_NEURAL_NET_ALGORITHM,
+       0.470048757876438},
+  };
+  for (const Case& test_case : cases) {
+    mt19937 bit_gen(100000);
+    RandomGenerator rand_gen(&bit_gen);
+    Generator generator;
+    Evaluator evaluator(MEAN_FITNESS_COMBINATION, *test_case.tasks, &rand_gen,
+                        nullptr,  // functional_cache
+                        nullptr,  // train_budget
+                        kMaxAbsError);
+    const double fitness =
+        evaluator.Evaluate(generator.ModelByID(test_case.model));
+    std::cout << "Model " << test_case.model
+              << " fitness delta from double precision = "
+              << fitness - test_case.double_precision_fitness << std::endl;
+    EXPECT_NEAR(fitness, test_case.double_precision_fitness,
+                kPrecisionFitnessTolerance)
+        << "model " << test_case.model;
+  }
+}
+
+TEST(EvaluatorTest, EvaluatesEveryRegisteredFeaturesSize) {
+  vector<FeatureIndexT> features_sizes;
+#define AUTOML_ZERO_ADD_FEATURES_SIZE(F) features_sizes.push_back(F);
+  AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(AUTOML_ZERO_ADD_FEATURES_SIZE)
+#undef AUTOML_ZERO_ADD_FEATURES_SIZE
+  Generator generator;
+  for (const FeatureIndexT features_size : features_sizes) {
+    SCOPED_TRACE(features_size);
+    const auto task_collection = ParseTextFormat<TaskCollection>(
+        StrCat("tasks { "
+               "  scalar_linear_regression_task {} "
+               "  features_size: ",
+               features_size,
+               " "
+               "  num_train_examples: 1000 "
+               "  num_valid_examples: ",
+               kNumValidExamples,
+               " "
+               "  num_tasks: 1 "
+               "  eval_type: RMS_ERROR "
+               "} "));
+    auto evaluate = [&](const Algorithm& algorithm) {
+      mt19937 bit_gen(100000);
+      RandomGenerator rand_gen(&bit_gen);
+      EvaluatorOptions options;
+      options.use_jit = true;
+      Evaluator evaluator(MEAN_FITNESS_COMBINATION, task_collection,
+                          &rand_gen,
+                          nullptr,  // functional_cache
+                          nullptr,  // train_budget
+                          kMaxAbsError, options);
+      return evaluator.Evaluate(algorithm);
+    };
+    // The learning rate keeps the training stable for all the sizes.
+    EXPECT_GT(evaluate(generator.LinearModel(0.1 / features_size)),
+              evaluate(generator.LinearModel(0.0)));
+  }
+}
+
+TEST(EvaluatorTest, EvaluatesMiniBatchTasks) {
+  const auto task_collection = ParseTextFormat<TaskCollection>(
+      StrCat("tasks { "
+             "  scalar_linear_regression_task {} "
+             "  features_size: 4 "
+             "  num_train_examples: 100 "
+             "  num_valid_examples: ",
+             kNumValidExamples,
+             " "
+             "  num_tasks: ",
+             kNumTasks,
+             " "
+             "  batch_size: 4 "
+             "  eval_type: RMS_ERROR "
+             "} "));
+  auto evaluate = [&](const Algorithm& algorithm) {
+    mt19937 bit_gen(100000);
+    RandomGenerator rand_gen(&bit_gen);
+    EvaluatorOptions options;
+    options.use_jit = true;
+    options.use_task_lanes = true;
+    Evaluator evaluator(MEAN_FITNESS_COMBINATION, task_collection, &rand_gen,
+                        nullptr,  // functional_cache
+                        nullptr,  // train_budget
+                        kMaxAbsError, options);
+    const double fitness = evaluator.Evaluate(algorithm);
+    EXPECT_EQ(evaluator.GetNumTrainStepsCompleted(), 100 * kNumTasks);
+    return fitness;
+  };
+  // The predictions only reach the executor through the mini-batch addresses,
+  // which the optimizations must not prune.
+  Generator generator;
+  EXPECT_GT(evaluate(generator.MiniBatchLinearModel(kDefaultLearningRate)),
+            evaluate(generator.MiniBatchLinearModel(0.0)));
+}
+
+TEST(EvaluatorTest, TaskLanesMatchSequentialExecution) {
+  const TaskCollection task_collection = LinearTasks(6);
+  const vector<Algorithm> algorithms = RandomAlgorithms(
+      {SCALAR_CONST_SET_OP, VECTOR_GAUSSIAN_SET_OP}, DeterministicOps());
+  // Predicts with a random projection of the features, drawn in setup. With
+  // the counter-based generator, the setup of each task draws it from the
+  // stream of the task.
+  Algorithm random_projection = NoOpAlgorithm();
+  random_projection.setup_[0] = make_shared<const Instruction>(
+      VECTOR_GAUSSIAN_SET_OP, 1, FloatDataSetter(0.0), FloatDataSetter(1.0));
+  random_projection.predict_[0] = make_shared<const Instruction>(
+      VECTOR_INNER_PRODUCT_OP, 1, kFeaturesVectorAddress,
+      kPredictionsScalarAddress);
+  for (const bool use_counter_based_rng : {false, true}) {
+    SCOPED_TRACE(use_counter_based_rng);
+    EvaluatorOptions sequential_options;
+    sequential_options.use_counter_based_rng = use_counter_based_rng;
+    mt19937 sequential_bit_gen(1);
+    RandomGenerator sequential_rand_gen(&sequential_bit_gen);
+    Evaluator sequential_evaluator(
+        MEAN_FITNESS_COMBINATION, task_collection, &sequential_rand_gen,
+        nullptr,  // functional_cache
+        nullptr,  // train_budget
+        kMaxAbsError, sequential_options);
+    EvaluatorOptions lanes_options = sequential_options;
+    lanes_options.use_task_lanes = true;
+    mt19937 lanes_bit_gen(1);
+    RandomGenerator lanes_rand_gen(&lanes_bit_gen);
+    Evaluator lanes_evaluator(
+        MEAN_FITNESS_COMBINATION, task_collection, &lanes_rand_gen,
+        nullptr,  // functional_cache
+        nullptr,  // train_budget
+        kMaxAbsError, lanes_options);
+    EXPECT_EQ(lanes_evaluator.Evaluate(random_projection),
+              sequential_evaluator.Evaluate(random_projection));
+    for (const Algorithm& algorithm : algorithms) {
+      EXPECT_EQ(lanes_evaluator.Evaluate(algorithm),
+                sequential_evaluator.Evaluate(algorithm));
+    }
+    EXPECT_EQ(lanes_evaluator.GetNumTrainStepsCompleted(),
+              sequential_evaluator.GetNumTrainStepsCompleted());
+  }
+}
+
+TEST(EvaluatorTest, CountsExecutionsSkippingLearn) {
+  const TaskCollection task_collection = LinearTasks(kNumTasks);
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  Evaluator evaluator(MEAN_FITNESS_COMBINATION, task_collection, &rand_gen,
+                      nullptr,  // functional_cache
+                      nullptr,  // train_budget
+                      kMaxAbsError);
+  Algorithm algorithm = SimpleGz();
+  evaluator.Evaluate(algorithm);
+  EXPECT_EQ(evaluator.GetNumExecutions(), kNumTasks);
+  EXPECT_EQ(evaluator.GetNumExecutionsSkippingLearn(), 0);
+
+  algorithm.learn_.clear();
+  evaluator.Evaluate(algorithm);
+  EXPECT_EQ(evaluator.GetNumExecutions(), 2 * kNumTasks);
+  EXPECT_EQ(evaluator.GetNumExecutionsSkippingLearn(), kNumTasks);
+}
+
+TEST(EvaluatorTest, ResumingFunctionalCacheProbesMatchesStartingOver) {
+  const std::string task_spec = StrCat(LinearTaskSpec(1),
+                                       "param_seeds: 1000 "
+                                       "data_seeds: 10000 ");
+  const auto task_collection =
+      ParseTextFormat<TaskCollection>(StrCat("tasks { ", task_spec, " } "));
+  const Task<4> task = GenerateTask<4>(task_spec);
+  const FECSpec fec_spec = SmallFECSpec();
+  // The random ops in learn draw after the probe.
+  vector<Op> ops = DeterministicOps();
+  ops.push_back(VECTOR_GAUSSIAN_SET_OP);
+  // Draws its weights in setup, and takes a random walk on them in learn.
+  Algorithm random_walk = NoOpAlgorithm();
+  random_walk.setup_[0] = make_shared<const Instruction>(
+      VECTOR_GAUSSIAN_SET_OP, 1, FloatDataSetter(0.0), FloatDataSetter(1.0));
+  random_walk.predict_[0] = make_shared<const Instruction>(
+      VECTOR_INNER_PRODUCT_OP, 1, kFeaturesVectorAddress,
+      kPredictionsScalarAddress);
+  random_walk.learn_[0] = make_shared<const Instruction>(
+      VECTOR_GAUSSIAN_SET_OP, 2, FloatDataSetter(0.0), FloatDataSetter(0.1));
+  random_walk.learn_[1] =
+      make_shared<const Instruction>(VECTOR_SUM_OP, 1, 2, 1);
+  vector<Algorithm> algorithms = RandomAlgorithms(ops, ops);
+  algorithms.insert(algorithms.begin(), random_walk);
+  IntegerT num_resumed_train_steps = 0;
+  IntegerT num_started_over_train_steps = 0;
+  for (const Algorithm& algorithm : algorithms) {
+    // A new cache each time, so that every evaluation resumes its own probe.
+    mt19937 actual_bit_gen(1);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    FECCache functional_cache(fec_spec);
+    EvaluatorOptions options;
+    options.resume_functional_cache_probes = true;
+    Evaluator evaluator(
+        MEAN_FITNESS_COMBINATION, task_collection, &actual_rand_gen,
+        &functional_cache,
+        nullptr,  // train_budget
+        kMaxAbsError, options);
+    const double fitness = evaluator.Evaluate(algorithm);
+    num_resumed_train_steps += evaluator.GetNumTrainStepsCompleted();
+    // Starts over from the state of the random generator of the probe, with
+    // the Algorithm the Evaluator executes.
+    const Algorithm optimized_algorithm = OptimizeAlgorithm(algorithm);
+    mt19937 expected_bit_gen(kFunctionalCacheRandomSeed);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> executor(optimized_algorithm, task, 100,
+                         kNumValidExamples, &expected_rand_gen, kMaxAbsError,
+                         false,  // use_jit
+                         true,  // wipe_used_memory_only
+                         true,  // short_circuit_constant_predictions
+                         nullptr,  // initial_state
+                         true);  // stop_on_fatal_nans
+    EXPECT_EQ(fitness, executor.Execute());
+    num_started_over_train_steps +=
+        functional_cache.NumTrainExamples() +
+        executor.GetNumTrainStepsCompleted();
+  }
+  // The examples the probes trained on are not trained on again.
+  EXPECT_LT(num_resumed_train_steps, num_started_over_train_steps);
+}
+
+TEST(EvaluatorTest, ParallelExecutionDoesNotDependOnNumThreads) {
+  const TaskCollection task_collection = LinearTasks(6);
+  const FECSpec fec_spec = SmallFECSpec();
+  vector<Op> ops = DeterministicOps();
+  ops.push_back(VECTOR_GAUSSIAN_SET_OP);
+  ops.push_back(SCALAR_UNIFORM_SET_OP);
+  const vector<Algorithm> algorithms = RandomAlgorithms(ops, ops);
+  // Executors of an Algorithm share its JIT-compiled code across threads and
+  // functional cache probes.
+  for (const bool use_jit : {false, true}) {
+    SCOPED_TRACE(use_jit);
+    const vector<IntegerT> all_num_threads = {1, 2, 4};
+    vector<std::unique_ptr<mt19937>> bit_gens;
+    vector<std::unique_ptr<RandomGenerator>> rand_gens;
+    vector<std::unique_ptr<FECCache>> functional_caches;
+    vector<std::unique_ptr<Evaluator>> evaluators;
+    for (const IntegerT num_threads : all_num_threads) {
+      bit_gens.emplace_back(new mt19937(1));
+      rand_gens.emplace_back(new RandomGenerator(bit_gens.back().get()));
+      functional_caches.emplace_back(new FECCache(fec_spec));
+      EvaluatorOptions options;
+      options.use_jit = use_jit;
+      options.num_threads = num_threads;
+      evaluators.emplace_back(new Evaluator(
+          MEAN_FITNESS_COMBINATION, task_collection, rand_gens.back().get(),
+          functional_caches.back().get(),
+          nullptr,  // train_budget
+          kMaxAbsError, options));
+    }
+    for (const Algorithm& algorithm : algorithms) {
+      const double fitness = evaluators[0]->Evaluate(algorithm);
+      for (IntegerT j = 1; j < evaluators.size(); ++j) {
+        EXPECT_EQ(evaluators[j]->Evaluate(algorithm), fitness);
+      }
+    }
+    for (IntegerT j = 1; j < evaluators.size(); ++j) {
+      EXPECT_EQ(evaluators[j]->GetNumTrainStepsCompleted(),
+                evaluators[0]->GetNumTrainStepsCompleted());
+      EXPECT_EQ(evaluators[j]->GetNumExecutions(),
+                evaluators[0]->GetNumExecutions());
+    }
+  }
+}
+
+TEST(EvaluatorTest, ParallelExecutionMatchesSequentialWithoutRandomOps) {
+  const TaskCollection task_collection = LinearTasks(6);
+  const FECSpec fec_spec = SmallFECSpec();
+  const vector<Algorithm> algorithms =
+      RandomAlgorithms(DeterministicOps(), DeterministicOps());
+  for (const bool resume_functional_cache_probes : {false, true}) {
+    EvaluatorOptions sequential_options;
+    sequential_options.resume_functional_cache_probes =
+        resume_functional_cache_probes;
+    mt19937 sequential_bit_gen(1);
+    RandomGenerator sequential_rand_gen(&sequential_bit_gen);
+    FECCache sequential_functional_cache(fec_spec);
+    Evaluator sequential_evaluator(
+        MEAN_FITNESS_COMBINATION, task_collection, &sequential_rand_gen,
+        &sequential_functional_cache,
+        nullptr,  // train_budget
+        kMaxAbsError, sequential_options);
+    EvaluatorOptions parallel_options = sequential_options;
+    parallel_options.num_threads = 3;
+    mt19937 parallel_bit_gen(1);
+    RandomGenerator parallel_rand_gen(&parallel_bit_gen);
+    FECCache parallel_functional_cache(fec_spec);
+    Evaluator parallel_evaluator(
+        MEAN_FITNESS_COMBINATION, task_collection, &parallel_rand_gen,
+        &parallel_functional_cache,
+        nullptr,  // train_budget
+        kMaxAbsError, parallel_options);
+    for (const Algorithm& algorithm : algorithms) {
+      EXPECT_EQ(parallel_evaluator.Evaluate(algorithm),
+                sequential_evaluator.Evaluate(algorithm));
+      // Functional cache hits.
+      EXPECT_EQ(parallel_evaluator.Evaluate(algorithm),
+                sequential_evaluator.Evaluate(algorithm));
+    }
+    EXPECT_EQ(parallel_evaluator.GetNumTrainStepsCompleted(),
+              sequential_evaluator.GetNumTrainStepsCompleted());
+    EXPECT_EQ(parallel_evaluator.GetNumExecutions(),
+              sequential_evaluator.GetNumExecutions());
+    EXPECT_EQ(parallel_evaluator.GetNumExecutionsSkippingLearn(),
+              sequential_evaluator.GetNumExecutionsSkippingLearn());
+  }
+}
+
+TEST(EvaluatorTest, EvaluatesOnRungs) {
+  const TaskCollection task_collection = LinearTasks(4, 1000);
+  Generator generator;
+  const Algorithm algorithm = generator.LinearModel(kDefaultLearningRate);
+  auto make_evaluator = [&](RandomGenerator* rand_gen) {
+    return absl::make_unique<Evaluator>(
+        MEAN_FITNESS_COMBINATION, task_collection, rand_gen,
+        nullptr,  // functional_cache
+        nullptr,  // train_budget
+        kMaxAbsError);
+  };
+
+  // The default rung is the full evaluation.
+  mt19937 full_bit_gen(100000);
+  RandomGenerator full_rand_gen(&full_bit_gen);
+  auto full_evaluator = make_evaluator(&full_rand_gen);
+  mt19937 default_rung_bit_gen(100000);
+  RandomGenerator default_rung_rand_gen(&default_rung_bit_gen);
+  auto default_rung_evaluator = make_evaluator(&default_rung_rand_gen);
+  EXPECT_EQ(default_rung_evaluator->Evaluate(algorithm, EvaluationRung()),
+            full_evaluator->Evaluate(algorithm));
+  EXPECT_EQ(default_rung_evaluator->GetNumTrainStepsCompleted(), 4000);
+  EXPECT_EQ(full_evaluator->NominalTrainSteps(EvaluationRung()), 4000);
+
+  // A rung on a fraction of the examples of a subset of the tasks.
+  const auto rung = ParseTextFormat<EvaluationRung>(
+      "train_examples_fraction: 0.1 "
+      "num_tasks: 2 ");
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  auto evaluator = make_evaluator(&rand_gen);
+  const double fitness = evaluator->Evaluate(algorithm, rung);
+  EXPECT_GE(fitness, kMinFitness);
+  EXPECT_LE(fitness, kMaxFitness);
+  EXPECT_EQ(evaluator->GetNumTrainStepsCompleted(), 200);
+  EXPECT_EQ(evaluator->NominalTrainSteps(rung), 200);
+}
+
+TEST(EvaluatorTest, BoundsFitnessesBelowThreshold) {
+  const TaskCollection task_collection = LinearTasks(kNumTasks, 100, 1000);
+  const FECSpec fec_spec = SmallFECSpec();
+  Generator generator;
+  const Algorithm good_algorithm =
+      generator.LinearModel(kDefaultLearningRate);
+  const Algorithm bad_algorithm = generator.LinearModel(0.0);
+  // With more tasks, the threshold of each task would be too low to stop at.
+  EvaluationRung rung;
+  rung.set_num_tasks(1);
+
+  mt19937 expected_bit_gen(100000);
+  RandomGenerator expected_rand_gen(&expected_bit_gen);
+  Evaluator expected_evaluator(
+      MEAN_FITNESS_COMBINATION, task_collection, &expected_rand_gen,
+      nullptr,  // functional_cache
+      nullptr,  // train_budget
+      kMaxAbsError);
+  const double good_fitness = expected_evaluator.Evaluate(good_algorithm, rung);
+  const double bad_fitness = expected_evaluator.Evaluate(bad_algorithm, rung);
+  ASSERT_GT(good_fitness, bad_fitness);
+  const double fitness_threshold = (good_fitness + bad_fitness) / 2.0;
+
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  FECCache functional_cache(fec_spec);
+  EvaluatorOptions options;
+  options.bound_validation = true;
+  Evaluator evaluator(
+      MEAN_FITNESS_COMBINATION, task_collection, &rand_gen,
+      &functional_cache,
+      nullptr,  // train_budget
+      kMaxAbsError, options);
+  bool fitness_is_estimate = true;
+  EXPECT_EQ(evaluator.Evaluate(good_algorithm, rung, fitness_threshold,
+                               &fitness_is_estimate),
+            good_fitness);
+  EXPECT_FALSE(fitness_is_estimate);
+  EXPECT_EQ(evaluator.GetNumEstimatedFitnesses(), 0);
+  const double bad_fitness_estimate = evaluator.Evaluate(
+      bad_algorithm, rung, fitness_threshold, &fitness_is_estimate);
+  EXPECT_TRUE(fitness_is_estimate);
+  EXPECT_LE(bad_fitness_estimate, fitness_threshold);
+  EXPECT_NE(bad_fitness_estimate, bad_fitness);
+  EXPECT_GT(evaluator.GetNumEstimatedFitnesses(), 0);
+  EXPECT_GT(evaluator.GetNumValidStepsSaved(), 0);
+  // The estimates do not reach the functional cache.
+  EXPECT_EQ(evaluator.Evaluate(bad_algorithm, rung), bad_fitness);
+}
+
+TEST(EvaluatorTest, RacesTasksAgainstThreshold) {
+  const TaskCollection task_collection = LinearTasks(8);
+  Generator generator;
+  const Algorithm good_algorithm =
+      generator.LinearModel(kDefaultLearningRate);
+  const Algorithm bad_algorithm = generator.LinearModel(0.0);
+  const EvaluationRung rung;
+  for (const FitnessCombinationMode mode :
+       {MEAN_FITNESS_COMBINATION, MEDIAN_FITNESS_COMBINATION}) {
+    for (const IntegerT num_threads : {0, 3}) {
+      mt19937 expected_bit_gen(100000);
+      RandomGenerator expected_rand_gen(&expected_bit_gen);
+      Evaluator expected_evaluator(
+          mode, task_collection, &expected_rand_gen,
+          nullptr,  // functional_cache
+          nullptr,  // train_budget
+          kMaxAbsError);
+      const double good_fitness = expected_evaluator.Evaluate(good_algorithm);
+      const double bad_fitness = expected_evaluator.Evaluate(bad_algorithm);
+      ASSERT_GT(good_fitness, bad_fitness);
+      // High enough for the race to stop before the last round of tasks.
+      const double fitness_threshold =
+          good_fitness - (good_fitness - bad_fitness) / 4.0;
+
+      mt19937 bit_gen(100000);
+      RandomGenerator rand_gen(&bit_gen);
+      EvaluatorOptions options;
+      options.num_threads = num_threads;
+      options.race_tasks = true;
+      Evaluator evaluator(
+          mode, task_collection, &rand_gen,
+          nullptr,  // functional_cache
+          nullptr,  // train_budget
+          kMaxAbsError, options);
+      // Above the threshold, all the tasks execute.
+      bool fitness_is_estimate = true;
+      EXPECT_FLOAT_EQ(
+          evaluator.Evaluate(good_algorithm, rung, fitness_threshold,
+                             &fitness_is_estimate),
+          good_fitness);
+      EXPECT_FALSE(fitness_is_estimate);
+      EXPECT_EQ(evaluator.GetNumTasksSkippedByRacing(), 0);
+      // The estimate does not count the skipped tasks as perfect.
+      const double bad_fitness_estimate = evaluator.Evaluate(
+          bad_algorithm, rung, fitness_threshold, &fitness_is_estimate);
+      EXPECT_TRUE(fitness_is_estimate);
+      EXPECT_LE(bad_fitness_estimate, fitness_threshold);
+      EXPECT_NEAR(bad_fitness_estimate, bad_fitness,
+                  (good_fitness - bad_fitness) / 4.0);
+      EXPECT_GT(evaluator.GetNumTasksSkippedByRacing(), 0);
+      // Without a threshold, there is no race.
+      EXPECT_FLOAT_EQ(evaluator.Evaluate(bad_algorithm), bad_fitness);
+    }
+  }
+}
+
 namespace internal {
 
 TEST(CombineFitnessesTest, MeanWorksCorrectly) {
@@ -31,9 +31,14 @@
 #include "definitions.h"
 #include "instruction.pb.h"
 #include "algorithm.h"
+#include "dataflow.h"
+#include "executor_profile.h"
+#include "fast_math.h"
 #include "instruction.h"
+#include "jit.h"
 #include "memory.h"
 #include "random_generator.h"
+#include "simd_kernels.h"
 #include "gtest/gtest_prod.h"
 
 namespace automl_zero {
@@ -41,6 +46,285 @@ namespace automl_zero {
 constexpr FeatureIndexT kNumClasses = 10;
 constexpr double kPadLabel = 0.0;
 
+////////////////////////////////////////////////////////////////////////////////
+// Pre-decoded instruction streams.
+////////////////////////////////////////////////////////////////////////////////
+
+// Decoded op codes. Values below kNumDecodedProtoOps coincide with the Op enum.
+// The rest are internal to the interpreter and never appear in an Algorithm.
+typedef uint16_t DecodedOpT;
+constexpr DecodedOpT kNumDecodedProtoOps = MATRIX_GAUSSIAN_SET_OP + 1;
+constexpr DecodedOpT kUnsupportedDecodedOp = kNumDecodedProtoOps;
+// Superinstructions, which run a short sequence of consecutive instructions
+// with a single fused kernel (see FuseDecodedInstructions). The "DeadTemp"
+// variants skip writing the intermediate result, which nothing reads.
+constexpr DecodedOpT kAxpyDecodedOp = kUnsupportedDecodedOp + 1;
+constexpr DecodedOpT kAxpyDeadTempDecodedOp = kAxpyDecodedOp + 1;
+constexpr DecodedOpT kMatVecHeavisideDecodedOp = kAxpyDeadTempDecodedOp + 1;
+constexpr DecodedOpT kMatVecHeavisideDeadTempDecodedOp =
+    kMatVecHeavisideDecodedOp + 1;
+constexpr DecodedOpT kMatVecProductDecodedOp =
+    kMatVecHeavisideDeadTempDecodedOp + 1;
+constexpr DecodedOpT kMatVecProductDeadTempDecodedOp =
+    kMatVecProductDecodedOp + 1;
+constexpr DecodedOpT kOuterProductSumDecodedOp =
+    kMatVecProductDeadTempDecodedOp + 1;
+constexpr DecodedOpT kOuterProductSumDeadTempDecodedOp =
+    kOuterProductSumDecodedOp + 1;
+constexpr DecodedOpT kInnerProductDiffProductDecodedOp =
+    kOuterProductSumDeadTempDecodedOp + 1;
+constexpr DecodedOpT kTransposeMatVecDecodedOp =
+    kInnerProductDiffProductDecodedOp + 1;
+constexpr DecodedOpT kTransposeMatVecDeadTempDecodedOp =
+    kTransposeMatVecDecodedOp + 1;
+constexpr DecodedOpT kEndOfStreamDecodedOp =
+    kTransposeMatVecDeadTempDecodedOp + 1;
+constexpr DecodedOpT kNumDecodedOps = kEndOfStreamDecodedOp + 1;
+static_assert(kNumDecodedOps <= kJitProfiledOp,
+              "The decoded op codes must fit in the ExecutorProfile.");
+
+// Returns the name of a decoded op code, or of kJitProfiledOp, for profiles.
+inline std::string DecodedOpName(const IntegerT op) {
+  if (op < kNumDecodedProtoOps) {
+    return Op_Name(static_cast<Op>(op));
+  }
+  switch (op) {
+    case kUnsupportedDecodedOp:
+      return "UNSUPPORTED_OP";
+    case kAxpyDecodedOp:
+      return "AXPY_FUSED_OP";
+    case kAxpyDeadTempDecodedOp:
+      return "AXPY_DEAD_TEMP_FUSED_OP";
+    case kMatVecHeavisideDecodedOp:
+      return "MAT_VEC_HEAVISIDE_FUSED_OP";
+    case kMatVecHeavisideDeadTempDecodedOp:
+      return "MAT_VEC_HEAVISIDE_DEAD_TEMP_FUSED_OP";
+    case kMatVecProductDecodedOp:
+      return "MAT_VEC_PRODUCT_FUSED_OP";
+    case kMatVecProductDeadTempDecodedOp:
+      return "MAT_VEC_PRODUCT_DEAD_TEMP_FUSED_OP";
+    case kOuterProductSumDecodedOp:
+      return "OUTER_PRODUCT_SUM_FUSED_OP";
+    case kOuterProductSumDeadTempDecodedOp:
+      return "OUTER_PRODUCT_SUM_DEAD_TEMP_FUSED_OP";
+    case kInnerProductDiffProductDecodedOp:
+      return "INNER_PRODUCT_DIFF_PRODUCT_FUSED_OP";
+    case kTransposeMatVecDecodedOp:
+      return "TRANSPOSE_MAT_VEC_FUSED_OP";
+    case kTransposeMatVecDeadTempDecodedOp:
+      return "TRANSPOSE_MAT_VEC_DEAD_TEMP_FUSED_OP";
+    case kEndOfStreamDecodedOp:
+      return "END_OF_STREAM";
+    case kJitProfiledOp:
+      return "JIT_COMPONENT_FUNCTION";
+  }
+  return "UNKNOWN_OP";
+}
+
+// A compact copy of an Instruction, holding only what the op kernels read.
+// Two of these fit exactly in a 64-byte cache line, and never straddle one.
+struct alignas(32) DecodedInstruction {
+  // Constructs an end-of-stream marker.
+  DecodedInstruction()
+      : op_(kEndOfStreamDecodedOp), in1_(0), in2_(0), out_(0),
+        activation_data_(0.0),
+        float_data_0_(0.0), float_data_1_(0.0), float_data_2_(0.0) {}
+
+  explicit DecodedInstruction(const Instruction& instruction)
+      : op_(instruction.op_ >= 0 && instruction.op_ < kNumDecodedProtoOps ?
+            static_cast<DecodedOpT>(instruction.op_) :
+            kUnsupportedDecodedOp),
+        in1_(instruction.in1_),
+        in2_(instruction.in2_),
+        out_(instruction.out_),
+        activation_data_(instruction.GetActivationData()),
+        float_data_0_(instruction.GetFloatData0()),
+        float_data_1_(instruction.GetFloatData1()),
+        float_data_2_(instruction.GetFloatData2()) {}
+
+  // Same accessors as the Instruction, so the op kernels accept either.
+  inline double GetActivationData() const {return activation_data_;}
+  inline float GetFloatData0() const {return float_data_0_;}
+  inline float GetFloatData1() const {return float_data_1_;}
+  inline float GetFloatData2() const {return float_data_2_;}
+
+  DecodedOpT op_;
+  AddressT in1_;
+  AddressT in2_;
+  AddressT out_;
+  double activation_data_;
+  float float_data_0_;
+  float float_data_1_;
+  float float_data_2_;
+};
+static_assert(sizeof(DecodedInstruction) == 32,
+              "DecodedInstruction should occupy half a cache line.");
+
+// Returns whether the value that an instruction writes at the given address is
+// overwritten before anything reads it, looking at the instructions of the
+// component function from position `begin` on. Conservatively returns false if
+// the value may survive until the end of the component function, since later
+// component functions or examples may read it.
+inline bool IsOverwrittenBeforeRead(
+    const std::vector<std::shared_ptr<const Instruction>>& component_function,
+    const IntegerT begin, const OperandType type, const AddressT address) {
+  for (IntegerT position = begin; position < component_function.size();
+       ++position) {
+    const Instruction& instruction = *component_function[position];
+    const OpSignature signature = GetOpSignature(instruction.op_);
+    if ((signature.in1 == type && instruction.in1_ == address) ||
+        (signature.in2 == type && instruction.in2_ == address)) {
+      return false;
+    }
+    if (signature.out == type && instruction.out_ == address) {
+      return !signature.partial_out;
+    }
+  }
+  return false;
+}
+
+// Replaces the op codes of the instruction sequences that have a fused kernel
+// with the corresponding superinstruction. The superinstruction takes the
+// place of the first instruction of the sequence. The rest stay in the stream
+// for the fused kernel to read, and dispatch skips over them. The intermediate
+// results are written unless nothing reads them before they are overwritten.
+inline void FuseDecodedInstructions(
+    const std::vector<std::shared_ptr<const Instruction>>& component_function,
+    std::vector<DecodedInstruction>* instructions) {
+  const IntegerT size = component_function.size();
+  IntegerT position = 0;
+  while (position + 1 < size) {
+    const Instruction& first = *component_function[position];
+    const Instruction& second = *component_function[position + 1];
+    const bool second_reads_first =
+        second.in1_ == first.out_ || second.in2_ == first.out_;
+    // Whether the intermediate vector or matrix is dead.
+    auto temp_is_dead = [&](const OperandType type) {
+      return second.out_ == first.out_ ||
+          IsOverwrittenBeforeRead(
+              component_function, position + 2, type, first.out_);
+    };
+    DecodedInstruction& fused = (*instructions)[position];
+    if (first.op_ == VECTOR_INNER_PRODUCT_OP &&
+        second.op_ == SCALAR_DIFF_OP && second_reads_first &&
+        position + 2 < size &&
+        component_function[position + 2]->op_ == SCALAR_PRODUCT_OP &&
+        (component_function[position + 2]->in1_ == second.out_ ||
+         component_function[position + 2]->in2_ == second.out_)) {
+      fused.op_ = kInnerProductDiffProductDecodedOp;
+      position += 3;
+    } else if (first.op_ == SCALAR_VECTOR_PRODUCT_OP &&
+               second.op_ == VECTOR_SUM_OP && second_reads_first) {
+      fused.op_ = temp_is_dead(kVectorOperand) ?
+          kAxpyDeadTempDecodedOp : kAxpyDecodedOp;
+      position += 2;
+    } else if (first.op_ == MATRIX_VECTOR_PRODUCT_OP &&
+               second.op_ == VECTOR_HEAVYSIDE_OP &&
+               second.in1_ == first.out_) {
+      fused.op_ = temp_is_dead(kVectorOperand) ?
+          kMatVecHeavisideDeadTempDecodedOp : kMatVecHeavisideDecodedOp;
+      position += 2;
+    } else if (first.op_ == MATRIX_VECTOR_PRODUCT_OP &&
+               second.op_ == VECTOR_PRODUCT_OP && second_reads_first) {
+      fused.op_ = temp_is_dead(kVectorOperand) ?
+          kMatVecProductDeadTempDecodedOp : kMatVecProductDecodedOp;
+      position += 2;
+    } else if (first.op_ == VECTOR_OUTER_PRODUCT_OP &&
+               second.op_ == MATRIX_SUM_OP && second_reads_first) {
+      fused.op_ = temp_is_dead(kMatrixOperand) ?
+          kOuterProductSumDeadTempDecodedOp : kOuterProductSumDecodedOp;
+      position += 2;
+    } else if (first.op_ == MATRIX_TRANSPOSE_OP &&
+               second.op_ == MATRIX_VECTOR_PRODUCT_OP &&
+               second.in1_ == first.out_) {
+      // The output is a vector, so it cannot overwrite the temp.
+      fused.op_ = IsOverwrittenBeforeRead(
+          component_function, position + 2, kMatrixOperand, first.out_) ?
+          kTransposeMatVecDeadTempDecodedOp : kTransposeMatVecDecodedOp;
+      position += 2;
+    } else {
+      ++position;
+    }
+  }
+}
+
+// A component function decoded into a contiguous instruction stream, which is
+// terminated by an end-of-stream marker. Decoding happens once per Executor, so
+// that the per-example loops do not chase the shared_ptrs in the Algorithm.
+class DecodedComponentFunction {
+ public:
+  // If `fuse` is true, frequent instruction sequences are replaced with
+  // superinstructions, which only ExecuteDecoded can run.
+  explicit DecodedComponentFunction(
+      const std::vector<std::shared_ptr<const Instruction>>&
+          component_function,
+      const bool fuse = false) {
+    instructions_.reserve(component_function.size() + 1);
+    for (const std::shared_ptr<const Instruction>& instruction :
+         component_function) {
+      instructions_.emplace_back(*instruction);
+    }
+    if (fuse) FuseDecodedInstructions(component_function, &instructions_);
+    instructions_.emplace_back();  // End-of-stream marker.
+  }
+
+  DecodedComponentFunction(const DecodedComponentFunction& other) = delete;
+  DecodedComponentFunction& operator=(
+      const DecodedComponentFunction& other) = delete;
+
+  // The number of instructions, excluding the end-of-stream marker.
+  IntegerT size() const {return instructions_.size() - 1;}
+
+  // The first instruction in the stream.
+  const DecodedInstruction* begin() const {return instructions_.data();}
+
+ private:
+  std::vector<DecodedInstruction> instructions_;
+};
+
+// The state of an Executor at the end of the training of its first epoch, saved
+// by Execute before validating. Another Executor of the same Algorithm on the
+// same dataset can continue from it, without running the setup and the
+// examples already trained on again.
+template <FeatureIndexT F>
+struct ExecutorState {
+  // Whether the state was saved. It is not if training stopped early.
+  bool saved = false;
+  // The number of training examples of the first epoch trained on.
+  IntegerT num_train_examples = 0;
+  Memory<F> memory;
+  RandomGenerator::State rand_gen;
+};
+
+// Lets validation stop before the last example once the fitness cannot exceed
+// a threshold, as when it only matters whether the fitness beats the
+// threshold. The fitness is then replaced by an estimate of it, extrapolated
+// from the examples validated so far, and known to be no larger than an upper
+// bound which is itself no larger than the threshold.
+struct ValidationBound {
+  // The threshold. kMinFitness never stops validation.
+  double fitness_threshold = kMinFitness;
+
+  // If positive, validation also stops once exceeding the threshold would take
+  // the losses of the remaining examples to be this many standard deviations
+  // below those of the examples validated so far (for the statistical mode).
+  // The bound is then only likely, not certain. With 0, validation only stops
+  // once exceeding the threshold is impossible.
+  double num_stdevs = 0.0;
+};
+
+// The predict and learn component functions of an Algorithm compiled by the
+// JIT. The code only depends on the features size, so the Executors of all the
+// tasks of that size can share it instead of each compiling its own. Either
+// can be null (see JitComponentFunction::Compile).
+struct JitAlgorithm {
+  std::unique_ptr<JitComponentFunction> predict;
+  std::unique_ptr<JitComponentFunction> learn;
+};
+
+template <FeatureIndexT F>
+std::unique_ptr<JitAlgorithm> CompileJitAlgorithm(const Algorithm& algorithm);
+
 template <FeatureIndexT F>
 class Executor {
  public:
@@ -56,20 +340,87 @@ class Executor {
            // be triggered if the loss for an example is infinite, nan, or too
            // large. If early stopping is triggered, the fitness for the
            // execution will be set to the minimum value.
-           double max_abs_error);
+           double max_abs_error,
+           // Whether to compile the predict and learn component functions to
+           // native code. Component functions the JIT cannot handle (e.g.
+           // because they use random ops) fall back to the interpreter.
+           bool use_jit = false,
+           // Whether to wipe only the memory addresses the Algorithm uses (see
+           // GetAddressUsage), leaving the rest undefined. Cheapest for
+           // Algorithms with compacted addresses (see CompactAddresses).
+           bool wipe_used_memory_only = false,
+           // Whether to skip running predict and learn when the predictions
+           // do not depend on the examples (see GetPredictionDependence). The
+           // fitness and the errors are then computed from the labels and the
+           // prediction alone, and are the same. The rest of the memory is not
+           // updated.
+           bool short_circuit_constant_predictions = false,
+           // If not nullptr, continues from this saved state instead of
+           // running the setup: the memory and the random generator are
+           // restored, and training starts after the examples trained on. The
+           // first epoch must have at least as many examples. Execute then
+           // returns the same fitness as the Executor that saved the state
+           // would have returned with the same arguments.
+           const ExecutorState<F>* initial_state = nullptr,
+           // Whether to stop training as soon as the memory holds a NaN that
+           // is certain to reach a prediction later in the same epoch (see
+           // GetFatalNanAddresses), instead of when it does. The fitness is
+           // the same. The training errors of the examples skipped are not
+           // recorded.
+           bool stop_on_fatal_nans = false,
+           // Whether the sigmoid of the training predictions of mini-batches
+           // uses the approximation in fast_math.h, applied coefficient-wise,
+           // instead of libm. It is within a few ULPs of libm, so the fitness
+           // can differ in the last digits. Nothing else is affected: the ops
+           // always use libm.
+           bool use_fast_math = false,
+           // When validation may stop early. Not applied when recording the
+           // validation errors.
+           const ValidationBound& validation_bound = ValidationBound(),
+           // If not nullptr and using the JIT, runs this code, compiled from
+           // the Algorithm by CompileJitAlgorithm<F>, instead of compiling it
+           // again. Must out-live the Executor.
+           const JitAlgorithm* jit_algorithm = nullptr);
   Executor(const Executor& other) = delete;
   Executor& operator=(const Executor& other) = delete;
 
   // Most code should use only the Execute method. Other methods below provide
   // lower-level access and can be used by tests and dataset generators. Returns
   // the fitness, according to the EvalType enum for the relevant dataset.
+  // When continuing from a saved state, the training errors of the examples
+  // trained on before are not recorded.
   double Execute(
       std::vector<double>* train_errors = nullptr,
-      std::vector<double>* valid_errors = nullptr);
+      std::vector<double>* valid_errors = nullptr,
+      // If not nullptr, saves the state at the end of the training of the
+      // first epoch into *state, before validating.
+      ExecutorState<F>* state = nullptr);
 
   // Get the number of train steps this executor has performed.
   IntegerT GetNumTrainStepsCompleted() const;
 
+  // Whether Execute skipped the learn component function, because it could
+  // not affect the predictions.
+  bool SkippedLearn() const;
+
+  // The number of training steps not run because training stopped at a fatal
+  // NaN (see stop_on_fatal_nans). Training would have stopped after these at
+  // the latest.
+  IntegerT GetNumTrainStepsSaved() const;
+
+  // Whether the fitness Execute returned is an estimate, because validation
+  // stopped early (see ValidationBound). With the statistical bound, a fitness
+  // above the threshold is only likely to be exact.
+  bool FitnessIsEstimate() const;
+
+  // An upper bound on the fitness Execute estimated, no larger than the
+  // threshold (only likely so with the statistical bound). The fitness itself
+  // if it is not an estimate.
+  double GetFitnessUpperBound() const;
+
+  // The number of validation steps not run because validation stopped early.
+  IntegerT GetNumValidStepsSaved() const;
+
   // Use only from unit tests.
   inline Memory<F>& MemoryRef() {return memory_;}
 
@@ -79,8 +430,9 @@ class Executor {
   FRIEND_TEST(ExecutorTest, ItereatesThroughFeatures);
   FRIEND_TEST(ExecutorTest, ItereatesThroughLabelsDuringTraining);
   FRIEND_TEST(ExecutorTest, ValidationDoesNotSeeLabels);
-  FRIEND_TEST(ExecutorTest, TrainOptimizationsAreCorrect);
+  FRIEND_TEST(ExecutorTest, DecodedTrainingMatchesInstructionByInstruction);
   FRIEND_TEST(ExecutorTest, MultiEpochTrainingWorksCorrectly);
+  FRIEND_TEST(ExecutorTest, SkippingLearnMatchesRunningLearn);
 
   // Performs training until the end. Returns whether successful. If not, it
   // means training stopped early.
@@ -96,36 +448,125 @@ class Executor {
              // updated after each training step.
              TaskIterator<F>* train_it);
 
-  // Implementations of the train component function, with different
-  // optimizations.
-  bool TrainNoOptImpl(IntegerT max_steps, std::vector<double>* errors,
-                      // See `Train` for more details about the following args.
-                      TaskIterator<F>* train_it);
-
-  template <size_t max_component_function_size>
-  bool TrainOptImpl(IntegerT max_steps, std::vector<double>* errors,
-                    // See `Train` for more details about the following args.
+  // Same as Train, but for a task with a batch size larger than 1. Each step
+  // trains on one example, as part of a mini-batch.
+  bool TrainBatches(IntegerT max_steps, std::vector<double>* errors,
                     TaskIterator<F>* train_it);
 
-  // Performs validation and returns the loss.
-  double Validate(std::vector<double>* errors);
+  // Performs validation and returns the fitness. If validation stops early
+  // because the fitness cannot exceed fitness_threshold (see ValidationBound),
+  // returns an estimate of it instead, extrapolated from the examples
+  // validated so far. If not null, sets *fitness_bound to an upper bound on
+  // the fitness, no larger than fitness_threshold in that case.
+  double Validate(std::vector<double>* errors,
+                  double fitness_threshold = kMinFitness,
+                  double* fitness_bound = nullptr);
+
+  // Converts the sum of the validation losses into the fitness.
+  inline double LossToFitness(double loss) const;
+
+  // The smallest sum of the validation losses for which the fitness cannot
+  // exceed the threshold, or infinity if there is none.
+  double StopLoss(double fitness_threshold) const;
+
+  // Whether validation can stop after num_done of its num_steps examples,
+  // whose losses have the given sum and sum of squares, because the fitness
+  // cannot exceed the threshold. If so, sets *fitness_bound.
+  inline bool CannotExceed(double fitness_threshold, double stop_loss,
+                           double loss, double loss_squares,
+                           IntegerT num_done, IntegerT num_steps,
+                           double* fitness_bound) const;
+
+  // Accumulates the loss of the prediction for one validation example. Returns
+  // false if the error is too large, which stops validation early. Otherwise
+  // records the error in *errors, if not nullptr.
+  inline bool AccumulateLoss(Scalar prediction, const Scalar& label,
+                             double* loss, std::vector<double>* errors);
 
   // Copies memory_ into *memory. Useful for tests.
   void GetMemory(Memory<F>* memory);
 
+  // Run one step of the predict or learn component function, including the
+  // assignment of the features and the label. Use the JIT-compiled code if
+  // available.
+  inline void RunPredict(const Vector<F>& features);
+  inline void RunLearn(const Vector<F>& features, const Scalar& label);
+
+  // Runs the predict component function even if it is short-circuited.
+  inline void RunPredictComponentFunction(const Vector<F>& features);
+
+  // Returns the fewest further training examples, up to max_examples, after
+  // which a NaN the memory now holds makes a prediction NaN, or 0 if there is
+  // no such NaN.
+  inline IntegerT FindFatalNan(IntegerT max_examples) const;
+
+  // Same as RunPredict and RunLearn, but for a mini-batch of examples. See
+  // "Mini-batch addresses" in definitions.h.
+  inline void RunBatchPredict(
+      const std::vector<const Vector<F>*>& batch_features);
+  inline void RunBatchLearn(
+      const std::vector<const Vector<F>*>& batch_features,
+      const Vector<F>& batch_labels);
+  inline void AssignBatchFeatures(
+      const std::vector<const Vector<F>*>& batch_features);
+
   // The Algorithm being trained.
   const Algorithm& algorithm_;
 
+  // The predict and learn component functions of algorithm_, decoded once
+  // (with superinstructions) so they can be run repeatedly for every example.
+  const DecodedComponentFunction predict_;
+  const DecodedComponentFunction learn_;
+
+  // Native versions of predict_ and learn_. Null if not using the JIT or if the
+  // JIT could not compile the component function. Owned by jit_owned_ if the
+  // Executor compiled them.
+  std::unique_ptr<JitAlgorithm> jit_owned_;
+  const JitComponentFunction* jit_predict_;
+  const JitComponentFunction* jit_learn_;
+
   // The dataset used for training.
   const Task<F>& dataset_;
 
+  // The number of examples predict and learn see at a time.
+  const IntegerT batch_size_;
+
+  // The addresses of memory_ that are wiped, saved and restored: those the
+  // Algorithm uses if wiping only those, or else all of them.
+  const AddressUsage used_addresses_;
+
   const IntegerT num_all_train_examples_;
   const IntegerT num_valid_examples_;
   RandomGenerator* rand_gen_;
-  Memory<F> memory_;
+  // On the heap, as it is too large for the stack with large features sizes.
+  const std::unique_ptr<Memory<F>> memory_owned_;
+  Memory<F>& memory_;
 
   const double max_abs_error_;
   IntegerT num_train_steps_completed_;
+
+  // The number of training examples of the first epoch the initial state had
+  // already trained on.
+  const IntegerT num_resumed_train_examples_;
+
+  // Whether to train without running learn. Set by Execute.
+  bool skip_learn_;
+
+  // kVariablePredictions unless predict and learn are short-circuited.
+  const PredictionDependence prediction_dependence_;
+  // The prediction, if kConstantPredictions.
+  Scalar constant_prediction_;
+
+  // Where to check for NaNs after each learn, if stopping on fatal NaNs.
+  const std::vector<FatalNanAddress> fatal_nan_addresses_;
+  IntegerT num_train_steps_saved_;
+
+  const bool use_fast_math_;
+
+  const ValidationBound validation_bound_;
+  bool fitness_is_estimate_;
+  double fitness_upper_bound_;
+  IntegerT num_valid_steps_saved_;
 };
 
 // Fills the training and validation labels, using the given Algorithm and
@@ -162,86 +603,86 @@ inline FeatureIndexT Argmax(const Vector<F>& input);
 // Scalar arithmetic-related instructions.
 ////////////////////////////////////////////////////////////////////////////////
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarSumOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->scalar_[instruction.in1_] + memory->scalar_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarDiffOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->scalar_[instruction.in1_] - memory->scalar_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->scalar_[instruction.in1_] * memory->scalar_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarDivisionOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->scalar_[instruction.in1_] /
       memory->scalar_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarMinOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::min(
       memory->scalar_[instruction.in1_],
       memory->scalar_[instruction.in2_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarMaxOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::max(
       memory->scalar_[instruction.in1_],
       memory->scalar_[instruction.in2_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarAbsOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::abs(
       memory->scalar_[instruction.in1_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarHeavisideOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->scalar_[instruction.in1_] >= 0.0 ? 1.0 : 0.0;
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarConstSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = instruction.GetActivationData();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarReciprocalOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
-      static_cast<double>(1.0) / memory->scalar_[instruction.in1_];
+      static_cast<Scalar>(1.0) / memory->scalar_[instruction.in1_];
 }
 
 
@@ -249,49 +690,49 @@ inline void ExecuteScalarReciprocalOp(
 // Trigonometry-related instructions.
 ////////////////////////////////////////////////////////////////////////////////
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarSinOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::sin(
       memory->scalar_[instruction.in1_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarCosOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::cos(
       memory->scalar_[instruction.in1_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarTanOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::tan(
       memory->scalar_[instruction.in1_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarArcSinOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::asin(
       memory->scalar_[instruction.in1_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarArcCosOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::acos(
       memory->scalar_[instruction.in1_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarArcTanOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::atan(
       memory->scalar_[instruction.in1_]);
@@ -302,17 +743,17 @@ inline void ExecuteScalarArcTanOp(
 // Calculus-related instructions.
 ////////////////////////////////////////////////////////////////////////////////
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarExpOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::exp(
       memory->scalar_[instruction.in1_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarLogOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] = std::log(
       memory->scalar_[instruction.in1_]);
@@ -323,73 +764,73 @@ inline void ExecuteScalarLogOp(
 // Vector arithmetic-related instructions.
 ////////////////////////////////////////////////////////////////////////////////
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorSumOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       memory->vector_[instruction.in1_] + memory->vector_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorDiffOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       memory->vector_[instruction.in1_] - memory->vector_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       (memory->vector_[instruction.in1_].array() *
        memory->vector_[instruction.in2_].array()).matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorDvisionOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       (memory->vector_[instruction.in1_].array() /
        memory->vector_[instruction.in2_].array()).matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorMinOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       (memory->vector_[instruction.in1_].array().min(
           memory->vector_[instruction.in2_].array())).matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorMaxOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       (memory->vector_[instruction.in1_].array().max(
           memory->vector_[instruction.in2_].array())).matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorAbsOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       memory->vector_[instruction.in1_].array().abs().matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorHeavisideOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  const double* in = memory->vector_[instruction.in1_].data();
-  const double* in_end = in + F;
-  double* out = memory->vector_[instruction.out_].data();
+  const Scalar* in = memory->vector_[instruction.in1_].data();
+  const Scalar* in_end = in + F;
+  Scalar* out = memory->vector_[instruction.out_].data();
   while (in != in_end) {
     *out = *in > 0.0 ? 1.0 : 0.0;
     ++out;
@@ -397,21 +838,21 @@ inline void ExecuteVectorHeavisideOp(
   }
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorConstSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   const FeatureIndexT index =
       FloatToIndex(instruction.GetFloatData0(), F);
   memory->vector_[instruction.out_](index) = instruction.GetFloatData1();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorReciprocalOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
-      (static_cast<double>(1.0) /
+      (static_cast<Scalar>(1.0) /
        memory->vector_[instruction.in1_].array())
           .matrix();
 }
@@ -421,51 +862,51 @@ inline void ExecuteVectorReciprocalOp(
 // Matrix arithmetic-related instructions.
 ////////////////////////////////////////////////////////////////////////////////
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixSumOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       memory->matrix_[instruction.in1_] + memory->matrix_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixDiffOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       memory->matrix_[instruction.in1_] - memory->matrix_[instruction.in2_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       (memory->matrix_[instruction.in1_].array() *
        memory->matrix_[instruction.in2_].array()).matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixDivisionOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       (memory->matrix_[instruction.in1_].array() /
        memory->matrix_[instruction.in2_].array()).matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixMinOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  const double* in1 = memory->matrix_[instruction.in1_].data();
-  const double* in2 = memory->matrix_[instruction.in2_].data();
-  const double* in1_end = in1 + F * F;
-  double* out = memory->matrix_[instruction.out_].data();
+  const Scalar* in1 = memory->matrix_[instruction.in1_].data();
+  const Scalar* in2 = memory->matrix_[instruction.in2_].data();
+  const Scalar* in1_end = in1 + F * F;
+  Scalar* out = memory->matrix_[instruction.out_].data();
   while (in1 != in1_end) {
-    const double in1v = *in1;
-    const double in2v = *in2;
+    const Scalar in1v = *in1;
+    const Scalar in2v = *in2;
     *out = in1v < in2v ? in1v : in2v;
     ++out;
     ++in1;
@@ -473,17 +914,17 @@ inline void ExecuteMatrixMinOp(
   }
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixMaxOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  const double* in1 = memory->matrix_[instruction.in1_].data();
-  const double* in2 = memory->matrix_[instruction.in2_].data();
-  const double* in1_end = in1 + F * F;
-  double* out = memory->matrix_[instruction.out_].data();
+  const Scalar* in1 = memory->matrix_[instruction.in1_].data();
+  const Scalar* in2 = memory->matrix_[instruction.in2_].data();
+  const Scalar* in1_end = in1 + F * F;
+  Scalar* out = memory->matrix_[instruction.out_].data();
   while (in1 != in1_end) {
-    const double in1v = *in1;
-    const double in2v = *in2;
+    const Scalar in1v = *in1;
+    const Scalar in2v = *in2;
     *out = in1v > in2v ? in1v : in2v;
     ++out;
     ++in1;
@@ -491,21 +932,21 @@ inline void ExecuteMatrixMaxOp(
   }
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixAbsOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       memory->matrix_[instruction.in1_].array().abs().matrix();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixHeavisideOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  const double* in = memory->matrix_[instruction.in1_].data();
-  const double* in_end = in + F * F;
-  double* out = memory->matrix_[instruction.out_].data();
+  const Scalar* in = memory->matrix_[instruction.in1_].data();
+  const Scalar* in_end = in + F * F;
+  Scalar* out = memory->matrix_[instruction.out_].data();
   while (in != in_end) {
     *out = *in > 0.0 ? 1.0 : 0.0;
     ++out;
@@ -513,9 +954,9 @@ inline void ExecuteMatrixHeavisideOp(
   }
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixConstSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_](
       FloatToIndex(instruction.GetFloatData0(), F),
@@ -523,12 +964,12 @@ inline void ExecuteMatrixConstSetOp(
           instruction.GetFloatData2();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixReciprocalOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
-      (static_cast<double>(1.0) /
+      (static_cast<Scalar>(1.0) /
        memory->matrix_[instruction.in1_].array())
           .matrix();
 }
@@ -538,83 +979,212 @@ inline void ExecuteMatrixReciprocalOp(
 // Linear algebra-related instructions.
 ////////////////////////////////////////////////////////////////////////////
 
+// The kernels of the small fixed-size matrix ops. Uses the hand-vectorized
+// kernels in simd_kernels.h for the features sizes they are specialized for,
+// if UseSimdKernels(), and Eigen otherwise.
+template<FeatureIndexT F, bool kSimd = HasSimdKernels(F)>
+struct MatrixKernels {
+  inline static void MatrixMatrixProduct(
+      const Matrix<F>& in1, const Matrix<F>& in2, Matrix<F>* out) {
+    *out = in1 * in2;
+  }
+  inline static void VectorOuterProduct(
+      const Vector<F>& in1, const Vector<F>& in2, Matrix<F>* out) {
+    *out = in1 * in2.transpose();
+  }
+  inline static void MatrixVectorProduct(
+      const Matrix<F>& in1, const Vector<F>& in2, Vector<F>* out) {
+    *out = in1 * in2;
+  }
+  // out = in1^T * in2, identical to MatrixVectorProduct on the transpose.
+  inline static void MatrixTransposeVectorProduct(
+      const Matrix<F>& in1, const Vector<F>& in2, Vector<F>* out) {
+    const Matrix<F> transposed = in1.transpose();
+    *out = transposed * in2;
+  }
+  inline static void MatrixRowNorm(const Matrix<F>& in, Vector<F>* out) {
+    *out = in.rowwise().norm();
+  }
+  inline static void MatrixColumnNorm(const Matrix<F>& in, Vector<F>* out) {
+    *out = in.colwise().norm();
+  }
+  inline static void MatrixRowMean(const Matrix<F>& in, Vector<F>* out) {
+    *out = in.rowwise().mean();
+  }
+  inline static void MatrixRowStDev(const Matrix<F>& in, Vector<F>* out) {
+    for (IntegerT row = 0; row < F; ++row) {
+      const Vector<F>& values = in.row(row);
+      const Scalar mean = values.mean();
+      const Scalar stdev =
+          sqrt((values.array() * values.array()).sum() /
+               static_cast<Scalar>(F) -
+               mean * mean);
+      (*out)(row) = stdev;
+    }
+  }
+};
+
 template<FeatureIndexT F>
+struct MatrixKernels<F, true> {
+  typedef MatrixKernels<F, false> EigenKernels;
+  inline static const SimdKernels<Scalar, F>& Kernels() {
+    return SimdKernels<Scalar, F>::kActive;
+  }
+  // The SIMD kernels need outputs that do not alias the inputs.
+  inline static void MatrixMatrixProduct(
+      const Matrix<F>& in1, const Matrix<F>& in2, Matrix<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::MatrixMatrixProduct(in1, in2, out);
+    } else if (out == &in1 || out == &in2) {
+      Matrix<F> result;
+      Kernels().matrix_matrix_product(in1.data(), in2.data(), result.data());
+      *out = result;
+    } else {
+      Kernels().matrix_matrix_product(in1.data(), in2.data(), out->data());
+    }
+  }
+  inline static void VectorOuterProduct(
+      const Vector<F>& in1, const Vector<F>& in2, Matrix<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::VectorOuterProduct(in1, in2, out);
+    } else {
+      Kernels().vector_outer_product(in1.data(), in2.data(), out->data());
+    }
+  }
+  inline static void MatrixVectorProduct(
+      const Matrix<F>& in1, const Vector<F>& in2, Vector<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::MatrixVectorProduct(in1, in2, out);
+    } else if (out == &in2) {
+      Vector<F> result;
+      Kernels().matrix_vector_product(in1.data(), in2.data(), result.data());
+      *out = result;
+    } else {
+      Kernels().matrix_vector_product(in1.data(), in2.data(), out->data());
+    }
+  }
+  inline static void MatrixTransposeVectorProduct(
+      const Matrix<F>& in1, const Vector<F>& in2, Vector<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::MatrixTransposeVectorProduct(in1, in2, out);
+    } else if (out == &in2) {
+      Vector<F> result;
+      Kernels().matrix_transpose_vector_product(
+          in1.data(), in2.data(), result.data());
+      *out = result;
+    } else {
+      Kernels().matrix_transpose_vector_product(
+          in1.data(), in2.data(), out->data());
+    }
+  }
+  inline static void MatrixRowNorm(const Matrix<F>& in, Vector<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::MatrixRowNorm(in, out);
+    } else {
+      Kernels().matrix_row_norm(in.data(), out->data());
+    }
+  }
+  inline static void MatrixColumnNorm(const Matrix<F>& in, Vector<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::MatrixColumnNorm(in, out);
+    } else {
+      Kernels().matrix_column_norm(in.data(), out->data());
+    }
+  }
+  inline static void MatrixRowMean(const Matrix<F>& in, Vector<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::MatrixRowMean(in, out);
+    } else {
+      Kernels().matrix_row_mean(in.data(), out->data());
+    }
+  }
+  inline static void MatrixRowStDev(const Matrix<F>& in, Vector<F>* out) {
+    if (!UseSimdKernels()) {
+      EigenKernels::MatrixRowStDev(in, out);
+    } else {
+      Kernels().matrix_row_st_dev(in.data(), out->data());
+    }
+  }
+};
+
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarVectorProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       memory->vector_[instruction.in2_] * memory->scalar_[instruction.in1_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorInnerProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->vector_[instruction.in1_].dot(
           memory->vector_[instruction.in2_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorOuterProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  memory->matrix_[instruction.out_] =
-      memory->vector_[instruction.in1_] *
-          memory->vector_[instruction.in2_].transpose();
+  MatrixKernels<F>::VectorOuterProduct(
+      memory->vector_[instruction.in1_], memory->vector_[instruction.in2_],
+      &memory->matrix_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarMatrixProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       memory->matrix_[instruction.in2_] * memory->scalar_[instruction.in1_];
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixVectorProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  memory->vector_[instruction.out_] =
-      memory->matrix_[instruction.in1_] * memory->vector_[instruction.in2_];
+  MatrixKernels<F>::MatrixVectorProduct(
+      memory->matrix_[instruction.in1_], memory->vector_[instruction.in2_],
+      &memory->vector_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorNormOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->vector_[instruction.in1_].norm();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixNormOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->matrix_[instruction.in1_].norm();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixRowNormOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  memory->vector_[instruction.out_] =
-      memory->matrix_[instruction.in1_].rowwise().norm();
+  MatrixKernels<F>::MatrixRowNorm(
+      memory->matrix_[instruction.in1_], &memory->vector_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixColumnNormOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  memory->vector_[instruction.out_] =
-      memory->matrix_[instruction.in1_].colwise().norm();
+  MatrixKernels<F>::MatrixColumnNorm(
+      memory->matrix_[instruction.in1_], &memory->vector_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixTransposeOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   if (instruction.out_ == instruction.in1_) {
     memory->matrix_[instruction.in1_].transposeInPlace();
@@ -624,33 +1194,34 @@ inline void ExecuteMatrixTransposeOp(
   }
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixMatrixProductOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  memory->matrix_[instruction.out_] =
-      memory->matrix_[instruction.in1_] * memory->matrix_[instruction.in2_];
+  MatrixKernels<F>::MatrixMatrixProduct(
+      memory->matrix_[instruction.in1_], memory->matrix_[instruction.in2_],
+      &memory->matrix_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarBroadcastOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->vector_[instruction.out_] =
       memory->scalar_[instruction.in1_] * Vector<F>::Ones(F);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorColumnBroadcastOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       memory->vector_[instruction.in1_].replicate(1, F);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorRowBroadcastOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->matrix_[instruction.out_] =
       memory->vector_[instruction.in1_].replicate(1, F).transpose();
@@ -661,117 +1232,109 @@ inline void ExecuteVectorRowBroadcastOp(
 // Probability-related instructions.
 ////////////////////////////////////////////////////////////////////////////////
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorMeanOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->vector_[instruction.in1_].mean();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorStDevOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   const Vector<F>& values = memory->vector_[instruction.in1_];
-  const double mean = values.mean();
+  const Scalar mean = values.mean();
   memory->scalar_[instruction.out_] =
-      sqrt(values.dot(values) / static_cast<double>(F) -
+      sqrt(values.dot(values) / static_cast<Scalar>(F) -
            mean * mean);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixMeanOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       memory->matrix_[instruction.in1_].mean();
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixStDevOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   const Matrix<F>& values = memory->matrix_[instruction.in1_];
-  const double mean = values.mean();
+  const Scalar mean = values.mean();
   memory->scalar_[instruction.out_] =
       sqrt((values.array() * values.array()).sum() /
-           static_cast<double>(F * F) -
+           static_cast<Scalar>(F * F) -
            mean * mean);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixRowMeanOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  memory->vector_[instruction.out_] =
-      memory->matrix_[instruction.in1_].rowwise().mean();
+  MatrixKernels<F>::MatrixRowMean(
+      memory->matrix_[instruction.in1_], &memory->vector_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixRowStDevOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  for (IntegerT row = 0; row < F; ++row) {
-    const Vector<F>& values =
-        memory->matrix_[instruction.in1_].row(row);
-    const double mean = values.mean();
-    const double stdev =
-        sqrt((values.array() * values.array()).sum() /
-             static_cast<double>(F) -
-             mean * mean);
-    memory->vector_[instruction.out_](row) = stdev;
-  }
+  MatrixKernels<F>::MatrixRowStDev(
+      memory->matrix_[instruction.in1_], &memory->vector_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarGaussianSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       rand_gen->GaussianActivation(
           instruction.GetFloatData0(), instruction.GetFloatData1());
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorGaussianSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   rand_gen->FillGaussian<F>(
       instruction.GetFloatData0(), instruction.GetFloatData1(),
       &memory->vector_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixGaussianSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   rand_gen->FillGaussian<F>(
       instruction.GetFloatData0(), instruction.GetFloatData1(),
       &memory->matrix_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteScalarUniformSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   memory->scalar_[instruction.out_] =
       rand_gen->UniformActivation(
           instruction.GetFloatData0(), instruction.GetFloatData1());
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteVectorUniformSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   rand_gen->FillUniform<F>(
       instruction.GetFloatData0(), instruction.GetFloatData1(),
       &memory->vector_[instruction.out_]);
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteMatrixUniformSetOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   rand_gen->FillUniform<F>(
       instruction.GetFloatData0(), instruction.GetFloatData1(),
@@ -783,160 +1346,441 @@ inline void ExecuteMatrixUniformSetOp(
 // Other instructions.
 ////////////////////////////////////////////////////////////////////////////////
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteNoOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
 }
 
-template<FeatureIndexT F>
+template<FeatureIndexT F, typename InstructionT>
 inline void ExecuteUnsupportedOp(
-    const Instruction& instruction, RandomGenerator* rand_gen,
+    const InstructionT& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
   LOG(FATAL) << "Unsupported op." << std::endl;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Fused op kernels.
+////////////////////////////////////////////////////////////////////////////////
+
+// Each kernel runs a superinstruction, reading the instructions it replaces
+// from the stream, starting at `instruction`. The arithmetic is the same as
+// that of the separate kernels, element by element, so the results are
+// identical as long as the compiler does not contract multiplies and adds.
+// The intermediate result is written only if kWriteTemp.
+
+// SCALAR_VECTOR_PRODUCT_OP followed by a VECTOR_SUM_OP of its result.
+template<FeatureIndexT F, bool kWriteTemp>
+inline void ExecuteAxpy(
+    const DecodedInstruction* instruction, Memory<F>* memory) {
+  const DecodedInstruction& product = instruction[0];
+  const DecodedInstruction& sum = instruction[1];
+  const Scalar scale = memory->scalar_[product.in1_];
+  const Scalar* in = memory->vector_[product.in2_].data();
+  Scalar* temp = memory->vector_[product.out_].data();
+  const AddressT other =
+      sum.in1_ == product.out_ ? sum.in2_ : sum.in1_;
+  const bool other_is_temp = other == product.out_;
+  const Scalar* other_in = memory->vector_[other].data();
+  Scalar* out = memory->vector_[sum.out_].data();
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    const Scalar scaled = in[i] * scale;
+    const Scalar addend = other_is_temp ? scaled : other_in[i];
+    if (kWriteTemp) temp[i] = scaled;
+    out[i] = scaled + addend;
+  }
+}
+
+// MATRIX_VECTOR_PRODUCT_OP followed by a VECTOR_HEAVYSIDE_OP of its result.
+template<FeatureIndexT F, bool kWriteTemp>
+inline void ExecuteMatVecHeaviside(
+    const DecodedInstruction* instruction, Memory<F>* memory) {
+  const DecodedInstruction& product = instruction[0];
+  const DecodedInstruction& heaviside = instruction[1];
+  Vector<F> result;
+  MatrixKernels<F>::MatrixVectorProduct(
+      memory->matrix_[product.in1_], memory->vector_[product.in2_], &result);
+  if (kWriteTemp) memory->vector_[product.out_] = result;
+  Scalar* out = memory->vector_[heaviside.out_].data();
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    out[i] = result(i) > 0.0 ? 1.0 : 0.0;
+  }
+}
+
+// MATRIX_VECTOR_PRODUCT_OP followed by a VECTOR_PRODUCT_OP of its result.
+template<FeatureIndexT F, bool kWriteTemp>
+inline void ExecuteMatVecProduct(
+    const DecodedInstruction* instruction, Memory<F>* memory) {
+  const DecodedInstruction& product = instruction[0];
+  const DecodedInstruction& elementwise = instruction[1];
+  Vector<F> result;
+  MatrixKernels<F>::MatrixVectorProduct(
+      memory->matrix_[product.in1_], memory->vector_[product.in2_], &result);
+  if (kWriteTemp) memory->vector_[product.out_] = result;
+  const AddressT other = elementwise.in1_ == product.out_ ?
+      elementwise.in2_ : elementwise.in1_;
+  const bool other_is_temp = other == product.out_;
+  const Scalar* other_in = memory->vector_[other].data();
+  Scalar* out = memory->vector_[elementwise.out_].data();
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    out[i] = result(i) * (other_is_temp ? result(i) : other_in[i]);
+  }
+}
 
+// VECTOR_OUTER_PRODUCT_OP followed by a MATRIX_SUM_OP of its result, e.g. to
+// accumulate a rank-one update.
+template<FeatureIndexT F, bool kWriteTemp>
+inline void ExecuteOuterProductSum(
+    const DecodedInstruction* instruction, Memory<F>* memory) {
+  const DecodedInstruction& product = instruction[0];
+  const DecodedInstruction& sum = instruction[1];
+  const Scalar* in1 = memory->vector_[product.in1_].data();
+  const Scalar* in2 = memory->vector_[product.in2_].data();
+  Scalar* temp = memory->matrix_[product.out_].data();
+  const AddressT other =
+      sum.in1_ == product.out_ ? sum.in2_ : sum.in1_;
+  const bool other_is_temp = other == product.out_;
+  const Scalar* other_in = memory->matrix_[other].data();
+  Scalar* out = memory->matrix_[sum.out_].data();
+  // Matrices are row-major.
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    for (FeatureIndexT j = 0; j < F; ++j) {
+      const IntegerT index = i * F + j;
+      const Scalar element = in1[i] * in2[j];
+      const Scalar addend = other_is_temp ? element : other_in[index];
+      if (kWriteTemp) temp[index] = element;
+      out[index] = element + addend;
+    }
+  }
+}
+
+// VECTOR_INNER_PRODUCT_OP followed by a SCALAR_DIFF_OP of its result and a
+// SCALAR_PRODUCT_OP of that, e.g. to compute a scaled prediction error. The
+// scalar intermediate results are always written.
 template<FeatureIndexT F>
-static constexpr std::array<
-    void(*)(const Instruction&, RandomGenerator*, Memory<F>*),
-    128> kOpIndexToExecuteFunction = {
-        &ExecuteNoOp<F>,                   // NO_OP = 0
-        &ExecuteScalarSumOp<F>,            // SCALAR_SUM_OP = 1
-        &ExecuteScalarDiffOp,              // SCALAR_DIFF_OP = 2
-        &ExecuteScalarProductOp,           // SCALAR_PRODUCT_OP = 3
-        &ExecuteScalarDivisionOp,          // SCALAR_DIVISION_OP = 4
-        &ExecuteScalarAbsOp,               // SCALAR_ABS_OP = 5
-        &ExecuteScalarReciprocalOp,        // SCALAR_RECIPROCAL_OP = 6
-        &ExecuteScalarSinOp,               // SCALAR_SIN_OP = 7
-        &ExecuteScalarCosOp,               // SCALAR_COS_OP = 8
-        &ExecuteScalarTanOp,               // SCALAR_TAN_OP = 9
-        &ExecuteScalarArcSinOp,            // SCALAR_ARCSIN_OP = 10
-        &ExecuteScalarArcCosOp,            // SCALAR_ARCCOS_OP = 11
-        &ExecuteScalarArcTanOp,            // SCALAR_ARCTAN_OP = 12
-        &ExecuteScalarExpOp,               // SCALAR_EXP_OP = 13
-        &ExecuteScalarLogOp,               // SCALAR_LOG_OP = 14
-        &ExecuteScalarHeavisideOp,         // SCALAR_HEAVYSIDE_OP = 15
-        &ExecuteVectorHeavisideOp,         // VECTOR_HEAVYSIDE_OP = 16
-        &ExecuteMatrixHeavisideOp,         // MATRIX_HEAVYSIDE_OP = 17
-        &ExecuteScalarVectorProductOp,     // SCALAR_VECTOR_PRODUCT_OP = 18
-        &ExecuteScalarBroadcastOp,         // SCALAR_BROADCAST_OP = 19
-        &ExecuteVectorReciprocalOp,        // VECTOR_RECIPROCAL_OP = 20
-        &ExecuteVectorNormOp,              // VECTOR_NORM_OP = 21
-        &ExecuteVectorAbsOp,               // VECTOR_ABS_OP = 22
-        &ExecuteVectorSumOp,               // VECTOR_SUM_OP = 23
-        &ExecuteVectorDiffOp,              // VECTOR_DIFF_OP = 24
-        &ExecuteVectorProductOp,           // VECTOR_PRODUCT_OP = 25
-        &ExecuteVectorDvisionOp,           // VECTOR_DIVISION_OP = 26
-        &ExecuteVectorInnerProductOp,      // VECTOR_INNER_PRODUCT_OP = 27
-        &ExecuteVectorOuterProductOp,      // VECTOR_OUTER_PRODUCT_OP = 28
-        &ExecuteScalarMatrixProductOp,     // SCALAR_MATRIX_PRODUCT_OP = 29
-        &ExecuteMatrixReciprocalOp,        // MATRIX_RECIPROCAL_OP = 30
-        &ExecuteMatrixVectorProductOp<F>,  // MATRIX_VECTOR_PRODUCT_OP = 31
-        &ExecuteVectorColumnBroadcastOp,   // VECTOR_COLUMN_BROADCAST_OP = 32
-        &ExecuteVectorRowBroadcastOp,      // VECTOR_ROW_BROADCAST_OP = 33
-        &ExecuteMatrixNormOp,              // MATRIX_NORM_OP = 34
-        &ExecuteMatrixColumnNormOp,        // MATRIX_COLUMN_NORM_OP = 35
-        &ExecuteMatrixRowNormOp,           // MATRIX_ROW_NORM_OP = 36
-        &ExecuteMatrixTransposeOp,         // MATRIX_TRANSPOSE_OP = 37
-        &ExecuteMatrixAbsOp,               // MATRIX_ABS_OP = 38
-        &ExecuteMatrixSumOp,               // MATRIX_SUM_OP = 39
-        &ExecuteMatrixDiffOp,              // MATRIX_DIFF_OP = 40
-        &ExecuteMatrixProductOp,           // MATRIX_PRODUCT_OP = 41
-        &ExecuteMatrixDivisionOp,          // MATRIX_DIVISION_OP = 42
-        &ExecuteMatrixMatrixProductOp,     // MATRIX_MATRIX_PRODUCT_OP = 43
-        &ExecuteScalarMinOp,               // SCALAR_MIN_OP = 44
-        &ExecuteVectorMinOp,               // VECTOR_MIN_OP = 45
-        &ExecuteMatrixMinOp,               // MATRIX_MIN_OP = 46
-        &ExecuteScalarMaxOp,               // SCALAR_MAX_OP = 47
-        &ExecuteVectorMaxOp,               // VECTOR_MAX_OP = 48
-        &ExecuteMatrixMaxOp,               // MATRIX_MAX_OP = 49
-        &ExecuteVectorMeanOp<F>,           // VECTOR_MEAN_OP = 50
-        &ExecuteMatrixMeanOp,              // MATRIX_MEAN_OP = 51
-        &ExecuteMatrixRowMeanOp,           // MATRIX_ROW_MEAN_OP = 52
-        &ExecuteMatrixRowStDevOp,          // MATRIX_ROW_ST_DEV_OP = 53
-        &ExecuteVectorStDevOp,             // VECTOR_ST_DEV_OP = 54
-        &ExecuteMatrixStDevOp,             // MATRIX_ST_DEV_OP = 55
-        &ExecuteScalarConstSetOp,          // SCALAR_CONST_SET_OP = 56
-        &ExecuteVectorConstSetOp,          // VECTOR_CONST_SET_OP = 57
-        &ExecuteMatrixConstSetOp,          // MATRIX_CONST_SET_OP = 58
-        &ExecuteScalarUniformSetOp,        // SCALAR_UNIFORM_SET_OP = 59
-        &ExecuteVectorUniformSetOp,        // VECTOR_UNIFORM_SET_OP = 60
-        &ExecuteMatrixUniformSetOp,        // MATRIX_UNIFORM_SET_OP = 61
-        &ExecuteScalarGaussianSetOp,       // SCALAR_GAUSSIAN_SET_OP = 62
-        &ExecuteVectorGaussianSetOp,       // VECTOR_GAUSSIAN_SET_OP = 63
-        &ExecuteMatrixGaussianSetOp,       // MATRIX_GAUSSIAN_SET_OP = 64
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 65
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 66
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 67
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 68
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 69
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 70
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 71
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 72
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 73
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 74
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 75
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 76
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 77
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 78
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 79
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 80
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 81
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 82
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 83
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 84
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 85
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 86
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 87
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 88
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 89
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 90
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 91
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 92
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 93
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 94
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 95
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 96
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 97
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 98
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 99
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 100
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 101
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 102
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 103
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 104
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 105
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 106
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 107
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 108
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 109
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 110
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 111
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 112
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 113
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 114
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 115
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 116
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 117
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 118
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 119
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 120
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 121
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 122
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 123
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 124
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 125
-        &ExecuteUnsupportedOp,             // UNSUPPORTED_OP = 126
-        &ExecuteUnsupportedOp              // UNSUPPORTED_OP = 127
-    };
+inline void ExecuteInnerProductDiffProduct(
+    const DecodedInstruction* instruction, Memory<F>* memory) {
+  ExecuteVectorInnerProductOp<F>(instruction[0], nullptr, memory);
+  ExecuteScalarDiffOp<F>(instruction[1], nullptr, memory);
+  ExecuteScalarProductOp<F>(instruction[2], nullptr, memory);
+}
+
+// MATRIX_TRANSPOSE_OP followed by a MATRIX_VECTOR_PRODUCT_OP of its result,
+// e.g. to back-propagate through a mini-batch. Multiplies by the transpose
+// without forming it, unless it is read later.
+template<FeatureIndexT F, bool kWriteTemp>
+inline void ExecuteTransposeMatVec(
+    const DecodedInstruction* instruction, Memory<F>* memory) {
+  const DecodedInstruction& transpose = instruction[0];
+  const DecodedInstruction& product = instruction[1];
+  // The product is computed first, as the temp may overwrite the input.
+  Vector<F> result;
+  MatrixKernels<F>::MatrixTransposeVectorProduct(
+      memory->matrix_[transpose.in1_], memory->vector_[product.in2_], &result);
+  if (kWriteTemp) ExecuteMatrixTransposeOp<F>(transpose, nullptr, memory);
+  memory->vector_[product.out_] = result;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decoded instruction interpreter.
+////////////////////////////////////////////////////////////////////////////////
 
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "The decoded instruction interpreter needs labels-as-values support."
+#endif
+
+#ifdef EXECUTOR_PROFILING
+
+// Profiling versions of the handlers below, which also count the invocations
+// and the cycles of each op in op_counters.
+#define AUTOML_ZERO_DECODED_OP_HANDLER(label, kernel)        \
+  label: {                                                   \
+    const uint64_t start_cycles = ReadCycleCounter();        \
+    kernel<F>(*instruction, rand_gen, memory);               \
+    op_counters[instruction->op_].Record(                    \
+        ReadCycleCounter() - start_cycles);                  \
+  }                                                          \
+    goto *kDispatchTable[(++instruction)->op_];
+
+#define AUTOML_ZERO_FUSED_OP_HANDLER(label, num_instructions, ...)  \
+  label: {                                                          \
+    const uint64_t start_cycles = ReadCycleCounter();               \
+    __VA_ARGS__(instruction, memory);                               \
+    op_counters[instruction->op_].Record(                           \
+        ReadCycleCounter() - start_cycles);                         \
+  }                                                                 \
+    instruction += num_instructions;                                \
+    goto *kDispatchTable[instruction->op_];
+
+#else
+
+// Defines a handler in ExecuteDecodedInstructions: runs the op kernel and
+// jumps directly to the handler of the next instruction in the stream.
+#define AUTOML_ZERO_DECODED_OP_HANDLER(label, kernel)        \
+  label:                                                     \
+    kernel<F>(*instruction, rand_gen, memory);               \
+    goto *kDispatchTable[(++instruction)->op_];
+
+// Defines a handler for a superinstruction that spans `num_instructions`
+// instructions in the stream. The kernel is passed last, as its template
+// arguments contain commas.
+#define AUTOML_ZERO_FUSED_OP_HANDLER(label, num_instructions, ...)  \
+  label:                                                            \
+    __VA_ARGS__(instruction, memory);                               \
+    instruction += num_instructions;                                \
+    goto *kDispatchTable[instruction->op_];
+
+#endif  // EXECUTOR_PROFILING
+
+// Runs a decoded instruction stream until its end-of-stream marker, using
+// computed-goto dispatch.
+template<FeatureIndexT F>
+void ExecuteDecodedInstructions(
+    const DecodedInstruction* instruction, RandomGenerator* rand_gen,
+    Memory<F>* memory) {
+  static const void* const kDispatchTable[kNumDecodedOps] = {
+      &&no_op,                         // NO_OP = 0
+      &&scalar_sum_op,                 // SCALAR_SUM_OP = 1
+      &&scalar_diff_op,                // SCALAR_DIFF_OP = 2
+      &&scalar_product_op,             // SCALAR_PRODUCT_OP = 3
+      &&scalar_division_op,            // SCALAR_DIVISION_OP = 4
+      &&scalar_abs_op,                 // SCALAR_ABS_OP = 5
+      &&scalar_reciprocal_op,          // SCALAR_RECIPROCAL_OP = 6
+      &&scalar_sin_op,                 // SCALAR_SIN_OP = 7
+      &&scalar_cos_op,                 // SCALAR_COS_OP = 8
+      &&scalar_tan_op,                 // SCALAR_TAN_OP = 9
+      &&scalar_arcsin_op,              // SCALAR_ARCSIN_OP = 10
+      &&scalar_arccos_op,              // SCALAR_ARCCOS_OP = 11
+      &&scalar_arctan_op,              // SCALAR_ARCTAN_OP = 12
+      &&scalar_exp_op,                 // SCALAR_EXP_OP = 13
+      &&scalar_log_op,                 // SCALAR_LOG_OP = 14
+      &&scalar_heaviside_op,           // SCALAR_HEAVYSIDE_OP = 15
+      &&vector_heaviside_op,           // VECTOR_HEAVYSIDE_OP = 16
+      &&matrix_heaviside_op,           // MATRIX_HEAVYSIDE_OP = 17
+      &&scalar_vector_product_op,      // SCALAR_VECTOR_PRODUCT_OP = 18
+      &&scalar_broadcast_op,           // SCALAR_BROADCAST_OP = 19
+      &&vector_reciprocal_op,          // VECTOR_RECIPROCAL_OP = 20
+      &&vector_norm_op,                // VECTOR_NORM_OP = 21
+      &&vector_abs_op,                 // VECTOR_ABS_OP = 22
+      &&vector_sum_op,                 // VECTOR_SUM_OP = 23
+      &&vector_diff_op,                // VECTOR_DIFF_OP = 24
+      &&vector_product_op,             // VECTOR_PRODUCT_OP = 25
+      &&vector_division_op,            // VECTOR_DIVISION_OP = 26
+      &&vector_inner_product_op,       // VECTOR_INNER_PRODUCT_OP = 27
+      &&vector_outer_product_op,       // VECTOR_OUTER_PRODUCT_OP = 28
+      &&scalar_matrix_product_op,      // SCALAR_MATRIX_PRODUCT_OP = 29
+      &&matrix_reciprocal_op,          // MATRIX_RECIPROCAL_OP = 30
+      &&matrix_vector_product_op,      // MATRIX_VECTOR_PRODUCT_OP = 31
+      &&vector_column_broadcast_op,    // VECTOR_COLUMN_BROADCAST_OP = 32
+      &&vector_row_broadcast_op,       // VECTOR_ROW_BROADCAST_OP = 33
+      &&matrix_norm_op,                // MATRIX_NORM_OP = 34
+      &&matrix_column_norm_op,         // MATRIX_COLUMN_NORM_OP = 35
+      &&matrix_row_norm_op,            // MATRIX_ROW_NORM_OP = 36
+      &&matrix_transpose_op,           // MATRIX_TRANSPOSE_OP = 37
+      &&matrix_abs_op,                 // MATRIX_ABS_OP = 38
+      &&matrix_sum_op,                 // MATRIX_SUM_OP = 39
+      &&matrix_diff_op,                // MATRIX_DIFF_OP = 40
+      &&matrix_product_op,             // MATRIX_PRODUCT_OP = 41
+      &&matrix_division_op,            // MATRIX_DIVISION_OP = 42
+      &&matrix_matrix_product_op,      // MATRIX_MATRIX_PRODUCT_OP = 43
+      &&scalar_min_op,                 // SCALAR_MIN_OP = 44
+      &&vector_min_op,                 // VECTOR_MIN_OP = 45
+      &&matrix_min_op,                 // MATRIX_MIN_OP = 46
+      &&scalar_max_op,                 // SCALAR_MAX_OP = 47
+      &&vector_max_op,                 // VECTOR_MAX_OP = 48
+      &&matrix_max_op,                 // MATRIX_MAX_OP = 49
+      &&vector_mean_op,                // VECTOR_MEAN_OP = 50
+      &&matrix_mean_op,                // MATRIX_MEAN_OP = 51
+      &&matrix_row_mean_op,            // MATRIX_ROW_MEAN_OP = 52
+      &&matrix_row_st_dev_op,          // MATRIX_ROW_ST_DEV_OP = 53
+      &&vector_st_dev_op,              // VECTOR_ST_DEV_OP = 54
+      &&matrix_st_dev_op,              // MATRIX_ST_DEV_OP = 55
+      &&scalar_const_set_op,           // SCALAR_CONST_SET_OP = 56
+      &&vector_const_set_op,           // VECTOR_CONST_SET_OP = 57
+      &&matrix_const_set_op,           // MATRIX_CONST_SET_OP = 58
+      &&scalar_uniform_set_op,         // SCALAR_UNIFORM_SET_OP = 59
+      &&vector_uniform_set_op,         // VECTOR_UNIFORM_SET_OP = 60
+      &&matrix_uniform_set_op,         // MATRIX_UNIFORM_SET_OP = 61
+      &&scalar_gaussian_set_op,        // SCALAR_GAUSSIAN_SET_OP = 62
+      &&vector_gaussian_set_op,        // VECTOR_GAUSSIAN_SET_OP = 63
+      &&matrix_gaussian_set_op,        // MATRIX_GAUSSIAN_SET_OP = 64
+      &&unsupported_op,                // kUnsupportedDecodedOp
+      &&axpy,                          // kAxpyDecodedOp
+      &&axpy_dead_temp,                // kAxpyDeadTempDecodedOp
+      &&mat_vec_heaviside,             // kMatVecHeavisideDecodedOp
+      &&mat_vec_heaviside_dead_temp,   // kMatVecHeavisideDeadTempDecodedOp
+      &&mat_vec_product,               // kMatVecProductDecodedOp
+      &&mat_vec_product_dead_temp,     // kMatVecProductDeadTempDecodedOp
+      &&outer_product_sum,             // kOuterProductSumDecodedOp
+      &&outer_product_sum_dead_temp,   // kOuterProductSumDeadTempDecodedOp
+      &&inner_product_diff_product,    // kInnerProductDiffProductDecodedOp
+      &&transpose_mat_vec,             // kTransposeMatVecDecodedOp
+      &&transpose_mat_vec_dead_temp,   // kTransposeMatVecDeadTempDecodedOp
+      &&end_of_stream                  // kEndOfStreamDecodedOp
+  };
+#ifdef EXECUTOR_PROFILING
+  OpCounter* const op_counters =
+      ThreadExecutorProfile()->Counters(ThreadExecutionPhase(), F);
+#endif
+
+  goto *kDispatchTable[instruction->op_];
+
+  AUTOML_ZERO_DECODED_OP_HANDLER(no_op, ExecuteNoOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_sum_op, ExecuteScalarSumOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_diff_op, ExecuteScalarDiffOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_product_op, ExecuteScalarProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_division_op, ExecuteScalarDivisionOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_abs_op, ExecuteScalarAbsOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      scalar_reciprocal_op, ExecuteScalarReciprocalOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_sin_op, ExecuteScalarSinOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_cos_op, ExecuteScalarCosOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_tan_op, ExecuteScalarTanOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_arcsin_op, ExecuteScalarArcSinOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_arccos_op, ExecuteScalarArcCosOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_arctan_op, ExecuteScalarArcTanOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_exp_op, ExecuteScalarExpOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_log_op, ExecuteScalarLogOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_heaviside_op, ExecuteScalarHeavisideOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_heaviside_op, ExecuteVectorHeavisideOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_heaviside_op, ExecuteMatrixHeavisideOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      scalar_vector_product_op, ExecuteScalarVectorProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_broadcast_op, ExecuteScalarBroadcastOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      vector_reciprocal_op, ExecuteVectorReciprocalOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_norm_op, ExecuteVectorNormOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_abs_op, ExecuteVectorAbsOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_sum_op, ExecuteVectorSumOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_diff_op, ExecuteVectorDiffOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_product_op, ExecuteVectorProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_division_op, ExecuteVectorDvisionOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      vector_inner_product_op, ExecuteVectorInnerProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      vector_outer_product_op, ExecuteVectorOuterProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      scalar_matrix_product_op, ExecuteScalarMatrixProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      matrix_reciprocal_op, ExecuteMatrixReciprocalOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      matrix_vector_product_op, ExecuteMatrixVectorProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      vector_column_broadcast_op, ExecuteVectorColumnBroadcastOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      vector_row_broadcast_op, ExecuteVectorRowBroadcastOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_norm_op, ExecuteMatrixNormOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      matrix_column_norm_op, ExecuteMatrixColumnNormOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_row_norm_op, ExecuteMatrixRowNormOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_transpose_op, ExecuteMatrixTransposeOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_abs_op, ExecuteMatrixAbsOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_sum_op, ExecuteMatrixSumOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_diff_op, ExecuteMatrixDiffOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_product_op, ExecuteMatrixProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_division_op, ExecuteMatrixDivisionOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      matrix_matrix_product_op, ExecuteMatrixMatrixProductOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_min_op, ExecuteScalarMinOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_min_op, ExecuteVectorMinOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_min_op, ExecuteMatrixMinOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_max_op, ExecuteScalarMaxOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_max_op, ExecuteVectorMaxOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_max_op, ExecuteMatrixMaxOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_mean_op, ExecuteVectorMeanOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_mean_op, ExecuteMatrixMeanOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_row_mean_op, ExecuteMatrixRowMeanOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_row_st_dev_op, ExecuteMatrixRowStDevOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_st_dev_op, ExecuteVectorStDevOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_st_dev_op, ExecuteMatrixStDevOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(scalar_const_set_op, ExecuteScalarConstSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(vector_const_set_op, ExecuteVectorConstSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(matrix_const_set_op, ExecuteMatrixConstSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      scalar_uniform_set_op, ExecuteScalarUniformSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      vector_uniform_set_op, ExecuteVectorUniformSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      matrix_uniform_set_op, ExecuteMatrixUniformSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      scalar_gaussian_set_op, ExecuteScalarGaussianSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      vector_gaussian_set_op, ExecuteVectorGaussianSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(
+      matrix_gaussian_set_op, ExecuteMatrixGaussianSetOp)
+  AUTOML_ZERO_DECODED_OP_HANDLER(unsupported_op, ExecuteUnsupportedOp)
+  AUTOML_ZERO_FUSED_OP_HANDLER(axpy, 2, ExecuteAxpy<F, true>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(axpy_dead_temp, 2, ExecuteAxpy<F, false>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      mat_vec_heaviside, 2, ExecuteMatVecHeaviside<F, true>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      mat_vec_heaviside_dead_temp, 2, ExecuteMatVecHeaviside<F, false>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      mat_vec_product, 2, ExecuteMatVecProduct<F, true>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      mat_vec_product_dead_temp, 2, ExecuteMatVecProduct<F, false>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      outer_product_sum, 2, ExecuteOuterProductSum<F, true>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      outer_product_sum_dead_temp, 2, ExecuteOuterProductSum<F, false>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      inner_product_diff_product, 3, ExecuteInnerProductDiffProduct<F>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      transpose_mat_vec, 2, ExecuteTransposeMatVec<F, true>)
+  AUTOML_ZERO_FUSED_OP_HANDLER(
+      transpose_mat_vec_dead_temp, 2, ExecuteTransposeMatVec<F, false>)
+
+ end_of_stream:
+  return;
+}
+
+#undef AUTOML_ZERO_DECODED_OP_HANDLER
+#undef AUTOML_ZERO_FUSED_OP_HANDLER
+
+template<FeatureIndexT F>
+inline void ExecuteDecoded(
+    const DecodedComponentFunction& component_function,
+    RandomGenerator* rand_gen, Memory<F>* memory) {
+  ExecuteDecodedInstructions<F>(component_function.begin(), rand_gen, memory);
+}
+
+// Executes a single instruction. The Executor runs whole decoded component
+// functions instead; this is meant for tests and one-off uses.
 template<FeatureIndexT F>
 inline void ExecuteInstruction(
     const Instruction& instruction, RandomGenerator* rand_gen,
     Memory<F>* memory) {
-  (*kOpIndexToExecuteFunction<F>[instruction.op_])(
-      instruction, rand_gen, memory);
+  const DecodedInstruction stream[2] = {
+      DecodedInstruction(instruction), DecodedInstruction()};
+  ExecuteDecodedInstructions<F>(stream, rand_gen, memory);
+}
+
+// Describes where the typed memory spaces of a Memory<F> are, for the JIT.
+template<FeatureIndexT F>
+JitMemoryLayout MakeJitMemoryLayout(const Memory<F>& memory) {
+  const char* base = reinterpret_cast<const char*>(&memory);
+  JitMemoryLayout layout;
+  layout.features_size = F;
+  layout.scalar_offset =
+      reinterpret_cast<const char*>(memory.scalar_.data()) - base;
+  layout.vector_offset =
+      reinterpret_cast<const char*>(memory.vector_[0].data()) - base;
+  layout.vector_stride = sizeof(Vector<F>);
+  return layout;
+}
+
+template <FeatureIndexT F>
+std::unique_ptr<JitAlgorithm> CompileJitAlgorithm(const Algorithm& algorithm) {
+  // The layout is the same for every Memory<F>.
+  static const Memory<F>* const kLayoutMemory = new Memory<F>();
+  const JitMemoryLayout layout = MakeJitMemoryLayout(*kLayoutMemory);
+  std::unique_ptr<JitAlgorithm> jit_algorithm(new JitAlgorithm());
+  jit_algorithm->predict =
+      JitComponentFunction::Compile(algorithm.predict_, layout);
+  jit_algorithm->learn =
+      JitComponentFunction::Compile(algorithm.learn_, layout);
+  return jit_algorithm;
 }
 
 template <FeatureIndexT F>
@@ -970,8 +1814,8 @@ struct ErrorComputer {
 template <FeatureIndexT F>
 struct ProbabilityConverter {
   inline static void Convert(Memory<F>* memory) {
-    memory->scalar_[kPredictionsScalarAddress] =
-        Sigmoid(memory->scalar_[kPredictionsScalarAddress]);
+    Scalar& prediction = memory->scalar_[kPredictionsScalarAddress];
+    prediction = Sigmoid(prediction);
   }
 };
 
@@ -980,28 +1824,105 @@ Executor<F>::Executor(const Algorithm& algorithm, const Task<F>& dataset,
                       const IntegerT num_all_train_examples,
                       const IntegerT num_valid_examples,
                       RandomGenerator* rand_gen,
-                      const double max_abs_error)
+                      const double max_abs_error,
+                      const bool use_jit,
+                      const bool wipe_used_memory_only,
+                      const bool short_circuit_constant_predictions,
+                      const ExecutorState<F>* initial_state,
+                      const bool stop_on_fatal_nans,
+                      const bool use_fast_math,
+                      const ValidationBound& validation_bound,
+                      const JitAlgorithm* jit_algorithm)
     : algorithm_(algorithm),
+      predict_(algorithm_.predict_, true),  // fuse
+      learn_(algorithm_.learn_, true),  // fuse
+      jit_predict_(nullptr),
+      jit_learn_(nullptr),
       dataset_(dataset),
+      batch_size_(dataset.BatchSize()),
+      // With mini-batches, the Executor itself writes the batch addresses,
+      // which the Algorithm may not use.
+      used_addresses_(
+          wipe_used_memory_only && batch_size_ == 1 ?
+          GetAddressUsage(algorithm_) :
+          AddressUsage{kMaxScalarAddresses, kMaxVectorAddresses,
+                       kMaxMatrixAddresses}),
       num_all_train_examples_(num_all_train_examples),
       num_valid_examples_(num_valid_examples),
       rand_gen_(rand_gen),
+      memory_owned_(new Memory<F>()),
+      memory_(*memory_owned_),
       max_abs_error_(max_abs_error),
-      num_train_steps_completed_(0) {
-  memory_.Wipe();
-  for (const std::shared_ptr<const Instruction>& instruction :
-       algorithm_.setup_) {
-    ExecuteInstruction(*instruction, rand_gen_, &memory_);
+      num_train_steps_completed_(0),
+      num_resumed_train_examples_(
+          initial_state == nullptr ? 0 : initial_state->num_train_examples),
+      skip_learn_(false),
+      // The dataflow analyses assume that predict and learn see one example
+      // at a time.
+      prediction_dependence_(
+          short_circuit_constant_predictions && batch_size_ == 1 ?
+          GetPredictionDependence(algorithm_) : kVariablePredictions),
+      constant_prediction_(0.0),
+      fatal_nan_addresses_(
+          stop_on_fatal_nans && batch_size_ == 1 &&
+          prediction_dependence_ == kVariablePredictions ?
+          GetFatalNanAddresses(algorithm_) : std::vector<FatalNanAddress>()),
+      num_train_steps_saved_(0),
+      use_fast_math_(use_fast_math),
+      validation_bound_(validation_bound),
+      fitness_is_estimate_(false),
+      fitness_upper_bound_(kMinFitness),
+      num_valid_steps_saved_(0) {
+  CHECK_GE(validation_bound_.num_stdevs, 0.0);
+  if (initial_state != nullptr) {
+    CHECK(initial_state->saved);
+    memory_.CopyFrom(initial_state->memory, used_addresses_.num_scalars,
+                     used_addresses_.num_vectors,
+                     used_addresses_.num_matrices);
+    rand_gen_->Restore(initial_state->rand_gen);
+  } else {
+    memory_.Wipe(used_addresses_.num_scalars, used_addresses_.num_vectors,
+                 used_addresses_.num_matrices);
+    const DecodedComponentFunction setup(algorithm_.setup_, true);  // fuse
+    ScopedExecutionPhase phase(kSetupPhase);
+    ExecuteDecoded(setup, rand_gen_, &memory_);
+  }
+  // The JIT only knows how to assign one example at a time.
+  if (use_jit && batch_size_ == 1) {
+    if (jit_algorithm == nullptr) {
+      jit_owned_ = CompileJitAlgorithm<F>(algorithm_);
+      jit_algorithm = jit_owned_.get();
+    }
+    jit_predict_ = jit_algorithm->predict.get();
+    jit_learn_ = jit_algorithm->learn.get();
+  }
+  if (prediction_dependence_ == kConstantPredictions) {
+    // Any features give the same prediction, which is the same for all the
+    // examples because predict only reads memory that does not change.
+    ScopedExecutionPhase phase(kTrainPredictPhase);
+    RunPredictComponentFunction(Vector<F>::Zero());
+    constant_prediction_ = memory_.scalar_[kPredictionsScalarAddress];
   }
 }
 
 template <FeatureIndexT F>
 double Executor<F>::Execute(std::vector<double>* train_errors,
-                            std::vector<double>* valid_errors) {
+                            std::vector<double>* valid_errors,
+                            ExecutorState<F>* state) {
   CHECK_GE(dataset_.NumTrainEpochs(), 1);
 
+  // If nothing learn does reaches predict, training still runs predict for the
+  // early stopping checks, and for the memory predict carries over to the
+  // validation, but not learn.
+  skip_learn_ = batch_size_ == 1 &&
+      (prediction_dependence_ != kVariablePredictions ||
+       !LearnIsLive(algorithm_));
+
   // Iterators that track the progresss of training.
   TaskIterator<F> train_it = dataset_.TrainIterator();
+  for (IntegerT i = 0; i < num_resumed_train_examples_; ++i) {
+    train_it.Next();
+  }
 
   // Train for multiple epochs, evaluate on validation set
   // after each epoch and take the best validation result as fitness.
@@ -1012,20 +1933,49 @@ double Executor<F>::Execute(std::vector<double>* train_errors,
       dataset_.TrainExamplesPerEpoch() == kNumTrainExamplesNotSet ?
       num_all_train_examples : dataset_.TrainExamplesPerEpoch();
   IntegerT num_remaining = num_all_train_examples;
+  IntegerT num_trained_in_epoch = num_resumed_train_examples_;
+  CHECK_LE(num_trained_in_epoch,
+           std::min(num_examples_per_epoch, num_all_train_examples));
   double best_fitness = kMinFitness;
+  double best_fitness_bound = kMinFitness;
+  bool stopped_validation = false;
   while (num_remaining > 0) {
-    if (!Train(
-            std::min(num_examples_per_epoch, num_remaining),
-            train_errors, &train_it)) {
+    const IntegerT num_in_epoch =
+        std::min(num_examples_per_epoch, num_remaining);
+    if (!Train(num_in_epoch - num_trained_in_epoch, train_errors,
+               &train_it)) {
       if (num_remaining == num_all_train_examples) {
         return kMinFitness;
       } else {
         break;
       }
     }
+    num_trained_in_epoch = 0;
+    if (state != nullptr) {
+      state->saved = true;
+      state->num_train_examples = num_in_epoch;
+      state->memory.CopyFrom(memory_, used_addresses_.num_scalars,
+                             used_addresses_.num_vectors,
+                             used_addresses_.num_matrices);
+      rand_gen_->Save(&state->rand_gen);
+      state = nullptr;
+    }
     num_remaining -= num_examples_per_epoch;
-    const double current_fitness = Validate(valid_errors);
+    // Only the last validation is bounded, as stopping one early would change
+    // the random numbers the next epoch draws. It only matters if it beats the
+    // previous epochs.
+    const IntegerT num_valid_steps_saved = num_valid_steps_saved_;
+    double current_fitness_bound;
+    const double current_fitness = Validate(
+        valid_errors,
+        num_remaining <= 0 &&
+        validation_bound_.fitness_threshold > kMinFitness ?
+        std::max(validation_bound_.fitness_threshold, best_fitness) :
+        kMinFitness,
+        &current_fitness_bound);
+    stopped_validation |= num_valid_steps_saved_ > num_valid_steps_saved;
     best_fitness = std::max(current_fitness, best_fitness);
+    best_fitness_bound = std::max(current_fitness_bound, best_fitness_bound);
     // Only save the errors of the first epoch.
     if (train_errors != nullptr) {
       train_errors = nullptr;
@@ -1033,6 +1983,16 @@ double Executor<F>::Execute(std::vector<double>* train_errors,
     }
   }
 
+#ifdef EXECUTOR_PROFILING
+  MaybeWriteExecutorProfileHistogram(DecodedOpName);
+#endif
+  // Above the threshold, the fitness is that of a previous epoch, which the
+  // last one did not beat (only likely so with the statistical bound).
+  fitness_is_estimate_ =
+      stopped_validation &&
+      best_fitness_bound <= validation_bound_.fitness_threshold;
+  fitness_upper_bound_ =
+      fitness_is_estimate_ ? best_fitness_bound : best_fitness;
   return best_fitness;
 }
 
@@ -1041,6 +2001,31 @@ IntegerT Executor<F>::GetNumTrainStepsCompleted() const {
   return num_train_steps_completed_;
 }
 
+template <FeatureIndexT F>
+bool Executor<F>::SkippedLearn() const {
+  return skip_learn_;
+}
+
+template <FeatureIndexT F>
+IntegerT Executor<F>::GetNumTrainStepsSaved() const {
+  return num_train_steps_saved_;
+}
+
+template <FeatureIndexT F>
+bool Executor<F>::FitnessIsEstimate() const {
+  return fitness_is_estimate_;
+}
+
+template <FeatureIndexT F>
+double Executor<F>::GetFitnessUpperBound() const {
+  return fitness_upper_bound_;
+}
+
+template <FeatureIndexT F>
+IntegerT Executor<F>::GetNumValidStepsSaved() const {
+  return num_valid_steps_saved_;
+}
+
 template <FeatureIndexT F>
 bool Executor<F>::Train(std::vector<double>* errors) {
   // Iterators that tracks the progresss of training.
@@ -1055,38 +2040,15 @@ bool Executor<F>::Train(std::vector<double>* errors) {
                &train_label_it);
 }
 
-// At or above these many steps, we optimize the train component function.
-constexpr IntegerT kTrainStepsOptThreshold = 1000;
-
 template <FeatureIndexT F>
 bool Executor<F>::Train(const IntegerT max_steps, std::vector<double>* errors,
                         TaskIterator<F>* train_it) {
+  if (batch_size_ > 1) {
+    return TrainBatches(max_steps, errors, train_it);
+  }
   CHECK(errors == nullptr || max_steps <= 100) <<
       "You should only record the training errors for few training steps."
       << std::endl;
-  if (max_steps < kTrainStepsOptThreshold) {
-    return TrainNoOptImpl(max_steps, errors, train_it);
-  } else {
-    if (algorithm_.predict_.size() <= 10 && algorithm_.learn_.size() <= 10) {
-      return TrainOptImpl<10>(max_steps, errors, train_it);
-    } else if (algorithm_.predict_.size() <= 100 &&
-               algorithm_.learn_.size() <= 100) {
-      return TrainOptImpl<100>(max_steps, errors, train_it);
-    } else if (algorithm_.predict_.size() <= 1000 &&
-               algorithm_.learn_.size() <= 1000) {
-      return TrainOptImpl<1000>(max_steps, errors, train_it);
-    } else {
-      LOG(FATAL) << "ComponentFunction size not yet supported." << std::endl;
-    }
-  }
-}
-
-// We don't care that this function is inline. We just want to keep it here,
-// next to TrainOptImpl (below).
-template <FeatureIndexT F>
-inline bool Executor<F>::TrainNoOptImpl(const IntegerT max_steps,
-                                        std::vector<double>* errors,
-                                        TaskIterator<F>* train_it) {
   if (errors != nullptr) {
     errors->reserve(max_steps);
   }
@@ -1094,11 +2056,9 @@ inline bool Executor<F>::TrainNoOptImpl(const IntegerT max_steps,
     num_train_steps_completed_++;
     // Run predict component function for this example.
     const Vector<F>& features = train_it->GetFeatures();
-    memory_.vector_[kFeaturesVectorAddress] = features;
-    ZeroLabelAssigner<F>::Assign(&memory_);
-    for (const std::shared_ptr<const Instruction>& instruction :
-         algorithm_.predict_) {
-      ExecuteInstruction(*instruction, rand_gen_, &memory_);
+    {
+      ScopedExecutionPhase phase(kTrainPredictPhase);
+      RunPredict(features);
     }
 
     if (dataset_.eval_type_ == ACCURACY) {
@@ -1116,11 +2076,19 @@ inline bool Executor<F>::TrainNoOptImpl(const IntegerT max_steps,
     }
 
     // Run learn component function for this example.
-    memory_.vector_[kFeaturesVectorAddress] = features;
-    LabelAssigner<F>::Assign(label, &memory_);
-    for (const std::shared_ptr<const Instruction>& instruction :
-         algorithm_.learn_) {
-      ExecuteInstruction(*instruction, rand_gen_, &memory_);
+    if (!skip_learn_) {
+      ScopedExecutionPhase phase(kTrainLearnPhase);
+      RunLearn(features, label);
+    }
+
+    // Stop early if a NaN will reach a prediction of this call.
+    if (!skip_learn_ && !fatal_nan_addresses_.empty()) {
+      const IntegerT num_examples = FindFatalNan(
+          std::min(max_steps - step, train_it->NumRemaining()) - 1);
+      if (num_examples > 0) {
+        num_train_steps_saved_ += num_examples;
+        return false;
+      }
     }
 
     // Check whether we are done.
@@ -1133,96 +2101,82 @@ inline bool Executor<F>::TrainNoOptImpl(const IntegerT max_steps,
 }
 
 template <FeatureIndexT F>
-template <size_t max_component_function_size>
-bool Executor<F>::TrainOptImpl(const IntegerT max_steps,
-                               std::vector<double>* errors,
-                               TaskIterator<F>* train_it) {
+bool Executor<F>::TrainBatches(
+    const IntegerT max_steps, std::vector<double>* errors,
+    TaskIterator<F>* train_it) {
+  CHECK(errors == nullptr || max_steps <= 100) <<
+      "You should only record the training errors for few training steps."
+      << std::endl;
   if (errors != nullptr) {
     errors->reserve(max_steps);
   }
-
-  std::array<Instruction, max_component_function_size>
-      optimized_predict_component_function;
-  typename std::array<Instruction, max_component_function_size>::iterator
-      optimized_predict_instr_it = optimized_predict_component_function.begin();
-  for (const std::shared_ptr<const Instruction>& predict_instr :
-       algorithm_.predict_) {
-    *optimized_predict_instr_it = *predict_instr;
-    ++optimized_predict_instr_it;
-  }
-  const IntegerT num_predict_instr = algorithm_.predict_.size();
-
-  std::array<Instruction, max_component_function_size>
-      optimized_learn_component_function;
-  typename std::array<Instruction, max_component_function_size>::iterator
-      optimized_learn_instr_it = optimized_learn_component_function.begin();
-  for (const std::shared_ptr<const Instruction>& learn_instr :
-       algorithm_.learn_) {
-    *optimized_learn_instr_it = *learn_instr;
-    ++optimized_learn_instr_it;
-  }
-  const IntegerT num_learn_instr = algorithm_.learn_.size();
-
-  for (IntegerT step = 0; step < max_steps; ++step) {
-    num_train_steps_completed_++;
-    // Run predict component function for this example.
-    const Vector<F>& features = train_it->GetFeatures();
-    memory_.vector_[kFeaturesVectorAddress] = features;
-    ZeroLabelAssigner<F>::Assign(&memory_);
-    IntegerT predict_instr_num = 0;
-    for (const Instruction& instruction :
-         optimized_predict_component_function) {
-      if (predict_instr_num == num_predict_instr) {
-        break;
-      }
-      ExecuteInstruction(instruction, rand_gen_, &memory_);
-      ++predict_instr_num;
+  std::vector<const Vector<F>*> batch_features;
+  batch_features.reserve(batch_size_);
+  Vector<F> batch_labels;
+  bool done = false;
+  IntegerT step = 0;
+  while (step < max_steps && !done) {
+    // Gather the next mini-batch, which is shorter at the end.
+    batch_features.clear();
+    batch_labels.setZero();
+    while (batch_features.size() < batch_size_ && step < max_steps && !done) {
+      batch_labels(batch_features.size()) = train_it->GetLabel();
+      batch_features.push_back(&train_it->GetFeatures());
+      ++step;
+      train_it->Next();
+      done = train_it->Done();  // Reached the end of the dataset.
     }
+    num_train_steps_completed_ += batch_features.size();
 
-    if (dataset_.eval_type_ == ACCURACY) {
-      ProbabilityConverter<F>::Convert(&memory_);
+    // Run predict component function for this mini-batch.
+    {
+      ScopedExecutionPhase phase(kTrainPredictPhase);
+      RunBatchPredict(batch_features);
     }
 
     // Check whether we should stop early.
-    const Scalar& label = train_it->GetLabel();
-    const double abs_error = ErrorComputer<F>::Compute(memory_, label);
-    if (isnan(abs_error) || abs_error > max_abs_error_) {
-      return false;
+    Vector<F>& predictions = memory_.vector_[kPredictionsVectorAddress];
+    if (dataset_.eval_type_ == ACCURACY && use_fast_math_) {
+      // The padding past the mini-batch is converted too, which is harmless.
+      ApplyCoefficientWise<FastSigmoid>(predictions, &predictions);
     }
-    if (errors != nullptr) {
-      errors->push_back(abs_error);
-    }
-
-    // Run learn component function for this example.
-    memory_.vector_[kFeaturesVectorAddress] = features;
-    LabelAssigner<F>::Assign(label, &memory_);
-    IntegerT learn_instr_num = 0;
-    for (const Instruction& instruction : optimized_learn_component_function) {
-      if (learn_instr_num == num_learn_instr) {
-        break;
+    for (IntegerT i = 0; i < batch_features.size(); ++i) {
+      if (dataset_.eval_type_ == ACCURACY && !use_fast_math_) {
+        predictions(i) = Sigmoid(predictions(i));
+      }
+      const double abs_error = std::abs(batch_labels(i) - predictions(i));
+      if (isnan(abs_error) || abs_error > max_abs_error_) {
+        return false;
+      }
+      if (errors != nullptr) {
+        errors->push_back(abs_error);
       }
-      ExecuteInstruction(instruction, rand_gen_, &memory_);
-      ++learn_instr_num;
     }
 
-    // Check whether we are done.
-    train_it->Next();
-    if (train_it->Done()) {
-      break;  // Reached the end of the dataset.
+    // Run learn component function for this mini-batch.
+    {
+      ScopedExecutionPhase phase(kTrainLearnPhase);
+      RunBatchLearn(batch_features, batch_labels);
     }
   }
   return true;
 }
 
+// The statistical validation bound needs this many examples to estimate the
+// spread of the losses.
+constexpr IntegerT kMinStatisticalBoundValidSteps = 30;
+
+constexpr double kMinusTwoOverPi = -0.63661977236758138243;
+
 // Minimum negative error tolerated to account for numerical issue around zero.
 constexpr double kNegativeErrorTolerance = -1e-6;
 
 template <FeatureIndexT F>
 struct SquashedRmseLossAccumulator {
   inline static void Accumulate(
-      const Memory<F>& memory, const Scalar& label,
+      const Scalar prediction, const Scalar& label,
       double* error, double* loss) {
-    *error = label - memory.scalar_[kPredictionsScalarAddress];
+    *error = label - prediction;
     *loss += *error * *error;
   }
 };
@@ -1230,9 +2184,9 @@ struct SquashedRmseLossAccumulator {
 template <FeatureIndexT F>
 struct ProbAccuracyLossAccumulator {
   inline static void Accumulate(
-      const Memory<F>& memory, const Scalar& label,
+      const Scalar prediction, const Scalar& label,
       double* error, double* loss) {
-    double logit = memory.scalar_[kPredictionsScalarAddress];
+    double logit = prediction;
     double pred_prob = Sigmoid(logit);
     if ((pred_prob > 1.0) || (pred_prob < 0.0)) {
       *error = std::numeric_limits<double>::infinity();
@@ -1245,8 +2199,15 @@ struct ProbAccuracyLossAccumulator {
 };
 
 template <FeatureIndexT F>
-double Executor<F>::Validate(std::vector<double>* errors) {
+double Executor<F>::Validate(std::vector<double>* errors,
+                             const double fitness_threshold,
+                             double* fitness_bound_out) {
   double loss = 0.0;
+  // The sum of the squares of the losses of the examples, for the statistical
+  // bound.
+  double loss_squares = 0.0;
+  IntegerT num_done = 0;
+  double fitness_bound;
   if (errors != nullptr) {
     errors->reserve(dataset_.ValidSteps());
   }
@@ -1258,52 +2219,98 @@ double Executor<F>::Validate(std::vector<double>* errors) {
       "You should only record the validation errors for few validation steps."
       << std::endl;
 
-  TaskIterator<F> valid_it = dataset_.ValidIterator();
-  for (IntegerT step = 0; step < num_steps; ++step) {
-    // Run predict component function for this example.
-    const Vector<F>& features = valid_it.GetFeatures();
-    memory_.vector_[kFeaturesVectorAddress] = features;
-    ZeroLabelAssigner<F>::Assign(&memory_);
-    for (const std::shared_ptr<const Instruction>& instruction :
-         algorithm_.predict_) {
-      ExecuteInstruction(*instruction, rand_gen_, &memory_);
+  // The errors are only recorded for few steps, all of which are needed.
+  const double stop_loss =
+      errors == nullptr ? StopLoss(fitness_threshold) :
+      std::numeric_limits<double>::infinity();
+  auto can_stop = [&](const double example_loss) {
+    ++num_done;
+    if (validation_bound_.num_stdevs > 0.0) {
+      loss_squares += example_loss * example_loss;
+    }
+    if (CannotExceed(fitness_threshold, stop_loss, loss, loss_squares,
+                     num_done, num_steps, &fitness_bound)) {
+      num_valid_steps_saved_ += num_steps - num_done;
+      return true;
     }
+    return false;
+  };
+  // Extrapolates the loss of the examples validated so far to all of them.
+  // This is at least the smallest loss CannotExceed assumed, so the estimate
+  // never exceeds the bound.
+  auto fitness_estimate = [&]() {
+    if (fitness_bound_out != nullptr) *fitness_bound_out = fitness_bound;
+    return std::min(
+        fitness_bound,
+        LossToFitness(loss * static_cast<double>(num_steps) /
+                      static_cast<double>(num_done)));
+  };
+  if (fitness_bound_out != nullptr) *fitness_bound_out = kMinFitness;
 
-    // Accumulate the loss.
-    double error = 0.0;
-    const Scalar& label = valid_it.GetLabel();
-    switch (dataset_.eval_type_) {
-      case RMS_ERROR: {
-        SquashedRmseLossAccumulator<F>::Accumulate(memory_, label, &error,
-                                                   &loss);
-        break;
+  TaskIterator<F> valid_it = dataset_.ValidIterator();
+  ScopedExecutionPhase phase(kValidPredictPhase);
+  if (batch_size_ > 1) {
+    std::vector<const Vector<F>*> batch_features;
+    batch_features.reserve(batch_size_);
+    std::vector<Scalar> batch_labels;
+    batch_labels.reserve(batch_size_);
+    bool done = false;
+    IntegerT step = 0;
+    while (step < num_steps && !done) {
+      // Run predict component function for the next mini-batch.
+      batch_features.clear();
+      batch_labels.clear();
+      while (batch_features.size() < batch_size_ && step < num_steps &&
+             !done) {
+        batch_features.push_back(&valid_it.GetFeatures());
+        batch_labels.push_back(valid_it.GetLabel());
+        ++step;
+        valid_it.Next();
+        done = valid_it.Done();  // Reached the end of the dataset.
       }
-      case ACCURACY: {
-        ProbAccuracyLossAccumulator<F>::Accumulate(memory_, label, &error,
-                                                   &loss);
-        break;
+      RunBatchPredict(batch_features);
+
+      // Accumulate the loss.
+      const Vector<F>& predictions =
+          memory_.vector_[kPredictionsVectorAddress];
+      for (IntegerT i = 0; i < batch_labels.size(); ++i) {
+        const double previous_loss = loss;
+        if (!AccumulateLoss(predictions(i), batch_labels[i], &loss, errors)) {
+          // Stop early. Return infinite loss.
+          return kMinFitness;
+        }
+        if (can_stop(loss - previous_loss)) return fitness_estimate();
       }
-      case INVALID_EVAL_TYPE:
-        LOG(FATAL) << "Invalid eval type." << std::endl;
-      // Do not add default case here. All enum values should be supported.
-    }
-
-    const double abs_error = std::abs(error);
-    if (isnan(abs_error) || abs_error > max_abs_error_) {
-      // Stop early. Return infinite loss.
-      return kMinFitness;
-    }
-    if (errors != nullptr) {
-      errors->push_back(std::abs(error));
     }
+  } else {
+    for (IntegerT step = 0; step < num_steps; ++step) {
+      // Run predict component function for this example.
+      const Vector<F>& features = valid_it.GetFeatures();
+      RunPredict(features);
+
+      // Accumulate the loss.
+      const double previous_loss = loss;
+      if (!AccumulateLoss(memory_.scalar_[kPredictionsScalarAddress],
+                          valid_it.GetLabel(), &loss, errors)) {
+        // Stop early. Return infinite loss.
+        return kMinFitness;
+      }
+      if (can_stop(loss - previous_loss)) return fitness_estimate();
 
-    valid_it.Next();
-    if (valid_it.Done()) {
-      break;  // Reached the end of the dataset.
+      valid_it.Next();
+      if (valid_it.Done()) {
+        break;  // Reached the end of the dataset.
+      }
     }
   }
 
-  // Convert to fitness.
+  const double fitness = LossToFitness(loss);
+  if (fitness_bound_out != nullptr) *fitness_bound_out = fitness;
+  return fitness;
+}
+
+template <FeatureIndexT F>
+inline double Executor<F>::LossToFitness(double loss) const {
   double fitness;
   switch (dataset_.eval_type_) {
     case INVALID_EVAL_TYPE:
@@ -1317,10 +2324,92 @@ double Executor<F>::Validate(std::vector<double>* errors) {
       fitness = 1.0 - loss;
       break;
   }
-
   return fitness;
 }
 
+template <FeatureIndexT F>
+double Executor<F>::StopLoss(const double fitness_threshold) const {
+  if (fitness_threshold <= kMinFitness) {
+    return std::numeric_limits<double>::infinity();
+  }
+  // The losses are never negative, so the loss so far bounds the final loss
+  // from below, and the fitness decreases with the final loss.
+  const double num_valid_steps = static_cast<double>(dataset_.ValidSteps());
+  switch (dataset_.eval_type_) {
+    case INVALID_EVAL_TYPE:
+      LOG(FATAL) << "Invalid eval type." << std::endl;
+    case RMS_ERROR: {
+      // Inverts FlipAndSquash.
+      if (fitness_threshold >= kMaxFitness) return 0.0;
+      const double rms_error =
+          std::tan((1.0 - fitness_threshold) / -kMinusTwoOverPi);
+      return num_valid_steps * rms_error * rms_error;
+    }
+    case ACCURACY:
+      return num_valid_steps * (1.0 - fitness_threshold);
+  }
+}
+
+template <FeatureIndexT F>
+inline bool Executor<F>::CannotExceed(
+    const double fitness_threshold, const double stop_loss, const double loss,
+    const double loss_squares, const IntegerT num_done,
+    const IntegerT num_steps, double* fitness_bound) const {
+  if (std::isinf(stop_loss)) return false;
+  double min_loss = loss;
+  if (validation_bound_.num_stdevs > 0.0 &&
+      num_done >= kMinStatisticalBoundValidSteps) {
+    // Assumes the remaining examples are drawn like the ones so far. The
+    // spread of their total loss adds the uncertainty of the mean so far.
+    const double num_remaining = static_cast<double>(num_steps - num_done);
+    const double mean = loss / static_cast<double>(num_done);
+    const double variance =
+        std::max(0.0, loss_squares / static_cast<double>(num_done) -
+                      mean * mean);
+    const double stdev = std::sqrt(
+        variance * (num_remaining +
+                    num_remaining * num_remaining /
+                    static_cast<double>(num_done)));
+    min_loss += std::max(
+        0.0, num_remaining * mean - validation_bound_.num_stdevs * stdev);
+  }
+  if (min_loss < stop_loss) return false;
+  // Guards against the rounding in StopLoss.
+  *fitness_bound = LossToFitness(min_loss);
+  return *fitness_bound <= fitness_threshold;
+}
+
+template <FeatureIndexT F>
+inline bool Executor<F>::AccumulateLoss(
+    const Scalar prediction, const Scalar& label, double* loss,
+    std::vector<double>* errors) {
+  double error = 0.0;
+  switch (dataset_.eval_type_) {
+    case RMS_ERROR: {
+      SquashedRmseLossAccumulator<F>::Accumulate(prediction, label, &error,
+                                                 loss);
+      break;
+    }
+    case ACCURACY: {
+      ProbAccuracyLossAccumulator<F>::Accumulate(prediction, label, &error,
+                                                 loss);
+      break;
+    }
+    case INVALID_EVAL_TYPE:
+      LOG(FATAL) << "Invalid eval type." << std::endl;
+    // Do not add default case here. All enum values should be supported.
+  }
+
+  const double abs_error = std::abs(error);
+  if (isnan(abs_error) || abs_error > max_abs_error_) {
+    return false;
+  }
+  if (errors != nullptr) {
+    errors->push_back(abs_error);
+  }
+  return true;
+}
+
 template <FeatureIndexT F>
 void Executor<F>::GetMemory(Memory<F>* memory) {
   memory->scalar_ = memory_.scalar_;
@@ -1328,10 +2417,121 @@ void Executor<F>::GetMemory(Memory<F>* memory) {
   memory->matrix_ = memory_.matrix_;
 }
 
+template <FeatureIndexT F>
+inline void Executor<F>::RunPredict(const Vector<F>& features) {
+  switch (prediction_dependence_) {
+    case kVariablePredictions:
+      RunPredictComponentFunction(features);
+      return;
+    case kConstantPredictions:
+      memory_.scalar_[kPredictionsScalarAddress] = constant_prediction_;
+      return;
+    case kUnwrittenPredictions:
+      return;
+    // Do not add default case here. All enum values should be supported.
+  }
+}
+
+template <FeatureIndexT F>
+inline IntegerT Executor<F>::FindFatalNan(const IntegerT max_examples) const {
+  IntegerT fewest_examples = 0;
+  for (const FatalNanAddress& fatal : fatal_nan_addresses_) {
+    if (fatal.num_examples > max_examples ||
+        (fewest_examples > 0 && fatal.num_examples >= fewest_examples)) {
+      continue;
+    }
+    bool is_nan = false;
+    switch (fatal.type) {
+      case kScalarOperand:
+        is_nan = isnan(memory_.scalar_[fatal.address]);
+        break;
+      case kVectorOperand:
+        is_nan = memory_.vector_[fatal.address].hasNaN();
+        break;
+      case kMatrixOperand:
+        is_nan = memory_.matrix_[fatal.address].hasNaN();
+        break;
+      case kNoOperand:
+        break;
+    }
+    if (is_nan) fewest_examples = fatal.num_examples;
+  }
+  return fewest_examples;
+}
+
+template <FeatureIndexT F>
+inline void Executor<F>::RunPredictComponentFunction(
+    const Vector<F>& features) {
+  if (jit_predict_ != nullptr) {
+#ifdef EXECUTOR_PROFILING
+    const uint64_t start_cycles = ReadCycleCounter();
+    jit_predict_->Run(&memory_, features.data(), 0.0);
+    ThreadExecutorProfile()->Counters(ThreadExecutionPhase(), F)[
+        kJitProfiledOp].Record(ReadCycleCounter() - start_cycles);
+#else
+    jit_predict_->Run(&memory_, features.data(), 0.0);
+#endif
+  } else {
+    memory_.vector_[kFeaturesVectorAddress] = features;
+    ZeroLabelAssigner<F>::Assign(&memory_);
+    ExecuteDecoded(predict_, rand_gen_, &memory_);
+  }
+}
+
+template <FeatureIndexT F>
+inline void Executor<F>::RunLearn(
+    const Vector<F>& features, const Scalar& label) {
+  if (jit_learn_ != nullptr) {
+#ifdef EXECUTOR_PROFILING
+    const uint64_t start_cycles = ReadCycleCounter();
+    jit_learn_->Run(&memory_, features.data(), label);
+    ThreadExecutorProfile()->Counters(ThreadExecutionPhase(), F)[
+        kJitProfiledOp].Record(ReadCycleCounter() - start_cycles);
+#else
+    jit_learn_->Run(&memory_, features.data(), label);
+#endif
+  } else {
+    memory_.vector_[kFeaturesVectorAddress] = features;
+    LabelAssigner<F>::Assign(label, &memory_);
+    ExecuteDecoded(learn_, rand_gen_, &memory_);
+  }
+}
+
+template <FeatureIndexT F>
+inline void Executor<F>::AssignBatchFeatures(
+    const std::vector<const Vector<F>*>& batch_features) {
+  Matrix<F>& matrix = memory_.matrix_[kBatchFeaturesMatrixAddress];
+  for (IntegerT i = 0; i < batch_features.size(); ++i) {
+    matrix.row(i) = batch_features[i]->transpose();
+  }
+  for (IntegerT i = batch_features.size(); i < F; ++i) {
+    matrix.row(i).setZero();
+  }
+}
+
+template <FeatureIndexT F>
+inline void Executor<F>::RunBatchPredict(
+    const std::vector<const Vector<F>*>& batch_features) {
+  AssignBatchFeatures(batch_features);
+  memory_.vector_[kLabelsVectorAddress].setZero();
+  ExecuteDecoded(predict_, rand_gen_, &memory_);
+}
+
+template <FeatureIndexT F>
+inline void Executor<F>::RunBatchLearn(
+    const std::vector<const Vector<F>*>& batch_features,
+    const Vector<F>& batch_labels) {
+  AssignBatchFeatures(batch_features);
+  memory_.vector_[kLabelsVectorAddress] = batch_labels;
+  ExecuteDecoded(learn_, rand_gen_, &memory_);
+}
+
 template <FeatureIndexT F>
 void ExecuteAndFillLabels(const Algorithm& algorithm, Memory<F>* memory,
                           TaskBuffer<F>* buffer,
                           RandomGenerator* rand_gen) {
+  const DecodedComponentFunction predict(algorithm.predict_);
+
   // Fill training labels.
   typename std::vector<Scalar>::iterator train_label_it =
       buffer->train_labels_.begin();
@@ -1339,10 +2539,7 @@ void ExecuteAndFillLabels(const Algorithm& algorithm, Memory<F>* memory,
     // Run predict component function for this example.
     memory->vector_[kFeaturesVectorAddress] = train_features;
     ZeroLabelAssigner<F>::Assign(memory);
-    for (const std::shared_ptr<const Instruction>& instruction :
-         algorithm.predict_) {
-      ExecuteInstruction(*instruction, rand_gen, memory);
-    }
+    ExecuteDecoded(predict, rand_gen, memory);
     *train_label_it = PredictionGetter<F>::Get(memory);
     ++train_label_it;
   }
@@ -1354,17 +2551,12 @@ void ExecuteAndFillLabels(const Algorithm& algorithm, Memory<F>* memory,
     // Run predict component function for this example.
     memory->vector_[kFeaturesVectorAddress] = valid_features;
     ZeroLabelAssigner<F>::Assign(memory);
-    for (const std::shared_ptr<const Instruction>& instruction :
-         algorithm.predict_) {
-      ExecuteInstruction(*instruction, rand_gen, memory);
-    }
+    ExecuteDecoded(predict, rand_gen, memory);
     *valid_label_it = PredictionGetter<F>::Get(memory);
     ++valid_label_it;
   }
 }
 
-constexpr double kMinusTwoOverPi = -0.63661977236758138243;
-
 inline double FlipAndSquash(const double value) {
   if (isnan(value) || isinf(value)) {
     return 0.0;
@@ -0,0 +1,227 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "executor_profile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+
+#include "absl/time/clock.h"
+
+namespace automl_zero {
+
+using ::std::endl;  // NOLINT
+using ::std::function;  // NOLINT
+using ::std::lock_guard;  // NOLINT
+using ::std::memory_order_relaxed;  // NOLINT
+using ::std::mutex;  // NOLINT
+using ::std::ostream;  // NOLINT
+using ::std::setw;  // NOLINT
+using ::std::string;  // NOLINT
+using ::std::unique_ptr;  // NOLINT
+using ::std::vector;  // NOLINT
+
+namespace {
+
+// The profiles of all the threads, which live until the end of the process.
+struct ProfileRegistry {
+  mutex lock;
+  vector<unique_ptr<ExecutorProfile>> profiles;
+};
+
+ProfileRegistry* GetProfileRegistry() {
+  static ProfileRegistry* const registry = new ProfileRegistry();
+  return registry;
+}
+
+ExecutionPhase* MutableThreadExecutionPhase() {
+  thread_local ExecutionPhase phase = kOtherPhase;
+  return &phase;
+}
+
+struct HistogramFile {
+  mutex lock;
+  string path;
+  IntegerT period_secs = 0;
+  IntegerT last_write_secs = 0;
+};
+
+HistogramFile* GetHistogramFile() {
+  static HistogramFile* const histogram_file = new HistogramFile();
+  return histogram_file;
+}
+
+IntegerT CurrentSecs() {
+  return absl::GetCurrentTimeNanos() / 1000000000;
+}
+
+}  // namespace
+
+const char* ExecutionPhaseName(const ExecutionPhase phase) {
+  switch (phase) {
+    case kSetupPhase:
+      return "setup";
+    case kTrainPredictPhase:
+      return "train_predict";
+    case kTrainLearnPhase:
+      return "train_learn";
+    case kValidPredictPhase:
+      return "valid_predict";
+    case kOtherPhase:
+      return "other";
+    case kNumExecutionPhases:
+      break;
+    // Do not add default case here. All enum values should be supported.
+  }
+  LOG(FATAL) << "Invalid phase." << endl;
+}
+
+ExecutorProfile::ExecutorProfile()
+    : counters_(kNumExecutionPhases * kNumFeaturesSizeSlots *
+                kNumProfiledOps) {}
+
+void ExecutorProfile::Add(const ExecutorProfile& other) {
+  for (IntegerT i = 0; i < counters_.size(); ++i) {
+    counters_[i].count.store(
+        counters_[i].count.load(memory_order_relaxed) +
+            other.counters_[i].count.load(memory_order_relaxed),
+        memory_order_relaxed);
+    counters_[i].total_cycles.store(
+        counters_[i].total_cycles.load(memory_order_relaxed) +
+            other.counters_[i].total_cycles.load(memory_order_relaxed),
+        memory_order_relaxed);
+  }
+}
+
+vector<OpProfileEntry> ExecutorProfile::Entries() const {
+  vector<OpProfileEntry> entries;
+  IntegerT i = 0;
+  for (IntegerT phase = 0; phase < kNumExecutionPhases; ++phase) {
+    for (IntegerT slot = 0; slot < kNumFeaturesSizeSlots; ++slot) {
+      for (IntegerT op = 0; op < kNumProfiledOps; ++op, ++i) {
+        const uint64_t count = counters_[i].count.load(memory_order_relaxed);
+        if (count == 0) continue;
+        OpProfileEntry entry;
+        entry.phase = static_cast<ExecutionPhase>(phase);
+        entry.features_size = FeatureIndexT{1} << slot;
+        entry.op = op;
+        entry.count = count;
+        entry.total_cycles =
+            counters_[i].total_cycles.load(memory_order_relaxed);
+        entries.push_back(entry);
+      }
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const OpProfileEntry& a, const OpProfileEntry& b) {
+                     return a.total_cycles > b.total_cycles;
+                   });
+  return entries;
+}
+
+ExecutorProfile* ThreadExecutorProfile() {
+  thread_local ExecutorProfile* profile = nullptr;
+  if (profile == nullptr) {
+    ProfileRegistry* registry = GetProfileRegistry();
+    lock_guard<mutex> guard(registry->lock);
+    registry->profiles.emplace_back(new ExecutorProfile());
+    profile = registry->profiles.back().get();
+  }
+  return profile;
+}
+
+void MergeExecutorProfiles(ExecutorProfile* merged) {
+  ProfileRegistry* registry = GetProfileRegistry();
+  lock_guard<mutex> guard(registry->lock);
+  for (const unique_ptr<ExecutorProfile>& profile : registry->profiles) {
+    merged->Add(*profile);
+  }
+}
+
+ExecutionPhase ThreadExecutionPhase() {
+  return *MutableThreadExecutionPhase();
+}
+
+#ifdef EXECUTOR_PROFILING
+ScopedExecutionPhase::ScopedExecutionPhase(const ExecutionPhase phase)
+    : previous_phase_(*MutableThreadExecutionPhase()) {
+  *MutableThreadExecutionPhase() = phase;
+}
+
+ScopedExecutionPhase::~ScopedExecutionPhase() {
+  *MutableThreadExecutionPhase() = previous_phase_;
+}
+#endif
+
+void PrintExecutorProfile(
+    const ExecutorProfile& profile, const function<string(IntegerT)>& op_name,
+    ostream* stream) {
+  const vector<OpProfileEntry> entries = profile.Entries();
+  double all_cycles = 0.0;
+  for (const OpProfileEntry& entry : entries) {
+    all_cycles += entry.total_cycles;
+  }
+  *stream << std::left << setw(14) << "phase" << std::right << setw(4) << "F"
+          << "  " << std::left << setw(34) << "op" << std::right
+          << setw(14) << "count" << setw(18) << "cycles"
+          << setw(12) << "cycles/op" << setw(8) << "%" << endl;
+  for (const OpProfileEntry& entry : entries) {
+    *stream << std::left << setw(14) << ExecutionPhaseName(entry.phase)
+            << std::right << setw(4) << entry.features_size << "  "
+            << std::left << setw(34) << op_name(entry.op) << std::right
+            << setw(14) << entry.count << setw(18) << entry.total_cycles
+            << setw(12) << std::fixed << std::setprecision(1)
+            << static_cast<double>(entry.total_cycles) / entry.count
+            << setw(8) << std::setprecision(2)
+            << 100.0 * entry.total_cycles / all_cycles << endl;
+  }
+}
+
+void SetExecutorProfileHistogramFile(
+    const string& path, const IntegerT period_secs) {
+  HistogramFile* histogram_file = GetHistogramFile();
+  lock_guard<mutex> guard(histogram_file->lock);
+  histogram_file->path = path;
+  histogram_file->period_secs = period_secs;
+  histogram_file->last_write_secs = CurrentSecs();
+}
+
+void MaybeWriteExecutorProfileHistogram(
+    const function<string(IntegerT)>& op_name) {
+  HistogramFile* histogram_file = GetHistogramFile();
+  lock_guard<mutex> guard(histogram_file->lock);
+  if (histogram_file->path.empty()) return;
+  const IntegerT now_secs = CurrentSecs();
+  if (now_secs <
+      histogram_file->last_write_secs + histogram_file->period_secs) {
+    return;
+  }
+  histogram_file->last_write_secs = now_secs;
+  ExecutorProfile profile;
+  MergeExecutorProfiles(&profile);
+  std::ofstream file(histogram_file->path, std::ios::app);
+  CHECK(file.good()) << "Cannot open " << histogram_file->path << endl;
+  // One line per op, all with the same timestamp, so that consecutive writes
+  // give the evolution of each op over time.
+  for (const OpProfileEntry& entry : profile.Entries()) {
+    file << now_secs << "\t" << ExecutionPhaseName(entry.phase) << "\t"
+         << entry.features_size << "\t" << op_name(entry.op) << "\t"
+         << entry.count << "\t" << entry.total_cycles << "\n";
+  }
+}
+
+}  // namespace automl_zero
@@ -0,0 +1,189 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-op execution counters for the Executor. Building with
+// --copt=-DEXECUTOR_PROFILING makes the Executor count the invocations and the
+// CPU cycles of every op it interprets. Without it, the Executor contains no
+// instrumentation at all and these counters stay empty.
+
+#ifndef AUTOML_ZERO_EXECUTOR_PROFILE_H_
+#define AUTOML_ZERO_EXECUTOR_PROFILE_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "definitions.h"
+
+namespace automl_zero {
+
+#ifdef EXECUTOR_PROFILING
+constexpr bool kExecutorProfiling = true;
+#else
+constexpr bool kExecutorProfiling = false;
+#endif
+
+// Which part of an evaluation an instruction runs in.
+enum ExecutionPhase : IntegerT {
+  kSetupPhase = 0,
+  kTrainPredictPhase = 1,
+  kTrainLearnPhase = 2,
+  kValidPredictPhase = 3,
+  // Instructions run outside an Executor, e.g. to generate labels.
+  kOtherPhase = 4,
+  kNumExecutionPhases = 5
+};
+
+// Returns a short name for the phase, e.g. "train_learn".
+const char* ExecutionPhaseName(ExecutionPhase phase);
+
+// The op codes that can be profiled are below this. Covers the decoded op
+// codes of the Executor (see DecodedOpT).
+constexpr IntegerT kNumProfiledOps = 128;
+// The pseudo-op that counts whole calls to JIT-compiled component functions,
+// whose ops cannot be told apart.
+constexpr IntegerT kJitProfiledOp = kNumProfiledOps - 1;
+
+// The counters of one op. Only the owning thread writes them, so they are
+// updated without read-modify-write instructions. They are atomic so that
+// other threads can read them while they change.
+struct OpCounter {
+  inline void Record(const uint64_t cycles) {
+    count.store(count.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    total_cycles.store(
+        total_cycles.load(std::memory_order_relaxed) + cycles,
+        std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> total_cycles{0};
+};
+
+// One row of an ExecutorProfile.
+struct OpProfileEntry {
+  ExecutionPhase phase;
+  FeatureIndexT features_size;
+  IntegerT op;
+  uint64_t count;
+  uint64_t total_cycles;
+};
+
+// The op counters of one thread, or the sum of those of several threads.
+class ExecutorProfile {
+ public:
+  ExecutorProfile();
+  ExecutorProfile(const ExecutorProfile& other) = delete;
+  ExecutorProfile& operator=(const ExecutorProfile& other) = delete;
+
+  // Returns the counters of all the ops for the given phase and features size,
+  // indexed by op code.
+  inline OpCounter* Counters(
+      const ExecutionPhase phase, const FeatureIndexT features_size) {
+    return &counters_[(phase * kNumFeaturesSizeSlots +
+                       FeaturesSizeSlot(features_size)) * kNumProfiledOps];
+  }
+
+  // Adds the counters of another profile to these ones.
+  void Add(const ExecutorProfile& other);
+
+  // Returns the ops that ran at least once, by decreasing total cycles.
+  std::vector<OpProfileEntry> Entries() const;
+
+ private:
+  // Features sizes are counted separately for each power of two up to 128.
+  // Other sizes share the counters of the next power of two.
+  static constexpr IntegerT kNumFeaturesSizeSlots = 8;
+  static inline IntegerT FeaturesSizeSlot(FeatureIndexT features_size) {
+    IntegerT slot = 0;
+    while ((FeatureIndexT{1} << slot) < features_size &&
+           slot + 1 < kNumFeaturesSizeSlots) {
+      ++slot;
+    }
+    return slot;
+  }
+
+  std::vector<OpCounter> counters_;
+};
+
+// Returns the profile of the calling thread. Each thread has its own, so that
+// recording never contends. MergeExecutorProfiles adds them up.
+ExecutorProfile* ThreadExecutorProfile();
+
+// Adds the profiles of all the threads that recorded so far, including threads
+// that have exited, to *merged.
+void MergeExecutorProfiles(ExecutorProfile* merged);
+
+// The phase the Executor of the calling thread is in.
+ExecutionPhase ThreadExecutionPhase();
+
+// Sets the phase of the calling thread for the lifetime of this object. Does
+// nothing unless profiling.
+class ScopedExecutionPhase {
+ public:
+#ifdef EXECUTOR_PROFILING
+  explicit ScopedExecutionPhase(ExecutionPhase phase);
+  ~ScopedExecutionPhase();
+#else
+  explicit ScopedExecutionPhase(ExecutionPhase phase) {}
+#endif
+  ScopedExecutionPhase(const ScopedExecutionPhase& other) = delete;
+  ScopedExecutionPhase& operator=(const ScopedExecutionPhase& other) = delete;
+
+ private:
+#ifdef EXECUTOR_PROFILING
+  const ExecutionPhase previous_phase_;
+#endif
+};
+
+// Returns a timestamp in CPU cycles, or in nanoseconds on platforms without a
+// cycle counter.
+inline uint64_t ReadCycleCounter() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Prints one line per op that ran, by decreasing total cycles, with its share
+// of all the cycles. op_name maps op codes to names.
+void PrintExecutorProfile(
+    const ExecutorProfile& profile,
+    const std::function<std::string(IntegerT)>& op_name,
+    std::ostream* stream);
+
+// Makes MaybeWriteExecutorProfileHistogram append the merged profile of all
+// threads to the given file at most once every period_secs.
+void SetExecutorProfileHistogramFile(
+    const std::string& path, IntegerT period_secs);
+
+// Appends the merged profile to the file set with
+// SetExecutorProfileHistogramFile, as tab-separated lines, if the period has
+// elapsed since the last time. Thread-safe.
+void MaybeWriteExecutorProfileHistogram(
+    const std::function<std::string(IntegerT)>& op_name);
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_EXECUTOR_PROFILE_H_
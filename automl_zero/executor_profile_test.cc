@@ -0,0 +1,125 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "executor_profile.h"
+
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "definitions.h"
+#include "gtest/gtest.h"
+
+namespace automl_zero {
+
+using ::std::string;  // NOLINT
+using ::std::vector;  // NOLINT
+
+string TestOpName(const IntegerT op) {
+  return "OP_" + std::to_string(op);
+}
+
+TEST(ExecutorProfileTest, StartsEmpty) {
+  ExecutorProfile profile;
+  EXPECT_TRUE(profile.Entries().empty());
+}
+
+TEST(ExecutorProfileTest, CountsByPhaseFeaturesSizeAndOp) {
+  ExecutorProfile profile;
+  profile.Counters(kTrainLearnPhase, 16)[3].Record(10);
+  profile.Counters(kTrainLearnPhase, 16)[3].Record(20);
+  profile.Counters(kValidPredictPhase, 4)[5].Record(100);
+  const vector<OpProfileEntry> entries = profile.Entries();
+  ASSERT_EQ(entries.size(), 2);
+  // By decreasing total cycles.
+  EXPECT_EQ(entries[0].phase, kValidPredictPhase);
+  EXPECT_EQ(entries[0].features_size, 4);
+  EXPECT_EQ(entries[0].op, 5);
+  EXPECT_EQ(entries[0].count, 1);
+  EXPECT_EQ(entries[0].total_cycles, 100);
+  EXPECT_EQ(entries[1].phase, kTrainLearnPhase);
+  EXPECT_EQ(entries[1].features_size, 16);
+  EXPECT_EQ(entries[1].op, 3);
+  EXPECT_EQ(entries[1].count, 2);
+  EXPECT_EQ(entries[1].total_cycles, 30);
+}
+
+TEST(ExecutorProfileTest, OtherFeaturesSizesShareTheNextPowerOfTwo) {
+  ExecutorProfile profile;
+  EXPECT_EQ(profile.Counters(kSetupPhase, 10),
+            profile.Counters(kSetupPhase, 16));
+  EXPECT_NE(profile.Counters(kSetupPhase, 8),
+            profile.Counters(kSetupPhase, 16));
+}
+
+TEST(ExecutorProfileTest, AddsProfiles) {
+  ExecutorProfile profile1;
+  profile1.Counters(kSetupPhase, 8)[1].Record(7);
+  ExecutorProfile profile2;
+  profile2.Counters(kSetupPhase, 8)[1].Record(5);
+  profile2.Counters(kSetupPhase, 8)[2].Record(1);
+  profile1.Add(profile2);
+  const vector<OpProfileEntry> entries = profile1.Entries();
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries[0].op, 1);
+  EXPECT_EQ(entries[0].count, 2);
+  EXPECT_EQ(entries[0].total_cycles, 12);
+  EXPECT_EQ(entries[1].op, 2);
+}
+
+TEST(ExecutorProfileTest, MergesAllThreads) {
+  ExecutorProfile before;
+  MergeExecutorProfiles(&before);
+  std::thread thread1([]() {
+    ThreadExecutorProfile()->Counters(kOtherPhase, 2)[9].Record(1);
+  });
+  std::thread thread2([]() {
+    ThreadExecutorProfile()->Counters(kOtherPhase, 2)[9].Record(1);
+  });
+  thread1.join();
+  thread2.join();
+  ExecutorProfile after;
+  MergeExecutorProfiles(&after);
+  EXPECT_EQ(after.Counters(kOtherPhase, 2)[9].count.load() -
+                before.Counters(kOtherPhase, 2)[9].count.load(),
+            2);
+}
+
+TEST(ExecutorProfileTest, ScopedPhaseIsRestored) {
+  const ExecutionPhase outer_phase = ThreadExecutionPhase();
+  {
+    ScopedExecutionPhase phase(kTrainPredictPhase);
+    if (kExecutorProfiling) {
+      EXPECT_EQ(ThreadExecutionPhase(), kTrainPredictPhase);
+    }
+  }
+  EXPECT_EQ(ThreadExecutionPhase(), outer_phase);
+}
+
+TEST(ExecutorProfileTest, PrintsOneLinePerOp) {
+  ExecutorProfile profile;
+  profile.Counters(kTrainPredictPhase, 32)[43].Record(300);
+  profile.Counters(kTrainLearnPhase, 32)[28].Record(100);
+  std::ostringstream stream;
+  PrintExecutorProfile(profile, TestOpName, &stream);
+  const string output = stream.str();
+  EXPECT_NE(output.find("train_predict"), string::npos);
+  EXPECT_NE(output.find("OP_43"), string::npos);
+  EXPECT_NE(output.find("75.00"), string::npos);
+  EXPECT_NE(output.find("OP_28"), string::npos);
+  EXPECT_NE(output.find("25.00"), string::npos);
+}
+
+}  // namespace automl_zero
@@ -25,11 +25,13 @@
 #include "definitions.h"
 #include "instruction.pb.h"
 #include "algorithm.h"
+#include "dataflow.h"
 #include "generator.h"
 #include "generator_test_util.h"
 #include "instruction.h"
 #include "memory.h"
 #include "random_generator.h"
+#include "test_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/strings/str_cat.h"
@@ -55,12 +57,12 @@ constexpr double kMaxAbsError = 100.0;
 constexpr double kLargeMaxAbsError = 1000000000.0;
 
 bool VectorEq(const Vector<4>& vector1,
-              const vector<double>& vector2) {
+              const vector<Scalar>& vector2) {
   Eigen::Map<const Vector<4>> vector2_eigen(vector2.data());
   return vector1.isApprox(vector2_eigen);
 }
 bool VectorEq(const Vector<16>& vector1,
-              const vector<double>& vector2) {
+              const vector<Scalar>& vector2) {
   Eigen::Map<const Vector<16>> vector2_eigen(vector2.data());
   return vector1.isApprox(vector2_eigen);
 }
@@ -162,6 +164,122 @@ TEST(ExecutorTest, ComputesLossCorrectly) {
   EXPECT_FLOAT_EQ(fitness, FlipAndSquash(0.1));
 }
 
+TEST(ExecutorTest, FitnessIsCloseToDoublePrecisionFitness) {
+  const Task<4> dataset = GenerateTask<4>(StrCat(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: ", kNumTrainExamples, " "
+      "num_valid_examples: ", kNumValidExamples, " "
+      "num_train_epochs: 1 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 1000 "
+      "data_seeds: 10000 "));
+  Generator generator;
+  const Algorithm algorithm = generator.LinearModel(kDefaultLearningRate);
+  RandomGenerator rand_gen;
+  Executor<4> executor(algorithm, dataset, kNumTrainExamples,
+                       kNumValidExamples, &rand_gen, kMaxAbsError);
+  const double fitness = executor.Execute();
+
+  // Train and validate the same linear model in double precision.
+  Eigen::Matrix<double, 4, 1> weights = Eigen::Matrix<double, 4, 1>::Zero();
+  TaskIterator<4> train_it = dataset.TrainIterator();
+  for (IntegerT step = 0; step < kNumTrainExamples; ++step) {
+    const Eigen::Matrix<double, 4, 1> features =
+        train_it.GetFeatures().cast<double>();
+    const double error = train_it.GetLabel() - weights.dot(features);
+    weights += kDefaultLearningRate * error * features;
+    train_it.Next();
+  }
+  double loss = 0.0;
+  TaskIterator<4> valid_it = dataset.ValidIterator();
+  for (IntegerT step = 0; step < kNumValidExamples; ++step) {
+    const double error = valid_it.GetLabel() -
+                         weights.dot(valid_it.GetFeatures().cast<double>());
+    loss += error * error;
+    valid_it.Next();
+  }
+  const double expected_fitness =
+      FlipAndSquash(sqrt(loss / static_cast<double>(kNumValidExamples)));
+
+  // Only the rounding of the memory differs.
+  std::cout << "Fitness delta from double precision = "
+            << fitness - expected_fitness << std::endl;
+  EXPECT_NEAR(fitness, expected_fitness, kPrecisionFitnessTolerance);
+}
+
+TEST(ExecutorTest, MiniBatchTrainingMatchesReference) {
+  constexpr IntegerT kBatchSize = 4;
+  constexpr IntegerT kNumEpochExamples = 10;
+  constexpr IntegerT kNumEpochs = 2;
+  const Task<4> dataset = GenerateTask<4>(StrCat(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: ", kNumEpochExamples, " "
+      "num_valid_examples: ", kNumEpochExamples, " "
+      "num_train_epochs: ", kNumEpochs, " "
+      "batch_size: ", kBatchSize, " "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 1000 "
+      "data_seeds: 10000 "));
+  Generator generator;
+  const Algorithm algorithm =
+      generator.MiniBatchLinearModel(kDefaultLearningRate);
+  RandomGenerator rand_gen;
+  Executor<4> executor(algorithm, dataset, kNumEpochExamples * kNumEpochs,
+                       kNumEpochExamples, &rand_gen, kMaxAbsError,
+                       true,  // use_jit
+                       true,  // wipe_used_memory_only
+                       true);  // short_circuit_constant_predictions
+  vector<double> train_errors;
+  vector<double> valid_errors;
+  executor.Execute(&train_errors, &valid_errors);
+
+  // The mini-batches do not span epochs, so the last one of each is shorter.
+  Vector<4> weights = Vector<4>::Zero();
+  vector<double> expected_train_errors;
+  TaskIterator<4> train_it = dataset.TrainIterator();
+  for (IntegerT epoch = 0; epoch < kNumEpochs; ++epoch) {
+    for (IntegerT begin = 0; begin < kNumEpochExamples; begin += kBatchSize) {
+      Vector<4> correction = Vector<4>::Zero();
+      for (IntegerT i = begin;
+           i < std::min(begin + kBatchSize, kNumEpochExamples); ++i) {
+        const Vector<4>& features = train_it.GetFeatures();
+        const Scalar error = train_it.GetLabel() - weights.dot(features);
+        if (epoch == 0) expected_train_errors.push_back(abs(error));
+        correction += error * features;
+        train_it.Next();
+      }
+      weights += kDefaultLearningRate * correction;
+    }
+  }
+  EXPECT_TRUE(executor.MemoryRef()
+                  .vector_[Generator::kMiniBatchLinearModelWeightsAddress]
+                  .isApprox(weights));
+  ASSERT_EQ(train_errors.size(), kNumEpochExamples);
+  for (IntegerT i = 0; i < kNumEpochExamples; ++i) {
+    EXPECT_NEAR(train_errors[i], expected_train_errors[i], kTestTolerance);
+  }
+  EXPECT_EQ(valid_errors.size(), kNumEpochExamples);
+  EXPECT_EQ(executor.GetNumTrainStepsCompleted(),
+            kNumEpochExamples * kNumEpochs);
+}
+
+TEST(ExecutorTest, MiniBatchPredictDoesNotSeeLabels) {
+  const Task<4> dataset = GenerateTask<4>(StrCat(
+      "unit_test_ones_task {} "
+      "num_train_examples: ", kNumTrainExamples, " "
+      "num_valid_examples: ", kNumValidExamples, " "
+      "batch_size: 3 "
+      "eval_type: RMS_ERROR "));
+  // Predicts the labels, if it can see them. Vector 3 stays zero.
+  Algorithm algorithm = SimpleNoOpAlgorithm();
+  algorithm.predict_[0] = make_shared<const Instruction>(
+      VECTOR_SUM_OP, kLabelsVectorAddress, 3, kPredictionsVectorAddress);
+  RandomGenerator rand_gen;
+  Executor<4> executor(algorithm, dataset, kNumTrainExamples,
+                       kNumValidExamples, &rand_gen, kLargeMaxAbsError);
+  EXPECT_FLOAT_EQ(executor.Execute(), FlipAndSquash(1.0));
+}
+
 TEST(ExecutorTest, ProbAccuracyComputesLossCorrectly) {
   auto dataset =
       GenerateTask<4>(StrCat("unit_test_ones_task {} "
@@ -836,7 +954,7 @@ TEST(ExecutorTest, DoesNotStopsEarlyIfEverythingIsFine) {
   EXPECT_FLOAT_EQ(fitness, FlipAndSquash(0.0));
 }
 
-TEST(ExecutorTest, TrainOptimizationsAreCorrect) {
+TEST(ExecutorTest, DecodedTrainingMatchesInstructionByInstruction) {
   Task<4> dataset =
       GenerateTask<4>(StrCat("scalar_2layer_nn_regression_task {} "
                                 "num_train_examples: ",
@@ -853,28 +971,722 @@ TEST(ExecutorTest, TrainOptimizationsAreCorrect) {
                                 kFirstDataSeedForTest));
   RandomGenerator rand_gen;
   Algorithm algorithm = SimpleGz();
-  double fitness_no_opt;
-  { // Without optimization.
-    Executor<4> executor(
-        algorithm, dataset, kNumTrainExamples, kNumValidExamples,
-        &rand_gen, kLargeMaxAbsError);
-    // Iterators that tracks the progresss of training.
-    TaskIterator<4> train_it = executor.dataset_.TrainIterator();
-    EXPECT_TRUE(executor.TrainNoOptImpl(kNumTrainExamples, nullptr, &train_it));
-    fitness_no_opt = executor.Validate(nullptr);
+  Memory<4> reference_memory;
+  { // Instruction by instruction.
+    reference_memory.Wipe();
+    for (const std::shared_ptr<const Instruction>& instruction :
+         algorithm.setup_) {
+      ExecuteInstruction(*instruction, &rand_gen, &reference_memory);
+    }
+    TaskIterator<4> train_it = dataset.TrainIterator();
+    for (IntegerT step = 0; step < kNumTrainExamples; ++step) {
+      reference_memory.vector_[kFeaturesVectorAddress] =
+          train_it.GetFeatures();
+      reference_memory.scalar_[kLabelsScalarAddress] = 0.0;
+      for (const std::shared_ptr<const Instruction>& instruction :
+           algorithm.predict_) {
+        ExecuteInstruction(*instruction, &rand_gen, &reference_memory);
+      }
+      reference_memory.vector_[kFeaturesVectorAddress] =
+          train_it.GetFeatures();
+      reference_memory.scalar_[kLabelsScalarAddress] = train_it.GetLabel();
+      for (const std::shared_ptr<const Instruction>& instruction :
+           algorithm.learn_) {
+        ExecuteInstruction(*instruction, &rand_gen, &reference_memory);
+      }
+      train_it.Next();
+    }
   }
-  double fitness_opt;
-  { // With optimization.
+  Memory<4> decoded_memory;
+  { // Decoded.
     Executor<4> executor(
         algorithm, dataset, kNumTrainExamples, kNumValidExamples,
         &rand_gen, kLargeMaxAbsError);
-    // Iterators that tracks the progresss of training.
     TaskIterator<4> train_it = executor.dataset_.TrainIterator();
-    EXPECT_TRUE(
-        executor.TrainOptImpl<10>(kNumTrainExamples, nullptr, &train_it));
-    fitness_opt = executor.Validate(nullptr);
+    EXPECT_TRUE(executor.Train(kNumTrainExamples, nullptr, &train_it));
+    executor.GetMemory(&decoded_memory);
+  }
+  for (AddressT address = 0; address < kMaxScalarAddresses; ++address) {
+    EXPECT_DOUBLE_EQ(decoded_memory.scalar_[address],
+                     reference_memory.scalar_[address]);
+  }
+  for (AddressT address = 0; address < kMaxVectorAddresses; ++address) {
+    EXPECT_TRUE(decoded_memory.vector_[address].isApprox(
+        reference_memory.vector_[address]));
   }
-  EXPECT_FLOAT_EQ(fitness_no_opt, fitness_opt);
+}
+
+TEST(ExecutorTest, DecodesLongComponentFunctions) {
+  auto dataset = GenerateTask<4>(StrCat("unit_test_ones_task {} "
+                                        "eval_type: RMS_ERROR "
+                                        "num_train_examples: 10 "
+                                        "num_valid_examples: 10 "
+                                        "num_tasks: 1 "
+                                        "features_size: 4 "));
+  // Longer than any of the sizes previously supported by the train loop.
+  constexpr IntegerT kNumInstructions = 2000;
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, kPredictionsScalarAddress,
+      ActivationDataSetter(0.0)));
+  for (IntegerT i = 0; i < kNumInstructions; ++i) {
+    algorithm.predict_.emplace_back(make_shared<const Instruction>(
+        SCALAR_SUM_OP, kPredictionsScalarAddress, 2,
+        kPredictionsScalarAddress));
+    algorithm.learn_.emplace_back(make_shared<const Instruction>(NO_OP, 0, 0));
+  }
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2, ActivationDataSetter(0.0005)));
+  RandomGenerator rand_gen;
+  Executor<4> executor(algorithm, dataset, 10, 10, &rand_gen,
+                       kLargeMaxAbsError);
+  executor.Execute();
+  EXPECT_NEAR(executor.MemoryRef().scalar_[kPredictionsScalarAddress],
+              1.0, kTestTolerance);
+}
+
+TEST(ExecutorTest, FusesFrequentInstructionSequences) {
+  vector<std::shared_ptr<const Instruction>> component_function;
+  // Axpy whose intermediate result is overwritten before being read.
+  component_function.emplace_back(
+      make_shared<const Instruction>(SCALAR_VECTOR_PRODUCT_OP, 2, 1, 3));
+  component_function.emplace_back(
+      make_shared<const Instruction>(VECTOR_SUM_OP, 2, 3, 2));
+  component_function.emplace_back(
+      make_shared<const Instruction>(SCALAR_BROADCAST_OP, 2, 3));
+  // Not fused: the sum does not read the product.
+  component_function.emplace_back(
+      make_shared<const Instruction>(SCALAR_VECTOR_PRODUCT_OP, 2, 1, 3));
+  component_function.emplace_back(
+      make_shared<const Instruction>(VECTOR_SUM_OP, 1, 2, 2));
+  // Rank-one update whose intermediate result survives.
+  component_function.emplace_back(
+      make_shared<const Instruction>(VECTOR_OUTER_PRODUCT_OP, 1, 2, 0));
+  component_function.emplace_back(
+      make_shared<const Instruction>(MATRIX_SUM_OP, 1, 0, 1));
+  // Scaled error.
+  component_function.emplace_back(
+      make_shared<const Instruction>(VECTOR_INNER_PRODUCT_OP, 1, 2, 3));
+  component_function.emplace_back(
+      make_shared<const Instruction>(SCALAR_DIFF_OP, 0, 3, 3));
+  component_function.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 2, 3, 3));
+  // Matrix-vector product followed by a step function.
+  component_function.emplace_back(
+      make_shared<const Instruction>(MATRIX_VECTOR_PRODUCT_OP, 1, 2, 3));
+  component_function.emplace_back(
+      make_shared<const Instruction>(VECTOR_HEAVYSIDE_OP, 3, 3));
+  // Product with a transpose that is overwritten before being read.
+  component_function.emplace_back(
+      make_shared<const Instruction>(MATRIX_TRANSPOSE_OP, 0, 2));
+  component_function.emplace_back(
+      make_shared<const Instruction>(MATRIX_VECTOR_PRODUCT_OP, 2, 1, 1));
+  component_function.emplace_back(
+      make_shared<const Instruction>(MATRIX_TRANSPOSE_OP, 1, 2));
+
+  const DecodedComponentFunction fused(component_function, true);
+  const DecodedInstruction* instructions = fused.begin();
+  EXPECT_EQ(fused.size(), component_function.size());
+  EXPECT_EQ(instructions[0].op_, kAxpyDeadTempDecodedOp);
+  EXPECT_EQ(instructions[2].op_, SCALAR_BROADCAST_OP);
+  EXPECT_EQ(instructions[3].op_, SCALAR_VECTOR_PRODUCT_OP);
+  EXPECT_EQ(instructions[4].op_, VECTOR_SUM_OP);
+  EXPECT_EQ(instructions[5].op_, kOuterProductSumDecodedOp);
+  EXPECT_EQ(instructions[7].op_, kInnerProductDiffProductDecodedOp);
+  EXPECT_EQ(instructions[10].op_, kMatVecHeavisideDeadTempDecodedOp);
+  EXPECT_EQ(instructions[12].op_, kTransposeMatVecDeadTempDecodedOp);
+  EXPECT_EQ(instructions[14].op_, MATRIX_TRANSPOSE_OP);
+
+  const DecodedComponentFunction unfused(component_function);
+  for (IntegerT i = 0; i < component_function.size(); ++i) {
+    EXPECT_EQ(unfused.begin()[i].op_, component_function[i]->op_);
+  }
+}
+
+// Returns an Algorithm that goes through every transcendental op to predict
+// and learns a scale for its prediction. With mini-batches, it predicts the
+// same for all the examples.
+Algorithm TranscendentalAlgorithm() {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2, ActivationDataSetter(0.5)));
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 3, ActivationDataSetter(0.01)));
+  const Op ops[] = {SCALAR_ARCTAN_OP, SCALAR_EXP_OP, SCALAR_LOG_OP,
+                    SCALAR_SIN_OP, SCALAR_ARCSIN_OP, SCALAR_COS_OP,
+                    SCALAR_ARCCOS_OP, SCALAR_TAN_OP};
+  // Reads the features of one example, or of a mini-batch.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_MEAN_OP, kFeaturesVectorAddress, 4));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      MATRIX_MEAN_OP, kBatchFeaturesMatrixAddress, 6));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 4, 6, 4));
+  for (const Op op : ops) {
+    algorithm.predict_.emplace_back(make_shared<const Instruction>(op, 4, 4));
+  }
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_PRODUCT_OP, 4, 2, kPredictionsScalarAddress));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_BROADCAST_OP, kPredictionsScalarAddress,
+      kPredictionsVectorAddress));
+  // s2 += s3 * (label - prediction) * s4.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_DIFF_OP, kLabelsScalarAddress, kPredictionsScalarAddress, 5));
+  algorithm.learn_.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 5, 3, 5));
+  algorithm.learn_.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 5, 4, 5));
+  algorithm.learn_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 2, 5, 2));
+  return algorithm;
+}
+
+TEST(ExecutorTest, FastMathFitnessIsCloseToLibmFitness) {
+  const Algorithm algorithm = TranscendentalAlgorithm();
+  for (const char* task_spec :
+       {"scalar_linear_regression_task {} eval_type: RMS_ERROR ",
+        "unit_test_increment_task {increment: 0.01} eval_type: ACCURACY "}) {
+    for (const IntegerT batch_size : {1, 4}) {
+      const Task<4> dataset = GenerateTask<4>(StrCat(
+          task_spec,
+          "num_train_examples: 100 "
+          "num_valid_examples: 100 "
+          "batch_size: ", batch_size, " "
+          "param_seeds: 100 "
+          "data_seeds: 1000 "));
+      RandomGenerator libm_rand_gen;
+      Executor<4> libm_executor(
+          algorithm, dataset, 100, 100, &libm_rand_gen, kLargeMaxAbsError);
+      const double libm_fitness = libm_executor.Execute();
+      RandomGenerator fast_rand_gen;
+      Executor<4> fast_executor(
+          algorithm, dataset, 100, 100, &fast_rand_gen, kLargeMaxAbsError,
+          false,  // use_jit
+          false,  // wipe_used_memory_only
+          false,  // short_circuit_constant_predictions
+          nullptr,  // initial_state
+          false,  // stop_on_fatal_nans
+          true);  // use_fast_math
+      const double fast_fitness = fast_executor.Execute();
+      EXPECT_GT(libm_fitness, kMinFitness);
+      EXPECT_NEAR(fast_fitness, libm_fitness, kPrecisionFitnessTolerance);
+      if (batch_size == 1) {
+        // Only the sigmoid of the mini-batches is approximated.
+        EXPECT_EQ(fast_fitness, libm_fitness);
+      }
+    }
+  }
+}
+
+TEST(ExecutorTest, ProfilesOpsByPhase) {
+  auto dataset =
+      GenerateTask<4>(StrCat("unit_test_ones_task {} "
+                                "eval_type: RMS_ERROR "
+                                "num_train_examples: ",
+                                kNumTrainExamples,
+                                " "
+                                "num_valid_examples: ",
+                                kNumValidExamples,
+                                " "
+                                "num_tasks: 1 "
+                                "features_size: 4 "));
+  Algorithm algorithm = SimpleNoOpAlgorithm();
+  algorithm.learn_[0] = make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, 3, 4);
+
+  ExecutorProfile before;
+  MergeExecutorProfiles(&before);
+  RandomGenerator rand_gen;
+  Executor<4> executor(algorithm, dataset, kNumTrainExamples, kNumValidExamples,
+                       &rand_gen, kLargeMaxAbsError);
+  executor.Execute();
+  ExecutorProfile after;
+  MergeExecutorProfiles(&after);
+
+  auto count_increase = [&](const ExecutionPhase phase, const IntegerT op) {
+    return after.Counters(phase, 4)[op].count.load() -
+        before.Counters(phase, 4)[op].count.load();
+  };
+  if (kExecutorProfiling) {
+    EXPECT_EQ(count_increase(kTrainLearnPhase, SCALAR_SUM_OP),
+              kNumTrainExamples);
+    EXPECT_EQ(count_increase(kTrainPredictPhase, SCALAR_SUM_OP), 0);
+    EXPECT_EQ(count_increase(kValidPredictPhase, NO_OP),
+              kNumValidExamples * algorithm.predict_.size());
+  } else {
+    EXPECT_EQ(count_increase(kTrainLearnPhase, SCALAR_SUM_OP), 0);
+  }
+}
+
+TEST(ExecutorTest, FusedInstructionsMatchSeparateInstructions) {
+  constexpr IntegerT kNumTrials = 1000;
+  constexpr IntegerT kNumInstructions = 12;
+  // Few addresses, so that the fusable sequences and aliasing are frequent.
+  constexpr AddressT kNumAddresses = 3;
+  const vector<Op> ops = {
+      SCALAR_VECTOR_PRODUCT_OP, VECTOR_SUM_OP, MATRIX_VECTOR_PRODUCT_OP,
+      VECTOR_HEAVYSIDE_OP, VECTOR_PRODUCT_OP, VECTOR_OUTER_PRODUCT_OP,
+      MATRIX_SUM_OP, VECTOR_INNER_PRODUCT_OP, SCALAR_DIFF_OP,
+      SCALAR_PRODUCT_OP, MATRIX_TRANSPOSE_OP};
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  IntegerT num_fused = 0;
+  for (IntegerT trial = 0; trial < kNumTrials; ++trial) {
+    vector<std::shared_ptr<const Instruction>> component_function;
+    for (IntegerT i = 0; i < kNumInstructions; ++i) {
+      component_function.emplace_back(make_shared<const Instruction>(
+          ops[rand_gen.UniformInteger(0, ops.size())],
+          rand_gen.UniformInteger(0, kNumAddresses),
+          rand_gen.UniformInteger(0, kNumAddresses),
+          rand_gen.UniformInteger(0, kNumAddresses)));
+    }
+    Memory<4> expected_memory;
+    Memory<4> actual_memory;
+    expected_memory.Wipe();
+    for (AddressT address = 0; address < kNumAddresses; ++address) {
+      expected_memory.scalar_[address] = rand_gen.GaussianActivation(0.0, 1.0);
+      rand_gen.FillGaussian(0.0, 1.0, &expected_memory.vector_[address]);
+      rand_gen.FillGaussian(0.0, 1.0, &expected_memory.matrix_[address]);
+    }
+    actual_memory.scalar_ = expected_memory.scalar_;
+    actual_memory.vector_ = expected_memory.vector_;
+    actual_memory.matrix_ = expected_memory.matrix_;
+
+    for (const std::shared_ptr<const Instruction>& instruction :
+         component_function) {
+      ExecuteInstruction(*instruction, &rand_gen, &expected_memory);
+    }
+    const DecodedComponentFunction fused(component_function, true);
+    for (IntegerT i = 0; i < fused.size(); ++i) {
+      if (fused.begin()[i].op_ > kUnsupportedDecodedOp) ++num_fused;
+    }
+    ExecuteDecoded(fused, &rand_gen, &actual_memory);
+
+    for (AddressT address = 0; address < kNumAddresses; ++address) {
+      EXPECT_EQ(actual_memory.scalar_[address],
+                expected_memory.scalar_[address]);
+      EXPECT_EQ(actual_memory.vector_[address],
+                expected_memory.vector_[address]);
+      EXPECT_EQ(actual_memory.matrix_[address],
+                expected_memory.matrix_[address]);
+    }
+  }
+  EXPECT_GT(num_fused, kNumTrials / 10);
+}
+
+// Returns a random component function over few addresses, so that constant
+// and unwritten predictions are frequent.
+vector<std::shared_ptr<const Instruction>> RandomSmallComponentFunction(
+    const IntegerT size, RandomGenerator* rand_gen) {
+  constexpr AddressT kNumAddresses = 4;
+  const vector<Op> ops = {
+      SCALAR_CONST_SET_OP, SCALAR_SUM_OP, SCALAR_PRODUCT_OP,
+      SCALAR_DIVISION_OP, SCALAR_COS_OP, VECTOR_INNER_PRODUCT_OP,
+      VECTOR_SUM_OP, SCALAR_UNIFORM_SET_OP};
+  vector<std::shared_ptr<const Instruction>> component_function;
+  for (IntegerT i = 0; i < size; ++i) {
+    const Op op = ops[rand_gen->UniformInteger(0, ops.size())];
+    const AddressT out = rand_gen->UniformInteger(0, kNumAddresses);
+    if (op == SCALAR_CONST_SET_OP) {
+      component_function.emplace_back(make_shared<const Instruction>(
+          op, out,
+          ActivationDataSetter(rand_gen->GaussianActivation(0.0, 1.0))));
+    } else if (op == SCALAR_UNIFORM_SET_OP) {
+      component_function.emplace_back(make_shared<const Instruction>(
+          op, out, FloatDataSetter(-1.0), FloatDataSetter(1.0)));
+    } else {
+      component_function.emplace_back(make_shared<const Instruction>(
+          op, rand_gen->UniformInteger(0, kNumAddresses),
+          rand_gen->UniformInteger(0, kNumAddresses), out));
+    }
+  }
+  return component_function;
+}
+
+void ExpectShortCircuitingMatchesExecuting(const Task<4>& dataset) {
+  constexpr IntegerT kNumTrials = 1000;
+  const IntegerT num_train_examples = dataset.MaxTrainExamples();
+  const IntegerT num_valid_examples = dataset.ValidSteps();
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  IntegerT num_short_circuited = 0;
+  for (IntegerT trial = 0; trial < kNumTrials; ++trial) {
+    Algorithm algorithm;
+    algorithm.setup_ = RandomSmallComponentFunction(3, &rand_gen);
+    algorithm.predict_ = RandomSmallComponentFunction(3, &rand_gen);
+    algorithm.learn_ = RandomSmallComponentFunction(3, &rand_gen);
+    if (GetPredictionDependence(algorithm) != kVariablePredictions) {
+      ++num_short_circuited;
+    }
+
+    mt19937 expected_bit_gen(trial);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> expected_executor(
+        algorithm, dataset, num_train_examples, num_valid_examples,
+        &expected_rand_gen, kMaxAbsError);
+    vector<double> expected_train_errors;
+    vector<double> expected_valid_errors;
+    const double expected_fitness = expected_executor.Execute(
+        &expected_train_errors, &expected_valid_errors);
+
+    mt19937 actual_bit_gen(trial);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    Executor<4> actual_executor(
+        algorithm, dataset, num_train_examples, num_valid_examples,
+        &actual_rand_gen, kMaxAbsError,
+        false,  // use_jit
+        false,  // wipe_used_memory_only
+        true);  // short_circuit_constant_predictions
+    vector<double> actual_train_errors;
+    vector<double> actual_valid_errors;
+    const double actual_fitness = actual_executor.Execute(
+        &actual_train_errors, &actual_valid_errors);
+
+    EXPECT_EQ(actual_fitness, expected_fitness);
+    EXPECT_EQ(actual_train_errors, expected_train_errors);
+    EXPECT_EQ(actual_valid_errors, expected_valid_errors);
+    EXPECT_EQ(actual_executor.GetNumTrainStepsCompleted(),
+              expected_executor.GetNumTrainStepsCompleted());
+    // The random draws happen in the same order.
+    EXPECT_EQ(actual_bit_gen(), expected_bit_gen());
+  }
+  EXPECT_GT(num_short_circuited, kNumTrials / 10);
+}
+
+TEST(ExecutorTest, ShortCircuitingMatchesExecutingForRmsError) {
+  ExpectShortCircuitingMatchesExecuting(GenerateTask<4>(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 50 "
+      "num_train_epochs: 2 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 "));
+}
+
+TEST(ExecutorTest, ShortCircuitingMatchesExecutingForAccuracy) {
+  ExpectShortCircuitingMatchesExecuting(GenerateTask<4>(
+      "unit_test_increment_task {increment: 0.01} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 50 "
+      "num_train_epochs: 2 "
+      "eval_type: ACCURACY "));
+}
+
+TEST(ExecutorTest, SkippingLearnMatchesRunningLearn) {
+  constexpr IntegerT kNumTrials = 1000;
+  const Task<4> dataset = GenerateTask<4>(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 50 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 ");
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  IntegerT num_skipped = 0;
+  for (IntegerT trial = 0; trial < kNumTrials; ++trial) {
+    Algorithm algorithm;
+    algorithm.setup_ = RandomSmallComponentFunction(3, &rand_gen);
+    algorithm.predict_ = RandomSmallComponentFunction(4, &rand_gen);
+    algorithm.learn_ = RandomSmallComponentFunction(4, &rand_gen);
+
+    // Trains and validates without the analysis, always running learn.
+    mt19937 expected_bit_gen(trial);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> expected_executor(
+        algorithm, dataset, 50, 50, &expected_rand_gen, kMaxAbsError);
+    TaskIterator<4> train_it = dataset.TrainIterator();
+    double expected_fitness = kMinFitness;
+    if (expected_executor.Train(50, nullptr, &train_it)) {
+      expected_fitness = expected_executor.Validate(nullptr);
+    }
+
+    mt19937 actual_bit_gen(trial);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    Executor<4> actual_executor(
+        algorithm, dataset, 50, 50, &actual_rand_gen, kMaxAbsError);
+    const double actual_fitness = actual_executor.Execute();
+    if (actual_executor.SkippedLearn()) ++num_skipped;
+
+    EXPECT_EQ(actual_fitness, expected_fitness);
+    EXPECT_EQ(actual_executor.GetNumTrainStepsCompleted(),
+              expected_executor.GetNumTrainStepsCompleted());
+    EXPECT_EQ(actual_bit_gen(), expected_bit_gen());
+  }
+  EXPECT_GT(num_skipped, kNumTrials / 10);
+}
+
+TEST(ExecutorTest, ResumingMatchesExecutingFromTheStart) {
+  constexpr IntegerT kNumTrials = 1000;
+  constexpr IntegerT kNumProbeExamples = 10;
+  const Task<4> dataset = GenerateTask<4>(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 50 "
+      "num_train_epochs: 2 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 ");
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  IntegerT num_resumed = 0;
+  for (IntegerT trial = 0; trial < kNumTrials; ++trial) {
+    Algorithm algorithm;
+    algorithm.setup_ = RandomSmallComponentFunction(3, &rand_gen);
+    algorithm.predict_ = RandomSmallComponentFunction(4, &rand_gen);
+    algorithm.learn_ = RandomSmallComponentFunction(4, &rand_gen);
+
+    mt19937 expected_bit_gen(trial);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> expected_executor(
+        algorithm, dataset, 100, 50, &expected_rand_gen, kMaxAbsError);
+    const double expected_fitness = expected_executor.Execute();
+
+    // A shorter execution, whose validation draws random numbers and changes
+    // the memory after the state is saved.
+    mt19937 actual_bit_gen(trial);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    ExecutorState<4> state;
+    Executor<4> probe_executor(
+        algorithm, dataset, kNumProbeExamples, kNumProbeExamples,
+        &actual_rand_gen, kMaxAbsError);
+    probe_executor.Execute(nullptr, nullptr, &state);
+    if (!state.saved) {
+      EXPECT_EQ(expected_fitness, kMinFitness);
+      continue;
+    }
+    ++num_resumed;
+    EXPECT_EQ(state.num_train_examples, kNumProbeExamples);
+    Executor<4> actual_executor(
+        algorithm, dataset, 100, 50, &actual_rand_gen, kMaxAbsError,
+        false,  // use_jit
+        false,  // wipe_used_memory_only
+        false,  // short_circuit_constant_predictions
+        &state);
+    const double actual_fitness = actual_executor.Execute();
+
+    EXPECT_EQ(actual_fitness, expected_fitness);
+    if (expected_fitness != kMinFitness) {
+      EXPECT_EQ(actual_executor.GetNumTrainStepsCompleted() +
+                    kNumProbeExamples,
+                expected_executor.GetNumTrainStepsCompleted());
+    }
+    EXPECT_EQ(actual_bit_gen(), expected_bit_gen());
+  }
+  EXPECT_GT(num_resumed, kNumTrials / 10);
+}
+
+TEST(ExecutorTest, StopsAtFatalNans) {
+  const Task<4> dataset = GenerateTask<4>(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 50 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 ");
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 3, ActivationDataSetter(-1.0)));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, kLabelsScalarAddress, kPredictionsScalarAddress));
+  // The NaN of the first learn reaches the prediction of the fourth example.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 5, kLabelsScalarAddress, 2));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 4, kLabelsScalarAddress, 5));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_LOG_OP, 3, 4));
+
+  RandomGenerator rand_gen;
+  Executor<4> expected_executor(
+      algorithm, dataset, 50, 50, &rand_gen, kMaxAbsError);
+  EXPECT_EQ(expected_executor.Execute(), kMinFitness);
+  EXPECT_EQ(expected_executor.GetNumTrainStepsCompleted(), 4);
+  EXPECT_EQ(expected_executor.GetNumTrainStepsSaved(), 0);
+
+  Executor<4> actual_executor(
+      algorithm, dataset, 50, 50, &rand_gen, kMaxAbsError,
+      false,  // use_jit
+      false,  // wipe_used_memory_only
+      false,  // short_circuit_constant_predictions
+      nullptr,  // initial_state
+      true);  // stop_on_fatal_nans
+  EXPECT_EQ(actual_executor.Execute(), kMinFitness);
+  EXPECT_EQ(actual_executor.GetNumTrainStepsCompleted(), 1);
+  EXPECT_EQ(actual_executor.GetNumTrainStepsSaved(), 3);
+}
+
+TEST(ExecutorTest, StoppingAtFatalNansMatchesExecuting) {
+  constexpr IntegerT kNumTrials = 1000;
+  const Task<4> dataset = GenerateTask<4>(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 50 "
+      "num_train_epochs: 2 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 ");
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  IntegerT num_stopped = 0;
+  for (IntegerT trial = 0; trial < kNumTrials; ++trial) {
+    Algorithm algorithm;
+    algorithm.setup_ = RandomSmallComponentFunction(3, &rand_gen);
+    algorithm.predict_ = RandomSmallComponentFunction(4, &rand_gen);
+    algorithm.learn_ = RandomSmallComponentFunction(4, &rand_gen);
+
+    mt19937 expected_bit_gen(trial);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> expected_executor(
+        algorithm, dataset, 100, 50, &expected_rand_gen, kMaxAbsError);
+    const double expected_fitness = expected_executor.Execute();
+
+    mt19937 actual_bit_gen(trial);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    Executor<4> actual_executor(
+        algorithm, dataset, 100, 50, &actual_rand_gen, kMaxAbsError,
+        false,  // use_jit
+        false,  // wipe_used_memory_only
+        false,  // short_circuit_constant_predictions
+        nullptr,  // initial_state
+        true);  // stop_on_fatal_nans
+    const double actual_fitness = actual_executor.Execute();
+    if (actual_executor.GetNumTrainStepsSaved() > 0) ++num_stopped;
+
+    EXPECT_EQ(actual_fitness, expected_fitness);
+    EXPECT_LE(actual_executor.GetNumTrainStepsCompleted(),
+              expected_executor.GetNumTrainStepsCompleted());
+    EXPECT_GE(actual_executor.GetNumTrainStepsCompleted() +
+                  actual_executor.GetNumTrainStepsSaved(),
+              expected_executor.GetNumTrainStepsCompleted());
+    EXPECT_EQ(actual_bit_gen(), expected_bit_gen());
+  }
+  EXPECT_GT(num_stopped, 0);
+}
+
+// Executes random Algorithms with and without stopping validation at the given
+// thresholds, and returns the validation steps saved.
+IntegerT ExpectValidationBoundIsSound(const Task<4>& dataset,
+                                      const double num_stdevs) {
+  constexpr IntegerT kNumTrials = 300;
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  IntegerT num_valid_steps_saved = 0;
+  for (IntegerT trial = 0; trial < kNumTrials; ++trial) {
+    Algorithm algorithm;
+    algorithm.setup_ = RandomSmallComponentFunction(3, &rand_gen);
+    algorithm.predict_ = RandomSmallComponentFunction(4, &rand_gen);
+    algorithm.learn_ = RandomSmallComponentFunction(4, &rand_gen);
+
+    mt19937 expected_bit_gen(trial);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> expected_executor(
+        algorithm, dataset, dataset.MaxTrainExamples(), dataset.ValidSteps(),
+        &expected_rand_gen, kMaxAbsError);
+    const double expected_fitness = expected_executor.Execute();
+    EXPECT_FALSE(expected_executor.FitnessIsEstimate());
+
+    for (const double fitness_threshold : {0.2, 0.5, 0.8}) {
+      mt19937 actual_bit_gen(trial);
+      RandomGenerator actual_rand_gen(&actual_bit_gen);
+      Executor<4> actual_executor(
+          algorithm, dataset, dataset.MaxTrainExamples(), dataset.ValidSteps(),
+          &actual_rand_gen, kMaxAbsError,
+          false,  // use_jit
+          false,  // wipe_used_memory_only
+          false,  // short_circuit_constant_predictions
+          nullptr,  // initial_state
+          false,  // stop_on_fatal_nans
+          false,  // use_fast_math
+          ValidationBound{fitness_threshold, num_stdevs});
+      const double actual_fitness = actual_executor.Execute();
+      num_valid_steps_saved += actual_executor.GetNumValidStepsSaved();
+      const double fitness_bound = actual_executor.GetFitnessUpperBound();
+      if (actual_executor.FitnessIsEstimate()) {
+        EXPECT_LE(actual_fitness, fitness_bound);
+        EXPECT_LE(fitness_bound, fitness_threshold);
+        EXPECT_GT(actual_executor.GetNumValidStepsSaved(), 0);
+        if (num_stdevs == 0.0) {
+          EXPECT_LE(expected_fitness, fitness_bound);
+        }
+      } else if (actual_executor.GetNumValidStepsSaved() > 0) {
+        // Only the last of the two epochs stopped validating early.
+        EXPECT_GT(actual_fitness, fitness_threshold);
+        if (num_stdevs == 0.0) {
+          EXPECT_EQ(actual_fitness, expected_fitness);
+        }
+      } else {
+        EXPECT_EQ(actual_fitness, expected_fitness);
+      }
+      if (!actual_executor.FitnessIsEstimate()) {
+        EXPECT_EQ(fitness_bound, actual_fitness);
+      }
+      if (num_stdevs == 0.0 && expected_fitness > fitness_threshold) {
+        EXPECT_EQ(actual_fitness, expected_fitness);
+        EXPECT_FALSE(actual_executor.FitnessIsEstimate());
+      }
+      EXPECT_EQ(actual_executor.GetNumTrainStepsCompleted(),
+                expected_executor.GetNumTrainStepsCompleted());
+    }
+  }
+  return num_valid_steps_saved;
+}
+
+TEST(ExecutorTest, BoundsValidationForRmsError) {
+  const Task<4> dataset = GenerateTask<4>(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 200 "
+      "num_train_epochs: 2 "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 ");
+  const IntegerT exact_steps_saved = ExpectValidationBoundIsSound(dataset, 0.0);
+  EXPECT_GT(exact_steps_saved, 0);
+  EXPECT_GE(ExpectValidationBoundIsSound(dataset, 3.0), exact_steps_saved);
+}
+
+TEST(ExecutorTest, BoundsValidationForAccuracy) {
+  // The statistical bound is not tested here, as the examples of this task
+  // come in order of their labels instead of at random.
+  const Task<4> dataset = GenerateTask<4>(
+      "unit_test_increment_task {increment: 0.01} "
+      "num_train_examples: 50 "
+      "num_valid_examples: 200 "
+      "num_train_epochs: 2 "
+      "eval_type: ACCURACY ");
+  EXPECT_GT(ExpectValidationBoundIsSound(dataset, 0.0), 0);
+}
+
+TEST(ExecutorTest, StopsValidationOnceThresholdIsOutOfReach) {
+  const Task<4> dataset = GenerateTask<4>(
+      "unit_test_increment_task {increment: 0.01} "
+      "num_train_examples: 10 "
+      "num_valid_examples: 100 "
+      "eval_type: ACCURACY ");
+  // Always predicts label 1, which is wrong on the first 50 examples.
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, kPredictionsScalarAddress,
+      ActivationDataSetter(10.0)));
+  RandomGenerator rand_gen;
+  Executor<4> executor(
+      algorithm, dataset, 10, 100, &rand_gen, kMaxAbsError,
+      false,  // use_jit
+      false,  // wipe_used_memory_only
+      false,  // short_circuit_constant_predictions
+      nullptr,  // initial_state
+      false,  // stop_on_fatal_nans
+      false,  // use_fast_math
+      ValidationBound{0.75, 0.0});
+  // The accuracy cannot exceed 0.75 after 25 errors. Extrapolating these
+  // estimates it as 0.
+  EXPECT_FLOAT_EQ(executor.Execute(), 0.0);
+  EXPECT_TRUE(executor.FitnessIsEstimate());
+  EXPECT_FLOAT_EQ(executor.GetFitnessUpperBound(), 0.75);
+  EXPECT_EQ(executor.GetNumValidStepsSaved(), 75);
 }
 
 // TODO(crazydonkey): the number of examples passed to the executor is not
@@ -969,7 +1781,7 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyNothingToVectorEquals(
       const Instruction& instruction,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& expected_out) {
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
     Vector<4> expected_out_vector(expected_out.data());
     EXPECT_LE((memory_.vector_[out_] - expected_out_vector).norm(),
@@ -984,7 +1796,7 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyNothingToMatrixEquals(
       const Instruction& instruction,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& expected_out) {
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
     Matrix<4> expected_out_matrix(expected_out.data());
     EXPECT_LE((memory_.matrix_[out_] - expected_out_matrix).norm(),
@@ -1035,7 +1847,7 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyVectorToScalarEquals(
       const Instruction& instruction,
-      const vector<double>& in1,
+      const vector<Scalar>& in1,
       const double expected_out) {
     memory_.vector_[in1_] = Vector<4>(in1.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1043,8 +1855,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyVectorToVectorEquals(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& expected_out) {
     memory_.vector_[in1_] = Vector<4>(in1.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
     Vector<4> expected_out_vector(expected_out.data());
@@ -1053,7 +1865,7 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyMatrixToScalarEquals(
       const Instruction& instruction,
-      const vector<double>& in1,
+      const vector<Scalar>& in1,
       const double expected_out) {
     memory_.matrix_[in1_] = Matrix<4>(in1.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1061,8 +1873,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyMatrixToVectorEquals(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& expected_out) {
     memory_.matrix_[in1_] = Matrix<4>(in1.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
     Vector<4> expected_out_vector(expected_out.data());
@@ -1100,8 +1912,8 @@ class ExecuteInstructionTest : public Test {
   void VerifyScalarVectorToVectorEquals(
       const Instruction& instruction,
       const double in1,
-      const vector<double>& in2,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in2,
+      const vector<Scalar>& expected_out) {
     memory_.scalar_[in1_] = in1;
     memory_.vector_[in2_] = Vector<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1112,8 +1924,8 @@ class ExecuteInstructionTest : public Test {
   void VerifyScalarMatrixToMatrixEquals(
       const Instruction& instruction,
       const double in1,
-      const vector<double>& in2,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in2,
+      const vector<Scalar>& expected_out) {
     memory_.scalar_[in1_] = in1;
     memory_.matrix_[in2_] = Matrix<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1123,8 +1935,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyVectorVectorToScalarEquals(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2,
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2,
       const double expected_out) {
     memory_.vector_[in1_] = Vector<4>(in1.data());
     memory_.vector_[in2_] = Vector<4>(in2.data());
@@ -1133,9 +1945,9 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyVectorVectorToVectorInstructionWorksCorrectly(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2,
+      const vector<Scalar>& expected_out) {
     memory_.vector_[in1_] = Vector<4>(in1.data());
     memory_.vector_[in2_] = Vector<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1145,8 +1957,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyVectorVectorToVectorInstructionIsNan(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2) {
     memory_.vector_[in1_] = Vector<4>(in1.data());
     memory_.vector_[in2_] = Vector<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1154,8 +1966,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyVectorVectorToVectorInstructionIsInf(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2) {
     memory_.vector_[in1_] = Vector<4>(in1.data());
     memory_.vector_[in2_] = Vector<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1163,9 +1975,9 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyVectorVectorToMatrixEquals(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2,
+      const vector<Scalar>& expected_out) {
     memory_.vector_[in1_] = Vector<4>(in1.data());
     memory_.vector_[in2_] = Vector<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1175,9 +1987,9 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyMatrixVectorToVectorEquals(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2,
+      const vector<Scalar>& expected_out) {
     memory_.matrix_[in1_] = Matrix<4>(in1.data());
     memory_.vector_[in2_] = Vector<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1187,9 +1999,9 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyMatrixMatrixToMatrixInstructionWorksCorrectly(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2,
+      const vector<Scalar>& expected_out) {
     memory_.matrix_[in1_] = Matrix<4>(in1.data());
     memory_.matrix_[in2_] = Matrix<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1199,8 +2011,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyMatrixMatrixToMatrixInstructionIsNan(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2) {
     memory_.matrix_[in1_] = Matrix<4>(in1.data());
     memory_.matrix_[in2_] = Matrix<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1208,8 +2020,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyMatrixMatrixToMatrixInstructionIsInf(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& in2) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& in2) {
     memory_.matrix_[in1_] = Matrix<4>(in1.data());
     memory_.matrix_[in2_] = Matrix<4>(in2.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
@@ -1217,8 +2029,8 @@ class ExecuteInstructionTest : public Test {
   }
   void VerifyMatrixToMatrixInstructionWorksCorrectly(
       const Instruction& instruction,
-      const vector<double>& in1,
-      const vector<double>& expected_out) {
+      const vector<Scalar>& in1,
+      const vector<Scalar>& expected_out) {
     memory_.matrix_[in1_] = Matrix<4>(in1.data());
     ExecuteInstruction(instruction, &train_rand_gen_, &memory_);
     Matrix<4> expected_out_matrix(expected_out.data());
@@ -1335,9 +2147,16 @@ TEST_F(ExecuteInstructionTest, TrigonometryRelated_ScalarTanOp) {
       MakeOneInputInstruction(SCALAR_TAN_OP), 3 * kPi / 4.0, -1.0);
   VerifyScalarToScalarEquals(
       MakeOneInputInstruction(SCALAR_TAN_OP), 5 * kPi / 4.0, 1.0);
+#ifdef SINGLE_PRECISION
+  // A float cannot get as close to pi / 2.
+  VerifyScalarToScalarIsGreater(
+      MakeOneInputInstruction(SCALAR_TAN_OP),
+      kPi / 2.0 - 0.0001, 1000.0);
+#else
   VerifyScalarToScalarIsGreater(
       MakeOneInputInstruction(SCALAR_TAN_OP),
       kPi / 2.0 - 0.000000001, 1000000.0);
+#endif
   VerifyScalarToScalarIsLess(
       MakeOneInputInstruction(SCALAR_TAN_OP),
       kPi / 2.0 + 0.000000001, -1000000.0);
@@ -1722,6 +2541,22 @@ TEST_F(ExecuteInstructionTest, LinearAlgebraRelated_MatrixMatrixProductOp) {
        201.527, 2.3792, -139.4326, -150.6448});
 }
 
+TEST(MatrixKernelsTest, UsesEigenUnlessSimdKernelsAreEnabled) {
+  EXPECT_FALSE(UseSimdKernels());
+  RandomGenerator rand_gen;
+  Matrix<16> matrix1, matrix2;
+  rand_gen.FillGaussian<16>(0.0, 1.0, &matrix1);
+  rand_gen.FillGaussian<16>(0.0, 1.0, &matrix2);
+  const Matrix<16> expected = matrix1 * matrix2;
+  Matrix<16> product;
+  MatrixKernels<16>::MatrixMatrixProduct(matrix1, matrix2, &product);
+  EXPECT_EQ(product, expected);
+  SetUseSimdKernels(true);
+  MatrixKernels<16>::MatrixMatrixProduct(matrix1, matrix2, &product);
+  SetUseSimdKernels(false);
+  EXPECT_TRUE(product.isApprox(expected));
+}
+
 TEST_F(ExecuteInstructionTest, ProbabilityRelated_VectorMeanOp) {
   VerifyVectorToScalarEquals(
       MakeOneInputInstruction(VECTOR_MEAN_OP),
@@ -0,0 +1,115 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A polynomial approximation of the sigmoid, for the Executor's fast-math
+// mode, which applies it to the training predictions of mini-batches. It is
+// inlined and branch-free, so that the per-coefficient loops over vectors and
+// matrices (see ApplyCoefficientWise) compile to SIMD code. The exp underneath
+// uses a Taylor polynomial. NaNs propagate, and the infinities give the same
+// results as libm. See fast_math_test.cc for the error bounds, in units in the
+// last place (ULPs) of the libm result, and fast_math_benchmark.cc for the
+// timings against libm.
+
+#ifndef AUTOML_ZERO_FAST_MATH_H_
+#define AUTOML_ZERO_FAST_MATH_H_
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "definitions.h"
+
+namespace automl_zero {
+
+namespace internal {
+
+inline uint64_t DoubleToBits(const double x) {
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+inline double BitsToDouble(const uint64_t bits) {
+  double x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// Adding this rounds a double in (-2^51, 2^51) to the nearest integer, and
+// leaves that integer in the low bits of the mantissa, offset by 2^51.
+constexpr double kRoundingShifter = 6755399441055744.0;  // 1.5 * 2^52.
+
+// 2^n, where n in [-1022, 1023] is the integer that kRoundingShifter was
+// rounded into `shifted`. Only uses unsigned arithmetic, which vectorizes.
+inline double ShiftedToPow2(const double shifted) {
+  return BitsToDouble((DoubleToBits(shifted) + 1023) << 52);
+}
+
+}  // namespace internal
+
+inline double FastExp(const double x) {
+  constexpr double kOverflow = 7.09782712893383973096e+02;
+  constexpr double kUnderflow = -7.45133219101941108420e+02;
+  constexpr double kInvLn2 = 1.44269504088896338700e+00;
+  constexpr double kLn2High = 6.93147180369123816490e-01;
+  constexpr double kLn2Low = 1.90821492927058770002e-10;
+  constexpr double kTwoTo64 = 1.8446744073709551616e+19;
+  constexpr double kTwoToMinus64 = 5.42101086242752217004e-20;
+  // Clamping keeps the exponent below within range. It lets NaNs through.
+  double clamped = x > kOverflow ? kOverflow : x;
+  clamped = clamped < kUnderflow ? kUnderflow : clamped;
+  // exp(x) = 2^n * exp(r), with |r| <= ln(2) / 2.
+  const double shifted = clamped * kInvLn2 + internal::kRoundingShifter;
+  const double n = shifted - internal::kRoundingShifter;
+  const double r = (clamped - n * kLn2High) - n * kLn2Low;
+  // The Taylor polynomial of degree 13, evaluated with Estrin's scheme, which
+  // has a shorter dependency chain than Horner's.
+  const double r2 = r * r;
+  const double r4 = r2 * r2;
+  const double r8 = r4 * r4;
+  const double p01 = 1.0 + r;
+  const double p23 = 1.0 / 2 + r * (1.0 / 6);
+  const double p45 = 1.0 / 24 + r * (1.0 / 120);
+  const double p67 = 1.0 / 720 + r * (1.0 / 5040);
+  const double p89 = 1.0 / 40320 + r * (1.0 / 362880);
+  const double p1011 = 1.0 / 3628800 + r * (1.0 / 39916800);
+  const double p1213 = 1.0 / 479001600 + r * (1.0 / 6227020800);
+  const double exp_r = ((p01 + r2 * p23) + r4 * (p45 + r2 * p67)) +
+      r8 * ((p89 + r2 * p1011) + r4 * p1213);
+  // 2^n, in two factors, as n can be outside the range of normal exponents.
+  const double result =
+      exp_r * internal::ShiftedToPow2(shifted + (n < 0.0 ? 64.0 : -64.0)) *
+      (n < 0.0 ? kTwoToMinus64 : kTwoTo64);
+  return x > kOverflow ? std::numeric_limits<double>::infinity() :
+      x < kUnderflow ? 0.0 : result;
+}
+
+inline double FastSigmoid(const double x) {
+  return 1.0 / (1.0 + FastExp(-x));
+}
+
+// Applies FastExp or FastSigmoid to each coefficient of a vector or matrix.
+// `out` may be `in`.
+template <double (*Function)(double), typename EigenT>
+inline void ApplyCoefficientWise(const EigenT& in, EigenT* out) {
+  const Scalar* in_data = in.data();
+  Scalar* out_data = out->data();
+  for (IntegerT i = 0; i < in.size(); ++i) {
+    out_data[i] = Function(in_data[i]);
+  }
+}
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_FAST_MATH_H_
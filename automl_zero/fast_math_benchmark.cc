@@ -0,0 +1,118 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Prints the time per value of libm's exp and sigmoid and of their fast_math.h
+// approximations, both for dependent scalar calls and coefficient-wise over a
+// vector and a matrix, as the Executor applies the batch sigmoid.
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#include "definitions.h"
+#include "fast_math.h"
+
+namespace automl_zero {
+
+constexpr IntegerT kNumRepetitions = 20;
+constexpr IntegerT kNumIterations = 20000;
+constexpr FeatureIndexT kFeaturesSize = 32;
+
+// Keeps the compiler from optimizing the timed calls away.
+volatile double benchmark_sink = 0.0;
+
+double LibmExp(const double x) {return std::exp(x);}
+double LibmSigmoid(const double x) {return 1.0 / (1.0 + std::exp(-x));}
+
+// Returns the best time over the repetitions, in nanoseconds per call of
+// `run`, which must evaluate the function on `num_values` values.
+template <typename RunT>
+double BestNanosPerValue(const IntegerT num_values, RunT run) {
+  double best = std::numeric_limits<double>::infinity();
+  for (IntegerT repetition = 0; repetition < kNumRepetitions; ++repetition) {
+    const auto start = std::chrono::steady_clock::now();
+    for (IntegerT i = 0; i < kNumIterations; ++i) run();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::nano>(end - start).count() /
+                  static_cast<double>(kNumIterations * num_values));
+  }
+  return best;
+}
+
+// Each call depends on the previous one, like consecutive scalar ops. The
+// argument stays close to `x` so that it remains in the domain.
+template <double (*Function)(double)>
+double ScalarNanos(const double x) {
+  double value = 0.0;
+  const double nanos = BestNanosPerValue(1, [&]() {
+    value = Function(x + value * 1.0e-30);
+  });
+  benchmark_sink = value;
+  return nanos;
+}
+
+template <double (*Function)(double), typename EigenT>
+double CoefficientWiseNanos(const double low, const double high) {
+  EigenT in;
+  EigenT out;
+  Scalar* in_data = in.data();
+  for (IntegerT i = 0; i < in.size(); ++i) {
+    in_data[i] = low + (high - low) * static_cast<double>(i) /
+        static_cast<double>(in.size());
+  }
+  const double nanos = BestNanosPerValue(in.size(), [&]() {
+    ApplyCoefficientWise<Function>(in, &out);
+    in_data[0] += out.data()[1] * 1.0e-30;
+  });
+  benchmark_sink = out.data()[0];
+  return nanos;
+}
+
+template <double (*LibmFunction)(double), double (*FastFunction)(double)>
+void PrintComparison(const char* name, const double low, const double high) {
+  const double x = 0.5 * (low + high) + 0.1;
+  const double libm_scalar = ScalarNanos<LibmFunction>(x);
+  const double fast_scalar = ScalarNanos<FastFunction>(x);
+  const double libm_vector =
+      CoefficientWiseNanos<LibmFunction, Vector<kFeaturesSize>>(low, high);
+  const double fast_vector =
+      CoefficientWiseNanos<FastFunction, Vector<kFeaturesSize>>(low, high);
+  const double libm_matrix =
+      CoefficientWiseNanos<LibmFunction, Matrix<kFeaturesSize>>(low, high);
+  const double fast_matrix =
+      CoefficientWiseNanos<FastFunction, Matrix<kFeaturesSize>>(low, high);
+  std::printf(
+      "%-8s %7.2f %7.2f %5.2fx   %7.2f %7.2f %5.2fx   %7.2f %7.2f %5.2fx\n",
+      name, libm_scalar, fast_scalar, libm_scalar / fast_scalar, libm_vector,
+      fast_vector, libm_vector / fast_vector, libm_matrix, fast_matrix,
+      libm_matrix / fast_matrix);
+}
+
+void Run() {
+  std::printf("Nanoseconds per value, libm / fast / speedup.\n");
+  std::printf("%-8s %-29s %-29s %-29s\n", "", "scalar (dependent)",
+              "vector (F = 32)", "matrix (F = 32)");
+  PrintComparison<LibmExp, FastExp>("exp", -5.0, 5.0);
+  PrintComparison<LibmSigmoid, FastSigmoid>("sigmoid", -10.0, 10.0);
+}
+
+}  // namespace automl_zero
+
+int main(int argc, char** argv) {
+  automl_zero::Run();
+  return 0;
+}
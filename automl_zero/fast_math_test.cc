@@ -0,0 +1,140 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fast_math.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+
+#include "definitions.h"
+#include "gtest/gtest.h"
+
+namespace automl_zero {
+
+using ::std::mt19937_64;  // NOLINT
+using ::std::numeric_limits;  // NOLINT
+
+constexpr IntegerT kNumSamples = 200000;
+constexpr double kInfinity = numeric_limits<double>::infinity();
+
+// The error bounds, in ULPs of the libm result. libm itself is within 1 ULP of
+// the exact result.
+constexpr double kMaxExpUlps = 3.0;
+constexpr double kMaxSigmoidUlps = 5.0;
+
+// The number of doubles between x and y, or 0 if both are NaN, or infinity if
+// only one is.
+double UlpDistance(const double x, const double y) {
+  if (std::isnan(x) || std::isnan(y)) {
+    return std::isnan(x) && std::isnan(y) ? 0.0 : kInfinity;
+  }
+  // Maps the doubles to integers in the same order.
+  auto to_ordered = [](const double value) {
+    int64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? numeric_limits<int64_t>::min() - bits : bits;
+  };
+  const int64_t ordered_x = to_ordered(x);
+  const int64_t ordered_y = to_ordered(y);
+  // Unsigned, as the difference may not fit in an int64_t.
+  return static_cast<double>(
+      ordered_x > ordered_y ?
+      static_cast<uint64_t>(ordered_x) - static_cast<uint64_t>(ordered_y) :
+      static_cast<uint64_t>(ordered_y) - static_cast<uint64_t>(ordered_x));
+}
+
+double LibmSigmoid(const double x) {
+  return 1.0 / (1.0 + std::exp(-x));
+}
+
+// Returns the largest ULP distance between the two functions on uniform
+// samples of [low, high].
+double MaxUlpDistance(double (*actual)(double), double (*expected)(double),
+                      const double low, const double high) {
+  mt19937_64 bit_gen(1000);
+  std::uniform_real_distribution<double> distribution(low, high);
+  double max_distance = 0.0;
+  for (IntegerT i = 0; i < kNumSamples; ++i) {
+    const double x = distribution(bit_gen);
+    max_distance = std::max(max_distance, UlpDistance(actual(x), expected(x)));
+  }
+  return max_distance;
+}
+
+// Checks the arguments where the functions have special cases: signed zeros,
+// infinities, NaNs, subnormals and overflowing arguments.
+void ExpectSpecialValuesMatch(double (*actual)(double),
+                              double (*expected)(double),
+                              const double max_ulps) {
+  const double denorm_min = numeric_limits<double>::denorm_min();
+  for (const double x : {0.0, -0.0, 1.0, -1.0, 2.0, -2.0, kInfinity,
+                         -kInfinity, numeric_limits<double>::quiet_NaN(),
+                         denorm_min, -denorm_min, 1.0e-310, 1.0e300, -1.0e300,
+                         710.0, -746.0, 1.0e6, -1.0e6}) {
+    EXPECT_LE(UlpDistance(actual(x), expected(x)), max_ulps)
+        << "x = " << x << ", actual = " << actual(x)
+        << ", expected = " << expected(x);
+  }
+}
+
+TEST(FastMathTest, ExpIsAccurate) {
+  double (*libm)(double) = std::exp;
+  EXPECT_LE(MaxUlpDistance(FastExp, libm, -1.0, 1.0), kMaxExpUlps);
+  EXPECT_LE(MaxUlpDistance(FastExp, libm, -50.0, 50.0), kMaxExpUlps);
+  // Includes the overflowing and the subnormal results.
+  EXPECT_LE(MaxUlpDistance(FastExp, libm, -750.0, 720.0), kMaxExpUlps);
+  ExpectSpecialValuesMatch(FastExp, libm, kMaxExpUlps);
+}
+
+TEST(FastMathTest, SigmoidIsAccurate) {
+  EXPECT_LE(MaxUlpDistance(FastSigmoid, LibmSigmoid, -40.0, 40.0),
+            kMaxSigmoidUlps);
+  ExpectSpecialValuesMatch(FastSigmoid, LibmSigmoid, kMaxSigmoidUlps);
+}
+
+TEST(FastMathTest, AppliesToVectorsAndMatrices) {
+  mt19937_64 bit_gen(1000);
+  std::uniform_real_distribution<double> distribution(-5.0, 5.0);
+  Vector<8> vector;
+  Matrix<8> matrix;
+  for (FeatureIndexT i = 0; i < 8; ++i) {
+    vector(i) = distribution(bit_gen);
+    for (FeatureIndexT j = 0; j < 8; ++j) {
+      matrix(i, j) = distribution(bit_gen);
+    }
+  }
+  Vector<8> vector_out;
+  ApplyCoefficientWise<FastExp>(vector, &vector_out);
+  Matrix<8> matrix_out;
+  ApplyCoefficientWise<FastSigmoid>(matrix, &matrix_out);
+  for (FeatureIndexT i = 0; i < 8; ++i) {
+    EXPECT_EQ(vector_out(i), static_cast<Scalar>(FastExp(vector(i))));
+    for (FeatureIndexT j = 0; j < 8; ++j) {
+      EXPECT_EQ(matrix_out(i, j),
+                static_cast<Scalar>(FastSigmoid(matrix(i, j))));
+    }
+  }
+
+  // In place.
+  const Vector<8> expected = vector_out;
+  ApplyCoefficientWise<FastSigmoid>(vector_out, &vector_out);
+  for (FeatureIndexT i = 0; i < 8; ++i) {
+    EXPECT_EQ(vector_out(i), static_cast<Scalar>(FastSigmoid(expected(i))));
+  }
+}
+
+}  // namespace automl_zero
@@ -0,0 +1,148 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fitness_surrogate.h"
+
+#include <cmath>
+#include <iomanip>
+#include <memory>
+
+#include "dataflow.h"
+#include "instruction.h"
+
+namespace automl_zero {
+
+using ::std::abs;  // NOLINT
+using ::std::endl;  // NOLINT
+using ::std::fixed;  // NOLINT
+using ::std::ostream;  // NOLINT
+using ::std::setprecision;  // NOLINT
+using ::std::shared_ptr;  // NOLINT
+using ::std::vector;  // NOLINT
+
+namespace {
+
+// Keeps the normalized update finite for all-zero features.
+constexpr double kNormEpsilon = 1e-6;
+
+// Appends the share of each op and of the live instructions in the component
+// function.
+void AppendComponentFunctionFeatures(
+    const vector<shared_ptr<const Instruction>>& component_function,
+    const vector<bool>& live, vector<double>* features) {
+  const IntegerT start = features->size();
+  features->resize(start + Op_ARRAYSIZE + 1, 0.0);
+  if (component_function.empty()) return;
+  const double share = 1.0 / static_cast<double>(component_function.size());
+  for (IntegerT index = 0; index < component_function.size(); ++index) {
+    (*features)[start + component_function[index]->op_] += share;
+    if (live[index]) {
+      (*features)[start + Op_ARRAYSIZE] += share;
+    }
+  }
+}
+
+}  // namespace
+
+FitnessSurrogate::FitnessSurrogate(const FitnessSurrogateSpec& spec)
+    : spec_(spec),
+      weights_(NumFeatures(), 0.0),
+      num_train_examples_(0),
+      num_skipped_(0),
+      num_explored_(0),
+      total_abs_error_(0.0) {
+  CHECK_GE(spec_.skip_margin(), 0.0);
+  // Positive, so that some child is eventually evaluated.
+  CHECK_GT(spec_.exploration_rate(), 0.0);
+  CHECK_LE(spec_.exploration_rate(), 1.0);
+  CHECK_GE(spec_.min_train_examples(), 0);
+  CHECK_GT(spec_.learning_rate(), 0.0);
+  CHECK_LT(spec_.learning_rate(), 2.0);
+}
+
+vector<double> FitnessSurrogate::Features(const Algorithm& child,
+                                          const double parent_fitness,
+                                          const MutationType mutation_type) {
+  vector<double> features;
+  features.reserve(NumFeatures());
+  features.push_back(1.0);  // Bias.
+  const Liveness liveness = ComputeLiveness(child);
+  AppendComponentFunctionFeatures(child.setup_, liveness.setup, &features);
+  AppendComponentFunctionFeatures(child.predict_, liveness.predict, &features);
+  AppendComponentFunctionFeatures(child.learn_, liveness.learn, &features);
+  features.push_back(parent_fitness);
+  const IntegerT mutation_type_start = features.size();
+  features.resize(mutation_type_start + MutationType_ARRAYSIZE, 0.0);
+  features[mutation_type_start + mutation_type] = 1.0;
+  CHECK_EQ(features.size(), NumFeatures());
+  return features;
+}
+
+IntegerT FitnessSurrogate::NumFeatures() {
+  return 1 + 3 * (Op_ARRAYSIZE + 1) + 1 + MutationType_ARRAYSIZE;
+}
+
+double FitnessSurrogate::Predict(const vector<double>& features) const {
+  CHECK_EQ(features.size(), weights_.size());
+  double prediction = 0.0;
+  for (IntegerT index = 0; index < features.size(); ++index) {
+    prediction += weights_[index] * features[index];
+  }
+  return prediction;
+}
+
+bool FitnessSurrogate::ShouldEvaluate(const vector<double>& features,
+                                      const double threshold,
+                                      RandomGenerator* rand_gen) {
+  if (num_train_examples_ < spec_.min_train_examples() ||
+      Predict(features) >= threshold - spec_.skip_margin()) {
+    return true;
+  }
+  if (rand_gen->UniformProbability() < spec_.exploration_rate()) {
+    ++num_explored_;
+    return true;
+  }
+  ++num_skipped_;
+  return false;
+}
+
+void FitnessSurrogate::Train(const vector<double>& features,
+                             const double fitness) {
+  const double error = fitness - Predict(features);
+  double squared_norm = kNormEpsilon;
+  for (const double feature : features) {
+    squared_norm += feature * feature;
+  }
+  const double step = spec_.learning_rate() * error / squared_norm;
+  for (IntegerT index = 0; index < features.size(); ++index) {
+    weights_[index] += step * features[index];
+  }
+  ++num_train_examples_;
+  total_abs_error_ += abs(error);
+}
+
+double FitnessSurrogate::MeanAbsError() const {
+  if (num_train_examples_ == 0) return 0.0;
+  return total_abs_error_ / static_cast<double>(num_train_examples_);
+}
+
+void FitnessSurrogate::PrintStats(ostream* stream) const {
+  *stream << "Fitness surrogate: trained=" << num_train_examples_
+          << ", skipped=" << num_skipped_
+          << ", explored=" << num_explored_
+          << ", mean_abs_error=" << setprecision(6) << fixed << MeanAbsError()
+          << endl;
+}
+
+}  // namespace automl_zero
@@ -0,0 +1,84 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef AUTOML_ZERO_FITNESS_SURROGATE_H_
+#define AUTOML_ZERO_FITNESS_SURROGATE_H_
+
+#include <ostream>
+#include <vector>
+
+#include "algorithm.h"
+#include "definitions.h"
+#include "experiment.pb.h"
+#include "mutator.pb.h"
+#include "random_generator.h"
+
+namespace automl_zero {
+
+// Predicts the fitness of a child from cheap static features, so that the
+// children predicted to be far below a threshold can be skipped instead of
+// evaluated. The features are the share of each op and of the live
+// instructions in each component function, the fitness of the parent and the
+// type of the mutation that produced the child. The model is linear and learns
+// online (normalized least mean squares) from the children that are evaluated,
+// so predicting and learning take a single pass over the features.
+class FitnessSurrogate {
+ public:
+  explicit FitnessSurrogate(const FitnessSurrogateSpec& spec);
+
+  FitnessSurrogate(const FitnessSurrogate& other) = delete;
+  FitnessSurrogate& operator=(const FitnessSurrogate& other) = delete;
+
+  // The features of a child. All are in [0, 1] if the parent fitness is.
+  static std::vector<double> Features(const Algorithm& child,
+                                      double parent_fitness,
+                                      MutationType mutation_type);
+  static IntegerT NumFeatures();
+
+  double Predict(const std::vector<double>& features) const;
+
+  // Whether to evaluate the child with these features, whose fitness needs to
+  // exceed the threshold. Returns false if the model has learned from enough
+  // children, predicts a fitness more than the skip margin below the threshold
+  // and the child is not drawn for exploration. Draws a random number only in
+  // that last case.
+  bool ShouldEvaluate(const std::vector<double>& features, double threshold,
+                      RandomGenerator* rand_gen);
+
+  // Learns from an evaluated child.
+  void Train(const std::vector<double>& features, double fitness);
+
+  IntegerT NumTrainExamples() const {return num_train_examples_;}
+  IntegerT NumSkipped() const {return num_skipped_;}
+  // The children evaluated even though the model would have skipped them.
+  IntegerT NumExplored() const {return num_explored_;}
+
+  // The mean absolute error of the predictions for the children learned from,
+  // each predicted before learning from it.
+  double MeanAbsError() const;
+
+  void PrintStats(std::ostream* stream) const;
+
+ private:
+  const FitnessSurrogateSpec spec_;
+  std::vector<double> weights_;
+  IntegerT num_train_examples_;
+  IntegerT num_skipped_;
+  IntegerT num_explored_;
+  double total_abs_error_;
+};
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_FITNESS_SURROGATE_H_
@@ -0,0 +1,178 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fitness_surrogate.h"
+
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "algorithm.h"
+#include "definitions.h"
+#include "experiment.pb.h"
+#include "generator_test_util.h"
+#include "mutator.pb.h"
+#include "random_generator.h"
+#include "test_util.h"
+#include "gtest/gtest.h"
+
+namespace automl_zero {
+
+using ::std::abs;  // NOLINT
+using ::std::function;  // NOLINT
+using ::std::mt19937;  // NOLINT
+using ::std::vector;  // NOLINT
+
+// Returns how many features differ.
+IntegerT NumDifferent(const vector<double>& features1,
+                      const vector<double>& features2) {
+  CHECK_EQ(features1.size(), features2.size());
+  IntegerT num_different = 0;
+  for (IntegerT index = 0; index < features1.size(); ++index) {
+    if (features1[index] != features2[index]) ++num_different;
+  }
+  return num_different;
+}
+
+FitnessSurrogateSpec TestSpec() {
+  return ParseTextFormat<FitnessSurrogateSpec>(
+      "skip_margin: 0.1 "
+      "exploration_rate: 0.000001 "
+      "min_train_examples: 10 "
+      "learning_rate: 0.5 ");
+}
+
+// Trains on children of constant fitness.
+void TrainOnConstant(const vector<double>& features, const double fitness,
+                     FitnessSurrogate* surrogate) {
+  for (IntegerT i = 0; i < 100; ++i) {
+    surrogate->Train(features, fitness);
+  }
+}
+
+TEST(FitnessSurrogateTest, ComputesFeatures) {
+  const Algorithm algorithm = SimpleGz();
+  const vector<double> features = FitnessSurrogate::Features(
+      algorithm, 0.5, ALTER_PARAM_MUTATION_TYPE);
+  EXPECT_EQ(features.size(), FitnessSurrogate::NumFeatures());
+  for (const double feature : features) {
+    EXPECT_GE(feature, 0.0);
+    EXPECT_LE(feature, 1.0);
+  }
+
+  // The parent fitness is a single feature.
+  const vector<double> other_parent_features = FitnessSurrogate::Features(
+      algorithm, 0.25, ALTER_PARAM_MUTATION_TYPE);
+  EXPECT_EQ(NumDifferent(features, other_parent_features), 1);
+
+  // The mutation type is one-hot.
+  const vector<double> other_mutation_features = FitnessSurrogate::Features(
+      algorithm, 0.5, INSERT_INSTRUCTION_MUTATION_TYPE);
+  EXPECT_EQ(NumDifferent(features, other_mutation_features), 2);
+
+  // The ops are seen.
+  const vector<double> no_op_features = FitnessSurrogate::Features(
+      SimpleNoOpAlgorithm(), 0.5, ALTER_PARAM_MUTATION_TYPE);
+  EXPECT_GT(NumDifferent(features, no_op_features), 0);
+}
+
+TEST(FitnessSurrogateTest, LearnsLinearFitness) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  FitnessSurrogate surrogate(TestSpec());
+  const Algorithm algorithm = SimpleGz();
+  auto fitness = [](const double parent_fitness,
+                    const MutationType mutation_type) {
+    return 0.8 * parent_fitness +
+        (mutation_type == ALTER_PARAM_MUTATION_TYPE ? 0.1 : 0.0);
+  };
+  for (IntegerT i = 0; i < 5000; ++i) {
+    const double parent_fitness = rand_gen.UniformProbability();
+    const MutationType mutation_type =
+        rand_gen.UniformProbability() < 0.5 ?
+        ALTER_PARAM_MUTATION_TYPE : RANDOMIZE_INSTRUCTION_MUTATION_TYPE;
+    surrogate.Train(
+        FitnessSurrogate::Features(algorithm, parent_fitness, mutation_type),
+        fitness(parent_fitness, mutation_type));
+  }
+  EXPECT_EQ(surrogate.NumTrainExamples(), 5000);
+  for (const double parent_fitness : {0.1, 0.5, 0.9}) {
+    for (const MutationType mutation_type :
+         {ALTER_PARAM_MUTATION_TYPE, RANDOMIZE_INSTRUCTION_MUTATION_TYPE}) {
+      EXPECT_LT(abs(surrogate.Predict(FitnessSurrogate::Features(
+                        algorithm, parent_fitness, mutation_type)) -
+                    fitness(parent_fitness, mutation_type)),
+                0.01);
+    }
+  }
+}
+
+TEST(FitnessSurrogateTest, EvaluatesUntilTrained) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  FitnessSurrogate surrogate(TestSpec());
+  const vector<double> features = FitnessSurrogate::Features(
+      SimpleGz(), 0.1, ALTER_PARAM_MUTATION_TYPE);
+  for (IntegerT i = 0; i < 9; ++i) {
+    surrogate.Train(features, 0.1);
+  }
+  EXPECT_TRUE(surrogate.ShouldEvaluate(features, 0.9, &rand_gen));
+  surrogate.Train(features, 0.1);
+  EXPECT_FALSE(surrogate.ShouldEvaluate(features, 0.9, &rand_gen));
+}
+
+TEST(FitnessSurrogateTest, SkipsOnlyBeyondMargin) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  FitnessSurrogate surrogate(TestSpec());
+  const vector<double> features = FitnessSurrogate::Features(
+      SimpleGz(), 0.1, ALTER_PARAM_MUTATION_TYPE);
+  TrainOnConstant(features, 0.1, &surrogate);
+  EXPECT_TRUE(surrogate.ShouldEvaluate(features, 0.15, &rand_gen));
+  EXPECT_EQ(surrogate.NumSkipped(), 0);
+  EXPECT_FALSE(surrogate.ShouldEvaluate(features, 0.25, &rand_gen));
+  EXPECT_EQ(surrogate.NumSkipped(), 1);
+  EXPECT_EQ(surrogate.NumExplored(), 0);
+}
+
+TEST(FitnessSurrogateTest, Explores) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  FitnessSurrogateSpec spec = TestSpec();
+  spec.set_exploration_rate(0.5);
+  FitnessSurrogate surrogate(spec);
+  const vector<double> features = FitnessSurrogate::Features(
+      SimpleGz(), 0.1, ALTER_PARAM_MUTATION_TYPE);
+  TrainOnConstant(features, 0.1, &surrogate);
+  EXPECT_TRUE(IsEventually(
+      function<bool(void)>([&](){
+        return surrogate.ShouldEvaluate(features, 0.9, &rand_gen);
+      }),
+      {false, true}, {false, true}));
+  EXPECT_GT(surrogate.NumSkipped(), 0);
+  EXPECT_GT(surrogate.NumExplored(), 0);
+}
+
+TEST(FitnessSurrogateTest, TracksError) {
+  FitnessSurrogate surrogate(TestSpec());
+  EXPECT_EQ(surrogate.MeanAbsError(), 0.0);
+  const vector<double> features = FitnessSurrogate::Features(
+      SimpleGz(), 0.1, ALTER_PARAM_MUTATION_TYPE);
+  surrogate.Train(features, 0.5);
+  // Untrained, the model predicts zero.
+  EXPECT_DOUBLE_EQ(surrogate.MeanAbsError(), 0.5);
+}
+
+}  // namespace automl_zero
@@ -65,6 +65,21 @@ Generator::Generator(
           rand_gen_),
       no_op_instruction_(make_shared<const Instruction>()) {}
 
+AddressT Generator::NumScalarAddresses() const {
+  return rand_gen_ == nullptr ?
+      kMaxScalarAddresses : rand_gen_->NumScalarAddresses();
+}
+
+AddressT Generator::NumVectorAddresses() const {
+  return rand_gen_ == nullptr ?
+      kMaxVectorAddresses : rand_gen_->NumVectorAddresses();
+}
+
+AddressT Generator::NumMatrixAddresses() const {
+  return rand_gen_ == nullptr ?
+      kMaxMatrixAddresses : rand_gen_->NumMatrixAddresses();
+}
+
 Algorithm Generator::TheInitModel() {
   return ModelByID(init_model_);
 }
@@ -89,6 +104,8 @@ Algorithm Generator::ModelByID(const HardcodedAlgorithmID model) {
     }
     case LINEAR_ALGORITHM:
       return LinearModel(kDefaultLearningRate);
+    case MINI_BATCH_LINEAR_ALGORITHM:
+      return MiniBatchLinearModel(kDefaultLearningRate);
     default:
       LOG(FATAL) << "Unsupported algorithm ID." << endl;
   }
@@ -164,7 +181,7 @@ Algorithm Generator::UnitTestNeuralNetNoBiasNoGradient(
   // Scalar addresses
   constexpr AddressT kLearningRateAddress = 2;
   constexpr AddressT kPredictionErrorAddress = 3;
-  CHECK_GE(kMaxScalarAddresses, 4);
+  CHECK_GE(NumScalarAddresses(), 4);
 
   // Vector addresses.
   constexpr AddressT kFinalLayerWeightsAddress = 1;
@@ -177,7 +194,7 @@ Algorithm Generator::UnitTestNeuralNetNoBiasNoGradient(
   constexpr AddressT kGradientWrtFinalLayerWeightsAddress = 5;
   constexpr AddressT kGradientWrtActivationsAddress = 6;
   constexpr AddressT kGradientOfReluAddress = 7;
-  CHECK_GE(kMaxVectorAddresses, 8);
+  CHECK_GE(NumVectorAddresses(), 8);
 
   // Matrix addresses.
   constexpr AddressT kFirstLayerWeightsAddress = 0;
@@ -185,7 +202,7 @@ Algorithm Generator::UnitTestNeuralNetNoBiasNoGradient(
       kFirstLayerWeightsAddress,
       Generator::kUnitTestNeuralNetNoBiasNoGradientFirstLayerWeightsAddress);
   constexpr AddressT kGradientWrtFirstLayerWeightsAddress = 1;
-  CHECK_GE(kMaxMatrixAddresses, 2);
+  CHECK_GE(NumMatrixAddresses(), 2);
 
   shared_ptr<const Instruction> no_op_instruction =
       make_shared<const Instruction>();
@@ -264,7 +281,7 @@ Algorithm Generator::NeuralNet(
   constexpr AddressT kFinalLayerBiasAddress = 2;
   constexpr AddressT kLearningRateAddress = 3;
   constexpr AddressT kPredictionErrorAddress = 4;
-  CHECK_GE(kMaxScalarAddresses, 5);
+  CHECK_GE(NumScalarAddresses(), 5);
 
   // Vector addresses.
   constexpr AddressT kFirstLayerBiasAddress = 1;
@@ -275,12 +292,12 @@ Algorithm Generator::NeuralNet(
   constexpr AddressT kGradientWrtFinalLayerWeightsAddress = 6;
   constexpr AddressT kGradientWrtActivationsAddress = 7;
   constexpr AddressT kGradientOfReluAddress = 8;
-  CHECK_GE(kMaxVectorAddresses, 9);
+  CHECK_GE(NumVectorAddresses(), 9);
 
   // Matrix addresses.
   constexpr AddressT kFirstLayerWeightsAddress = 0;
   constexpr AddressT kGradientWrtFirstLayerWeightsAddress = 1;
-  CHECK_GE(kMaxMatrixAddresses, 2);
+  CHECK_GE(NumMatrixAddresses(), 2);
 
   shared_ptr<const Instruction> no_op_instruction =
       make_shared<const Instruction>();
@@ -320,7 +337,7 @@ Algorithm Generator::NeuralNet(
       VECTOR_INNER_PRODUCT_OP, kFirstLayerOutputAfterReluAddress,
       kFinalLayerWeightsAddress, kPredictionsScalarAddress));
   // Add final layer bias.
-  CHECK_LE(kFinalLayerBiasAddress, kMaxScalarAddresses);
+  CHECK_LT(kFinalLayerBiasAddress, NumScalarAddresses());
   algorithm.predict_.emplace_back(make_shared<const Instruction>(
       SCALAR_SUM_OP, kPredictionsScalarAddress, kFinalLayerBiasAddress,
       kPredictionsScalarAddress));
@@ -334,7 +351,7 @@ Algorithm Generator::NeuralNet(
   algorithm.learn_.emplace_back(make_shared<const Instruction>(
       SCALAR_PRODUCT_OP,
       kLearningRateAddress, kPredictionErrorAddress, kPredictionErrorAddress));
-  CHECK_LE(kFinalLayerBiasAddress, kMaxScalarAddresses);
+  CHECK_LT(kFinalLayerBiasAddress, NumScalarAddresses());
   // Update final layer bias.
   algorithm.learn_.emplace_back(make_shared<const Instruction>(
     SCALAR_SUM_OP, kFinalLayerBiasAddress, kPredictionErrorAddress,
@@ -381,14 +398,14 @@ Algorithm Generator::LinearModel(const double learning_rate) {
   // Scalar addresses
   constexpr AddressT kLearningRateAddress = 2;
   constexpr AddressT kPredictionErrorAddress = 3;
-  CHECK_GE(kMaxScalarAddresses, 4);
+  CHECK_GE(NumScalarAddresses(), 4);
 
   // Vector addresses.
   constexpr AddressT kWeightsAddress = 1;
   constexpr AddressT kCorrectionAddress = 2;
-  CHECK_GE(kMaxVectorAddresses, 3);
+  CHECK_GE(NumVectorAddresses(), 3);
 
-  CHECK_GE(kMaxMatrixAddresses, 0);
+  CHECK_GE(NumMatrixAddresses(), 0);
 
   shared_ptr<const Instruction> no_op_instruction =
       make_shared<const Instruction>();
@@ -425,4 +442,62 @@ Algorithm Generator::LinearModel(const double learning_rate) {
   return algorithm;
 }
 
+Algorithm Generator::MiniBatchLinearModel(const double learning_rate) {
+  Algorithm algorithm;
+
+  // Scalar addresses
+  constexpr AddressT kLearningRateAddress = 2;
+  CHECK_GE(NumScalarAddresses(), 3);
+
+  // Vector addresses.
+  constexpr AddressT kWeightsAddress = kMiniBatchLinearModelWeightsAddress;
+  constexpr AddressT kPredictionErrorsAddress = 4;
+  constexpr AddressT kCorrectionAddress = 5;
+  CHECK_GE(NumVectorAddresses(), 6);
+
+  // Matrix addresses.
+  constexpr AddressT kTransposedFeaturesAddress = 1;
+  CHECK_GE(NumMatrixAddresses(), 2);
+
+  shared_ptr<const Instruction> no_op_instruction =
+      make_shared<const Instruction>();
+
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP,
+      kLearningRateAddress,
+      ActivationDataSetter(learning_rate)));
+  PadComponentFunctionWithInstruction(
+      setup_size_init_, no_op_instruction, &algorithm.setup_);
+
+  // One prediction per row of the mini-batch.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      MATRIX_VECTOR_PRODUCT_OP,
+      kBatchFeaturesMatrixAddress, kWeightsAddress,
+      kPredictionsVectorAddress));
+  PadComponentFunctionWithInstruction(
+      predict_size_init_, no_op_instruction, &algorithm.predict_);
+
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      VECTOR_DIFF_OP,
+      kLabelsVectorAddress, kPredictionsVectorAddress,
+      kPredictionErrorsAddress));
+  // The sum over the mini-batch of the errors times the features.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      MATRIX_TRANSPOSE_OP,
+      kBatchFeaturesMatrixAddress, kTransposedFeaturesAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      MATRIX_VECTOR_PRODUCT_OP,
+      kTransposedFeaturesAddress, kPredictionErrorsAddress,
+      kCorrectionAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_VECTOR_PRODUCT_OP,
+      kLearningRateAddress, kCorrectionAddress, kCorrectionAddress));
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      VECTOR_SUM_OP,
+      kWeightsAddress, kCorrectionAddress, kWeightsAddress));
+  PadComponentFunctionWithInstruction(
+      learn_size_init_, no_op_instruction, &algorithm.learn_);
+  return algorithm;
+}
+
 }  // namespace automl_zero
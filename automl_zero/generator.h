@@ -78,6 +78,11 @@ class Generator {
   static constexpr AddressT LINEAR_ALGORITHMWeightsAddress = 1;
   Algorithm LinearModel(double learning_rate);
 
+  // A linear model with learning by gradient descent on the sum of the squared
+  // errors of each mini-batch. Only for tasks with a batch size larger than 1.
+  static constexpr AddressT kMiniBatchLinearModelWeightsAddress = 3;
+  Algorithm MiniBatchLinearModel(double learning_rate);
+
   // A 2-layer neural network with one nonlinearity, where both layers implement
   // learning by gradient descent. The weights are initialized randomly.
   Algorithm NeuralNet(
@@ -96,6 +101,13 @@ class Generator {
  private:
   friend Generator Generator();
 
+  // The numbers of addresses the search uses (see
+  // RandomGenerator::SetNumAddresses), which the hardcoded models must fit
+  // in. The capacity of the Memory if there is no random generator.
+  AddressT NumScalarAddresses() const;
+  AddressT NumVectorAddresses() const;
+  AddressT NumMatrixAddresses() const;
+
   const HardcodedAlgorithmID init_model_;
   const IntegerT setup_size_init_;
   const IntegerT predict_size_init_;
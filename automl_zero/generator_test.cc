@@ -176,6 +176,40 @@ TEST(GeneratorTest, LinearModel_Learns) {
   EXPECT_GT(fitness, 0.999);
 }
 
+TEST(GeneratorTest, MiniBatchLinearModel_Learns) {
+  Generator generator(
+      NO_OP_ALGORITHM,  // Irrelevant.
+      10,  // setup_size_init, irrelevant
+      12,  // predict_size_init, irrelevant
+      13,  // learn_size_init, irrelevant
+      {},  // allowed_setup_ops, irrelevant.
+      {},  // allowed_predict_ops, irrelevant.
+      {},  // allowed_learn_ops, irrelevant.
+      nullptr,  // bit_gen, irrelevant.
+      nullptr);  // rand_gen, irrelevant.
+  Task<4> dataset =
+      GenerateTask<4>(StrCat("scalar_linear_regression_task {} "
+                                "num_train_examples: ",
+                                kNumTrainExamples,
+                                " "
+                                "num_valid_examples: ",
+                                kNumValidExamples,
+                                " "
+                                "batch_size: 4 "
+                                "eval_type: RMS_ERROR "
+                                "param_seeds: 100 "
+                                "data_seeds: 1000 "));
+  Algorithm algorithm = generator.MiniBatchLinearModel(kDefaultLearningRate);
+  mt19937 bit_gen(10000);
+  RandomGenerator rand_gen(&bit_gen);
+  Executor<4> executor(algorithm, dataset, kNumTrainExamples, kNumValidExamples,
+                       &rand_gen, kLargeMaxAbsError);
+  double fitness = executor.Execute();
+  EXPECT_GE(fitness, 0.0);
+  EXPECT_LE(fitness, 1.0);
+  EXPECT_GT(fitness, 0.999);
+}
+
 TEST(GeneratorTest, GrTildeGrWithBias_PermanenceTest) {
   Generator generator(
       NO_OP_ALGORITHM,  // Irrelevant.
@@ -337,4 +371,24 @@ TEST(GeneratorTest, GzPadsComponentFunctionSizesCorrectly) {
   EXPECT_EQ(algorithm.learn_.size(), 13);
 }
 
+TEST(GeneratorTest, ModelsMustFitTheAddressesTheSearchUses) {
+  mt19937 bit_gen(100000);
+  RandomGenerator rand_gen(&bit_gen);
+  // Enough for the linear model, but not for the neural network.
+  rand_gen.SetNumAddresses(4, 3, 1);
+  Generator generator(
+      NO_OP_ALGORITHM,  // Irrelevant.
+      10,  // setup_size_init
+      12,  // predict_size_init
+      13,  // learn_size_init
+      {},  // allowed_setup_ops, irrelevant.
+      {},  // allowed_predict_ops, irrelevant.
+      {},  // allowed_learn_ops, irrelevant.
+      &bit_gen,
+      &rand_gen);
+  generator.LinearModel(kDefaultLearningRate);
+  EXPECT_DEATH({generator.NeuralNet(
+      kDefaultLearningRate, kDefaultInitScale, kDefaultInitScale);}, "");
+}
+
 }  // namespace automl_zero
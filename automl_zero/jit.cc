@@ -0,0 +1,433 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jit.h"
+
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(SINGLE_PRECISION)
+#include <sys/mman.h>
+#include <unistd.h>
+#define AUTOML_ZERO_JIT_AVAILABLE 1
+#else
+#define AUTOML_ZERO_JIT_AVAILABLE 0
+#endif
+
+namespace automl_zero {
+
+using ::std::numeric_limits;  // NOLINT
+using ::std::shared_ptr;  // NOLINT
+using ::std::unique_ptr;  // NOLINT
+using ::std::vector;  // NOLINT
+
+namespace {
+
+// Register numbers, as used in the ModRM byte. Only xmm0-xmm7 are used, so the
+// SSE instructions never need a REX prefix.
+enum XmmT : uint8_t { kXmm0 = 0, kXmm1 = 1, kXmm2 = 2 };
+enum GprT : uint8_t { kRax = 0, kRsi = 6, kRdi = 7 };
+
+// The generated functions follow the System V calling convention:
+// void(void* memory, const double* features, double label). So the memory
+// pointer arrives in rdi, the features in rsi and the label in xmm0.
+constexpr GprT kMemoryRegister = kRdi;
+constexpr GprT kFeaturesRegister = kRsi;
+
+// Mandatory prefixes of the SSE2 instructions.
+constexpr uint8_t kScalarDouble = 0xF2;  // The "sd" variants.
+constexpr uint8_t kPackedDouble = 0x66;  // The "pd" variants.
+
+// Second opcode bytes (after 0x0F) of the SSE2 instructions.
+constexpr uint8_t kMovLoadOpcode = 0x10;   // movsd / movupd xmm, m.
+constexpr uint8_t kMovStoreOpcode = 0x11;  // movsd / movupd m, xmm.
+constexpr uint8_t kUnpackLowOpcode = 0x14;   // unpcklpd.
+constexpr uint8_t kUnpackHighOpcode = 0x15;  // unpckhpd.
+constexpr uint8_t kMovAlignedOpcode = 0x28;  // movapd xmm, xmm.
+constexpr uint8_t kSqrtOpcode = 0x51;
+constexpr uint8_t kAndOpcode = 0x54;
+constexpr uint8_t kXorOpcode = 0x57;
+constexpr uint8_t kAddOpcode = 0x58;
+constexpr uint8_t kMulOpcode = 0x59;
+constexpr uint8_t kSubOpcode = 0x5C;
+constexpr uint8_t kMinOpcode = 0x5D;
+constexpr uint8_t kDivOpcode = 0x5E;
+constexpr uint8_t kMaxOpcode = 0x5F;
+constexpr uint8_t kCmpOpcode = 0xC2;
+constexpr uint8_t kCmpLessOrEqual = 2;
+
+constexpr uint64_t kAbsMaskBits = 0x7FFFFFFFFFFFFFFFull;
+
+uint64_t DoubleBits(const double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// Accumulates x86-64 machine code.
+class CodeBuffer {
+ public:
+  const vector<uint8_t>& Bytes() const {return bytes_;}
+
+  // <prefix> 0F <opcode> xmm, [base + disp32].
+  void SseMemory(const uint8_t prefix, const uint8_t opcode, const XmmT reg,
+                 const GprT base, const IntegerT disp) {
+    Byte(prefix);
+    Byte(0x0F);
+    Byte(opcode);
+    Byte(0x80 | (reg << 3) | base);  // mod=10: [base + disp32].
+    Int32(disp);
+  }
+
+  // <prefix> 0F <opcode> dest, src.
+  void SseRegister(const uint8_t prefix, const uint8_t opcode, const XmmT dest,
+                   const XmmT src) {
+    Byte(prefix);
+    Byte(0x0F);
+    Byte(opcode);
+    Byte(0xC0 | (dest << 3) | src);  // mod=11: register to register.
+  }
+
+  // cmpsd dest, src, predicate.
+  void CompareScalar(const XmmT dest, const XmmT src, const uint8_t predicate) {
+    SseRegister(kScalarDouble, kCmpOpcode, dest, src);
+    Byte(predicate);
+  }
+
+  // mov rax, imm64; movq xmm, rax.
+  void LoadImmediate(const XmmT reg, const uint64_t bits) {
+    MoveImmediateToRax(bits);
+    Byte(0x66);
+    Byte(0x48);
+    Byte(0x0F);
+    Byte(0x6E);
+    Byte(0xC0 | (reg << 3) | kRax);
+  }
+
+  // mov rax, imm64; mov [base + disp32], rax.
+  void StoreImmediate(const GprT base, const IntegerT disp,
+                      const uint64_t bits) {
+    MoveImmediateToRax(bits);
+    Byte(0x48);
+    Byte(0x89);
+    Byte(0x80 | (kRax << 3) | base);
+    Int32(disp);
+  }
+
+  void Return() {Byte(0xC3);}
+
+ private:
+  void MoveImmediateToRax(const uint64_t bits) {
+    Byte(0x48);
+    Byte(0xB8 | kRax);
+    for (int i = 0; i < 8; ++i) {
+      Byte(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+  }
+
+  void Byte(const uint8_t value) {bytes_.push_back(value);}
+
+  void Int32(const IntegerT value) {
+    CHECK_GE(value, numeric_limits<int32_t>::min());
+    CHECK_LE(value, numeric_limits<int32_t>::max());
+    const uint32_t bits = static_cast<uint32_t>(static_cast<int32_t>(value));
+    for (int i = 0; i < 4; ++i) {
+      Byte(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+  }
+
+  vector<uint8_t> bytes_;
+};
+
+// Lowers instructions into a CodeBuffer, given the memory layout.
+class Lowerer {
+ public:
+  Lowerer(const JitMemoryLayout& layout, CodeBuffer* code)
+      : layout_(layout), code_(code) {}
+
+  // Features and labels are copied in before the instructions run.
+  void EmitExampleSetup() {
+    // The label arrives in xmm0; store it before xmm0 gets reused.
+    code_->SseMemory(kScalarDouble, kMovStoreOpcode, kXmm0, kMemoryRegister,
+                     Scalar(kLabelsScalarAddress));
+    for (FeatureIndexT i = 0; i < layout_.features_size; i += 2) {
+      code_->SseMemory(kPackedDouble, kMovLoadOpcode, kXmm0, kFeaturesRegister,
+                       i * sizeof(double));
+      code_->SseMemory(kPackedDouble, kMovStoreOpcode, kXmm0, kMemoryRegister,
+                       Vector(kFeaturesVectorAddress, i));
+    }
+  }
+
+  void EmitInstruction(const Instruction& instruction) {
+    switch (instruction.op_) {
+      case NO_OP:
+        return;
+      case SCALAR_SUM_OP:
+        return EmitScalarBinary(kAddOpcode, instruction.in1_,
+                                instruction.in2_, instruction.out_);
+      case SCALAR_DIFF_OP:
+        return EmitScalarBinary(kSubOpcode, instruction.in1_,
+                                instruction.in2_, instruction.out_);
+      case SCALAR_PRODUCT_OP:
+        return EmitScalarBinary(kMulOpcode, instruction.in1_,
+                                instruction.in2_, instruction.out_);
+      case SCALAR_DIVISION_OP:
+        return EmitScalarBinary(kDivOpcode, instruction.in1_,
+                                instruction.in2_, instruction.out_);
+      // minsd/maxsd return their second operand unless the comparison with
+      // the first one succeeds, so swapping the operands reproduces
+      // std::min/std::max exactly, including for NaNs.
+      case SCALAR_MIN_OP:
+        return EmitScalarBinary(kMinOpcode, instruction.in2_,
+                                instruction.in1_, instruction.out_);
+      case SCALAR_MAX_OP:
+        return EmitScalarBinary(kMaxOpcode, instruction.in2_,
+                                instruction.in1_, instruction.out_);
+      case SCALAR_ABS_OP:
+        LoadScalar(kXmm0, instruction.in1_);
+        code_->LoadImmediate(kXmm1, kAbsMaskBits);
+        code_->SseRegister(kPackedDouble, kAndOpcode, kXmm0, kXmm1);
+        return StoreScalar(kXmm0, instruction.out_);
+      case SCALAR_HEAVYSIDE_OP:
+        // xmm1 = (0.0 <= x) ? 1.0 : 0.0. False for NaNs, as in the kernel.
+        LoadScalar(kXmm0, instruction.in1_);
+        code_->SseRegister(kPackedDouble, kXorOpcode, kXmm1, kXmm1);
+        code_->CompareScalar(kXmm1, kXmm0, kCmpLessOrEqual);
+        code_->LoadImmediate(kXmm2, DoubleBits(1.0));
+        code_->SseRegister(kPackedDouble, kAndOpcode, kXmm1, kXmm2);
+        return StoreScalar(kXmm1, instruction.out_);
+      case SCALAR_CONST_SET_OP:
+        code_->StoreImmediate(kMemoryRegister, Scalar(instruction.out_),
+                              DoubleBits(instruction.GetActivationData()));
+        return;
+      case SCALAR_RECIPROCAL_OP:
+        code_->LoadImmediate(kXmm0, DoubleBits(1.0));
+        code_->SseMemory(kScalarDouble, kDivOpcode, kXmm0, kMemoryRegister,
+                         Scalar(instruction.in1_));
+        return StoreScalar(kXmm0, instruction.out_);
+      case VECTOR_SUM_OP:
+        return EmitVectorBinary(kAddOpcode, instruction);
+      case VECTOR_DIFF_OP:
+        return EmitVectorBinary(kSubOpcode, instruction);
+      case VECTOR_PRODUCT_OP:
+        return EmitVectorBinary(kMulOpcode, instruction);
+      case VECTOR_DIVISION_OP:
+        return EmitVectorBinary(kDivOpcode, instruction);
+      case VECTOR_ABS_OP:
+        code_->LoadImmediate(kXmm1, kAbsMaskBits);
+        code_->SseRegister(kPackedDouble, kUnpackLowOpcode, kXmm1, kXmm1);
+        for (FeatureIndexT i = 0; i < layout_.features_size; i += 2) {
+          LoadPacket(kXmm0, instruction.in1_, i);
+          code_->SseRegister(kPackedDouble, kAndOpcode, kXmm0, kXmm1);
+          StorePacket(kXmm0, instruction.out_, i);
+        }
+        return;
+      case SCALAR_VECTOR_PRODUCT_OP:
+        LoadBroadcastScalar(kXmm1, instruction.in1_);
+        for (FeatureIndexT i = 0; i < layout_.features_size; i += 2) {
+          LoadPacket(kXmm0, instruction.in2_, i);
+          code_->SseRegister(kPackedDouble, kMulOpcode, kXmm0, kXmm1);
+          StorePacket(kXmm0, instruction.out_, i);
+        }
+        return;
+      case SCALAR_BROADCAST_OP:
+        LoadBroadcastScalar(kXmm0, instruction.in1_);
+        for (FeatureIndexT i = 0; i < layout_.features_size; i += 2) {
+          StorePacket(kXmm0, instruction.out_, i);
+        }
+        return;
+      case VECTOR_INNER_PRODUCT_OP:
+        EmitDotProduct(instruction.in1_, instruction.in2_);
+        return StoreScalar(kXmm0, instruction.out_);
+      case VECTOR_NORM_OP:
+        EmitDotProduct(instruction.in1_, instruction.in1_);
+        code_->SseRegister(kScalarDouble, kSqrtOpcode, kXmm0, kXmm0);
+        return StoreScalar(kXmm0, instruction.out_);
+      default:
+        LOG(FATAL) << "Op not supported by the JIT." << std::endl;
+    }
+  }
+
+ private:
+  IntegerT Scalar(const AddressT address) const {
+    return layout_.scalar_offset + address * sizeof(double);
+  }
+
+  IntegerT Vector(const AddressT address, const FeatureIndexT index) const {
+    return layout_.vector_offset + address * layout_.vector_stride +
+        index * sizeof(double);
+  }
+
+  void LoadScalar(const XmmT reg, const AddressT address) {
+    code_->SseMemory(kScalarDouble, kMovLoadOpcode, reg, kMemoryRegister,
+                     Scalar(address));
+  }
+
+  void StoreScalar(const XmmT reg, const AddressT address) {
+    code_->SseMemory(kScalarDouble, kMovStoreOpcode, reg, kMemoryRegister,
+                     Scalar(address));
+  }
+
+  // Loads a scalar into both lanes of a register.
+  void LoadBroadcastScalar(const XmmT reg, const AddressT address) {
+    LoadScalar(reg, address);
+    code_->SseRegister(kPackedDouble, kUnpackLowOpcode, reg, reg);
+  }
+
+  // Packets are two consecutive doubles. The memory operands are accessed
+  // with unaligned moves only, so no alignment is assumed anywhere.
+  void LoadPacket(const XmmT reg, const AddressT address,
+                  const FeatureIndexT index) {
+    code_->SseMemory(kPackedDouble, kMovLoadOpcode, reg, kMemoryRegister,
+                     Vector(address, index));
+  }
+
+  void StorePacket(const XmmT reg, const AddressT address,
+                   const FeatureIndexT index) {
+    code_->SseMemory(kPackedDouble, kMovStoreOpcode, reg, kMemoryRegister,
+                     Vector(address, index));
+  }
+
+  void EmitScalarBinary(const uint8_t opcode, const AddressT in1,
+                        const AddressT in2, const AddressT out) {
+    LoadScalar(kXmm0, in1);
+    code_->SseMemory(kScalarDouble, opcode, kXmm0, kMemoryRegister,
+                     Scalar(in2));
+    StoreScalar(kXmm0, out);
+  }
+
+  // Element-wise, so it is safe for the output to alias either input.
+  void EmitVectorBinary(const uint8_t opcode, const Instruction& instruction) {
+    for (FeatureIndexT i = 0; i < layout_.features_size; i += 2) {
+      LoadPacket(kXmm0, instruction.in1_, i);
+      LoadPacket(kXmm1, instruction.in2_, i);
+      code_->SseRegister(kPackedDouble, opcode, kXmm0, kXmm1);
+      StorePacket(kXmm0, instruction.out_, i);
+    }
+  }
+
+  // Leaves the dot product in the low lane of xmm0. The even and odd
+  // coordinates are summed separately and combined at the end, so the rounding
+  // may differ from Eigen's in the last bits for large features sizes.
+  void EmitDotProduct(const AddressT in1, const AddressT in2) {
+    LoadPacket(kXmm0, in1, 0);
+    LoadPacket(kXmm1, in2, 0);
+    code_->SseRegister(kPackedDouble, kMulOpcode, kXmm0, kXmm1);
+    for (FeatureIndexT i = 2; i < layout_.features_size; i += 2) {
+      LoadPacket(kXmm1, in1, i);
+      LoadPacket(kXmm2, in2, i);
+      code_->SseRegister(kPackedDouble, kMulOpcode, kXmm1, kXmm2);
+      code_->SseRegister(kPackedDouble, kAddOpcode, kXmm0, kXmm1);
+    }
+    code_->SseRegister(kPackedDouble, kMovAlignedOpcode, kXmm1, kXmm0);
+    code_->SseRegister(kPackedDouble, kUnpackHighOpcode, kXmm1, kXmm1);
+    code_->SseRegister(kScalarDouble, kAddOpcode, kXmm0, kXmm1);
+  }
+
+  const JitMemoryLayout layout_;
+  CodeBuffer* code_;
+};
+
+}  // namespace
+
+bool JitAvailable() {
+  return AUTOML_ZERO_JIT_AVAILABLE;
+}
+
+bool JitSupportsOp(const Op op, const FeatureIndexT features_size) {
+  switch (op) {
+    case NO_OP:
+    case SCALAR_SUM_OP:
+    case SCALAR_DIFF_OP:
+    case SCALAR_PRODUCT_OP:
+    case SCALAR_DIVISION_OP:
+    case SCALAR_MIN_OP:
+    case SCALAR_MAX_OP:
+    case SCALAR_ABS_OP:
+    case SCALAR_HEAVYSIDE_OP:
+    case SCALAR_CONST_SET_OP:
+    case SCALAR_RECIPROCAL_OP:
+      return true;
+    case VECTOR_SUM_OP:
+    case VECTOR_DIFF_OP:
+    case VECTOR_PRODUCT_OP:
+    case VECTOR_DIVISION_OP:
+    case VECTOR_ABS_OP:
+    case SCALAR_VECTOR_PRODUCT_OP:
+    case SCALAR_BROADCAST_OP:
+    case VECTOR_INNER_PRODUCT_OP:
+    case VECTOR_NORM_OP:
+      // Vectors are processed in packets of two doubles.
+      return features_size % 2 == 0;
+    default:
+      return false;
+  }
+}
+
+unique_ptr<JitComponentFunction> JitComponentFunction::Compile(
+    const vector<shared_ptr<const Instruction>>& component_function,
+    const JitMemoryLayout& layout) {
+  if (!JitAvailable() || layout.features_size % 2 != 0) {
+    return nullptr;
+  }
+  for (const shared_ptr<const Instruction>& instruction : component_function) {
+    if (!JitSupportsOp(instruction->op_, layout.features_size)) {
+      return nullptr;
+    }
+  }
+
+  CodeBuffer code;
+  Lowerer lowerer(layout, &code);
+  lowerer.EmitExampleSetup();
+  for (const shared_ptr<const Instruction>& instruction : component_function) {
+    lowerer.EmitInstruction(*instruction);
+  }
+  code.Return();
+
+#if AUTOML_ZERO_JIT_AVAILABLE
+  const size_t code_size = code.Bytes().size();
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t mapped_size =
+      (code_size + page_size - 1) / page_size * page_size;
+  void* mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    return nullptr;
+  }
+  std::memcpy(mapped, code.Bytes().data(), code_size);
+  if (mprotect(mapped, mapped_size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mapped, mapped_size);
+    return nullptr;
+  }
+  return unique_ptr<JitComponentFunction>(
+      new JitComponentFunction(mapped, mapped_size, code_size));
+#else
+  return nullptr;
+#endif
+}
+
+JitComponentFunction::JitComponentFunction(
+    void* code, const size_t mapped_size, const size_t code_size)
+    : code_(code),
+      mapped_size_(mapped_size),
+      code_size_(code_size),
+      function_(reinterpret_cast<FunctionT>(code)) {}
+
+JitComponentFunction::~JitComponentFunction() {
+#if AUTOML_ZERO_JIT_AVAILABLE
+  munmap(code_, mapped_size_);
+#endif
+}
+
+}  // namespace automl_zero
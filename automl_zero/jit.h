@@ -0,0 +1,87 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// An in-process x86-64 JIT for component functions.
+
+#ifndef AUTOML_ZERO_JIT_H_
+#define AUTOML_ZERO_JIT_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "definitions.h"
+#include "instruction.h"
+
+namespace automl_zero {
+
+// Where the typed memory spaces live, as byte offsets from the start of the
+// Memory object. Obtain with MakeJitMemoryLayout in executor.h.
+struct JitMemoryLayout {
+  FeatureIndexT features_size;
+  IntegerT scalar_offset;
+  IntegerT vector_offset;
+  IntegerT vector_stride;
+};
+
+// Returns whether this build can JIT-compile at all (x86-64 Linux only). The
+// generated code works on doubles, so single-precision builds cannot.
+bool JitAvailable();
+
+// Returns whether the JIT can lower the given op for the given features size.
+// Ops that consume random numbers are never supported, as they need the
+// RandomGenerator.
+bool JitSupportsOp(Op op, FeatureIndexT features_size);
+
+// Native code for one step of a component function. A step copies the features
+// of the current example into the features vector, stores the label in the
+// labels scalar, and then runs every instruction in the component function.
+// All memory addresses are lowered to fixed displacements from the memory
+// pointer, which is kept in a register.
+class JitComponentFunction {
+ public:
+  // Returns nullptr if the JIT is not available or if the component function
+  // contains an unsupported op. Callers should then use the interpreter.
+  static std::unique_ptr<JitComponentFunction> Compile(
+      const std::vector<std::shared_ptr<const Instruction>>& component_function,
+      const JitMemoryLayout& layout);
+
+  JitComponentFunction(const JitComponentFunction& other) = delete;
+  JitComponentFunction& operator=(const JitComponentFunction& other) = delete;
+  ~JitComponentFunction();
+
+  // Runs one step. `memory` must point to a Memory object with the layout given
+  // at compile time and `features` to features_size contiguous Scalars.
+  inline void Run(
+      void* memory, const Scalar* features, const Scalar label) const {
+    function_(memory, features, label);
+  }
+
+  // The size of the generated machine code, in bytes.
+  IntegerT CodeSize() const {return code_size_;}
+
+ private:
+  typedef void (*FunctionT)(void*, const Scalar*, Scalar);
+
+  JitComponentFunction(void* code, size_t mapped_size, size_t code_size);
+
+  void* code_;
+  const size_t mapped_size_;
+  const size_t code_size_;
+  FunctionT function_;
+};
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_JIT_H_
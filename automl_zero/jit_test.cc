@@ -0,0 +1,252 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jit.h"
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "task.h"
+#include "task_util.h"
+#include "definitions.h"
+#include "instruction.pb.h"
+#include "algorithm.h"
+#include "executor.h"
+#include "generator.h"
+#include "instruction.h"
+#include "memory.h"
+#include "random_generator.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+
+namespace automl_zero {
+
+using ::absl::StrCat;  // NOLINT
+using ::std::isnan;  // NOLINT
+using ::std::make_shared;  // NOLINT
+using ::std::mt19937;  // NOLINT
+using ::std::shared_ptr;  // NOLINT
+using ::std::unique_ptr;  // NOLINT
+using ::std::vector;  // NOLINT
+using test_only::GenerateTask;
+
+constexpr IntegerT kNumTrainExamples = 1000;
+constexpr IntegerT kNumValidExamples = 100;
+constexpr double kLargeMaxAbsError = 1000000000.0;
+constexpr IntegerT kNumTrials = 100;
+
+// Reductions may be summed in a different order than Eigen does.
+constexpr double kReductionTolerance = 1e-12;
+
+const vector<Op>& SupportedOps() {
+  static const vector<Op>* ops = new vector<Op>({
+      NO_OP, SCALAR_SUM_OP, SCALAR_DIFF_OP, SCALAR_PRODUCT_OP,
+      SCALAR_DIVISION_OP, SCALAR_MIN_OP, SCALAR_MAX_OP, SCALAR_ABS_OP,
+      SCALAR_HEAVYSIDE_OP, SCALAR_CONST_SET_OP, SCALAR_RECIPROCAL_OP,
+      VECTOR_SUM_OP, VECTOR_DIFF_OP, VECTOR_PRODUCT_OP, VECTOR_DIVISION_OP,
+      VECTOR_ABS_OP, SCALAR_VECTOR_PRODUCT_OP, SCALAR_BROADCAST_OP,
+      VECTOR_INNER_PRODUCT_OP, VECTOR_NORM_OP});
+  return *ops;
+}
+
+void ExpectSameValue(const double expected, const double actual) {
+  if (isnan(expected)) {
+    EXPECT_TRUE(isnan(actual));
+  } else if (std::isinf(expected)) {
+    EXPECT_EQ(actual, expected);
+  } else {
+    EXPECT_NEAR(actual, expected,
+                kReductionTolerance * (1.0 + std::abs(expected)));
+  }
+}
+
+// Fills the memory with values that include zeros, negative zeros and
+// infinities, so that the edge cases of the ops get exercised.
+template<FeatureIndexT F>
+void FillMemory(RandomGenerator* rand_gen, Memory<F>* memory) {
+  memory->Wipe();
+  for (AddressT address = 0; address < kMaxScalarAddresses; ++address) {
+    memory->scalar_[address] = rand_gen->GaussianActivation(0.0, 1.0);
+  }
+  for (AddressT address = 0; address < kMaxVectorAddresses; ++address) {
+    rand_gen->FillGaussian(0.0, 1.0, &memory->vector_[address]);
+  }
+  memory->scalar_[2] = 0.0;
+  memory->scalar_[3] = -0.0;
+  memory->scalar_[4] = std::numeric_limits<double>::infinity();
+  memory->vector_[2](0) = 0.0;
+  memory->vector_[2](1) = -0.0;
+}
+
+template<FeatureIndexT F>
+void ExpectJitMatchesInterpreter(const Op op) {
+  mt19937 bit_gen(op + 1000);
+  RandomGenerator rand_gen(&bit_gen);
+  for (IntegerT trial = 0; trial < kNumTrials; ++trial) {
+    vector<shared_ptr<const Instruction>> component_function;
+    component_function.emplace_back(
+        make_shared<const Instruction>(op, &rand_gen));
+    Memory<F> expected;
+    FillMemory(&rand_gen, &expected);
+    Memory<F> actual;
+    actual.scalar_ = expected.scalar_;
+    actual.vector_ = expected.vector_;
+    actual.matrix_ = expected.matrix_;
+    Vector<F> features;
+    rand_gen.FillGaussian(0.0, 1.0, &features);
+    const Scalar label = rand_gen.GaussianActivation(0.0, 1.0);
+
+    unique_ptr<JitComponentFunction> jit = JitComponentFunction::Compile(
+        component_function, MakeJitMemoryLayout(actual));
+    ASSERT_NE(jit, nullptr);
+    jit->Run(&actual, features.data(), label);
+
+    expected.vector_[kFeaturesVectorAddress] = features;
+    expected.scalar_[kLabelsScalarAddress] = label;
+    ExecuteInstruction(*component_function[0], &rand_gen, &expected);
+
+    for (AddressT address = 0; address < kMaxScalarAddresses; ++address) {
+      ExpectSameValue(expected.scalar_[address], actual.scalar_[address]);
+    }
+    for (AddressT address = 0; address < kMaxVectorAddresses; ++address) {
+      for (FeatureIndexT i = 0; i < F; ++i) {
+        ExpectSameValue(expected.vector_[address](i),
+                        actual.vector_[address](i));
+      }
+    }
+  }
+}
+
+TEST(JitTest, SupportedOpsMatchInterpreter) {
+  if (!JitAvailable()) GTEST_SKIP();
+  for (const Op op : SupportedOps()) {
+    SCOPED_TRACE(op);
+    ExpectJitMatchesInterpreter<2>(op);
+    ExpectJitMatchesInterpreter<4>(op);
+    ExpectJitMatchesInterpreter<16>(op);
+  }
+}
+
+TEST(JitTest, UnsupportedOpsAreRejected) {
+  Memory<4> memory;
+  const JitMemoryLayout layout = MakeJitMemoryLayout(memory);
+  RandomGenerator rand_gen;
+  vector<shared_ptr<const Instruction>> component_function;
+  component_function.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 2, 3, 4));
+  component_function.emplace_back(
+      make_shared<const Instruction>(VECTOR_GAUSSIAN_SET_OP, &rand_gen));
+  EXPECT_FALSE(JitSupportsOp(VECTOR_GAUSSIAN_SET_OP, 4));
+  EXPECT_FALSE(JitSupportsOp(MATRIX_VECTOR_PRODUCT_OP, 4));
+  EXPECT_EQ(JitComponentFunction::Compile(component_function, layout),
+            nullptr);
+}
+
+TEST(JitTest, OddFeaturesSizesAreRejected) {
+  EXPECT_FALSE(JitSupportsOp(VECTOR_SUM_OP, 3));
+  EXPECT_TRUE(JitSupportsOp(SCALAR_SUM_OP, 3));
+}
+
+TEST(JitTest, ExecutorWithJitMatchesInterpreter) {
+  Generator generator(
+      NO_OP_ALGORITHM,  // Irrelevant.
+      10,  // setup_size_init, irrelevant
+      12,  // predict_size_init, irrelevant
+      13,  // learn_size_init, irrelevant
+      {},  // allowed_setup_ops, irrelevant.
+      {},  // allowed_predict_ops, irrelevant.
+      {},  // allowed_learn_ops, irrelevant.
+      nullptr,  // bit_gen, irrelevant.
+      nullptr);  // rand_gen, irrelevant.
+  Task<4> dataset =
+      GenerateTask<4>(StrCat("scalar_linear_regression_task {} "
+                             "num_train_examples: ",
+                             kNumTrainExamples,
+                             " "
+                             "num_valid_examples: ",
+                             kNumValidExamples,
+                             " "
+                             "eval_type: RMS_ERROR "
+                             "param_seeds: 100 "
+                             "data_seeds: 1000 "));
+  Algorithm algorithm = generator.LinearModel(kDefaultLearningRate);
+  mt19937 bit_gen(10000);
+  RandomGenerator rand_gen(&bit_gen);
+  Executor<4> interpreted(algorithm, dataset, kNumTrainExamples,
+                          kNumValidExamples, &rand_gen, kLargeMaxAbsError);
+  Executor<4> compiled(algorithm, dataset, kNumTrainExamples,
+                       kNumValidExamples, &rand_gen, kLargeMaxAbsError,
+                       true);  // use_jit
+  EXPECT_NEAR(compiled.Execute(), interpreted.Execute(), kReductionTolerance);
+  EXPECT_EQ(compiled.GetNumTrainStepsCompleted(),
+            interpreted.GetNumTrainStepsCompleted());
+}
+
+TEST(JitTest, ExecutorsShareCompiledAlgorithm) {
+  Generator generator(
+      NO_OP_ALGORITHM,  // Irrelevant.
+      10,  // setup_size_init, irrelevant
+      12,  // predict_size_init, irrelevant
+      13,  // learn_size_init, irrelevant
+      {},  // allowed_setup_ops, irrelevant.
+      {},  // allowed_predict_ops, irrelevant.
+      {},  // allowed_learn_ops, irrelevant.
+      nullptr,  // bit_gen, irrelevant.
+      nullptr);  // rand_gen, irrelevant.
+  const Algorithm algorithm = generator.LinearModel(kDefaultLearningRate);
+  const unique_ptr<JitAlgorithm> jit_algorithm =
+      CompileJitAlgorithm<4>(algorithm);
+  if (!JitAvailable()) {
+    EXPECT_EQ(jit_algorithm->predict, nullptr);
+    return;
+  }
+  ASSERT_NE(jit_algorithm->predict, nullptr);
+  ASSERT_NE(jit_algorithm->learn, nullptr);
+  // The same code serves tasks with different data.
+  for (const IntegerT data_seed : {1000, 1001}) {
+    Task<4> dataset =
+        GenerateTask<4>(StrCat("scalar_linear_regression_task {} "
+                               "num_train_examples: ",
+                               kNumTrainExamples,
+                               " "
+                               "num_valid_examples: ",
+                               kNumValidExamples,
+                               " "
+                               "eval_type: RMS_ERROR "
+                               "param_seeds: 100 "
+                               "data_seeds: ",
+                               data_seed));
+    mt19937 bit_gen(10000);
+    RandomGenerator rand_gen(&bit_gen);
+    Executor<4> own(algorithm, dataset, kNumTrainExamples, kNumValidExamples,
+                    &rand_gen, kLargeMaxAbsError,
+                    true);  // use_jit
+    Executor<4> shared(algorithm, dataset, kNumTrainExamples,
+                       kNumValidExamples, &rand_gen, kLargeMaxAbsError,
+                       true,  // use_jit
+                       false,  // wipe_used_memory_only
+                       false,  // short_circuit_constant_predictions
+                       nullptr,  // initial_state
+                       false,  // stop_on_fatal_nans
+                       false,  // use_fast_math
+                       ValidationBound(),
+                       jit_algorithm.get());
+    EXPECT_EQ(shared.Execute(), own.Execute());
+  }
+}
+
+}  // namespace automl_zero
@@ -0,0 +1,827 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Executes one Algorithm on several tasks at once. Each task occupies a lane:
+// every scalar memory slot holds one value per lane, and every vector memory
+// slot holds, for each coordinate, one value per lane. The instruction stream
+// is decoded and dispatched once per example for all the lanes, and each
+// instruction becomes a short loop over the lanes that the compiler can
+// vectorize (e.g. AVX2 or AVX-512, depending on the build flags).
+
+#ifndef AUTOML_ZERO_LANE_EXECUTOR_H_
+#define AUTOML_ZERO_LANE_EXECUTOR_H_
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "task.h"
+#include "definitions.h"
+#include "instruction.pb.h"
+#include "algorithm.h"
+#include "dataflow.h"
+#include "executor.h"
+#include "instruction.h"
+#include "memory.h"
+#include "random_generator.h"
+#include "gtest/gtest_prod.h"
+
+namespace automl_zero {
+
+// The number of lanes the Evaluator uses. Matches the number of Scalars in the
+// widest vector registers the build targets.
+#if defined(__AVX512F__)
+constexpr IntegerT kNumTaskLanes = 64 / sizeof(Scalar);
+#else
+constexpr IntegerT kNumTaskLanes = 32 / sizeof(Scalar);
+#endif
+
+// One scalar per lane.
+template<IntegerT K>
+struct alignas(sizeof(Scalar) * K) LaneScalar {
+  static_assert((K & (K - 1)) == 0, "The number of lanes must be a power of 2");
+  Scalar lanes_[K];
+};
+
+// One vector per lane, stored lane-interleaved: element i of all the lanes is
+// contiguous.
+template<FeatureIndexT F, IntegerT K>
+struct LaneVector {
+  LaneScalar<K> elements_[F];
+};
+
+// The scalar and vector memory of K lanes. There are no matrices: the lane
+// executor only runs component functions that do not use them.
+template<FeatureIndexT F, IntegerT K>
+class LaneMemory {
+ public:
+  // Starts with all the lanes zeroed.
+  LaneMemory() : scalar_(), vector_() {}
+  LaneMemory(const LaneMemory& other) = delete;
+  LaneMemory& operator=(const LaneMemory& other) = delete;
+
+  // Copies the first num_scalars scalars and num_vectors vectors of a Memory
+  // into the given lane.
+  void SetLane(IntegerT lane, const Memory<F>& memory,
+               AddressT num_scalars = kMaxScalarAddresses,
+               AddressT num_vectors = kMaxVectorAddresses);
+
+  // Copies the scalars and vectors of the given lane into a Memory. Leaves the
+  // matrices untouched.
+  void GetLane(IntegerT lane, Memory<F>* memory) const;
+
+  std::array<LaneScalar<K>, kMaxScalarAddresses> scalar_;
+  std::array<LaneVector<F, K>, kMaxVectorAddresses> vector_;
+};
+
+// Returns whether the lane executor can run the op. Matrix ops and ops that
+// consume random numbers are not supported. The latter because running the
+// tasks in lockstep would change the order of the random draws.
+bool LaneExecutorSupportsOp(Op op);
+
+// Returns whether the lane executor can run the predict and learn component
+// functions of the given Algorithm. The setup component function can contain
+// any op, as it is run separately for each lane.
+bool LaneExecutorSupports(const Algorithm& algorithm);
+
+// Returns whether two tasks can share a LaneExecutor, i.e. they iterate over
+// the same number of examples in the same way, one example at a time.
+bool LaneCompatible(const TaskInterface& task1, const TaskInterface& task2);
+
+template<FeatureIndexT F, IntegerT K>
+class LaneExecutor {
+ public:
+  // Runs the setup component function for each task, in order, with the given
+  // random generator. If set, use_task_random_stream is called with each task
+  // right before its setup, e.g. to switch the random generator to a stream
+  // of the task. The tasks must be LaneCompatible with each other, and there
+  // can be at most K of them. All arguments are stored by reference, so they
+  // must out-live the LaneExecutor instance. The other arguments are as in the
+  // Executor.
+  LaneExecutor(const Algorithm& algorithm,
+               const std::vector<const Task<F>*>& tasks,
+               IntegerT num_all_train_examples, IntegerT num_valid_examples,
+               RandomGenerator* rand_gen, double max_abs_error,
+               const std::function<void(const Task<F>&)>&
+                   use_task_random_stream = nullptr);
+  LaneExecutor(const LaneExecutor& other) = delete;
+  LaneExecutor& operator=(const LaneExecutor& other) = delete;
+
+  // Returns the fitness for each task. Each equals what Executor::Execute
+  // would return for that task on its own.
+  std::vector<double> Execute();
+
+  // Get the number of train steps this executor has performed, summed over the
+  // tasks. Steps run in lanes that already stopped early are not counted.
+  IntegerT GetNumTrainStepsCompleted() const;
+
+ private:
+  FRIEND_TEST(LaneExecutorTest, MatchesExecutorMemory);
+
+  // Performs training for a given number of steps. Deactivates the lanes that
+  // stop early.
+  void Train(IntegerT max_steps,
+             std::vector<TaskIterator<F>>* train_its);
+
+  // Performs validation on the active lanes and fills their fitnesses.
+  void Validate(std::vector<double>* fitnesses);
+
+  // Loads the features and label of each task's current example into the
+  // lanes.
+  void AssignFeatures(const std::vector<TaskIterator<F>>& its);
+  void AssignLabels(const std::vector<TaskIterator<F>>& its);
+  void AssignZeroLabels();
+
+  bool AnyActive() const;
+
+  const Algorithm& algorithm_;
+  const DecodedComponentFunction predict_;
+  const DecodedComponentFunction learn_;
+  const std::vector<const Task<F>*> tasks_;
+  const IntegerT num_all_train_examples_;
+  const IntegerT num_valid_examples_;
+  const double max_abs_error_;
+  std::unique_ptr<LaneMemory<F, K>> memory_;
+
+  // Whether each lane is still training. Lanes beyond tasks_.size() are never
+  // active.
+  std::vector<bool> active_;
+  IntegerT num_train_steps_completed_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Lane kernels.
+////////////////////////////////////////////////////////////////////////////////
+
+// Each kernel mirrors the Executor's kernel for the same op, so that every lane
+// produces exactly the same values as an Executor would.
+
+#define AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(name, expression)                 \
+  template<FeatureIndexT F, IntegerT K>                                        \
+  inline void name(const DecodedInstruction& instruction,                      \
+                   LaneMemory<F, K>* memory) {                                 \
+    const Scalar* in = memory->scalar_[instruction.in1_].lanes_;               \
+    Scalar* out = memory->scalar_[instruction.out_].lanes_;                    \
+    for (IntegerT k = 0; k < K; ++k) {                                         \
+      const Scalar x = in[k];                                                  \
+      out[k] = (expression);                                                   \
+    }                                                                          \
+  }
+
+#define AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL(name, expression)                \
+  template<FeatureIndexT F, IntegerT K>                                        \
+  inline void name(const DecodedInstruction& instruction,                      \
+                   LaneMemory<F, K>* memory) {                                 \
+    const Scalar* in1 = memory->scalar_[instruction.in1_].lanes_;              \
+    const Scalar* in2 = memory->scalar_[instruction.in2_].lanes_;              \
+    Scalar* out = memory->scalar_[instruction.out_].lanes_;                    \
+    for (IntegerT k = 0; k < K; ++k) {                                         \
+      const Scalar x = in1[k];                                                 \
+      const Scalar y = in2[k];                                                 \
+      out[k] = (expression);                                                   \
+    }                                                                          \
+  }
+
+#define AUTOML_ZERO_LANE_VECTOR_UNARY_KERNEL(name, expression)                 \
+  template<FeatureIndexT F, IntegerT K>                                        \
+  inline void name(const DecodedInstruction& instruction,                      \
+                   LaneMemory<F, K>* memory) {                                 \
+    const LaneScalar<K>* in = memory->vector_[instruction.in1_].elements_;     \
+    LaneScalar<K>* out = memory->vector_[instruction.out_].elements_;          \
+    for (FeatureIndexT i = 0; i < F; ++i) {                                    \
+      for (IntegerT k = 0; k < K; ++k) {                                       \
+        const Scalar x = in[i].lanes_[k];                                      \
+        out[i].lanes_[k] = (expression);                                       \
+      }                                                                        \
+    }                                                                          \
+  }
+
+#define AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL(name, expression)                \
+  template<FeatureIndexT F, IntegerT K>                                        \
+  inline void name(const DecodedInstruction& instruction,                      \
+                   LaneMemory<F, K>* memory) {                                 \
+    const LaneScalar<K>* in1 = memory->vector_[instruction.in1_].elements_;    \
+    const LaneScalar<K>* in2 = memory->vector_[instruction.in2_].elements_;    \
+    LaneScalar<K>* out = memory->vector_[instruction.out_].elements_;          \
+    for (FeatureIndexT i = 0; i < F; ++i) {                                    \
+      for (IntegerT k = 0; k < K; ++k) {                                       \
+        const Scalar x = in1[i].lanes_[k];                                     \
+        const Scalar y = in2[i].lanes_[k];                                     \
+        out[i].lanes_[k] = (expression);                                       \
+      }                                                                        \
+    }                                                                          \
+  }
+
+AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL(ExecuteLaneScalarSumOp, x + y)
+AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL(ExecuteLaneScalarDiffOp, x - y)
+AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL(ExecuteLaneScalarProductOp, x * y)
+AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL(ExecuteLaneScalarDivisionOp, x / y)
+AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL(ExecuteLaneScalarMinOp, std::min(x, y))
+AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL(ExecuteLaneScalarMaxOp, std::max(x, y))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarAbsOp, std::abs(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(
+    ExecuteLaneScalarHeavisideOp, x >= 0.0 ? 1.0 : 0.0)
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(
+    ExecuteLaneScalarReciprocalOp, static_cast<Scalar>(1.0) / x)
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarSinOp, std::sin(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarCosOp, std::cos(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarTanOp, std::tan(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarArcSinOp, std::asin(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarArcCosOp, std::acos(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarArcTanOp, std::atan(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarExpOp, std::exp(x))
+AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL(ExecuteLaneScalarLogOp, std::log(x))
+
+AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL(ExecuteLaneVectorSumOp, x + y)
+AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL(ExecuteLaneVectorDiffOp, x - y)
+AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL(ExecuteLaneVectorProductOp, x * y)
+AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL(ExecuteLaneVectorDivisionOp, x / y)
+AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL(ExecuteLaneVectorMinOp, std::min(x, y))
+AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL(ExecuteLaneVectorMaxOp, std::max(x, y))
+AUTOML_ZERO_LANE_VECTOR_UNARY_KERNEL(ExecuteLaneVectorAbsOp, std::abs(x))
+AUTOML_ZERO_LANE_VECTOR_UNARY_KERNEL(
+    ExecuteLaneVectorHeavisideOp, x > 0.0 ? 1.0 : 0.0)
+AUTOML_ZERO_LANE_VECTOR_UNARY_KERNEL(
+    ExecuteLaneVectorReciprocalOp, static_cast<Scalar>(1.0) / x)
+
+#undef AUTOML_ZERO_LANE_SCALAR_UNARY_KERNEL
+#undef AUTOML_ZERO_LANE_SCALAR_BINARY_KERNEL
+#undef AUTOML_ZERO_LANE_VECTOR_UNARY_KERNEL
+#undef AUTOML_ZERO_LANE_VECTOR_BINARY_KERNEL
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneScalarConstSetOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  const Scalar value = instruction.GetActivationData();
+  Scalar* out = memory->scalar_[instruction.out_].lanes_;
+  for (IntegerT k = 0; k < K; ++k) {
+    out[k] = value;
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneVectorConstSetOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  const FeatureIndexT index = FloatToIndex(instruction.GetFloatData0(), F);
+  const Scalar value = instruction.GetFloatData1();
+  Scalar* out = memory->vector_[instruction.out_].elements_[index].lanes_;
+  for (IntegerT k = 0; k < K; ++k) {
+    out[k] = value;
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneScalarVectorProductOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  const LaneScalar<K>& scalar = memory->scalar_[instruction.in1_];
+  const LaneScalar<K>* in = memory->vector_[instruction.in2_].elements_;
+  LaneScalar<K>* out = memory->vector_[instruction.out_].elements_;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    for (IntegerT k = 0; k < K; ++k) {
+      out[i].lanes_[k] = in[i].lanes_[k] * scalar.lanes_[k];
+    }
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneScalarBroadcastOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  const LaneScalar<K>& scalar = memory->scalar_[instruction.in1_];
+  LaneScalar<K>* out = memory->vector_[instruction.out_].elements_;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    out[i] = scalar;
+  }
+}
+
+// Copies one lane of a vector into an Eigen vector. Reductions use this so
+// that they reuse Eigen's summation order and match the Executor bit for bit.
+template<FeatureIndexT F, IntegerT K>
+inline void GatherLane(const LaneVector<F, K>& lane_vector, const IntegerT k,
+                       Vector<F>* vector) {
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    (*vector)(i) = lane_vector.elements_[i].lanes_[k];
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneVectorInnerProductOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  Vector<F> in1;
+  Vector<F> in2;
+  Scalar* out = memory->scalar_[instruction.out_].lanes_;
+  for (IntegerT k = 0; k < K; ++k) {
+    GatherLane(memory->vector_[instruction.in1_], k, &in1);
+    GatherLane(memory->vector_[instruction.in2_], k, &in2);
+    out[k] = in1.dot(in2);
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneVectorNormOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  Vector<F> in;
+  Scalar* out = memory->scalar_[instruction.out_].lanes_;
+  for (IntegerT k = 0; k < K; ++k) {
+    GatherLane(memory->vector_[instruction.in1_], k, &in);
+    out[k] = in.norm();
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneVectorMeanOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  Vector<F> in;
+  Scalar* out = memory->scalar_[instruction.out_].lanes_;
+  for (IntegerT k = 0; k < K; ++k) {
+    GatherLane(memory->vector_[instruction.in1_], k, &in);
+    out[k] = in.mean();
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+inline void ExecuteLaneVectorStDevOp(
+    const DecodedInstruction& instruction, LaneMemory<F, K>* memory) {
+  Vector<F> values;
+  Scalar* out = memory->scalar_[instruction.out_].lanes_;
+  for (IntegerT k = 0; k < K; ++k) {
+    GatherLane(memory->vector_[instruction.in1_], k, &values);
+    const Scalar mean = values.mean();
+    out[k] = sqrt(values.dot(values) / static_cast<Scalar>(F) - mean * mean);
+  }
+}
+
+// Runs a decoded component function on all the lanes. The component function
+// must only contain ops for which LaneExecutorSupportsOp is true.
+template<FeatureIndexT F, IntegerT K>
+void ExecuteLaneInstructions(
+    const DecodedComponentFunction& component_function,
+    LaneMemory<F, K>* memory) {
+  for (const DecodedInstruction* instruction = component_function.begin();
+       instruction->op_ != kEndOfStreamDecodedOp; ++instruction) {
+    switch (instruction->op_) {
+      case NO_OP:
+        break;
+      case SCALAR_SUM_OP:
+        ExecuteLaneScalarSumOp(*instruction, memory);
+        break;
+      case SCALAR_DIFF_OP:
+        ExecuteLaneScalarDiffOp(*instruction, memory);
+        break;
+      case SCALAR_PRODUCT_OP:
+        ExecuteLaneScalarProductOp(*instruction, memory);
+        break;
+      case SCALAR_DIVISION_OP:
+        ExecuteLaneScalarDivisionOp(*instruction, memory);
+        break;
+      case SCALAR_ABS_OP:
+        ExecuteLaneScalarAbsOp(*instruction, memory);
+        break;
+      case SCALAR_RECIPROCAL_OP:
+        ExecuteLaneScalarReciprocalOp(*instruction, memory);
+        break;
+      case SCALAR_SIN_OP:
+        ExecuteLaneScalarSinOp(*instruction, memory);
+        break;
+      case SCALAR_COS_OP:
+        ExecuteLaneScalarCosOp(*instruction, memory);
+        break;
+      case SCALAR_TAN_OP:
+        ExecuteLaneScalarTanOp(*instruction, memory);
+        break;
+      case SCALAR_ARCSIN_OP:
+        ExecuteLaneScalarArcSinOp(*instruction, memory);
+        break;
+      case SCALAR_ARCCOS_OP:
+        ExecuteLaneScalarArcCosOp(*instruction, memory);
+        break;
+      case SCALAR_ARCTAN_OP:
+        ExecuteLaneScalarArcTanOp(*instruction, memory);
+        break;
+      case SCALAR_EXP_OP:
+        ExecuteLaneScalarExpOp(*instruction, memory);
+        break;
+      case SCALAR_LOG_OP:
+        ExecuteLaneScalarLogOp(*instruction, memory);
+        break;
+      case SCALAR_HEAVYSIDE_OP:
+        ExecuteLaneScalarHeavisideOp(*instruction, memory);
+        break;
+      case VECTOR_HEAVYSIDE_OP:
+        ExecuteLaneVectorHeavisideOp(*instruction, memory);
+        break;
+      case SCALAR_VECTOR_PRODUCT_OP:
+        ExecuteLaneScalarVectorProductOp(*instruction, memory);
+        break;
+      case SCALAR_BROADCAST_OP:
+        ExecuteLaneScalarBroadcastOp(*instruction, memory);
+        break;
+      case VECTOR_RECIPROCAL_OP:
+        ExecuteLaneVectorReciprocalOp(*instruction, memory);
+        break;
+      case VECTOR_NORM_OP:
+        ExecuteLaneVectorNormOp(*instruction, memory);
+        break;
+      case VECTOR_ABS_OP:
+        ExecuteLaneVectorAbsOp(*instruction, memory);
+        break;
+      case VECTOR_SUM_OP:
+        ExecuteLaneVectorSumOp(*instruction, memory);
+        break;
+      case VECTOR_DIFF_OP:
+        ExecuteLaneVectorDiffOp(*instruction, memory);
+        break;
+      case VECTOR_PRODUCT_OP:
+        ExecuteLaneVectorProductOp(*instruction, memory);
+        break;
+      case VECTOR_DIVISION_OP:
+        ExecuteLaneVectorDivisionOp(*instruction, memory);
+        break;
+      case VECTOR_INNER_PRODUCT_OP:
+        ExecuteLaneVectorInnerProductOp(*instruction, memory);
+        break;
+      case SCALAR_MIN_OP:
+        ExecuteLaneScalarMinOp(*instruction, memory);
+        break;
+      case VECTOR_MIN_OP:
+        ExecuteLaneVectorMinOp(*instruction, memory);
+        break;
+      case SCALAR_MAX_OP:
+        ExecuteLaneScalarMaxOp(*instruction, memory);
+        break;
+      case VECTOR_MAX_OP:
+        ExecuteLaneVectorMaxOp(*instruction, memory);
+        break;
+      case VECTOR_MEAN_OP:
+        ExecuteLaneVectorMeanOp(*instruction, memory);
+        break;
+      case VECTOR_ST_DEV_OP:
+        ExecuteLaneVectorStDevOp(*instruction, memory);
+        break;
+      case SCALAR_CONST_SET_OP:
+        ExecuteLaneScalarConstSetOp(*instruction, memory);
+        break;
+      case VECTOR_CONST_SET_OP:
+        ExecuteLaneVectorConstSetOp(*instruction, memory);
+        break;
+      default:
+        LOG(FATAL) << "Op not supported by the lane executor." << std::endl;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation.
+////////////////////////////////////////////////////////////////////////////////
+
+template<FeatureIndexT F, IntegerT K>
+void LaneMemory<F, K>::SetLane(const IntegerT lane, const Memory<F>& memory,
+                               const AddressT num_scalars,
+                               const AddressT num_vectors) {
+  for (AddressT address = 0; address < num_scalars; ++address) {
+    scalar_[address].lanes_[lane] = memory.scalar_[address];
+  }
+  for (AddressT address = 0; address < num_vectors; ++address) {
+    for (FeatureIndexT i = 0; i < F; ++i) {
+      vector_[address].elements_[i].lanes_[lane] = memory.vector_[address](i);
+    }
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+void LaneMemory<F, K>::GetLane(const IntegerT lane, Memory<F>* memory) const {
+  for (AddressT address = 0; address < kMaxScalarAddresses; ++address) {
+    memory->scalar_[address] = scalar_[address].lanes_[lane];
+  }
+  for (AddressT address = 0; address < kMaxVectorAddresses; ++address) {
+    for (FeatureIndexT i = 0; i < F; ++i) {
+      memory->vector_[address](i) = vector_[address].elements_[i].lanes_[lane];
+    }
+  }
+}
+
+inline bool LaneExecutorSupportsOp(const Op op) {
+  switch (op) {
+    case NO_OP:
+    case SCALAR_SUM_OP:
+    case SCALAR_DIFF_OP:
+    case SCALAR_PRODUCT_OP:
+    case SCALAR_DIVISION_OP:
+    case SCALAR_ABS_OP:
+    case SCALAR_RECIPROCAL_OP:
+    case SCALAR_SIN_OP:
+    case SCALAR_COS_OP:
+    case SCALAR_TAN_OP:
+    case SCALAR_ARCSIN_OP:
+    case SCALAR_ARCCOS_OP:
+    case SCALAR_ARCTAN_OP:
+    case SCALAR_EXP_OP:
+    case SCALAR_LOG_OP:
+    case SCALAR_HEAVYSIDE_OP:
+    case VECTOR_HEAVYSIDE_OP:
+    case SCALAR_VECTOR_PRODUCT_OP:
+    case SCALAR_BROADCAST_OP:
+    case VECTOR_RECIPROCAL_OP:
+    case VECTOR_NORM_OP:
+    case VECTOR_ABS_OP:
+    case VECTOR_SUM_OP:
+    case VECTOR_DIFF_OP:
+    case VECTOR_PRODUCT_OP:
+    case VECTOR_DIVISION_OP:
+    case VECTOR_INNER_PRODUCT_OP:
+    case SCALAR_MIN_OP:
+    case VECTOR_MIN_OP:
+    case SCALAR_MAX_OP:
+    case VECTOR_MAX_OP:
+    case VECTOR_MEAN_OP:
+    case VECTOR_ST_DEV_OP:
+    case SCALAR_CONST_SET_OP:
+    case VECTOR_CONST_SET_OP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+inline bool LaneExecutorSupports(const Algorithm& algorithm) {
+  for (const auto* component_function :
+       {&algorithm.predict_, &algorithm.learn_}) {
+    for (const std::shared_ptr<const Instruction>& instruction :
+         *component_function) {
+      if (!LaneExecutorSupportsOp(instruction->op_)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+inline bool LaneCompatible(
+    const TaskInterface& task1, const TaskInterface& task2) {
+  return task1.FeaturesSize() == task2.FeaturesSize() &&
+      task1.GetEvalType() == task2.GetEvalType() &&
+      task1.TrainExamplesPerEpoch() == task2.TrainExamplesPerEpoch() &&
+      task1.NumTrainEpochs() == task2.NumTrainEpochs() &&
+      task1.ValidSteps() == task2.ValidSteps() &&
+      task1.BatchSize() == 1 && task2.BatchSize() == 1;
+}
+
+template<FeatureIndexT F, IntegerT K>
+LaneExecutor<F, K>::LaneExecutor(
+    const Algorithm& algorithm, const std::vector<const Task<F>*>& tasks,
+    const IntegerT num_all_train_examples, const IntegerT num_valid_examples,
+    RandomGenerator* rand_gen, const double max_abs_error,
+    const std::function<void(const Task<F>&)>& use_task_random_stream)
+    : algorithm_(algorithm),
+      predict_(algorithm_.predict_),
+      learn_(algorithm_.learn_),
+      tasks_(tasks),
+      num_all_train_examples_(num_all_train_examples),
+      num_valid_examples_(num_valid_examples),
+      max_abs_error_(max_abs_error),
+      memory_(new LaneMemory<F, K>()),
+      active_(K, false),
+      num_train_steps_completed_(0) {
+  CHECK(!tasks_.empty());
+  CHECK_LE(tasks_.size(), K);
+  CHECK(LaneExecutorSupports(algorithm_));
+  for (const Task<F>* task : tasks_) {
+    CHECK(LaneCompatible(*tasks_[0], *task));
+  }
+  // Lanes without a task are left with a wiped memory. Only the addresses
+  // the Algorithm uses are wiped and copied; the rest stay zero.
+  const AddressUsage usage = GetAddressUsage(algorithm_);
+  const DecodedComponentFunction setup(algorithm_.setup_);
+  // On the heap, as it is too large for the stack with large features sizes.
+  const std::unique_ptr<Memory<F>> lane_memory_owned(new Memory<F>());
+  Memory<F>& lane_memory = *lane_memory_owned;
+  for (IntegerT k = 0; k < K; ++k) {
+    lane_memory.Wipe(usage.num_scalars, usage.num_vectors, usage.num_matrices);
+    if (k < tasks_.size()) {
+      if (use_task_random_stream) use_task_random_stream(*tasks_[k]);
+      ExecuteDecoded(setup, rand_gen, &lane_memory);
+      active_[k] = true;
+    }
+    memory_->SetLane(k, lane_memory, usage.num_scalars, usage.num_vectors);
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+std::vector<double> LaneExecutor<F, K>::Execute() {
+  const Task<F>& task = *tasks_[0];
+  CHECK_GE(task.NumTrainEpochs(), 1);
+
+  std::vector<TaskIterator<F>> train_its;
+  train_its.reserve(tasks_.size());
+  for (const Task<F>* lane_task : tasks_) {
+    train_its.push_back(lane_task->TrainIterator());
+  }
+
+  // Same control flow as Executor::Execute, which is identical for all lanes
+  // as the tasks are LaneCompatible. Only the early stopping differs by lane.
+  const IntegerT num_all_train_examples =
+      std::min(num_all_train_examples_,
+               static_cast<IntegerT>(task.MaxTrainExamples()));
+  const IntegerT num_examples_per_epoch =
+      task.TrainExamplesPerEpoch() == kNumTrainExamplesNotSet ?
+      num_all_train_examples : task.TrainExamplesPerEpoch();
+  IntegerT num_remaining = num_all_train_examples;
+  std::vector<double> best_fitnesses(tasks_.size(), kMinFitness);
+  while (num_remaining > 0 && AnyActive()) {
+    Train(std::min(num_examples_per_epoch, num_remaining), &train_its);
+    num_remaining -= num_examples_per_epoch;
+    std::vector<double> current_fitnesses(tasks_.size(), kMinFitness);
+    Validate(&current_fitnesses);
+    for (IntegerT k = 0; k < tasks_.size(); ++k) {
+      best_fitnesses[k] = std::max(current_fitnesses[k], best_fitnesses[k]);
+    }
+  }
+  return best_fitnesses;
+}
+
+template<FeatureIndexT F, IntegerT K>
+IntegerT LaneExecutor<F, K>::GetNumTrainStepsCompleted() const {
+  return num_train_steps_completed_;
+}
+
+template<FeatureIndexT F, IntegerT K>
+void LaneExecutor<F, K>::Train(const IntegerT max_steps,
+                               std::vector<TaskIterator<F>>* train_its) {
+  for (IntegerT step = 0; step < max_steps; ++step) {
+    for (IntegerT k = 0; k < tasks_.size(); ++k) {
+      if (active_[k]) ++num_train_steps_completed_;
+    }
+
+    // Run predict component function for this example.
+    AssignFeatures(*train_its);
+    AssignZeroLabels();
+    ExecuteLaneInstructions(predict_, memory_.get());
+
+    // Check whether we should stop early.
+    Scalar* predictions = memory_->scalar_[kPredictionsScalarAddress].lanes_;
+    for (IntegerT k = 0; k < tasks_.size(); ++k) {
+      if (tasks_[k]->eval_type_ == ACCURACY) {
+        predictions[k] = Sigmoid(predictions[k]);
+      }
+      const double abs_error =
+          std::abs((*train_its)[k].GetLabel() - predictions[k]);
+      if (std::isnan(abs_error) || abs_error > max_abs_error_) {
+        active_[k] = false;
+      }
+    }
+    if (!AnyActive()) return;
+
+    // Run learn component function for this example.
+    AssignFeatures(*train_its);
+    AssignLabels(*train_its);
+    ExecuteLaneInstructions(learn_, memory_.get());
+
+    // Check whether we are done.
+    bool done = false;
+    for (TaskIterator<F>& train_it : *train_its) {
+      train_it.Next();
+      done = train_it.Done();
+    }
+    if (done) {
+      break;  // Reached the end of the dataset.
+    }
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+void LaneExecutor<F, K>::Validate(std::vector<double>* fitnesses) {
+  const Task<F>& task = *tasks_[0];
+  const IntegerT num_steps =
+      std::min(num_valid_examples_, static_cast<IntegerT>(task.ValidSteps()));
+
+  // Lanes that stopped early during training or validation are not valid.
+  std::vector<bool> valid(active_.begin(), active_.begin() + tasks_.size());
+  std::vector<double> losses(tasks_.size(), 0.0);
+  std::vector<TaskIterator<F>> valid_its;
+  valid_its.reserve(tasks_.size());
+  for (const Task<F>* lane_task : tasks_) {
+    valid_its.push_back(lane_task->ValidIterator());
+  }
+  for (IntegerT step = 0; step < num_steps; ++step) {
+    // Run predict component function for this example.
+    AssignFeatures(valid_its);
+    AssignZeroLabels();
+    ExecuteLaneInstructions(predict_, memory_.get());
+
+    // Accumulate the losses.
+    const Scalar* predictions =
+        memory_->scalar_[kPredictionsScalarAddress].lanes_;
+    bool any_valid = false;
+    for (IntegerT k = 0; k < tasks_.size(); ++k) {
+      if (!valid[k]) continue;
+      const Scalar& label = valid_its[k].GetLabel();
+      double error = 0.0;
+      switch (task.eval_type_) {
+        case RMS_ERROR: {
+          error = label - predictions[k];
+          losses[k] += error * error;
+          break;
+        }
+        case ACCURACY: {
+          const double pred_prob = Sigmoid(predictions[k]);
+          if ((pred_prob > 1.0) || (pred_prob < 0.0)) {
+            error = std::numeric_limits<double>::infinity();
+          } else {
+            const bool is_correct = ((label > 0.5) == (pred_prob > 0.5));
+            error = is_correct ? 0.0 : 1.0;
+          }
+          losses[k] += error;
+          break;
+        }
+        case INVALID_EVAL_TYPE:
+          LOG(FATAL) << "Invalid eval type." << std::endl;
+        // Do not add default case here. All enum values should be supported.
+      }
+      const double abs_error = std::abs(error);
+      if (std::isnan(abs_error) || abs_error > max_abs_error_) {
+        // Stop early. The fitness of this lane stays at the minimum.
+        valid[k] = false;
+      }
+      any_valid = any_valid || valid[k];
+    }
+    if (!any_valid) return;
+
+    bool done = false;
+    for (TaskIterator<F>& valid_it : valid_its) {
+      valid_it.Next();
+      done = valid_it.Done();
+    }
+    if (done) {
+      break;  // Reached the end of the dataset.
+    }
+  }
+
+  // Convert to fitness.
+  for (IntegerT k = 0; k < tasks_.size(); ++k) {
+    if (!valid[k]) continue;
+    const double loss =
+        losses[k] / static_cast<double>(task.ValidSteps());
+    switch (task.eval_type_) {
+      case INVALID_EVAL_TYPE:
+        LOG(FATAL) << "Invalid eval type." << std::endl;
+      case RMS_ERROR:
+        (*fitnesses)[k] = FlipAndSquash(sqrt(loss));
+        break;
+      case ACCURACY:
+        (*fitnesses)[k] = 1.0 - loss;
+        break;
+    }
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+void LaneExecutor<F, K>::AssignFeatures(
+    const std::vector<TaskIterator<F>>& its) {
+  LaneScalar<K>* features =
+      memory_->vector_[kFeaturesVectorAddress].elements_;
+  for (IntegerT k = 0; k < its.size(); ++k) {
+    const Vector<F>& lane_features = its[k].GetFeatures();
+    for (FeatureIndexT i = 0; i < F; ++i) {
+      features[i].lanes_[k] = lane_features(i);
+    }
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+void LaneExecutor<F, K>::AssignLabels(
+    const std::vector<TaskIterator<F>>& its) {
+  Scalar* labels = memory_->scalar_[kLabelsScalarAddress].lanes_;
+  for (IntegerT k = 0; k < its.size(); ++k) {
+    labels[k] = its[k].GetLabel();
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+void LaneExecutor<F, K>::AssignZeroLabels() {
+  Scalar* labels = memory_->scalar_[kLabelsScalarAddress].lanes_;
+  for (IntegerT k = 0; k < K; ++k) {
+    labels[k] = 0.0;
+  }
+}
+
+template<FeatureIndexT F, IntegerT K>
+bool LaneExecutor<F, K>::AnyActive() const {
+  return std::find(active_.begin(), active_.end(), true) != active_.end();
+}
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_LANE_EXECUTOR_H_
@@ -0,0 +1,201 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lane_executor.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "task.h"
+#include "task_util.h"
+#include "definitions.h"
+#include "instruction.pb.h"
+#include "algorithm.h"
+#include "executor.h"
+#include "generator.h"
+#include "instruction.h"
+#include "memory.h"
+#include "random_generator.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+
+namespace automl_zero {
+
+using ::absl::StrCat;  // NOLINT
+using ::std::make_shared;  // NOLINT
+using ::std::mt19937;  // NOLINT
+using ::std::vector;  // NOLINT
+using test_only::GenerateTask;
+
+constexpr IntegerT kNumTrainExamples = 200;
+constexpr IntegerT kNumValidExamples = 50;
+constexpr double kMaxAbsError = 100.0;
+constexpr IntegerT kNumAlgorithms = 50;
+constexpr IntegerT kTestNumLanes = 4;
+
+// Ops that the lane executor supports and that make algorithms diverge at
+// different times on different tasks, so early stopping gets exercised.
+const vector<Op>& LaneOps() {
+  static const vector<Op>* ops = new vector<Op>({
+      SCALAR_SUM_OP, SCALAR_DIFF_OP, SCALAR_PRODUCT_OP, SCALAR_DIVISION_OP,
+      SCALAR_ABS_OP, SCALAR_RECIPROCAL_OP, SCALAR_SIN_OP, SCALAR_EXP_OP,
+      SCALAR_LOG_OP, SCALAR_HEAVYSIDE_OP, SCALAR_MIN_OP, SCALAR_MAX_OP,
+      SCALAR_CONST_SET_OP, VECTOR_SUM_OP, VECTOR_DIFF_OP, VECTOR_PRODUCT_OP,
+      VECTOR_HEAVYSIDE_OP, VECTOR_MAX_OP, SCALAR_VECTOR_PRODUCT_OP,
+      SCALAR_BROADCAST_OP, VECTOR_INNER_PRODUCT_OP, VECTOR_NORM_OP,
+      VECTOR_MEAN_OP, VECTOR_ST_DEV_OP, VECTOR_CONST_SET_OP});
+  return *ops;
+}
+
+// Returns RMS_ERROR regression tasks that differ in their data.
+vector<Task<4>> GenerateRegressionTasks(const IntegerT num_tasks) {
+  vector<Task<4>> tasks;
+  for (IntegerT i = 0; i < num_tasks; ++i) {
+    tasks.push_back(GenerateTask<4>(StrCat(
+        "scalar_linear_regression_task {} "
+        "num_train_examples: ", kNumTrainExamples, " "
+        "num_valid_examples: ", kNumValidExamples, " "
+        "num_train_epochs: 2 "
+        "eval_type: RMS_ERROR "
+        "param_seeds: ", 100 + i, " "
+        "data_seeds: ", 1000 + i, " ")));
+  }
+  return tasks;
+}
+
+// Returns ACCURACY tasks that differ in their data.
+vector<Task<4>> GenerateAccuracyTasks(const IntegerT num_tasks) {
+  vector<Task<4>> tasks;
+  for (IntegerT i = 0; i < num_tasks; ++i) {
+    tasks.push_back(GenerateTask<4>(StrCat(
+        "unit_test_increment_task {increment: ", 0.01 * (i + 1), "} "
+        "num_train_examples: ", kNumTrainExamples, " "
+        "num_valid_examples: ", kNumValidExamples, " "
+        "num_train_epochs: 2 "
+        "eval_type: ACCURACY ")));
+  }
+  return tasks;
+}
+
+void ExpectLanesMatchExecutors(const vector<Task<4>>& tasks) {
+  mt19937 bit_gen(10000);
+  RandomGenerator rand_gen(&bit_gen);
+  // The setup can use random ops, as it runs separately for each lane.
+  Generator generator(
+      NO_OP_ALGORITHM, 4, 6, 6,
+      {SCALAR_CONST_SET_OP, VECTOR_GAUSSIAN_SET_OP, SCALAR_UNIFORM_SET_OP},
+      LaneOps(), LaneOps(), &bit_gen, &rand_gen);
+  vector<const Task<4>*> task_ptrs;
+  for (const Task<4>& task : tasks) {
+    task_ptrs.push_back(&task);
+  }
+  for (IntegerT i = 0; i < kNumAlgorithms; ++i) {
+    const Algorithm algorithm = generator.Random();
+    ASSERT_TRUE(LaneExecutorSupports(algorithm));
+
+    mt19937 expected_bit_gen(i);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    vector<double> expected_fitnesses;
+    IntegerT expected_num_train_steps = 0;
+    for (const Task<4>& task : tasks) {
+      Executor<4> executor(algorithm, task, 2 * kNumTrainExamples,
+                           kNumValidExamples, &expected_rand_gen,
+                           kMaxAbsError);
+      expected_fitnesses.push_back(executor.Execute());
+      expected_num_train_steps += executor.GetNumTrainStepsCompleted();
+    }
+
+    mt19937 actual_bit_gen(i);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    LaneExecutor<4, kTestNumLanes> lane_executor(
+        algorithm, task_ptrs, 2 * kNumTrainExamples, kNumValidExamples,
+        &actual_rand_gen, kMaxAbsError);
+    EXPECT_EQ(lane_executor.Execute(), expected_fitnesses);
+    EXPECT_EQ(lane_executor.GetNumTrainStepsCompleted(),
+              expected_num_train_steps);
+  }
+}
+
+TEST(LaneExecutorTest, MatchesExecutorOnFullLanes) {
+  ExpectLanesMatchExecutors(GenerateRegressionTasks(kTestNumLanes));
+}
+
+TEST(LaneExecutorTest, MatchesExecutorOnPartialLanes) {
+  ExpectLanesMatchExecutors(GenerateRegressionTasks(kTestNumLanes - 1));
+}
+
+TEST(LaneExecutorTest, MatchesExecutorOnAccuracy) {
+  ExpectLanesMatchExecutors(GenerateAccuracyTasks(kTestNumLanes));
+}
+
+TEST(LaneExecutorTest, MatchesExecutorMemory) {
+  const vector<Task<4>> tasks = GenerateRegressionTasks(kTestNumLanes);
+  Generator generator;
+  const Algorithm algorithm = generator.LinearModel(kDefaultLearningRate);
+  RandomGenerator rand_gen;
+  vector<const Task<4>*> task_ptrs;
+  for (const Task<4>& task : tasks) {
+    task_ptrs.push_back(&task);
+  }
+  LaneExecutor<4, kTestNumLanes> lane_executor(
+      algorithm, task_ptrs, 2 * kNumTrainExamples, kNumValidExamples,
+      &rand_gen, kMaxAbsError);
+  lane_executor.Execute();
+  for (IntegerT lane = 0; lane < kTestNumLanes; ++lane) {
+    Executor<4> executor(algorithm, tasks[lane], 2 * kNumTrainExamples,
+                         kNumValidExamples, &rand_gen, kMaxAbsError);
+    executor.Execute();
+    Memory<4> lane_memory;
+    lane_memory.Wipe();
+    lane_executor.memory_->GetLane(lane, &lane_memory);
+    for (AddressT address = 0; address < kMaxScalarAddresses; ++address) {
+      EXPECT_EQ(lane_memory.scalar_[address],
+                executor.MemoryRef().scalar_[address]);
+    }
+    for (AddressT address = 0; address < kMaxVectorAddresses; ++address) {
+      EXPECT_EQ(lane_memory.vector_[address],
+                executor.MemoryRef().vector_[address]);
+    }
+  }
+}
+
+TEST(LaneExecutorTest, SupportsOnlyScalarAndVectorOpsWithoutRandomness) {
+  Generator generator;
+  Algorithm algorithm = generator.LinearModel(kDefaultLearningRate);
+  EXPECT_TRUE(LaneExecutorSupports(algorithm));
+  algorithm.setup_.emplace_back(
+      make_shared<const Instruction>(MATRIX_VECTOR_PRODUCT_OP, 1, 1, 2));
+  EXPECT_TRUE(LaneExecutorSupports(algorithm));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(MATRIX_VECTOR_PRODUCT_OP, 1, 1, 2));
+  EXPECT_FALSE(LaneExecutorSupports(algorithm));
+  EXPECT_FALSE(LaneExecutorSupportsOp(SCALAR_GAUSSIAN_SET_OP));
+  EXPECT_FALSE(LaneExecutorSupportsOp(VECTOR_UNIFORM_SET_OP));
+}
+
+TEST(LaneExecutorTest, CompatibleTasksMustHaveTheSameShape) {
+  const vector<Task<4>> tasks = GenerateRegressionTasks(2);
+  EXPECT_TRUE(LaneCompatible(tasks[0], tasks[1]));
+  const Task<4> accuracy_task = std::move(GenerateAccuracyTasks(1)[0]);
+  EXPECT_FALSE(LaneCompatible(tasks[0], accuracy_task));
+  const Task<4> short_task = GenerateTask<4>(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: 10 "
+      "num_valid_examples: 10 "
+      "eval_type: RMS_ERROR ");
+  EXPECT_FALSE(LaneCompatible(tasks[0], short_task));
+}
+
+}  // namespace automl_zero
@@ -17,11 +17,9 @@
 namespace automl_zero {
 
 // Define here all the class-instances of the template that will be compiled.
-// Bigger than 32 leads to allocs too large for dense-storage in Eigen in stack.
-template class Memory<2>;
-template class Memory<4>;
-template class Memory<8>;
-template class Memory<16>;
-template class Memory<32>;
+// From 64, a Memory is too large for the stack and is allocated on the heap.
+#define AUTOML_ZERO_INSTANTIATE_MEMORY(F) template class Memory<F>;
+AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(AUTOML_ZERO_INSTANTIATE_MEMORY)
+#undef AUTOML_ZERO_INSTANTIATE_MEMORY
 
 }  // namespace automl_zero
@@ -37,6 +37,16 @@ class Memory {
   // initialize the memory.
   void Wipe();
 
+  // Sets only the first Scalars, Vectors and Matrices to zero, leaving the
+  // rest undefined. Serves as a way to initialize the memory for an Algorithm
+  // that does not use the addresses past them.
+  void Wipe(AddressT num_scalars, AddressT num_vectors, AddressT num_matrices);
+
+  // Copies only the first Scalars, Vectors and Matrices of another Memory,
+  // leaving the rest untouched.
+  void CopyFrom(const Memory& other, AddressT num_scalars, AddressT num_vectors,
+                AddressT num_matrices);
+
   // Three typed-memory spaces.
   ::std::array<Scalar, kMaxScalarAddresses> scalar_;
   ::std::array<Vector<F>, kMaxVectorAddresses> vector_;
@@ -69,6 +79,35 @@ void Memory<F>::Wipe() {
   }
 }
 
+template<FeatureIndexT F>
+void Memory<F>::Wipe(const AddressT num_scalars, const AddressT num_vectors,
+                     const AddressT num_matrices) {
+  for (AddressT address = 0; address < num_scalars; ++address) {
+    scalar_[address] = 0.0;
+  }
+  for (AddressT address = 0; address < num_vectors; ++address) {
+    vector_[address].setZero();
+  }
+  for (AddressT address = 0; address < num_matrices; ++address) {
+    matrix_[address].setZero();
+  }
+}
+
+template<FeatureIndexT F>
+void Memory<F>::CopyFrom(const Memory& other, const AddressT num_scalars,
+                         const AddressT num_vectors,
+                         const AddressT num_matrices) {
+  for (AddressT address = 0; address < num_scalars; ++address) {
+    scalar_[address] = other.scalar_[address];
+  }
+  for (AddressT address = 0; address < num_vectors; ++address) {
+    vector_[address] = other.vector_[address];
+  }
+  for (AddressT address = 0; address < num_matrices; ++address) {
+    matrix_[address] = other.matrix_[address];
+  }
+}
+
 }  // namespace automl_zero
 
 #endif  // AUTOML_ZERO_MEMORY_H_
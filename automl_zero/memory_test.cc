@@ -49,6 +49,41 @@ TEST(MemoryTest, WipeSetsValuesToZero) {
   EXPECT_EQ(memory.matrix_[kSomeAddress](kX, kY), 0.0);
 }
 
+TEST(MemoryTest, PartialWipeSetsFirstValuesToZero) {
+  Memory<4> memory;
+  memory.scalar_[1] = 2.0;
+  memory.scalar_[2] = 2.0;
+  memory.vector_[0](1, 0) = 4.0;
+  memory.vector_[1](1, 0) = 4.0;
+  memory.matrix_[0](1, 2) = 0.5;
+
+  memory.Wipe(2, 1, 0);
+  EXPECT_EQ(memory.scalar_[1], 0.0);
+  EXPECT_EQ(memory.scalar_[2], 2.0);
+  EXPECT_EQ(memory.vector_[0](1, 0), 0.0);
+  EXPECT_EQ(memory.vector_[1](1, 0), 4.0);
+  EXPECT_EQ(memory.matrix_[0](1, 2), 0.5);
+}
+
+TEST(MemoryTest, PartialCopyCopiesFirstValues) {
+  Memory<4> memory;
+  memory.Wipe();
+  Memory<4> other;
+  other.Wipe();
+  other.scalar_[1] = 2.0;
+  other.scalar_[2] = 2.0;
+  other.vector_[0](1, 0) = 4.0;
+  other.vector_[1](1, 0) = 4.0;
+  other.matrix_[0](1, 2) = 0.5;
+
+  memory.CopyFrom(other, 2, 1, 0);
+  EXPECT_EQ(memory.scalar_[1], 2.0);
+  EXPECT_EQ(memory.scalar_[2], 0.0);
+  EXPECT_EQ(memory.vector_[0](1, 0), 4.0);
+  EXPECT_EQ(memory.vector_[1](1, 0), 0.0);
+  EXPECT_EQ(memory.matrix_[0](1, 2), 0.0);
+}
+
 TEST(MemoryTest, RespectsFeaturesSize) {
   Memory<4> memory4;
   EXPECT_EQ(memory4.vector_[0].size(), 4);
@@ -65,7 +65,8 @@ Mutator::Mutator(
           allowed_predict_ops_,
           allowed_learn_ops_,
           bit_gen_,
-          rand_gen_) {}
+          rand_gen_),
+      last_mutation_type_(IDENTITY_MUTATION_TYPE) {}
 
 vector<MutationType> ConvertToMutationType(
     const vector<IntegerT>& mutation_actions_as_ints) {
@@ -78,6 +79,7 @@ vector<MutationType> ConvertToMutationType(
 }
 
 void Mutator::Mutate(shared_ptr<const Algorithm>* algorithm) {
+  last_mutation_type_ = IDENTITY_MUTATION_TYPE;
   if (mutate_prob_ >= 1.0 || rand_gen_->UniformProbability() < mutate_prob_) {
     auto mutated = make_unique<Algorithm>(**algorithm);
     MutateImpl(mutated.get());
@@ -87,6 +89,7 @@ void Mutator::Mutate(shared_ptr<const Algorithm>* algorithm) {
 
 void Mutator::Mutate(const IntegerT num_mutations,
                      shared_ptr<const Algorithm>* algorithm) {
+  last_mutation_type_ = IDENTITY_MUTATION_TYPE;
   if (mutate_prob_ >= 1.0 || rand_gen_->UniformProbability() < mutate_prob_) {
     auto mutated = make_unique<Algorithm>(**algorithm);
     for (IntegerT i = 0; i < num_mutations; ++i) {
@@ -128,7 +131,8 @@ Mutator::Mutator()
           allowed_predict_ops_,
           allowed_learn_ops_,
           bit_gen_,
-          rand_gen_) {}
+          rand_gen_),
+      last_mutation_type_(IDENTITY_MUTATION_TYPE) {}
 
 void Mutator::MutateImpl(Algorithm* algorithm) {
   CHECK(!allowed_actions_.mutation_types().empty());
@@ -136,6 +140,7 @@ void Mutator::MutateImpl(Algorithm* algorithm) {
       absl::Uniform<size_t>(*bit_gen_, 0,
                             allowed_actions_.mutation_types_size());
   const MutationType action = allowed_actions_.mutation_types(action_index);
+  last_mutation_type_ = action;
   switch (action) {
     case ALTER_PARAM_MUTATION_TYPE:
       AlterParam(algorithm);
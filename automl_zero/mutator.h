@@ -63,6 +63,10 @@ class Mutator {
   void Mutate(IntegerT num_mutations,
               std::shared_ptr<const Algorithm>* algorithm);
 
+  // The type of the last mutation applied by the last call to Mutate.
+  // IDENTITY_MUTATION_TYPE if that call did not mutate.
+  MutationType LastMutationType() const {return last_mutation_type_;}
+
   // Used to create a simple instance for tests.
   Mutator();
 
@@ -146,6 +150,7 @@ class Mutator {
   std::unique_ptr<RandomGenerator> rand_gen_owned_;
   RandomGenerator* rand_gen_;
   Randomizer randomizer_;
+  MutationType last_mutation_type_;
 };
 
 }  // namespace automl_zero
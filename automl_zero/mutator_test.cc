@@ -120,6 +120,34 @@ TEST(MutatorTest, RespectsMutateProb) {
       {original_size, original_size + 1}));
 }
 
+TEST(MutatorTest, RecordsLastMutationType) {
+  mt19937 bit_gen;
+  RandomGenerator rand_gen(&bit_gen);
+  Mutator mutator(
+      ParseTextFormat<MutationTypeList>(
+          "mutation_types: [ "
+          "  INSERT_INSTRUCTION_MUTATION_TYPE "
+          "] "),
+      0.5,  // mutate_prob
+      {},  // allowed_setup_ops
+      {NO_OP},  // allowed_predict_ops
+      {},  // allowed_learn_ops
+      0, 10000, 0, 10000, 0, 10000,  // min/max component function sizes
+      &bit_gen,
+      &rand_gen);
+  const Algorithm algorithm = SimpleRandomAlgorithm();
+  const IntegerT original_size = algorithm.predict_.size();
+  for (IntegerT i = 0; i < 100; ++i) {
+    auto mutated_algorithm = make_shared<const Algorithm>(algorithm);
+    mutator.Mutate(&mutated_algorithm);
+    if (mutated_algorithm->predict_.size() == original_size) {
+      EXPECT_EQ(mutator.LastMutationType(), IDENTITY_MUTATION_TYPE);
+    } else {
+      EXPECT_EQ(mutator.LastMutationType(), INSERT_INSTRUCTION_MUTATION_TYPE);
+    }
+  }
+}
+
 TEST(MutatorTest, InstructionIndexTest) {
   mt19937 bit_gen;
   RandomGenerator rand_gen(&bit_gen);
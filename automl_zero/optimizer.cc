@@ -0,0 +1,468 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "optimizer.h"
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "dataflow.h"
+#include "executor.h"
+#include "instruction.h"
+#include "memory.h"
+
+namespace automl_zero {
+
+using ::std::make_shared;  // NOLINT
+using ::std::map;  // NOLINT
+using ::std::ostream;  // NOLINT
+using ::std::shared_ptr;  // NOLINT
+using ::std::tuple;  // NOLINT
+using ::std::vector;  // NOLINT
+
+namespace {
+
+// Identifies a value: two addresses with the same value number hold the same
+// bits (up to the payload of NaNs).
+typedef IntegerT ValueNumber;
+
+// Constant folding only needs the scalar memory, which does not depend on the
+// features size.
+constexpr FeatureIndexT kFoldingFeaturesSize = 2;
+
+constexpr IntegerT kNoAddress = -1;
+
+IntegerT NumAddresses(const OperandType type) {
+  switch (type) {
+    case kNoOperand:
+      return 0;
+    case kScalarOperand:
+      return kMaxScalarAddresses;
+    case kVectorOperand:
+      return kMaxVectorAddresses;
+    case kMatrixOperand:
+      return kMaxMatrixAddresses;
+  }
+}
+
+// Whether swapping the inputs of the op gives the same bits.
+bool IsCommutative(const Op op) {
+  switch (op) {
+    case SCALAR_SUM_OP:
+    case SCALAR_PRODUCT_OP:
+    case VECTOR_SUM_OP:
+    case VECTOR_PRODUCT_OP:
+    case VECTOR_INNER_PRODUCT_OP:
+    case MATRIX_SUM_OP:
+    case MATRIX_PRODUCT_OP:
+      return true;
+    default:
+      // Not min and max, which return their first input if either is a NaN.
+      return false;
+  }
+}
+
+// Numbers the values held by the memory as a component function runs, so that
+// equal values are recognized.
+class ValueNumbering {
+ public:
+  // All addresses hold distinct unknown values.
+  ValueNumbering() {
+    for (const OperandType type :
+         {kScalarOperand, kVectorOperand, kMatrixOperand}) {
+      values_[type].resize(NumAddresses(type));
+      for (IntegerT address = 0; address < NumAddresses(type); ++address) {
+        values_[type][address] = NewValue();
+        leaders_[values_[type][address]] = address;
+      }
+    }
+  }
+
+  ValueNumber Get(const OperandType type, const AddressT address) const {
+    return values_[type][address];
+  }
+
+  void Set(const OperandType type, const AddressT address,
+           const ValueNumber value) {
+    values_[type][address] = value;
+    if (Holder(type, value) == kNoAddress) leaders_[value] = address;
+  }
+
+  // Returns the address that has held the value of the given address for the
+  // longest time, which may be the given address itself.
+  AddressT Leader(const OperandType type, const AddressT address) const {
+    const IntegerT holder = Holder(type, Get(type, address));
+    return holder == kNoAddress ? address : holder;
+  }
+
+  // Returns an address that holds the value, or kNoAddress.
+  IntegerT Holder(const OperandType type, const ValueNumber value) const {
+    const IntegerT leader = leaders_[value];
+    if (leader != kNoAddress && values_[type][leader] == value) return leader;
+    return kNoAddress;
+  }
+
+  ValueNumber NewValue() {
+    leaders_.push_back(kNoAddress);
+    constants_.push_back(0.0);
+    is_constant_.push_back(false);
+    definitions_.emplace_back(NO_OP, 0, 0);
+    return leaders_.size() - 1;
+  }
+
+  ValueNumber Constant(const Scalar value) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(value));
+    auto it = constant_values_.find(bits);
+    if (it != constant_values_.end()) return it->second;
+    const ValueNumber number = NewValue();
+    constants_[number] = value;
+    is_constant_[number] = true;
+    constant_values_[bits] = number;
+    return number;
+  }
+
+  bool IsConstant(const ValueNumber value) const {
+    return is_constant_[value];
+  }
+  Scalar ConstantValue(const ValueNumber value) const {
+    return constants_[value];
+  }
+  // Whether the value is the constant with exactly these bits.
+  bool Is(const ValueNumber value, const Scalar constant) const {
+    if (!is_constant_[value]) return false;
+    return std::memcmp(&constants_[value], &constant, sizeof(Scalar)) == 0;
+  }
+
+  // Returns the value computed by the op from the given values. Sets
+  // *existing to whether the same value was computed before.
+  ValueNumber Compute(const Op op, ValueNumber in1, ValueNumber in2,
+                      bool* existing) {
+    const ValueNumber identity = Identity(op, in1, in2);
+    if (identity != kNoValue) {
+      *existing = true;
+      return identity;
+    }
+    if (IsCommutative(op) && in2 < in1) std::swap(in1, in2);
+    const tuple<IntegerT, ValueNumber, ValueNumber> key(op, in1, in2);
+    auto it = computed_values_.find(key);
+    if (it != computed_values_.end()) {
+      *existing = true;
+      return it->second;
+    }
+    *existing = false;
+    const ValueNumber number = NewValue();
+    definitions_[number] = key;
+    computed_values_[key] = number;
+    return number;
+  }
+
+ private:
+  static constexpr ValueNumber kNoValue = -1;
+
+  // Returns the input value if the op leaves it unchanged (exactly, for all
+  // inputs), or kNoValue.
+  ValueNumber Identity(const Op op, const ValueNumber in1,
+                       const ValueNumber in2) const {
+    switch (op) {
+      case SCALAR_PRODUCT_OP:
+        if (Is(in1, 1.0)) return in2;
+        if (Is(in2, 1.0)) return in1;
+        return kNoValue;
+      case SCALAR_DIVISION_OP:
+        if (Is(in2, 1.0)) return in1;
+        return kNoValue;
+      case SCALAR_SUM_OP:
+        // Only -0.0, as -0.0 + 0.0 = 0.0.
+        if (Is(in1, -0.0)) return in2;
+        if (Is(in2, -0.0)) return in1;
+        return kNoValue;
+      case SCALAR_DIFF_OP:
+        // Only 0.0, as -0.0 - -0.0 = 0.0.
+        if (Is(in2, 0.0)) return in1;
+        return kNoValue;
+      case SCALAR_VECTOR_PRODUCT_OP:
+      case SCALAR_MATRIX_PRODUCT_OP:
+        if (Is(in1, 1.0)) return in2;
+        return kNoValue;
+      case SCALAR_MIN_OP:
+      case SCALAR_MAX_OP:
+      case VECTOR_MIN_OP:
+      case VECTOR_MAX_OP:
+      case MATRIX_MIN_OP:
+      case MATRIX_MAX_OP:
+        if (in1 == in2) return in1;
+        return kNoValue;
+      case SCALAR_ABS_OP:
+      case VECTOR_ABS_OP:
+      case MATRIX_ABS_OP:
+        if (std::get<0>(definitions_[in1]) == op) return in1;
+        return kNoValue;
+      case MATRIX_TRANSPOSE_OP:
+        if (std::get<0>(definitions_[in1]) == op) {
+          return std::get<1>(definitions_[in1]);
+        }
+        return kNoValue;
+      default:
+        return kNoValue;
+    }
+  }
+
+  // Indexed by OperandType.
+  vector<ValueNumber> values_[4];
+  // Indexed by value number.
+  vector<IntegerT> leaders_;
+  vector<Scalar> constants_;
+  vector<bool> is_constant_;
+  vector<tuple<IntegerT, ValueNumber, ValueNumber>> definitions_;
+
+  map<uint64_t, ValueNumber> constant_values_;
+  map<tuple<IntegerT, ValueNumber, ValueNumber>, ValueNumber>
+      computed_values_;
+};
+
+IntegerT NumInstructions(const Algorithm& algorithm) {
+  return algorithm.setup_.size() + algorithm.predict_.size() +
+         algorithm.learn_.size();
+}
+
+IntegerT NumExampleInstructions(const Algorithm& algorithm) {
+  return algorithm.predict_.size() + algorithm.learn_.size();
+}
+
+class Simplifier {
+ public:
+  explicit Simplifier(OptimizationStats* stats) : stats_(stats) {}
+
+  void Simplify(
+      const vector<shared_ptr<const Instruction>>& component_function,
+      ValueNumbering* numbering,
+      vector<shared_ptr<const Instruction>>* simplified) {
+    simplified->clear();
+    simplified->reserve(component_function.size());
+    for (const shared_ptr<const Instruction>& instruction :
+         component_function) {
+      Simplify(instruction, numbering, simplified);
+    }
+  }
+
+ private:
+  void Simplify(const shared_ptr<const Instruction>& instruction,
+                ValueNumbering* numbering,
+                vector<shared_ptr<const Instruction>>* simplified) {
+    const OpSignature signature = GetOpSignature(instruction->op_);
+    if (signature.out == kNoOperand) {
+      simplified->push_back(instruction);
+      return;
+    }
+    if (signature.random || signature.partial_out) {
+      numbering->Set(signature.out, instruction->out_, numbering->NewValue());
+      simplified->push_back(instruction);
+      return;
+    }
+    if (instruction->op_ == SCALAR_CONST_SET_OP) {
+      const ValueNumber value = numbering->Constant(
+          static_cast<Scalar>(instruction->GetActivationData()));
+      Write(instruction, value, numbering, simplified);
+      return;
+    }
+
+    // Read the inputs from where their values have been the longest.
+    Instruction renamed = *instruction;
+    ValueNumber in1 = 0;
+    ValueNumber in2 = 0;
+    if (signature.in1 != kNoOperand) {
+      renamed.in1_ = numbering->Leader(signature.in1, instruction->in1_);
+      in1 = numbering->Get(signature.in1, renamed.in1_);
+    }
+    if (signature.in2 != kNoOperand) {
+      renamed.in2_ = numbering->Leader(signature.in2, instruction->in2_);
+      in2 = numbering->Get(signature.in2, renamed.in2_);
+    }
+
+    if (signature.out == kScalarOperand &&
+        signature.in1 == kScalarOperand && numbering->IsConstant(in1) &&
+        (signature.in2 == kNoOperand ||
+         (signature.in2 == kScalarOperand && numbering->IsConstant(in2)))) {
+      // Run the op itself, so that the result has exactly the same bits. The
+      // Executors run the transcendental ops with libm in every mode, as the
+      // fast-math mode only approximates the sigmoid of the mini-batches.
+      folding_memory_.scalar_[instruction->in1_] =
+          numbering->ConstantValue(in1);
+      if (signature.in2 != kNoOperand) {
+        folding_memory_.scalar_[instruction->in2_] =
+            numbering->ConstantValue(in2);
+      }
+      ExecuteInstruction(*instruction, nullptr, &folding_memory_);
+      const Scalar result = folding_memory_.scalar_[instruction->out_];
+      const ValueNumber value = numbering->Constant(result);
+      if (numbering->Get(kScalarOperand, instruction->out_) == value) {
+        if (stats_ != nullptr) ++stats_->num_eliminated;
+        return;
+      }
+      numbering->Set(kScalarOperand, instruction->out_, value);
+      simplified->push_back(make_shared<const Instruction>(
+          SCALAR_CONST_SET_OP, instruction->out_,
+          ActivationDataSetter(result)));
+      if (stats_ != nullptr) ++stats_->num_folded;
+      return;
+    }
+
+    bool existing = false;
+    const ValueNumber value =
+        numbering->Compute(instruction->op_, in1, in2, &existing);
+    if (existing && numbering->Get(signature.out, instruction->out_) != value &&
+        numbering->Holder(signature.out, value) != kNoAddress &&
+        stats_ != nullptr) {
+      ++stats_->num_redundant;
+    }
+    if (renamed.in1_ == instruction->in1_ &&
+        renamed.in2_ == instruction->in2_) {
+      Write(instruction, value, numbering, simplified);
+    } else {
+      Write(make_shared<const Instruction>(renamed), value, numbering,
+            simplified);
+    }
+  }
+
+  // Adds the instruction, which writes the value to its output, unless its
+  // output already holds the value.
+  void Write(const shared_ptr<const Instruction>& instruction,
+             const ValueNumber value, ValueNumbering* numbering,
+             vector<shared_ptr<const Instruction>>* simplified) {
+    const OperandType out = GetOpSignature(instruction->op_).out;
+    if (numbering->Get(out, instruction->out_) == value) {
+      if (stats_ != nullptr) ++stats_->num_eliminated;
+      return;
+    }
+    numbering->Set(out, instruction->out_, value);
+    simplified->push_back(instruction);
+  }
+
+  OptimizationStats* stats_;
+  Memory<kFoldingFeaturesSize> folding_memory_;
+};
+
+// Adds the addresses the component function writes to *written.
+void AddWrites(
+    const vector<shared_ptr<const Instruction>>& component_function,
+    AddressSet* written) {
+  for (const shared_ptr<const Instruction>& instruction : component_function) {
+    const OpSignature signature = GetOpSignature(instruction->op_);
+    if (signature.out != kNoOperand) {
+      written->Insert(signature.out, instruction->out_);
+    }
+  }
+}
+
+}  // namespace
+
+void OptimizationStats::Add(const OptimizationStats& other) {
+  num_algorithms += other.num_algorithms;
+  num_example_instructions_before += other.num_example_instructions_before;
+  num_example_instructions_after += other.num_example_instructions_after;
+  num_instructions_before += other.num_instructions_before;
+  num_instructions_after += other.num_instructions_after;
+  num_folded += other.num_folded;
+  num_redundant += other.num_redundant;
+  num_eliminated += other.num_eliminated;
+  num_pruned += other.num_pruned;
+  num_hoisted += other.num_hoisted;
+}
+
+ostream& operator<<(ostream& stream, const OptimizationStats& stats) {
+  return stream << stats.num_algorithms << " algorithms, "
+                << stats.num_example_instructions_before << " -> "
+                << stats.num_example_instructions_after
+                << " instructions per example, "
+                << stats.num_instructions_before << " -> "
+                << stats.num_instructions_after << " in all (folded "
+                << stats.num_folded << ", redundant " << stats.num_redundant
+                << ", eliminated " << stats.num_eliminated << ", pruned "
+                << stats.num_pruned << ", hoisted " << stats.num_hoisted
+                << ")";
+}
+
+Algorithm SimplifyInstructions(const Algorithm& algorithm,
+                               OptimizationStats* stats) {
+  Simplifier simplifier(stats);
+  Algorithm simplified;
+
+  // The Executor wipes the memory before the setup.
+  ValueNumbering setup_numbering;
+  for (AddressT address = 0; address < kMaxScalarAddresses; ++address) {
+    setup_numbering.Set(kScalarOperand, address, setup_numbering.Constant(0.0));
+  }
+  simplifier.Simplify(algorithm.setup_, &setup_numbering, &simplified.setup_);
+
+  // The constants the setup leaves in the memory that predict and learn do not
+  // write. The Executor converts the predictions between predict and learn.
+  AddressSet written;
+  AddWrites(algorithm.predict_, &written);
+  AddWrites(algorithm.learn_, &written);
+  written.Insert(kScalarOperand, kPredictionsScalarAddress);
+  written.Insert(kScalarOperand, kLabelsScalarAddress);
+  ValueNumbering predict_numbering;
+  ValueNumbering learn_numbering;
+  for (AddressT address = 0; address < kMaxScalarAddresses; ++address) {
+    const ValueNumber value = setup_numbering.Get(kScalarOperand, address);
+    if (written.Contains(kScalarOperand, address) ||
+        !setup_numbering.IsConstant(value)) {
+      continue;
+    }
+    const Scalar constant = setup_numbering.ConstantValue(value);
+    predict_numbering.Set(kScalarOperand, address,
+                          predict_numbering.Constant(constant));
+    learn_numbering.Set(kScalarOperand, address,
+                        learn_numbering.Constant(constant));
+  }
+  // The labels are zero in predict.
+  predict_numbering.Set(kScalarOperand, kLabelsScalarAddress,
+                        predict_numbering.Constant(0.0));
+
+  simplifier.Simplify(algorithm.predict_, &predict_numbering,
+                      &simplified.predict_);
+  simplifier.Simplify(algorithm.learn_, &learn_numbering, &simplified.learn_);
+  return simplified;
+}
+
+Algorithm OptimizeAlgorithm(const Algorithm& algorithm,
+                            OptimizationStats* stats) {
+  OptimizationStats algorithm_stats;
+  algorithm_stats.num_algorithms = 1;
+  algorithm_stats.num_instructions_before = NumInstructions(algorithm);
+  algorithm_stats.num_example_instructions_before =
+      NumExampleInstructions(algorithm);
+  const Algorithm simplified =
+      SimplifyInstructions(algorithm, &algorithm_stats);
+  const Algorithm pruned = PruneDeadInstructions(simplified);
+  algorithm_stats.num_pruned =
+      NumInstructions(simplified) - NumInstructions(pruned);
+  const Algorithm hoisted = HoistInvariantInstructions(pruned);
+  algorithm_stats.num_hoisted =
+      NumExampleInstructions(pruned) - NumExampleInstructions(hoisted);
+  Algorithm optimized = CompactAddresses(hoisted);
+  algorithm_stats.num_instructions_after = NumInstructions(optimized);
+  algorithm_stats.num_example_instructions_after =
+      NumExampleInstructions(optimized);
+  if (stats != nullptr) stats->Add(algorithm_stats);
+  return optimized;
+}
+
+}  // namespace automl_zero
@@ -0,0 +1,87 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Rewrites Algorithms into cheaper ones that the Executor runs with exactly the
+// same results. The Algorithms being evolved are never modified; the rewritten
+// copies are only executed.
+
+#ifndef AUTOML_ZERO_OPTIMIZER_H_
+#define AUTOML_ZERO_OPTIMIZER_H_
+
+#include <ostream>
+
+#include "algorithm.h"
+#include "definitions.h"
+
+namespace automl_zero {
+
+// Counts of what the optimizer did, summed over the Algorithms it optimized.
+struct OptimizationStats {
+  IntegerT num_algorithms = 0;
+  // The instructions of predict and learn, which run for every example, before
+  // and after optimizing.
+  IntegerT num_example_instructions_before = 0;
+  IntegerT num_example_instructions_after = 0;
+  // All the instructions, including the setup.
+  IntegerT num_instructions_before = 0;
+  IntegerT num_instructions_after = 0;
+  // Instructions whose inputs are all known constants, replaced by a
+  // SCALAR_CONST_SET_OP.
+  IntegerT num_folded = 0;
+  // Instructions found to compute a value that is already in memory, either
+  // by an algebraic identity (e.g. x * 1 = x) or because an earlier
+  // instruction computed it. Their output is then read from where the value
+  // already is.
+  IntegerT num_redundant = 0;
+  // Instructions removed because their output already held their result.
+  IntegerT num_eliminated = 0;
+  // Instructions removed as dead (see PruneDeadInstructions).
+  IntegerT num_pruned = 0;
+  // Instructions moved to the setup (see HoistInvariantInstructions).
+  IntegerT num_hoisted = 0;
+
+  void Add(const OptimizationStats& other);
+};
+
+// Prints the stats on one line.
+std::ostream& operator<<(std::ostream& stream, const OptimizationStats& stats);
+
+// Returns a copy of the Algorithm where, within each component function:
+// - scalar instructions whose inputs are all known constants are replaced by a
+//   SCALAR_CONST_SET_OP of their result;
+// - inputs holding a value that is also held by an address written earlier
+//   (by the same computation, or by an identity such as x * 1, x / 1, x - 0,
+//   abs(abs(x)) or the transpose of a transpose) are read from that address
+//   instead, so that the later computation may become dead;
+// - instructions whose output already holds their result are removed.
+// Constants come from SCALAR_CONST_SET_OP, from the memory the Executor wipes
+// before the setup, from the zero label in predict, and from the setup for the
+// memory that predict and learn do not write. Only identities that are exact
+// for all values, including infinities and NaNs, are used, so executing the
+// copy produces the same memory, predictions, early stopping and random draws.
+// Instructions that are not changed are shared with the original Algorithm.
+Algorithm SimplifyInstructions(const Algorithm& algorithm,
+                               OptimizationStats* stats = nullptr);
+
+// Returns the cheapest equivalent of the Algorithm for the Executor: the
+// instructions are simplified (see SimplifyInstructions), the dead ones pruned
+// (see PruneDeadInstructions), those invariant across examples hoisted (see
+// HoistInvariantInstructions) and the addresses compacted (see
+// CompactAddresses). Adds what it did to *stats, if not nullptr.
+Algorithm OptimizeAlgorithm(const Algorithm& algorithm,
+                            OptimizationStats* stats = nullptr);
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_OPTIMIZER_H_
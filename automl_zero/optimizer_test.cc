@@ -0,0 +1,312 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "optimizer.h"
+
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "task.h"
+#include "task_util.h"
+#include "definitions.h"
+#include "instruction.pb.h"
+#include "algorithm.h"
+#include "dataflow.h"
+#include "executor.h"
+#include "generator.h"
+#include "instruction.h"
+#include "random_generator.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+
+namespace automl_zero {
+
+using ::absl::StrCat;  // NOLINT
+using ::std::make_shared;  // NOLINT
+using ::std::mt19937;  // NOLINT
+using ::std::shared_ptr;  // NOLINT
+using ::std::vector;  // NOLINT
+using test_only::GenerateTask;
+
+constexpr IntegerT kNumTrainExamples = 50;
+constexpr IntegerT kNumValidExamples = 50;
+constexpr double kMaxAbsError = 100.0;
+
+TEST(OptimizerTest, FoldsConstants) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2, ActivationDataSetter(2.0)));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 3, ActivationDataSetter(3.0)));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 2, 3, 4));
+  // The labels are zero in predict.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 4, kLabelsScalarAddress, kPredictionsScalarAddress));
+
+  OptimizationStats stats;
+  const Algorithm simplified = SimplifyInstructions(algorithm, &stats);
+  ASSERT_EQ(simplified.predict_.size(), 3);
+  EXPECT_EQ(simplified.predict_[0], algorithm.predict_[0]);
+  EXPECT_EQ(simplified.predict_[1]->op_, SCALAR_CONST_SET_OP);
+  EXPECT_EQ(simplified.predict_[1]->out_, 4);
+  EXPECT_EQ(simplified.predict_[1]->GetActivationData(), 6.0);
+  EXPECT_EQ(simplified.predict_[2]->op_, SCALAR_CONST_SET_OP);
+  EXPECT_EQ(simplified.predict_[2]->out_, kPredictionsScalarAddress);
+  EXPECT_EQ(simplified.predict_[2]->GetActivationData(), 6.0);
+  EXPECT_EQ(stats.num_folded, 2);
+}
+
+TEST(OptimizerTest, DoesNotFoldMemoryWrittenEveryExample) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2, ActivationDataSetter(2.0)));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_PRODUCT_OP, 2, 2, kPredictionsScalarAddress));
+  // Changes s2 for the next example.
+  algorithm.learn_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 2, kLabelsScalarAddress, 2));
+  const Algorithm simplified = SimplifyInstructions(algorithm);
+  EXPECT_EQ(simplified.predict_, algorithm.predict_);
+  EXPECT_EQ(simplified.learn_, algorithm.learn_);
+}
+
+TEST(OptimizerTest, ReadsRecomputedValuesFromTheFirstAddress) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_INNER_PRODUCT_OP, kFeaturesVectorAddress, 1, 2));
+  // Same value, with the inputs swapped.
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_INNER_PRODUCT_OP, 1, kFeaturesVectorAddress, 3));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_DIVISION_OP, 3, 3, kPredictionsScalarAddress));
+
+  OptimizationStats stats;
+  const Algorithm simplified = SimplifyInstructions(algorithm, &stats);
+  ASSERT_EQ(simplified.predict_.size(), 3);
+  EXPECT_EQ(simplified.predict_[2]->op_, SCALAR_DIVISION_OP);
+  EXPECT_EQ(simplified.predict_[2]->in1_, 2);
+  EXPECT_EQ(simplified.predict_[2]->in2_, 2);
+  EXPECT_EQ(stats.num_redundant, 1);
+  // The recomputation is now dead.
+  const Algorithm pruned = PruneDeadInstructions(simplified);
+  EXPECT_EQ(pruned.predict_.size(), 2);
+}
+
+TEST(OptimizerTest, AppliesIdentities) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 5, ActivationDataSetter(1.0)));
+  // abs(abs(x)) = abs(x).
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_ABS_OP, kFeaturesVectorAddress, 1));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(VECTOR_ABS_OP, 1, 2));
+  // 1 * x = x.
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_VECTOR_PRODUCT_OP, 5, 2, 3));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_NORM_OP, 3, kPredictionsScalarAddress));
+
+  const Algorithm simplified = SimplifyInstructions(algorithm);
+  ASSERT_EQ(simplified.predict_.size(), 4);
+  EXPECT_EQ(simplified.predict_[3]->in1_, 1);
+  const Algorithm pruned = PruneDeadInstructions(simplified);
+  ASSERT_EQ(pruned.predict_.size(), 2);
+  EXPECT_EQ(pruned.predict_[0], algorithm.predict_[0]);
+}
+
+TEST(OptimizerTest, EliminatesTransposesOfTransposes) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      MATRIX_GAUSSIAN_SET_OP, 0,
+      FloatDataSetter(0.0), FloatDataSetter(1.0)));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(MATRIX_TRANSPOSE_OP, 0, 1));
+  // Transposes back into the matrix that already holds the result.
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(MATRIX_TRANSPOSE_OP, 1, 0));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      MATRIX_VECTOR_PRODUCT_OP, 0, kFeaturesVectorAddress, 1));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_MEAN_OP, 1, kPredictionsScalarAddress));
+
+  OptimizationStats stats;
+  const Algorithm simplified = SimplifyInstructions(algorithm, &stats);
+  ASSERT_EQ(simplified.predict_.size(), 3);
+  EXPECT_EQ(simplified.predict_[0], algorithm.predict_[0]);
+  EXPECT_EQ(simplified.predict_[1], algorithm.predict_[2]);
+  EXPECT_EQ(stats.num_eliminated, 1);
+}
+
+TEST(OptimizerTest, KeepsNonFiniteBehavior) {
+  Algorithm algorithm;
+  algorithm.setup_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 3, ActivationDataSetter(0.0)));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_NORM_OP, kFeaturesVectorAddress, 2));
+  // Not 0 if s2 is infinite or NaN.
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_DIFF_OP, 2, 2, 4));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 2, 3, 5));
+  // Not the first input if the second is NaN.
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_MIN_OP, 4, 5, 6));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_MIN_OP, 5, 4, kPredictionsScalarAddress));
+  const Algorithm simplified = SimplifyInstructions(algorithm);
+  EXPECT_EQ(simplified.predict_, algorithm.predict_);
+}
+
+TEST(OptimizerTest, CountsInstructions) {
+  Algorithm algorithm;
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_CONST_SET_OP, 2, ActivationDataSetter(2.0)));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      VECTOR_NORM_OP, kFeaturesVectorAddress, 3));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 2, 3, 4));
+  algorithm.predict_.emplace_back(
+      make_shared<const Instruction>(SCALAR_PRODUCT_OP, 3, 2, 5));
+  algorithm.predict_.emplace_back(make_shared<const Instruction>(
+      SCALAR_SUM_OP, 4, 5, kPredictionsScalarAddress));
+  algorithm.learn_.emplace_back(
+      make_shared<const Instruction>(SCALAR_SUM_OP, 3, 3, 6));
+
+  OptimizationStats stats;
+  const Algorithm optimized = OptimizeAlgorithm(algorithm, &stats);
+  EXPECT_EQ(stats.num_algorithms, 1);
+  EXPECT_EQ(stats.num_instructions_before, 6);
+  EXPECT_EQ(stats.num_example_instructions_before, 6);
+  EXPECT_EQ(stats.num_redundant, 1);
+  // The recomputation and learn.
+  EXPECT_EQ(stats.num_pruned, 2);
+  // The constant.
+  EXPECT_EQ(stats.num_hoisted, 1);
+  EXPECT_EQ(stats.num_instructions_after, 4);
+  EXPECT_EQ(stats.num_example_instructions_after, 3);
+  EXPECT_EQ(optimized.setup_.size(), 1);
+
+  std::ostringstream stream;
+  stream << stats;
+  EXPECT_EQ(stream.str(),
+            "1 algorithms, 6 -> 3 instructions per example, 6 -> 4 in all "
+            "(folded 0, redundant 1, eliminated 0, pruned 2, hoisted 1)");
+}
+
+// Returns a random component function over few addresses and with ops that
+// the optimizer can simplify, so that simplifications are frequent.
+vector<shared_ptr<const Instruction>> RandomComponentFunction(
+    const IntegerT size, RandomGenerator* rand_gen) {
+  constexpr AddressT kNumAddresses = 4;
+  const vector<Op> ops = {
+      SCALAR_CONST_SET_OP, SCALAR_SUM_OP, SCALAR_DIFF_OP, SCALAR_PRODUCT_OP,
+      SCALAR_DIVISION_OP, SCALAR_MIN_OP, SCALAR_ABS_OP, SCALAR_EXP_OP,
+      SCALAR_VECTOR_PRODUCT_OP, VECTOR_INNER_PRODUCT_OP, VECTOR_SUM_OP,
+      VECTOR_ABS_OP, VECTOR_MAX_OP, MATRIX_TRANSPOSE_OP,
+      MATRIX_VECTOR_PRODUCT_OP, VECTOR_OUTER_PRODUCT_OP, MATRIX_NORM_OP,
+      SCALAR_UNIFORM_SET_OP};
+  const vector<double> constants = {0.0, -0.0, 1.0, 2.0, -1.0};
+  vector<shared_ptr<const Instruction>> component_function;
+  for (IntegerT i = 0; i < size; ++i) {
+    const Op op = ops[rand_gen->UniformInteger(0, ops.size())];
+    const AddressT out = rand_gen->UniformInteger(0, kNumAddresses);
+    if (op == SCALAR_CONST_SET_OP) {
+      component_function.emplace_back(make_shared<const Instruction>(
+          op, out,
+          ActivationDataSetter(
+              constants[rand_gen->UniformInteger(0, constants.size())])));
+    } else if (op == SCALAR_UNIFORM_SET_OP) {
+      component_function.emplace_back(make_shared<const Instruction>(
+          op, out, FloatDataSetter(-1.0), FloatDataSetter(1.0)));
+    } else {
+      component_function.emplace_back(make_shared<const Instruction>(
+          op, rand_gen->UniformInteger(0, kNumAddresses),
+          rand_gen->UniformInteger(0, kNumAddresses), out));
+    }
+  }
+  return component_function;
+}
+
+// Checks that optimized random Algorithms execute exactly like the original
+// ones: same fitness, errors, early stopping and random draws.
+void ExpectSameExecution(const Task<4>& task) {
+  constexpr IntegerT kNumAlgorithms = 1000;
+  mt19937 bit_gen(10000);
+  RandomGenerator rand_gen(&bit_gen);
+  OptimizationStats stats;
+  for (IntegerT i = 0; i < kNumAlgorithms; ++i) {
+    Algorithm algorithm;
+    algorithm.setup_ = RandomComponentFunction(4, &rand_gen);
+    algorithm.predict_ = RandomComponentFunction(6, &rand_gen);
+    algorithm.learn_ = RandomComponentFunction(6, &rand_gen);
+    const Algorithm optimized = OptimizeAlgorithm(algorithm, &stats);
+
+    mt19937 expected_bit_gen(i);
+    RandomGenerator expected_rand_gen(&expected_bit_gen);
+    Executor<4> expected_executor(algorithm, task, kNumTrainExamples,
+                                  kNumValidExamples, &expected_rand_gen,
+                                  kMaxAbsError);
+    vector<double> expected_train_errors;
+    vector<double> expected_valid_errors;
+    const double expected_fitness = expected_executor.Execute(
+        &expected_train_errors, &expected_valid_errors);
+
+    mt19937 actual_bit_gen(i);
+    RandomGenerator actual_rand_gen(&actual_bit_gen);
+    Executor<4> actual_executor(optimized, task, kNumTrainExamples,
+                                kNumValidExamples, &actual_rand_gen,
+                                kMaxAbsError,
+                                false,  // use_jit
+                                true);  // wipe_used_memory_only
+    vector<double> actual_train_errors;
+    vector<double> actual_valid_errors;
+    const double actual_fitness = actual_executor.Execute(
+        &actual_train_errors, &actual_valid_errors);
+
+    EXPECT_EQ(actual_fitness, expected_fitness);
+    EXPECT_EQ(actual_train_errors, expected_train_errors);
+    EXPECT_EQ(actual_valid_errors, expected_valid_errors);
+    EXPECT_EQ(actual_executor.GetNumTrainStepsCompleted(),
+              expected_executor.GetNumTrainStepsCompleted());
+    EXPECT_EQ(actual_bit_gen(), expected_bit_gen());
+  }
+  EXPECT_GT(stats.num_folded, kNumAlgorithms / 10);
+  EXPECT_GT(stats.num_redundant, kNumAlgorithms / 10);
+  EXPECT_GT(stats.num_eliminated, kNumAlgorithms / 10);
+  EXPECT_LT(stats.num_instructions_after, stats.num_instructions_before);
+}
+
+TEST(OptimizerTest, OptimizingDoesNotChangeRmsErrorExecution) {
+  ExpectSameExecution(GenerateTask<4>(StrCat(
+      "scalar_linear_regression_task {} "
+      "num_train_examples: ", kNumTrainExamples, " "
+      "num_valid_examples: ", kNumValidExamples, " "
+      "eval_type: RMS_ERROR "
+      "param_seeds: 100 "
+      "data_seeds: 1000 ")));
+}
+
+TEST(OptimizerTest, OptimizingDoesNotChangeAccuracyExecution) {
+  ExpectSameExecution(GenerateTask<4>(StrCat(
+      "unit_test_increment_task {increment: 0.01} "
+      "num_train_examples: ", kNumTrainExamples, " "
+      "num_valid_examples: ", kNumValidExamples, " "
+      "eval_type: ACCURACY ")));
+}
+
+}  // namespace automl_zero
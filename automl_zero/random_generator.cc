@@ -14,6 +14,9 @@
 
 #include "random_generator.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "definitions.h"
 #include "absl/memory/memory.h"
 #include "absl/random/distributions.h"
@@ -28,7 +31,144 @@ using ::std::mt19937;
 using ::std::numeric_limits;
 using ::std::string;
 
-RandomGenerator::RandomGenerator(mt19937* bit_gen) : bit_gen_(bit_gen) {}
+namespace {
+
+// The Philox-4x32 constants.
+constexpr uint32_t kPhiloxMultiplier0 = 0xD2511F53;
+constexpr uint32_t kPhiloxMultiplier1 = 0xCD9E8D57;
+constexpr uint32_t kPhiloxKeyIncrement0 = 0x9E3779B9;
+constexpr uint32_t kPhiloxKeyIncrement1 = 0xBB67AE85;
+constexpr IntegerT kPhiloxRounds = 10;
+
+// The number of blocks computed together. Each round is a loop over the lanes,
+// without dependencies between iterations, so that it gets vectorized.
+constexpr IntegerT kPhiloxLanes = 16;
+
+// Maps two random words to a double with 53 random bits in the open interval
+// (0, 1).
+inline double OpenUnitInterval(const uint32_t high, const uint32_t low) {
+  const uint64_t bits = (static_cast<uint64_t>(high) << 21) | (low >> 11);
+  return (static_cast<double>(bits) + 0.5) / 9007199254740992.0;  // 2^53.
+}
+
+}  // namespace
+
+void PhiloxGenerator::Fill(uint32_t* words, const IntegerT size) {
+  CHECK_EQ(size % 4, 0);
+  const IntegerT num_blocks = size / 4;
+  for (IntegerT first = 0; first < num_blocks; first += kPhiloxLanes) {
+    uint32_t x0[kPhiloxLanes], x1[kPhiloxLanes];
+    uint32_t x2[kPhiloxLanes], x3[kPhiloxLanes];
+    for (IntegerT lane = 0; lane < kPhiloxLanes; ++lane) {
+      const uint64_t counter = counter_ + first + lane;
+      x0[lane] = static_cast<uint32_t>(counter);
+      x1[lane] = static_cast<uint32_t>(counter >> 32);
+      x2[lane] = 0;
+      x3[lane] = 0;
+    }
+    uint32_t key0 = static_cast<uint32_t>(key_);
+    uint32_t key1 = static_cast<uint32_t>(key_ >> 32);
+    for (IntegerT round = 0; round < kPhiloxRounds; ++round) {
+      for (IntegerT lane = 0; lane < kPhiloxLanes; ++lane) {
+        const uint64_t product0 =
+            static_cast<uint64_t>(kPhiloxMultiplier0) * x0[lane];
+        const uint64_t product1 =
+            static_cast<uint64_t>(kPhiloxMultiplier1) * x2[lane];
+        x0[lane] = static_cast<uint32_t>(product1 >> 32) ^ x1[lane] ^ key0;
+        x1[lane] = static_cast<uint32_t>(product1);
+        x2[lane] = static_cast<uint32_t>(product0 >> 32) ^ x3[lane] ^ key1;
+        x3[lane] = static_cast<uint32_t>(product0);
+      }
+      key0 += kPhiloxKeyIncrement0;
+      key1 += kPhiloxKeyIncrement1;
+    }
+    const IntegerT num_lanes = std::min(kPhiloxLanes, num_blocks - first);
+    for (IntegerT lane = 0; lane < num_lanes; ++lane) {
+      uint32_t* block = words + 4 * (first + lane);
+      block[0] = x0[lane];
+      block[1] = x1[lane];
+      block[2] = x2[lane];
+      block[3] = x3[lane];
+    }
+  }
+  counter_ += num_blocks;
+}
+
+RandomGenerator::RandomGenerator(mt19937* bit_gen)
+    : bit_gen_(bit_gen),
+      num_scalar_addresses_(kMaxScalarAddresses),
+      num_vector_addresses_(kMaxVectorAddresses),
+      num_matrix_addresses_(kMaxMatrixAddresses),
+      use_counter_based_fills_(false) {}
+
+void RandomGenerator::UseCounterBasedFills(const uint64_t key) {
+  use_counter_based_fills_ = true;
+  counter_based_gen_.SetKey(key);
+}
+
+void RandomGenerator::SetNumAddresses(
+    const AddressT num_scalars, const AddressT num_vectors,
+    const AddressT num_matrices) {
+  // Leave room for at least one output address in each space.
+  CHECK_GT(num_scalars, kFirstOutScalarAddress);
+  CHECK_LE(num_scalars, kMaxScalarAddresses);
+  CHECK_GT(num_vectors, kFirstOutVectorAddress);
+  CHECK_LE(num_vectors, kMaxVectorAddresses);
+  CHECK_GT(num_matrices, kFirstOutMatrixAddress);
+  CHECK_LE(num_matrices, kMaxMatrixAddresses);
+  num_scalar_addresses_ = num_scalars;
+  num_vector_addresses_ = num_vectors;
+  num_matrix_addresses_ = num_matrices;
+}
+
+void RandomGenerator::Save(State* state) const {
+  state->bit_gen = *bit_gen_;
+  state->use_counter_based_fills = use_counter_based_fills_;
+  state->counter_based_gen = counter_based_gen_;
+}
+
+void RandomGenerator::Restore(const State& state) {
+  *bit_gen_ = state.bit_gen;
+  use_counter_based_fills_ = state.use_counter_based_fills;
+  counter_based_gen_ = state.counter_based_gen;
+}
+
+void RandomGenerator::CounterBasedFillUniform(
+    const double low, const double high, Scalar* values, const IntegerT size) {
+  // Two words per value, rounded up to whole blocks.
+  const IntegerT num_words = (2 * size + 3) / 4 * 4;
+  counter_based_words_.resize(num_words);
+  uint32_t* words = counter_based_words_.data();
+  counter_based_gen_.Fill(words, num_words);
+  const double range = high - low;
+  for (IntegerT i = 0; i < size; ++i) {
+    values[i] = static_cast<Scalar>(
+        low + range * OpenUnitInterval(words[2 * i], words[2 * i + 1]));
+  }
+}
+
+void RandomGenerator::CounterBasedFillGaussian(
+    const double mean, const double stdev, Scalar* values,
+    const IntegerT size) {
+  // Box-Muller: each block of 4 words gives two uniforms, which give two
+  // independent Gaussians.
+  const IntegerT num_pairs = (size + 1) / 2;
+  counter_based_words_.resize(4 * num_pairs);
+  uint32_t* words = counter_based_words_.data();
+  counter_based_gen_.Fill(words, 4 * num_pairs);
+  for (IntegerT pair = 0; pair < num_pairs; ++pair) {
+    const uint32_t* block = words + 4 * pair;
+    const double uniform0 = OpenUnitInterval(block[0], block[1]);
+    const double radius = stdev * std::sqrt(-2.0 * std::log(uniform0));
+    const double angle =
+        6.283185307179586 * OpenUnitInterval(block[2], block[3]);  // 2 pi.
+    values[2 * pair] = static_cast<Scalar>(mean + radius * std::cos(angle));
+    if (2 * pair + 1 < size) {
+      values[2 * pair + 1] =
+          static_cast<Scalar>(mean + radius * std::sin(angle));
+    }
+  }
+}
 
 float RandomGenerator::GaussianFloat(float mean, float stdev) {
   return ::absl::Gaussian<float>(*bit_gen_, mean, stdev);
@@ -92,30 +232,30 @@ FeatureIndexT RandomGenerator::FeatureIndex(
 }
 
 AddressT RandomGenerator::ScalarInAddress() {
-  return absl::Uniform<AddressT>(*bit_gen_, 0, kMaxScalarAddresses);
+  return absl::Uniform<AddressT>(*bit_gen_, 0, num_scalar_addresses_);
 }
 
 AddressT RandomGenerator::VectorInAddress() {
-  return absl::Uniform<AddressT>(*bit_gen_, 0, kMaxVectorAddresses);
+  return absl::Uniform<AddressT>(*bit_gen_, 0, num_vector_addresses_);
 }
 
 AddressT RandomGenerator::MatrixInAddress() {
-  return absl::Uniform<AddressT>(*bit_gen_, 0, kMaxMatrixAddresses);
+  return absl::Uniform<AddressT>(*bit_gen_, 0, num_matrix_addresses_);
 }
 
 AddressT RandomGenerator::ScalarOutAddress() {
   return absl::Uniform<AddressT>(
-      *bit_gen_, kFirstOutScalarAddress, kMaxScalarAddresses);
+      *bit_gen_, kFirstOutScalarAddress, num_scalar_addresses_);
 }
 
 AddressT RandomGenerator::VectorOutAddress() {
   return absl::Uniform<AddressT>(
-      *bit_gen_, kFirstOutVectorAddress, kMaxVectorAddresses);
+      *bit_gen_, kFirstOutVectorAddress, num_vector_addresses_);
 }
 
 AddressT RandomGenerator::MatrixOutAddress() {
   return absl::Uniform<AddressT>(
-      *bit_gen_, kFirstOutMatrixAddress, kMaxMatrixAddresses);
+      *bit_gen_, kFirstOutMatrixAddress, num_matrix_addresses_);
 }
 
 Choice2T RandomGenerator::Choice2() {
@@ -148,7 +288,11 @@ double RandomGenerator::BetaActivation(
 
 RandomGenerator::RandomGenerator()
     : bit_gen_owned_(make_unique<mt19937>(GenerateRandomSeed())),
-      bit_gen_(bit_gen_owned_.get()) {}
+      bit_gen_(bit_gen_owned_.get()),
+      num_scalar_addresses_(kMaxScalarAddresses),
+      num_vector_addresses_(kMaxVectorAddresses),
+      num_matrix_addresses_(kMaxMatrixAddresses),
+      use_counter_based_fills_(false) {}
 
 RandomSeedT GenerateRandomSeed() {
   RandomSeedT seed = 0;
@@ -15,14 +15,39 @@
 #ifndef AUTOML_ZERO_RANDOM_GENERATOR_H_
 #define AUTOML_ZERO_RANDOM_GENERATOR_H_
 
+#include <cstdint>
 #include <limits>
 #include <random>
+#include <vector>
 
 #include "definitions.h"
 #include "absl/random/random.h"
 
 namespace automl_zero {
 
+// The Philox-4x32-10 counter-based generator (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3", 2011). The n-th block of 4 words is a pure
+// function of the key and n, so blocks are independent of each other and are
+// computed several at a time, in SIMD lanes.
+class PhiloxGenerator {
+ public:
+  explicit PhiloxGenerator(uint64_t key = 0) : key_(key), counter_(0) {}
+
+  // Restarts the stream of the given key.
+  void SetKey(uint64_t key) {
+    key_ = key;
+    counter_ = 0;
+  }
+
+  // Writes the next size words of the stream. size must be a multiple of 4.
+  void Fill(uint32_t* words, IntegerT size);
+
+ private:
+  uint64_t key_;
+  // The number of blocks generated so far.
+  uint64_t counter_;
+};
+
 // Thread-compatible, but not thread-safe.
 class RandomGenerator {
  public:
@@ -38,6 +63,39 @@ class RandomGenerator {
     bit_gen_->seed(seed);
   }
 
+  // Makes FillUniform and FillGaussian draw from a PhiloxGenerator with the
+  // given key instead of from BitGen(). These fills then no longer advance
+  // BitGen() and depend only on the key and on the previous fills since the
+  // call. All other methods keep using BitGen().
+  void UseCounterBasedFills(uint64_t key);
+
+  // Makes all methods draw from BitGen() again. This is the default, which
+  // reproduces the random streams of runs that predate counter-based fills.
+  void UseBitGenFills() {use_counter_based_fills_ = false;}
+
+  // Makes the *InAddress and *OutAddress methods draw only from the first
+  // num_scalars, num_vectors and num_matrices addresses of each memory space.
+  // This sets the size of the search space at run time, up to the capacity of
+  // the Memory (kMaxScalarAddresses, etc.), which is the default.
+  void SetNumAddresses(
+      AddressT num_scalars, AddressT num_vectors, AddressT num_matrices);
+  AddressT NumScalarAddresses() const {return num_scalar_addresses_;}
+  AddressT NumVectorAddresses() const {return num_vector_addresses_;}
+  AddressT NumMatrixAddresses() const {return num_matrix_addresses_;}
+
+  // The state of all the streams the generator draws from, including the
+  // bit generator it does not own.
+  struct State {
+    std::mt19937 bit_gen;
+    bool use_counter_based_fills;
+    PhiloxGenerator counter_based_gen;
+  };
+
+  // Saves the state into *state. After Restore(*state), the generator draws
+  // the same numbers as after the call to Save.
+  void Save(State* state) const;
+  void Restore(const State& state);
+
   float GaussianFloat(float mean, float stdev);
 
   // Returns a uniform integer between low (incl) and high (excl).
@@ -101,8 +159,24 @@ class RandomGenerator {
  private:
   friend RandomGenerator RandomGenerator();
 
+  // The counter-based versions of FillUniform and FillGaussian, for size
+  // consecutive values.
+  void CounterBasedFillUniform(
+      double low, double high, Scalar* values, IntegerT size);
+  void CounterBasedFillGaussian(
+      double mean, double stdev, Scalar* values, IntegerT size);
+
   std::unique_ptr<std::mt19937> bit_gen_owned_;
   std::mt19937* bit_gen_;
+
+  AddressT num_scalar_addresses_;
+  AddressT num_vector_addresses_;
+  AddressT num_matrix_addresses_;
+
+  bool use_counter_based_fills_;
+  PhiloxGenerator counter_based_gen_;
+  // Scratch space for the words of counter_based_gen_.
+  std::vector<uint32_t> counter_based_words_;
 };
 
 // Generate a random seed using current time.
@@ -111,6 +185,10 @@ RandomSeedT GenerateRandomSeed();
 template<FeatureIndexT F>
 void RandomGenerator::FillUniform(
     double low, double high, Vector<F>* vector) {
+  if (use_counter_based_fills_) {
+    CounterBasedFillUniform(low, high, vector->data(), F);
+    return;
+  }
   for (FeatureIndexT i = 0; i < F; ++i) {
     (*vector)(i) =
         absl::Uniform<double>(absl::IntervalOpen, *bit_gen_, low, high);
@@ -120,6 +198,10 @@ void RandomGenerator::FillUniform(
 template<FeatureIndexT F>
 void RandomGenerator::FillUniform(
     double low, double high, Matrix<F>* matrix) {
+  if (use_counter_based_fills_) {
+    CounterBasedFillUniform(low, high, matrix->data(), F * F);
+    return;
+  }
   for (FeatureIndexT i = 0; i < F; ++i) {
     for (FeatureIndexT j = 0; j < F; ++j) {
       (*matrix)(i, j) =
@@ -131,6 +213,10 @@ void RandomGenerator::FillUniform(
 template<FeatureIndexT F>
 void RandomGenerator::FillGaussian(
     const double mean, const double stdev, Vector<F>* vector) {
+  if (use_counter_based_fills_) {
+    CounterBasedFillGaussian(mean, stdev, vector->data(), F);
+    return;
+  }
   for (FeatureIndexT i = 0; i < F; ++i) {
     (*vector)(i) = ::absl::Gaussian<double>(*bit_gen_, mean, stdev);
   }
@@ -139,6 +225,10 @@ void RandomGenerator::FillGaussian(
 template<FeatureIndexT F>
 void RandomGenerator::FillGaussian(
     const double mean, const double stdev, Matrix<F>* matrix) {
+  if (use_counter_based_fills_) {
+    CounterBasedFillGaussian(mean, stdev, matrix->data(), F * F);
+    return;
+  }
   for (FeatureIndexT i = 0; i < F; ++i) {
     for (FeatureIndexT j = 0; j < F; ++j) {
       (*matrix)(i, j) = ::absl::Gaussian<double>(*bit_gen_, mean, stdev);
@@ -17,6 +17,7 @@
 #include <cmath>
 #include <random>
 #include <unordered_set>
+#include <vector>
 
 #include "definitions.h"
 #include "test_util.h"
@@ -177,6 +178,33 @@ TEST(RandomGeneratorTest, MatrixOutAddressTest) {
           kFirstOutMatrixAddress, kMaxMatrixAddresses)));
 }
 
+TEST(RandomGeneratorTest, AddressesStayWithinNumAddresses) {
+  mt19937 bit_gen;
+  RandomGenerator rand_gen(&bit_gen);
+  rand_gen.SetNumAddresses(4, 3, 1);
+  EXPECT_TRUE(IsEventually(
+      function<AddressT(void)>([&](){return rand_gen.ScalarInAddress();}),
+      Range<AddressT>(0, 4), Range<AddressT>(0, 4)));
+  EXPECT_TRUE(IsEventually(
+      function<AddressT(void)>([&](){return rand_gen.VectorInAddress();}),
+      Range<AddressT>(0, 3), Range<AddressT>(0, 3)));
+  EXPECT_TRUE(IsEventually(
+      function<AddressT(void)>([&](){return rand_gen.MatrixInAddress();}),
+      Range<AddressT>(0, 1), Range<AddressT>(0, 1)));
+  EXPECT_TRUE(IsEventually(
+      function<AddressT(void)>([&](){return rand_gen.ScalarOutAddress();}),
+      Range<AddressT>(kFirstOutScalarAddress, 4),
+      Range<AddressT>(kFirstOutScalarAddress, 4)));
+  EXPECT_TRUE(IsEventually(
+      function<AddressT(void)>([&](){return rand_gen.VectorOutAddress();}),
+      Range<AddressT>(kFirstOutVectorAddress, 3),
+      Range<AddressT>(kFirstOutVectorAddress, 3)));
+  EXPECT_TRUE(IsEventually(
+      function<AddressT(void)>([&](){return rand_gen.MatrixOutAddress();}),
+      Range<AddressT>(kFirstOutMatrixAddress, 1),
+      Range<AddressT>(kFirstOutMatrixAddress, 1)));
+}
+
 TEST(RandomGeneratorTest, Choice2Test) {
   mt19937 bit_gen;
   RandomGenerator rand_gen(&bit_gen);
@@ -422,6 +450,142 @@ TEST(RandomGeneratorTest, FillBetaMatrixTest_Fis4) {
       Range<IntegerT>(0, 11)));
 }
 
+TEST(PhiloxGeneratorTest, MatchesKnownAnswer) {
+  // From the known-answer tests of the Random123 library.
+  PhiloxGenerator gen(0);
+  uint32_t words[4];
+  gen.Fill(words, 4);
+  EXPECT_EQ(words[0], 0x6627e8d5);
+  EXPECT_EQ(words[1], 0xe169c58d);
+  EXPECT_EQ(words[2], 0xbc57ac4c);
+  EXPECT_EQ(words[3], 0x9b00dbd8);
+}
+
+TEST(PhiloxGeneratorTest, StreamDoesNotDependOnFillSizes) {
+  PhiloxGenerator gen1(12345);
+  std::vector<uint32_t> words1(200);
+  gen1.Fill(words1.data(), 200);
+  PhiloxGenerator gen2(12345);
+  std::vector<uint32_t> words2(200);
+  gen2.Fill(words2.data(), 4);
+  gen2.Fill(words2.data() + 4, 68);
+  gen2.Fill(words2.data() + 72, 128);
+  EXPECT_EQ(words1, words2);
+  gen2.SetKey(12345);
+  gen2.Fill(words2.data(), 200);
+  EXPECT_EQ(words1, words2);
+  gen2.SetKey(12346);
+  gen2.Fill(words2.data(), 200);
+  EXPECT_NE(words1, words2);
+}
+
+TEST(RandomGeneratorTest, CounterBasedFillsDependOnlyOnKey) {
+  mt19937 bit_gen1(1);
+  RandomGenerator rand_gen1(&bit_gen1);
+  rand_gen1.UseCounterBasedFills(100);
+  Matrix<4> matrix1;
+  rand_gen1.FillGaussian<4>(0.0, 1.0, &matrix1);
+  Vector<4> vector1;
+  rand_gen1.FillUniform<4>(-1.0, 1.0, &vector1);
+
+  mt19937 bit_gen2(2);
+  RandomGenerator rand_gen2(&bit_gen2);
+  rand_gen2.UseCounterBasedFills(100);
+  Matrix<4> matrix2;
+  rand_gen2.FillGaussian<4>(0.0, 1.0, &matrix2);
+  Vector<4> vector2;
+  rand_gen2.FillUniform<4>(-1.0, 1.0, &vector2);
+
+  EXPECT_EQ(matrix1, matrix2);
+  EXPECT_EQ(vector1, vector2);
+  // The fills do not advance the bit generator.
+  EXPECT_EQ(bit_gen1(), mt19937(1)());
+}
+
+TEST(RandomGeneratorTest, BitGenFillsAreReproducible) {
+  mt19937 bit_gen1(1);
+  RandomGenerator rand_gen1(&bit_gen1);
+  Vector<8> vector1;
+  rand_gen1.FillGaussian<8>(0.0, 1.0, &vector1);
+
+  mt19937 bit_gen2(1);
+  RandomGenerator rand_gen2(&bit_gen2);
+  rand_gen2.UseCounterBasedFills(100);
+  rand_gen2.UseBitGenFills();
+  Vector<8> vector2;
+  rand_gen2.FillGaussian<8>(0.0, 1.0, &vector2);
+
+  EXPECT_EQ(vector1, vector2);
+}
+
+TEST(RandomGeneratorTest, RestoringRepeatsTheDraws) {
+  mt19937 bit_gen(1);
+  RandomGenerator rand_gen(&bit_gen);
+  rand_gen.UseCounterBasedFills(100);
+  Vector<4> vector;
+  rand_gen.FillUniform<4>(-1.0, 1.0, &vector);
+  rand_gen.UniformDouble(-1.0, 1.0);
+  RandomGenerator::State state;
+  rand_gen.Save(&state);
+
+  Vector<4> expected_vector;
+  rand_gen.FillUniform<4>(-1.0, 1.0, &expected_vector);
+  const double expected_value = rand_gen.UniformDouble(-1.0, 1.0);
+  rand_gen.UseBitGenFills();
+  rand_gen.FillUniform<4>(-1.0, 1.0, &vector);
+
+  rand_gen.Restore(state);
+  Vector<4> actual_vector;
+  rand_gen.FillUniform<4>(-1.0, 1.0, &actual_vector);
+  EXPECT_EQ(actual_vector, expected_vector);
+  EXPECT_EQ(rand_gen.UniformDouble(-1.0, 1.0), expected_value);
+}
+
+TEST(RandomGeneratorTest, CounterBasedFillUniformProducesAllValues) {
+  mt19937 bit_gen;
+  RandomGenerator rand_gen(&bit_gen);
+  rand_gen.UseCounterBasedFills(GenerateRandomSeed());
+  FeatureIndexT index = rand_gen.FeatureIndex(8);
+  EXPECT_TRUE(IsEventually(
+      function<IntegerT(void)>([&](){
+        return FillUniformVectorHelper<8>(index, &rand_gen);}),
+      Range<IntegerT>(-5, 11),
+      Range<IntegerT>(-5, 11)));
+}
+
+TEST(RandomGeneratorTest, CounterBasedFillGaussianProducesAllValues) {
+  mt19937 bit_gen;
+  RandomGenerator rand_gen(&bit_gen);
+  rand_gen.UseCounterBasedFills(GenerateRandomSeed());
+  FeatureIndexT index_x = rand_gen.FeatureIndex(4);
+  FeatureIndexT index_y = rand_gen.FeatureIndex(4);
+  EXPECT_TRUE(IsEventually(
+      function<IntegerT(void)>([&](){
+        return FillGaussianMatrixHelper<4>(index_x, index_y, &rand_gen);}),
+      Range<IntegerT>(-100, 101),
+      Range<IntegerT>(-10, 11)));
+}
+
+TEST(RandomGeneratorTest, CounterBasedFillGaussianHasRightMoments) {
+  mt19937 bit_gen;
+  RandomGenerator rand_gen(&bit_gen);
+  rand_gen.UseCounterBasedFills(7);
+  constexpr IntegerT kNumFills = 1000;
+  double sum = 0.0;
+  double sum_squares = 0.0;
+  for (IntegerT i = 0; i < kNumFills; ++i) {
+    Matrix<4> matrix;
+    rand_gen.FillGaussian<4>(1.0, 2.0, &matrix);
+    sum += matrix.sum();
+    sum_squares += matrix.squaredNorm();
+  }
+  const double num_values = kNumFills * 16;
+  const double mean = sum / num_values;
+  const double variance = sum_squares / num_values - mean * mean;
+  EXPECT_NEAR(mean, 1.0, 0.05);
+  EXPECT_NEAR(variance, 4.0, 0.2);
+}
+
 TEST(GenerateRandomSeedTest, GeneratesDifferentSeeds) {
   RandomSeedT seed1 = GenerateRandomSeed();
   usleep(100);
@@ -27,6 +27,7 @@
 #include "task_util.h"
 #include "definitions.h"
 #include "executor.h"
+#include "fitness_surrogate.h"
 #include "instruction.h"
 #include "random_generator.h"
 #include "absl/flags/flag.h"
@@ -55,15 +56,20 @@ using ::std::unique_ptr;  // NOLINT
 using ::std::vector;  // NOLINT
 
 constexpr double kLn2 = 0.69314718056;
-constexpr IntegerT kReductionFactor = 100;
 
 }  // namespace
 
 RegularizedEvolution::RegularizedEvolution(
     RandomGenerator* rand_gen, const IntegerT population_size,
     const IntegerT tournament_size, const IntegerT progress_every,
-    Generator* generator, Evaluator* evaluator, Mutator* mutator, DB_Connection* db)
+    Generator* generator, Evaluator* evaluator, Mutator* mutator, DB_Connection* db,
+    const vector<EvaluationRung>& evaluation_rungs,
+    const FitnessSurrogateSpec* fitness_surrogate_spec)
     : evaluator_(evaluator),
+      evaluation_ladder_(evaluation_rungs, evaluator),
+      fitness_surrogate_(
+          fitness_surrogate_spec == nullptr ?
+          nullptr : make_unique<FitnessSurrogate>(*fitness_surrogate_spec)),
       rand_gen_(rand_gen),
       start_secs_(GetCurrentTimeNanos() / kNanosPerSecond),
       epoch_secs_(start_secs_),
@@ -75,7 +81,6 @@ RegularizedEvolution::RegularizedEvolution(
       generator_(generator),
       mutator_(mutator),
       db_(db),
-      hurdle_(0),
       migrate_prob_(.001),
       evol_id_(rand() % 100000),
       population_size_(population_size),
@@ -89,11 +94,11 @@ IntegerT RegularizedEvolution::Init() {
   std::vector<double>::iterator fitness_it = fitnesses_.begin();
   for (shared_ptr<const Algorithm>& algorithm : algorithms_) {
     InitAlgorithm(&algorithm);
-    bool earlyEval = true;
-    *fitness_it = Execute(algorithm, earlyEval);
+    *fitness_it = Execute(algorithm);
     ++fitness_it;
   }
   CHECK(fitness_it == fitnesses_.end());
+  evaluation_ladder_.EndGeneration();
 
   MaybePrintProgress();
   initialized_ = true;
@@ -111,41 +116,24 @@ IntegerT RegularizedEvolution::Run(const IntegerT max_train_steps,
          GetCurrentTimeNanos() - start_nanos < max_nanos) {
     vector<double>::iterator next_fitness_it = fitnesses_.begin();
     for (shared_ptr<const Algorithm>& next_algorithm : algorithms_) {
-      SingleParentSelect(&next_algorithm);
-      mutator_->Mutate(1, &next_algorithm);
-      if (hurdle_ != 0) {
-        *next_fitness_it = Execute(next_algorithm, true);
-        if (*next_fitness_it > hurdle_) {
-          *next_fitness_it = Execute(next_algorithm, false);
-        }
-      }
-      else {
-      *next_fitness_it = Execute(next_algorithm, true);
+      if (fitness_surrogate_ == nullptr) {
+        SingleParentSelect(&next_algorithm);
+        mutator_->Mutate(1, &next_algorithm);
+        *next_fitness_it = Execute(next_algorithm);
+      } else {
+        *next_fitness_it = ExecuteSurrogateFilteredChild(&next_algorithm);
       }
       ++next_fitness_it;
     }
-    
-    // Sorting entire fitness vector and removing duplicate items
-    std::set<double> fitnesses_set(fitnesses_.begin(), fitnesses_.end());
-    vector<double> unique_fitnesses(fitnesses_set.begin(), fitnesses_set.end());
-    
-    hurdle_ = unique_fitnesses[int(unique_fitnesses.size()*.75)];
+    evaluation_ladder_.EndGeneration();
 
-    if (rand_gen_->UniformProbability() < migrate_prob_){
+    if (db_ != nullptr && rand_gen_->UniformProbability() < migrate_prob_){
       cout << "inserting algs with evol id: " << evol_id_ << endl;
       db_->Delete(evol_id_);
       db_->Insert(evol_id_, algorithms_);
       algorithms_ = db_->Migrate(evol_id_, algorithms_);
     } 
 
-    // Sorting just the 75% percentile of items in the array, but not removing duplicate items
-    // vector<double> unique_fitnesses;
-    // for (IntegerT i=0; i < fitnesses_.size(); i++){
-    //   unique_fitnesses.push_back(fitnesses_[i]);
-    // }
-    // std::nth_element(unique_fitnesses.begin(), unique_fitnesses.begin() + int(unique_fitnesses.size()*.75), unique_fitnesses.end());
-    // hurdle_ = unique_fitnesses[int(unique_fitnesses.size()*.75)];
-    
     MaybePrintProgress();
   }
   return evaluator_->GetNumTrainStepsCompleted() - start_train_steps;
@@ -163,6 +151,14 @@ IntegerT RegularizedEvolution::NumTrainSteps() const {
   return evaluator_->GetNumTrainStepsCompleted();
 }
 
+const EvaluationLadder& RegularizedEvolution::GetEvaluationLadder() const {
+  return evaluation_ladder_;
+}
+
+const FitnessSurrogate* RegularizedEvolution::GetFitnessSurrogate() const {
+  return fitness_surrogate_.get();
+}
+
 shared_ptr<const Algorithm> RegularizedEvolution::Get(
     double* fitness) {
   const IntegerT indiv_index =
@@ -222,22 +218,18 @@ void RegularizedEvolution::InitAlgorithm(
   mutator_->Mutate(0, algorithm);
 }
 
-double RegularizedEvolution::Execute(shared_ptr<const Algorithm> algorithm, bool earlyEval=false) {
+double RegularizedEvolution::Execute(shared_ptr<const Algorithm> algorithm,
+                                     double* first_rung_fitness,
+                                     bool* first_rung_fitness_is_estimate) {
   ++num_individuals_;
   epoch_secs_ = GetCurrentTimeNanos() / kNanosPerSecond;
-  if (earlyEval == true && true == true) {
-    const double fitness_early = evaluator_->EarlyEvaluate(*algorithm);
-    return fitness_early;
-  }
-  else {
-    const double fitness = evaluator_->Evaluate(*algorithm);
-    return fitness;
-  }
-  // return fitness;
+  const double fitness = evaluation_ladder_.Evaluate(
+      *algorithm, first_rung_fitness, first_rung_fitness_is_estimate);
+  return fitness;
 }
 
 shared_ptr<const Algorithm>
-    RegularizedEvolution::BestFitnessTournament() {
+    RegularizedEvolution::BestFitnessTournament(double* fitness) {
   double tour_best_fitness = -std::numeric_limits<double>::infinity();
   IntegerT best_index = -1;
   for (IntegerT tour_idx = 0; tour_idx < tournament_size_; ++tour_idx) {
@@ -249,6 +241,7 @@ shared_ptr<const Algorithm>
       best_index = algorithm_index;
     }
   }
+  if (fitness != nullptr) *fitness = tour_best_fitness;
   return algorithms_[best_index];
 }
 
@@ -257,6 +250,39 @@ void RegularizedEvolution::SingleParentSelect(
   *algorithm = BestFitnessTournament();
 }
 
+double RegularizedEvolution::ExecuteSurrogateFilteredChild(
+    shared_ptr<const Algorithm>* algorithm) {
+  // The skipped children stay out of the population, so that the tournaments
+  // only see evaluated Algorithms.
+  shared_ptr<const Algorithm> child;
+  vector<double> features;
+  while (true) {
+    double parent_fitness;
+    child = BestFitnessTournament(&parent_fitness);
+    mutator_->Mutate(1, &child);
+    features = FitnessSurrogate::Features(
+        *child, parent_fitness, mutator_->LastMutationType());
+    // The surrogate predicts the fitness on the first rung, so it is compared
+    // with the threshold of that rung.
+    if (!evaluation_ladder_.HasPromotionThreshold(0) ||
+        fitness_surrogate_->ShouldEvaluate(
+            features, evaluation_ladder_.GetPromotionThreshold(0),
+            rand_gen_)) {
+      break;
+    }
+  }
+  *algorithm = child;
+  double first_rung_fitness;
+  bool first_rung_fitness_is_estimate;
+  const double fitness = Execute(child, &first_rung_fitness,
+                                 &first_rung_fitness_is_estimate);
+  // An estimate would teach the surrogate the errors of the extrapolation.
+  if (!first_rung_fitness_is_estimate) {
+    fitness_surrogate_->Train(features, first_rung_fitness);
+  }
+  return fitness;
+}
+
 void RegularizedEvolution::MaybePrintProgress() {
   if (num_individuals_ < num_individuals_last_progress_ + progress_every_) {
     return;
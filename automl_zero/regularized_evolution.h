@@ -23,10 +23,13 @@
 
 #include "algorithm.h"
 #include "definitions.h"
+#include "evaluation_ladder.h"
 #include "evaluator.h"
+#include "fitness_surrogate.h"
 #include "generator.h"
 #include "mutator.h"
 #include "db_connection.h"
+#include "experiment.pb.h"
 #include "random_generator.h"
 #include "absl/flags/flag.h"
 #include "absl/time/time.h"
@@ -48,7 +51,14 @@ class RegularizedEvolution {
       Evaluator* evaluator,
       // The mutator to use to perform all mutations.
       Mutator* mutator,
-      DB_Connection* db);
+      // The database the population migrates through. If nullptr, the
+      // population does not migrate.
+      DB_Connection* db,
+      // The rungs the individuals are evaluated on. See EvaluationLadder.
+      const std::vector<EvaluationRung>& evaluation_rungs = {},
+      // If not nullptr, the children go through a FitnessSurrogate with this
+      // spec, which can skip them.
+      const FitnessSurrogateSpec* fitness_surrogate_spec = nullptr);
   RegularizedEvolution(
       const RegularizedEvolution& other) = delete;
   RegularizedEvolution& operator=(
@@ -80,6 +90,12 @@ class RegularizedEvolution {
 
   IntegerT PopulationSize() const;
 
+  // The rungs of the evaluations, and what happened on them.
+  const EvaluationLadder& GetEvaluationLadder() const;
+
+  // The FitnessSurrogate, or nullptr if there is none.
+  const FitnessSurrogate* GetFitnessSurrogate() const;
+
   void PopulationStats(
       double* pop_mean, double* pop_stdev,
       std::shared_ptr<const Algorithm>* pop_best_algorithm,
@@ -87,6 +103,7 @@ class RegularizedEvolution {
 
  private:
   FRIEND_TEST(RegularizedEvolutionTest, TimesCorrectly);
+  FRIEND_TEST(RegularizedEvolutionTest, EndsLadderGenerations);
 
   friend IntegerT PutsInPosition(
       const Algorithm&, RegularizedEvolution*);
@@ -97,12 +114,24 @@ class RegularizedEvolution {
       const RegularizedEvolution&);
 
   void InitAlgorithm(std::shared_ptr<const Algorithm>* algorithm);
-  double Execute(std::shared_ptr<const Algorithm> algorithm, bool earlyEval);
-  std::shared_ptr<const Algorithm> BestFitnessTournament();
+  // See EvaluationLadder::Evaluate.
+  double Execute(std::shared_ptr<const Algorithm> algorithm,
+                 double* first_rung_fitness = nullptr,
+                 bool* first_rung_fitness_is_estimate = nullptr);
+  // Also sets `fitness`, if not nullptr, to that of the winner.
+  std::shared_ptr<const Algorithm> BestFitnessTournament(
+      double* fitness = nullptr);
   void SingleParentSelect(std::shared_ptr<const Algorithm>* algorithm);
+  // Selects and mutates children until the FitnessSurrogate does not skip one,
+  // then evaluates it and trains the FitnessSurrogate on it, unless its first
+  // rung fitness is only an estimate. Returns its fitness.
+  double ExecuteSurrogateFilteredChild(
+      std::shared_ptr<const Algorithm>* algorithm);
   void MaybePrintProgress();
 
   Evaluator* evaluator_;
+  EvaluationLadder evaluation_ladder_;
+  std::unique_ptr<FitnessSurrogate> fitness_surrogate_;
   RandomGenerator* rand_gen_;
   const IntegerT start_secs_;
   IntegerT epoch_secs_;
@@ -115,7 +144,6 @@ class RegularizedEvolution {
   Mutator* mutator_;
   DB_Connection* db_;
 
-  double hurdle_;
   const double migrate_prob_;
   int evol_id_;
 
@@ -19,6 +19,8 @@
 
 #include "algorithm.h"
 #include "algorithm_test_util.h"
+#include "evaluation_ladder.h"
+#include "fitness_surrogate.h"
 #include "task_util.h"
 #include "definitions.h"
 #include "instruction.pb.h"
@@ -96,7 +98,8 @@ TEST(RegularizedEvolutionTest, Runs) {
       kUnlimitedIndividuals,  // progress_every
       &generator,
       &evaluator,
-      &mutator);
+      &mutator,
+      nullptr);  // db
   regularized_evolution.Init();
   regularized_evolution.Run(20 * kNumTrainStepsPerIndividual, kUnlimitedTime);
 }
@@ -132,7 +135,8 @@ TEST(RegularizedEvolutionTest, TimesCorrectly) {
       kUnlimitedIndividuals,  // progress_every
       &generator,
       &evaluator,
-      &mutator);
+      &mutator,
+      nullptr);  // db
   regularized_evolution.Init();
   const IntegerT one_second = 1000000000;
   IntegerT start_nanos = GetCurrentTimeNanos();
@@ -175,7 +179,10 @@ TEST(RegularizedEvolutionTest, CountsCorrectly) {
       kUnlimitedIndividuals,  // progress_every
       &generator,
       &evaluator,
-      &mutator);
+      &mutator,
+      nullptr,  // db
+      // Every individual gets a full evaluation.
+      vector<EvaluationRung>(1));
   EXPECT_EQ(regularized_evolution.NumTrainSteps(), 0);
   EXPECT_EQ(regularized_evolution.NumTrainSteps(), 0);
   EXPECT_EQ(regularized_evolution.Init(), 5);
@@ -201,6 +208,170 @@ TEST(RegularizedEvolutionTest, CountsCorrectly) {
             25 * kNumTrainStepsPerIndividual);
 }
 
+// Ops that make the predictions depend on the features.
+vector<Op> SearchOps() {
+  return {SCALAR_SUM_OP, SCALAR_DIFF_OP, SCALAR_PRODUCT_OP, SCALAR_DIVISION_OP,
+          SCALAR_EXP_OP, SCALAR_CONST_SET_OP, VECTOR_SUM_OP, VECTOR_PRODUCT_OP,
+          SCALAR_VECTOR_PRODUCT_OP, VECTOR_INNER_PRODUCT_OP};
+}
+
+// A cheap rung on one task, a middle rung and a full evaluation.
+vector<EvaluationRung> ThreeRungs() {
+  vector<EvaluationRung> rungs(3);
+  rungs[0] = ParseTextFormat<EvaluationRung>(
+      "train_examples_fraction: 0.01 "
+      "promotion_quantile: 0.5 "
+      "num_tasks: 1 ");
+  rungs[1] = ParseTextFormat<EvaluationRung>(
+      "train_examples_fraction: 0.1 "
+      "promotion_quantile: 0.5 ");
+  return rungs;
+}
+
+TEST(RegularizedEvolutionTest, EndsLadderGenerations) {
+  mt19937 bit_gen(kEvolutionSeed);
+  RandomGenerator rand_gen(&bit_gen);
+  // The random Algorithms of the default Generator all get the same fitness.
+  Generator generator(RANDOM_ALGORITHM, 3, 4, 4,
+                      {SCALAR_CONST_SET_OP, VECTOR_GAUSSIAN_SET_OP},
+                      SearchOps(), SearchOps(), &bit_gen, &rand_gen);
+  const auto task_collection = ParseTextFormat<TaskCollection>(
+      StrCat("tasks { "
+             "  scalar_2layer_nn_regression_task {} "
+             "  features_size: 4 "
+             "  num_train_examples: ",
+             kNumTrainExamplesForSearch,
+             " "
+             "  num_valid_examples: ",
+             kNumValidExamplesForSearch,
+             " "
+             "  num_tasks: ",
+             kNumTasksForSearch,
+             " "
+             "  eval_type: RMS_ERROR "
+             "} "));
+  Evaluator evaluator(MEAN_FITNESS_COMBINATION, task_collection, &rand_gen,
+                      nullptr,  // functional_cache
+                      nullptr,  // train_budget
+                      kLargeMaxAbsError);
+  Mutator mutator(
+      ParseTextFormat<MutationTypeList>(
+          "mutation_types: [ "
+          "  ALTER_PARAM_MUTATION_TYPE, "
+          "  RANDOMIZE_INSTRUCTION_MUTATION_TYPE "
+          "] "),
+      1.0,  // mutate_prob
+      {SCALAR_CONST_SET_OP, VECTOR_GAUSSIAN_SET_OP},  // allowed_setup_ops
+      SearchOps(),  // allowed_predict_ops
+      SearchOps(),  // allowed_learn_ops
+      3, 3, 4, 4, 4, 4,  // min/max component function sizes
+      &bit_gen,
+      &rand_gen);
+  RegularizedEvolution regularized_evolution(
+      &rand_gen,
+      10,  // population_size
+      2,  // tournament_size
+      kUnlimitedIndividuals,  // progress_every
+      &generator,
+      &evaluator,
+      &mutator,
+      nullptr,  // db
+      ThreeRungs());
+  const EvaluationLadder& ladder = regularized_evolution.GetEvaluationLadder();
+  regularized_evolution.Init();
+  // Nothing is promoted in the first generation, so the population holds the
+  // fitnesses on the first rung.
+  EXPECT_TRUE(ladder.HasPromotionThreshold(0));
+  EXPECT_FALSE(ladder.HasPromotionThreshold(1));
+  EXPECT_EQ(ladder.GetPromotionThreshold(0),
+            internal::PromotionThreshold(regularized_evolution.fitnesses_,
+                                         0.5));
+  EXPECT_EQ(ladder.GetRungStats()[1].num_evaluated, 0);
+
+  // One generation.
+  regularized_evolution.Run(1, kUnlimitedTime);
+  EXPECT_EQ(ladder.GetRungStats()[0].num_evaluated, 20);
+  EXPECT_GT(ladder.GetRungStats()[0].num_promoted, 0);
+  EXPECT_EQ(ladder.GetRungStats()[1].num_evaluated,
+            ladder.GetRungStats()[0].num_promoted);
+  EXPECT_TRUE(ladder.HasPromotionThreshold(1));
+}
+
+TEST(RegularizedEvolutionTest, TrainsSurrogateOnExactFitnesses) {
+  mt19937 bit_gen(kEvolutionSeed);
+  RandomGenerator rand_gen(&bit_gen);
+  // The random Algorithms of the default Generator all get the same fitness.
+  Generator generator(RANDOM_ALGORITHM, 3, 4, 4,
+                      {SCALAR_CONST_SET_OP, VECTOR_GAUSSIAN_SET_OP},
+                      SearchOps(), SearchOps(), &bit_gen, &rand_gen);
+  const auto task_collection = ParseTextFormat<TaskCollection>(
+      StrCat("tasks { "
+             "  scalar_2layer_nn_regression_task {} "
+             "  features_size: 4 "
+             "  num_train_examples: ",
+             kNumTrainExamplesForSearch,
+             " "
+             "  num_valid_examples: ",
+             kNumValidExamplesForSearch,
+             " "
+             "  num_tasks: ",
+             kNumTasksForSearch,
+             " "
+             "  eval_type: RMS_ERROR "
+             "} "));
+  EvaluatorOptions evaluator_options;
+  evaluator_options.bound_validation = true;
+  Evaluator evaluator(MEAN_FITNESS_COMBINATION, task_collection, &rand_gen,
+                      nullptr,  // functional_cache
+                      nullptr,  // train_budget
+                      kLargeMaxAbsError, evaluator_options);
+  Mutator mutator(
+      ParseTextFormat<MutationTypeList>(
+          "mutation_types: [ "
+          "  ALTER_PARAM_MUTATION_TYPE, "
+          "  RANDOMIZE_INSTRUCTION_MUTATION_TYPE "
+          "] "),
+      1.0,  // mutate_prob
+      {SCALAR_CONST_SET_OP, VECTOR_GAUSSIAN_SET_OP},  // allowed_setup_ops
+      SearchOps(),  // allowed_predict_ops
+      SearchOps(),  // allowed_learn_ops
+      3, 3, 4, 4, 4, 4,  // min/max component function sizes
+      &bit_gen,
+      &rand_gen);
+  const auto fitness_surrogate_spec = ParseTextFormat<FitnessSurrogateSpec>(
+      "skip_margin: 0.0 "
+      "exploration_rate: 0.5 "
+      "min_train_examples: 5 ");
+  RegularizedEvolution regularized_evolution(
+      &rand_gen,
+      10,  // population_size
+      2,  // tournament_size
+      kUnlimitedIndividuals,  // progress_every
+      &generator,
+      &evaluator,
+      &mutator,
+      nullptr,  // db
+      ThreeRungs(),
+      &fitness_surrogate_spec);
+  regularized_evolution.Init();
+  for (IntegerT generation = 0; generation < 5; ++generation) {
+    regularized_evolution.Run(1, kUnlimitedTime);
+  }
+
+  // The skipped children are replaced, and only the children whose fitness on
+  // the first rung is exact are learned from.
+  const FitnessSurrogate* fitness_surrogate =
+      regularized_evolution.GetFitnessSurrogate();
+  ASSERT_NE(fitness_surrogate, nullptr);
+  EXPECT_EQ(regularized_evolution.NumIndividuals(), 60);
+  EXPECT_GT(fitness_surrogate->NumSkipped(), 0);
+  const IntegerT num_estimated =
+      regularized_evolution.GetEvaluationLadder().GetRungStats()[0]
+          .num_estimated;
+  EXPECT_GT(num_estimated, 0);
+  EXPECT_EQ(fitness_surrogate->NumTrainExamples(), 50 - num_estimated);
+}
+
 bool PopulationsEq(
     const RegularizedEvolution& regularized_evolution_1,
     const RegularizedEvolution& regularized_evolution_2) {
@@ -20,9 +20,6 @@ DATA_DIR=$(pwd)/binary_cifar10_data/
 # projected binary tasks. Utility script to check whether the tasks are
 # ready.
 bazel run -c opt \
-  --copt=-DMAX_SCALAR_ADDRESSES=5 \
-  --copt=-DMAX_VECTOR_ADDRESSES=9 \
-  --copt=-DMAX_MATRIX_ADDRESSES=2 \
   :run_search_experiment -- \
   --search_experiment_spec=" \
     search_tasks { \
@@ -59,6 +56,9 @@ bazel run -c opt \
     mutate_predict_size_min: 1 \
     mutate_predict_size_max: 11 \
     learn_size_init: 1 \
+    num_scalar_addresses: 5 \
+    num_vector_addresses: 9 \
+    num_matrix_addresses: 2 \
     mutate_learn_size_min: 1 \
     mutate_learn_size_max: 23 \
     train_budget {train_budget_baseline: NEURAL_NET_ALGORITHM} \
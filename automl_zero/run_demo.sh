@@ -18,9 +18,6 @@
 # ./run_demo.sh
 
 bazel run -c opt \
-  --copt=-DMAX_SCALAR_ADDRESSES=4 \
-  --copt=-DMAX_VECTOR_ADDRESSES=3 \
-  --copt=-DMAX_MATRIX_ADDRESSES=1 \
   :run_search_experiment -- \
   --search_experiment_spec=" \
     search_tasks { \
@@ -39,6 +36,9 @@ bazel run -c opt \
     learn_size_init: 8 \
     setup_size_init: 10 \
     predict_size_init: 2 \
+    num_scalar_addresses: 4 \
+    num_vector_addresses: 3 \
+    num_matrix_addresses: 1 \
     fec {num_train_examples: 10 num_valid_examples: 10} \
     fitness_combination_mode: MEAN_FITNESS_COMBINATION \
     population_size: 1000 \
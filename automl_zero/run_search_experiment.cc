@@ -28,6 +28,8 @@
 #include "definitions.h"
 #include "instruction.pb.h"
 #include "evaluator.h"
+#include "executor.h"
+#include "executor_profile.h"
 #include "experiment.pb.h"
 #include "experiment_util.h"
 #include "fec_cache.h"
@@ -35,6 +37,7 @@
 #include "mutator.h"
 #include "random_generator.h"
 #include "regularized_evolution.h"
+#include "simd_kernels.h"
 #include "train_budget.h"
 #include "google/protobuf/text_format.h"
 #include "absl/flags/flag.h"
@@ -82,6 +85,14 @@ ABSL_FLAG(
 ABSL_FLAG(
     std::string, experiment_name, "",
     "The name of the experiment and database for this run. Required.");
+ABSL_FLAG(
+    std::string, executor_profile_file, "",
+    "Only in builds with --copt=-DEXECUTOR_PROFILING. If set, the per-op "
+    "counts and cycles of the executors are periodically appended to this "
+    "file, one tab-separated line per op.");
+ABSL_FLAG(
+    IntegerT, executor_profile_every_secs, 60,
+    "How often to append to `executor_profile_file`.");
 
 namespace automl_zero {
 
@@ -112,11 +123,24 @@ void run() {
   RandomGenerator rand_gen(&bit_gen);
   srand(random_seed);
   cout << "Random seed = " << random_seed << endl;
+  if (kExecutorProfiling && !GetFlag(FLAGS_executor_profile_file).empty()) {
+    SetExecutorProfileHistogramFile(
+        GetFlag(FLAGS_executor_profile_file),
+        GetFlag(FLAGS_executor_profile_every_secs));
+  }
 
   // Build reusable search and select structures.
   CHECK(!GetFlag(FLAGS_search_experiment_spec).empty());
   auto experiment_spec = ParseTextFormat<SearchExperimentSpec>(
       GetFlag(FLAGS_search_experiment_spec));
+  rand_gen.SetNumAddresses(
+      experiment_spec.has_num_scalar_addresses() ?
+          experiment_spec.num_scalar_addresses() : kMaxScalarAddresses,
+      experiment_spec.has_num_vector_addresses() ?
+          experiment_spec.num_vector_addresses() : kMaxVectorAddresses,
+      experiment_spec.has_num_matrix_addresses() ?
+          experiment_spec.num_matrix_addresses() : kMaxMatrixAddresses);
+  SetUseSimdKernels(experiment_spec.use_simd_kernels());
   const double sufficient_fitness = GetFlag(FLAGS_sufficient_fitness);
   const IntegerT max_experiments = GetFlag(FLAGS_max_experiments);
   Generator generator(
@@ -177,17 +201,34 @@ void run() {
         experiment_spec.has_fec() ?
             make_unique<FECCache>(experiment_spec.fec()) :
             nullptr;
+    EvaluatorOptions evaluator_options;
+    evaluator_options.use_jit = experiment_spec.use_jit();
+    evaluator_options.use_task_lanes = experiment_spec.use_task_lanes();
+    evaluator_options.use_counter_based_rng =
+        experiment_spec.use_counter_based_rng();
+    evaluator_options.resume_functional_cache_probes =
+        experiment_spec.resume_functional_cache_probes();
+    evaluator_options.use_fast_math = experiment_spec.use_fast_math();
+    evaluator_options.num_threads = experiment_spec.num_evaluation_threads();
+    evaluator_options.bound_validation = experiment_spec.bound_validation();
+    evaluator_options.validation_bound_num_stdevs =
+        experiment_spec.validation_bound_num_stdevs();
+    evaluator_options.race_tasks = experiment_spec.race_tasks();
     Evaluator evaluator(
         experiment_spec.fitness_combination_mode(),
         experiment_spec.search_tasks(),
         &rand_gen, functional_cache.get(), train_budget.get(),
-        experiment_spec.max_abs_error());
+        experiment_spec.max_abs_error(), evaluator_options);
 
     RegularizedEvolution regularized_evolution(
         &rand_gen, experiment_spec.population_size(),
         experiment_spec.tournament_size(),
         experiment_spec.progress_every(),
-        &generator, &evaluator, &mutator, &db);
+        &generator, &evaluator, &mutator, &db,
+        vector<EvaluationRung>(experiment_spec.evaluation_rungs().begin(),
+                               experiment_spec.evaluation_rungs().end()),
+        experiment_spec.has_fitness_surrogate() ?
+            &experiment_spec.fitness_surrogate() : nullptr);
 
     // Run one experiment.
     cout << "Running evolution experiment (on the T_search tasks)..." << endl;
@@ -197,6 +238,22 @@ void run() {
         regularized_evolution.NumTrainSteps();
     regularized_evolution.Run(remaining_train_steps, kUnlimitedTime);
     cout << "Experiment done. Retrieving candidate algorithm." << endl;
+    cout << "Executions that skipped learn = "
+         << evaluator.GetNumExecutionsSkippingLearn() << " of "
+         << evaluator.GetNumExecutions() << endl;
+    cout << "Train steps saved by stopping at NaNs = "
+         << evaluator.GetNumTrainStepsSavedOnNans() << endl;
+    cout << "Optimized " << evaluator.GetOptimizationStats() << endl;
+    regularized_evolution.GetEvaluationLadder().PrintStats(&cout);
+    cout << "Validation steps saved by the bounds = "
+         << evaluator.GetNumValidStepsSaved() << " ("
+         << evaluator.GetNumEstimatedFitnesses() << " estimated fitnesses)"
+         << endl;
+    cout << "Tasks skipped by racing = "
+         << evaluator.GetNumTasksSkippedByRacing() << endl;
+    if (regularized_evolution.GetFitnessSurrogate() != nullptr) {
+      regularized_evolution.GetFitnessSurrogate()->PrintStats(&cout);
+    }
 
     // Extract best algorithm based on T_search.
     double unused_pop_mean, unused_pop_stdev, search_fitness;
@@ -218,13 +275,16 @@ void run() {
     // Keep track of the best model on the T_select tasks.
     cout << "Evaluating candidate algorithm from experiment "
          << "(on T_select tasks)... " << endl;
+    EvaluatorOptions select_options;
+    select_options.num_threads = experiment_spec.num_evaluation_threads();
     Evaluator select_evaluator(
         MEAN_FITNESS_COMBINATION,
         select_tasks,
         &select_rand_gen,
         nullptr,  // functional_cache
         nullptr,  // train_budget
-        experiment_spec.max_abs_error());
+        experiment_spec.max_abs_error(),
+        select_options);
     const double select_fitness =
         select_evaluator.Evaluate(*candidate_algorithm);
     cout << "Select fitness for candidate algorithm = "
@@ -256,13 +316,16 @@ void run() {
       ParseTextFormat<TaskCollection>(GetFlag(FLAGS_final_tasks));
   mt19937 final_bit_gen(rand_gen.UniformRandomSeed());
   RandomGenerator final_rand_gen(&final_bit_gen);
+  EvaluatorOptions final_options;
+  final_options.num_threads = experiment_spec.num_evaluation_threads();
   Evaluator final_evaluator(
       MEAN_FITNESS_COMBINATION,
       final_tasks,
       &final_rand_gen,
       nullptr,  // functional_cache
       nullptr,  // train_budget
-      experiment_spec.max_abs_error());
+      experiment_spec.max_abs_error(),
+      final_options);
   const double final_fitness =
       final_evaluator.Evaluate(*best_algorithm);
 
@@ -270,6 +333,13 @@ void run() {
        << final_fitness << endl;
   cout << "Algorithm found: " << endl
        << best_algorithm->ToReadable() << endl;
+
+  if (kExecutorProfiling) {
+    cout << endl << "Executor profile (all threads):" << endl;
+    ExecutorProfile profile;
+    MergeExecutorProfiles(&profile);
+    PrintExecutorProfile(profile, DecodedOpName, &cout);
+  }
 }
 
 }  // namespace automl_zero
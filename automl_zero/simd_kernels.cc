@@ -0,0 +1,115 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simd_kernels.h"
+
+// The generic variant of the kernels, in plain C++.
+#define AUTOML_ZERO_SIMD_NAMESPACE generic
+#define AUTOML_ZERO_SIMD_TARGET_ATTRIBUTE
+#define AUTOML_ZERO_SIMD_MAX_BITS 0
+#define AUTOML_ZERO_SIMD_FMA 0
+#define AUTOML_ZERO_SIMD_KERNELS_GETTER GenericKernels
+#include "simd_kernels_impl.h"
+
+namespace automl_zero {
+
+namespace simd_internal {
+bool use_simd_kernels = false;
+}  // namespace simd_internal
+
+void SetUseSimdKernels(const bool use_simd_kernels) {
+  simd_internal::use_simd_kernels = use_simd_kernels;
+}
+
+SimdInstructionSet DetectSimdInstructionSet() {
+#if AUTOML_ZERO_X86_SIMD_KERNELS
+  // Needed when called during static initialization.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return kAvx512Instructions;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return kAvx2Instructions;
+  }
+  return kSse2Instructions;
+#else
+  return kGenericInstructions;
+#endif
+}
+
+bool SimdInstructionSetSupported(
+    const SimdInstructionSet instruction_set) {
+  return instruction_set <= DetectSimdInstructionSet();
+}
+
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> GetSimdKernels(const SimdInstructionSet instruction_set) {
+  CHECK(SimdInstructionSetSupported(instruction_set));
+  switch (instruction_set) {
+    case kGenericInstructions:
+      return simd_internal::GenericKernels<T, F>();
+#if AUTOML_ZERO_X86_SIMD_KERNELS
+    case kSse2Instructions:
+      return simd_internal::Sse2Kernels<T, F>();
+    case kAvx2Instructions:
+      return simd_internal::Avx2Kernels<T, F>();
+    case kAvx512Instructions:
+      return simd_internal::Avx512Kernels<T, F>();
+#else
+    case kSse2Instructions:
+    case kAvx2Instructions:
+    case kAvx512Instructions:
+      break;
+#endif
+    // Do not add default case here. All enum values should be supported.
+  }
+  LOG(FATAL) << "Unsupported instruction set." << std::endl;
+}
+
+template <typename T, FeatureIndexT F>
+const SimdKernels<T, F> SimdKernels<T, F>::kActive =
+    GetSimdKernels<T, F>(DetectSimdInstructionSet());
+
+template struct SimdKernels<float, 4>;
+template struct SimdKernels<float, 8>;
+template struct SimdKernels<float, 16>;
+template struct SimdKernels<float, 32>;
+template struct SimdKernels<float, 64>;
+template struct SimdKernels<float, 128>;
+template struct SimdKernels<double, 4>;
+template struct SimdKernels<double, 8>;
+template struct SimdKernels<double, 16>;
+template struct SimdKernels<double, 32>;
+template struct SimdKernels<double, 64>;
+template struct SimdKernels<double, 128>;
+
+template SimdKernels<float, 4> GetSimdKernels<float, 4>(SimdInstructionSet);
+template SimdKernels<float, 8> GetSimdKernels<float, 8>(SimdInstructionSet);
+template SimdKernels<float, 16> GetSimdKernels<float, 16>(SimdInstructionSet);
+template SimdKernels<float, 32> GetSimdKernels<float, 32>(SimdInstructionSet);
+template SimdKernels<float, 64> GetSimdKernels<float, 64>(SimdInstructionSet);
+template SimdKernels<float, 128> GetSimdKernels<float, 128>(
+    SimdInstructionSet);
+template SimdKernels<double, 4> GetSimdKernels<double, 4>(SimdInstructionSet);
+template SimdKernels<double, 8> GetSimdKernels<double, 8>(SimdInstructionSet);
+template SimdKernels<double, 16> GetSimdKernels<double, 16>(
+    SimdInstructionSet);
+template SimdKernels<double, 32> GetSimdKernels<double, 32>(
+    SimdInstructionSet);
+template SimdKernels<double, 64> GetSimdKernels<double, 64>(
+    SimdInstructionSet);
+template SimdKernels<double, 128> GetSimdKernels<double, 128>(
+    SimdInstructionSet);
+
+}  // namespace automl_zero
@@ -0,0 +1,134 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hand-vectorized kernels for the small fixed-size matrix ops, with one
+// variant per instruction set. The variant is chosen at startup from the
+// features of the CPU, so that the same binary runs well on every machine.
+// They are opt-in, as their results depend on the variant (see
+// UseSimdKernels).
+
+#ifndef AUTOML_ZERO_SIMD_KERNELS_H_
+#define AUTOML_ZERO_SIMD_KERNELS_H_
+
+#include "definitions.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define AUTOML_ZERO_X86_SIMD_KERNELS 1
+#else
+#define AUTOML_ZERO_X86_SIMD_KERNELS 0
+#endif
+
+namespace automl_zero {
+
+enum SimdInstructionSet : IntegerT {
+  // Plain C++, for CPUs without a dedicated variant.
+  kGenericInstructions = 0,
+  // 128-bit registers. Always available on x86-64.
+  kSse2Instructions = 1,
+  // 256-bit registers and fused multiply-adds.
+  kAvx2Instructions = 2,
+  // 512-bit registers.
+  kAvx512Instructions = 3
+};
+
+// Whether the SIMD kernels are specialized for the given features size. The
+// Executor uses Eigen for the other sizes. From 64, the kernels that produce a
+// matrix or read a whole column work on tiles of columns, so that their
+// accumulators stay in registers and the tile they read stays in the L1 cache.
+constexpr bool HasSimdKernels(const FeatureIndexT features_size) {
+  return features_size == 4 || features_size == 8 || features_size == 16 ||
+         features_size == 32 || features_size == 64 || features_size == 128;
+}
+
+// The kernels for one element type and one features size. Matrices are F x F
+// row-major arrays and vectors are arrays of F elements. The outputs must not
+// alias the inputs.
+template <typename T, FeatureIndexT F>
+struct SimdKernels {
+  static_assert(HasSimdKernels(F), "No SIMD kernels for this features size.");
+
+  // MATRIX_MATRIX_PRODUCT_OP: out = in1 * in2.
+  void (*matrix_matrix_product)(const T* in1, const T* in2, T* out);
+  // VECTOR_OUTER_PRODUCT_OP: out = in1 * in2^T.
+  void (*vector_outer_product)(const T* in1, const T* in2, T* out);
+  // MATRIX_VECTOR_PRODUCT_OP: out = in1 * in2.
+  void (*matrix_vector_product)(const T* in1, const T* in2, T* out);
+  // MATRIX_TRANSPOSE_OP followed by a MATRIX_VECTOR_PRODUCT_OP of its result:
+  // out = in1^T * in2. Identical to matrix_vector_product on the transpose.
+  void (*matrix_transpose_vector_product)(const T* in1, const T* in2, T* out);
+  // MATRIX_ROW_NORM_OP and MATRIX_COLUMN_NORM_OP.
+  void (*matrix_row_norm)(const T* in, T* out);
+  void (*matrix_column_norm)(const T* in, T* out);
+  // MATRIX_ROW_MEAN_OP and MATRIX_ROW_ST_DEV_OP.
+  void (*matrix_row_mean)(const T* in, T* out);
+  void (*matrix_row_st_dev)(const T* in, T* out);
+
+  // The kernels for the best instruction set of this CPU, chosen at startup.
+  static const SimdKernels kActive;
+};
+
+// Returns the best instruction set this CPU supports.
+SimdInstructionSet DetectSimdInstructionSet();
+
+// Returns whether this build and this CPU support the given instruction set.
+bool SimdInstructionSetSupported(SimdInstructionSet instruction_set);
+
+// Returns the kernels for the given instruction set, which must be supported.
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> GetSimdKernels(SimdInstructionSet instruction_set);
+
+namespace simd_internal {
+extern bool use_simd_kernels;
+}  // namespace simd_internal
+
+// Whether the Executor runs these kernels, instead of Eigen, for the features
+// sizes that have them. Off by default. The kernels do not round like Eigen:
+// they sum in another order, and the AVX2 and AVX-512 variants use fused
+// multiply-adds. So the fitnesses change in the last bits, and also depend on
+// the CPU. Applies to the whole process, so must be set before any execution
+// starts (see SearchExperimentSpec.use_simd_kernels).
+void SetUseSimdKernels(bool use_simd_kernels);
+inline bool UseSimdKernels() {return simd_internal::use_simd_kernels;}
+
+extern template struct SimdKernels<float, 4>;
+extern template struct SimdKernels<float, 8>;
+extern template struct SimdKernels<float, 16>;
+extern template struct SimdKernels<float, 32>;
+extern template struct SimdKernels<float, 64>;
+extern template struct SimdKernels<float, 128>;
+extern template struct SimdKernels<double, 4>;
+extern template struct SimdKernels<double, 8>;
+extern template struct SimdKernels<double, 16>;
+extern template struct SimdKernels<double, 32>;
+extern template struct SimdKernels<double, 64>;
+extern template struct SimdKernels<double, 128>;
+
+namespace simd_internal {
+
+// The kernels of each instruction set. Each one is defined in its own
+// translation unit by simd_kernels_impl.h.
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> GenericKernels();
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> Sse2Kernels();
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> Avx2Kernels();
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> Avx512Kernels();
+
+}  // namespace simd_internal
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_SIMD_KERNELS_H_
@@ -0,0 +1,542 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The SIMD kernels, written once over a "packet" of T elements that fits in a
+// vector register. Only to be included by the simd_kernels*.cc files, each of
+// which defines first:
+//   AUTOML_ZERO_SIMD_NAMESPACE: a namespace private to the instruction set, so
+//     that the same templates compiled for different instruction sets never
+//     get merged by the linker.
+//   AUTOML_ZERO_SIMD_TARGET_ATTRIBUTE: the attribute that compiles a function
+//     for the instruction set, or nothing for the baseline one.
+//   AUTOML_ZERO_SIMD_MAX_BITS: the widest register to use: 0 (no SIMD), 128,
+//     256 or 512.
+//   AUTOML_ZERO_SIMD_FMA: whether fused multiply-adds are available.
+//   AUTOML_ZERO_SIMD_KERNELS_GETTER: the simd_internal function to define.
+
+#ifndef AUTOML_ZERO_SIMD_KERNELS_IMPL_H_
+#define AUTOML_ZERO_SIMD_KERNELS_IMPL_H_
+
+#include <type_traits>
+
+#include "definitions.h"
+#include "simd_kernels.h"
+
+#if AUTOML_ZERO_SIMD_MAX_BITS > 0
+#include <immintrin.h>
+#endif
+
+#define AUTOML_ZERO_SIMD_FUNCTION AUTOML_ZERO_SIMD_TARGET_ATTRIBUTE inline
+
+namespace automl_zero {
+namespace AUTOML_ZERO_SIMD_NAMESPACE {
+
+AUTOML_ZERO_SIMD_FUNCTION float Sqrt(const float x) {
+  return __builtin_sqrtf(x);
+}
+AUTOML_ZERO_SIMD_FUNCTION double Sqrt(const double x) {
+  return __builtin_sqrt(x);
+}
+
+// A packet of kBits / (8 * sizeof(T)) elements. kBits = 0 is a single element.
+template <typename T, int kBits>
+struct Packet;
+
+template <typename T>
+struct Packet<T, 0> {
+  typedef T Reg;
+  static constexpr FeatureIndexT kWidth = 1;
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Load(const T* in) {return *in;}
+  static AUTOML_ZERO_SIMD_FUNCTION void Store(const Reg x, T* out) {*out = x;}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Set1(const T x) {return x;}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Zero() {return 0;}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Add(const Reg x, const Reg y) {
+    return x + y;
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Mul(const Reg x, const Reg y) {
+    return x * y;
+  }
+  // x * y + z.
+  static AUTOML_ZERO_SIMD_FUNCTION Reg MulAdd(
+      const Reg x, const Reg y, const Reg z) {
+    return x * y + z;
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Sqrt(const Reg x) {
+    return AUTOML_ZERO_SIMD_NAMESPACE::Sqrt(x);
+  }
+  // The sum of the elements.
+  static AUTOML_ZERO_SIMD_FUNCTION T Sum(const Reg x) {return x;}
+};
+
+#if AUTOML_ZERO_SIMD_MAX_BITS >= 128
+
+template <>
+struct Packet<double, 128> {
+  typedef __m128d Reg;
+  static constexpr FeatureIndexT kWidth = 2;
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Load(const double* in) {
+    return _mm_loadu_pd(in);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION void Store(const Reg x, double* out) {
+    _mm_storeu_pd(out, x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Set1(const double x) {
+    return _mm_set1_pd(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Zero() {return _mm_setzero_pd();}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Add(const Reg x, const Reg y) {
+    return _mm_add_pd(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Mul(const Reg x, const Reg y) {
+    return _mm_mul_pd(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg MulAdd(
+      const Reg x, const Reg y, const Reg z) {
+#if AUTOML_ZERO_SIMD_FMA
+    return _mm_fmadd_pd(x, y, z);
+#else
+    return _mm_add_pd(_mm_mul_pd(x, y), z);
+#endif
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Sqrt(const Reg x) {
+    return _mm_sqrt_pd(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION double Sum(const Reg x) {
+    return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+  }
+};
+
+template <>
+struct Packet<float, 128> {
+  typedef __m128 Reg;
+  static constexpr FeatureIndexT kWidth = 4;
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Load(const float* in) {
+    return _mm_loadu_ps(in);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION void Store(const Reg x, float* out) {
+    _mm_storeu_ps(out, x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Set1(const float x) {
+    return _mm_set1_ps(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Zero() {return _mm_setzero_ps();}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Add(const Reg x, const Reg y) {
+    return _mm_add_ps(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Mul(const Reg x, const Reg y) {
+    return _mm_mul_ps(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg MulAdd(
+      const Reg x, const Reg y, const Reg z) {
+#if AUTOML_ZERO_SIMD_FMA
+    return _mm_fmadd_ps(x, y, z);
+#else
+    return _mm_add_ps(_mm_mul_ps(x, y), z);
+#endif
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Sqrt(const Reg x) {
+    return _mm_sqrt_ps(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION float Sum(const Reg x) {
+    const Reg pairs = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    return _mm_cvtss_f32(
+        _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 0x55)));
+  }
+};
+
+#endif  // AUTOML_ZERO_SIMD_MAX_BITS >= 128
+
+#if AUTOML_ZERO_SIMD_MAX_BITS >= 256
+
+template <>
+struct Packet<double, 256> {
+  typedef __m256d Reg;
+  static constexpr FeatureIndexT kWidth = 4;
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Load(const double* in) {
+    return _mm256_loadu_pd(in);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION void Store(const Reg x, double* out) {
+    _mm256_storeu_pd(out, x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Set1(const double x) {
+    return _mm256_set1_pd(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Zero() {return _mm256_setzero_pd();}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Add(const Reg x, const Reg y) {
+    return _mm256_add_pd(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Mul(const Reg x, const Reg y) {
+    return _mm256_mul_pd(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg MulAdd(
+      const Reg x, const Reg y, const Reg z) {
+    return _mm256_fmadd_pd(x, y, z);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Sqrt(const Reg x) {
+    return _mm256_sqrt_pd(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION double Sum(const Reg x) {
+    return Packet<double, 128>::Sum(_mm_add_pd(
+        _mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1)));
+  }
+};
+
+template <>
+struct Packet<float, 256> {
+  typedef __m256 Reg;
+  static constexpr FeatureIndexT kWidth = 8;
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Load(const float* in) {
+    return _mm256_loadu_ps(in);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION void Store(const Reg x, float* out) {
+    _mm256_storeu_ps(out, x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Set1(const float x) {
+    return _mm256_set1_ps(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Zero() {return _mm256_setzero_ps();}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Add(const Reg x, const Reg y) {
+    return _mm256_add_ps(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Mul(const Reg x, const Reg y) {
+    return _mm256_mul_ps(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg MulAdd(
+      const Reg x, const Reg y, const Reg z) {
+    return _mm256_fmadd_ps(x, y, z);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Sqrt(const Reg x) {
+    return _mm256_sqrt_ps(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION float Sum(const Reg x) {
+    return Packet<float, 128>::Sum(_mm_add_ps(
+        _mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1)));
+  }
+};
+
+#endif  // AUTOML_ZERO_SIMD_MAX_BITS >= 256
+
+#if AUTOML_ZERO_SIMD_MAX_BITS >= 512
+
+template <>
+struct Packet<double, 512> {
+  typedef __m512d Reg;
+  static constexpr FeatureIndexT kWidth = 8;
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Load(const double* in) {
+    return _mm512_loadu_pd(in);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION void Store(const Reg x, double* out) {
+    _mm512_storeu_pd(out, x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Set1(const double x) {
+    return _mm512_set1_pd(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Zero() {return _mm512_setzero_pd();}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Add(const Reg x, const Reg y) {
+    return _mm512_add_pd(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Mul(const Reg x, const Reg y) {
+    return _mm512_mul_pd(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg MulAdd(
+      const Reg x, const Reg y, const Reg z) {
+    return _mm512_fmadd_pd(x, y, z);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Sqrt(const Reg x) {
+    return _mm512_sqrt_pd(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION double Sum(const Reg x) {
+    return _mm512_reduce_add_pd(x);
+  }
+};
+
+template <>
+struct Packet<float, 512> {
+  typedef __m512 Reg;
+  static constexpr FeatureIndexT kWidth = 16;
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Load(const float* in) {
+    return _mm512_loadu_ps(in);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION void Store(const Reg x, float* out) {
+    _mm512_storeu_ps(out, x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Set1(const float x) {
+    return _mm512_set1_ps(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Zero() {return _mm512_setzero_ps();}
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Add(const Reg x, const Reg y) {
+    return _mm512_add_ps(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Mul(const Reg x, const Reg y) {
+    return _mm512_mul_ps(x, y);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg MulAdd(
+      const Reg x, const Reg y, const Reg z) {
+    return _mm512_fmadd_ps(x, y, z);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION Reg Sqrt(const Reg x) {
+    return _mm512_sqrt_ps(x);
+  }
+  static AUTOML_ZERO_SIMD_FUNCTION float Sum(const Reg x) {
+    return _mm512_reduce_add_ps(x);
+  }
+};
+
+#endif  // AUTOML_ZERO_SIMD_MAX_BITS >= 512
+
+// The widest packet of at most kBits whose width divides F, so that a row of a
+// matrix is a whole number of packets.
+template <typename T, FeatureIndexT F, int kBits = AUTOML_ZERO_SIMD_MAX_BITS>
+struct WidestPacket {
+  typedef typename std::conditional<
+      F % (kBits / (8 * static_cast<int>(sizeof(T)))) == 0,
+      Packet<T, kBits>,
+      typename WidestPacket<T, F, kBits == 128 ? 0 : kBits / 2>::Type>::type
+      Type;
+};
+
+template <typename T, FeatureIndexT F>
+struct WidestPacket<T, F, 0> {
+  typedef Packet<T, 0> Type;
+};
+
+// The inner product of two arrays of F elements.
+template <typename P, typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION T Dot(const T* in1, const T* in2) {
+  typename P::Reg sum = P::Zero();
+  for (FeatureIndexT j = 0; j < F; j += P::kWidth) {
+    sum = P::MulAdd(P::Load(in1 + j), P::Load(in2 + j), sum);
+  }
+  return P::Sum(sum);
+}
+
+// The sum of an array of F elements.
+template <typename P, typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION T Sum(const T* in) {
+  typename P::Reg sum = P::Zero();
+  for (FeatureIndexT j = 0; j < F; j += P::kWidth) {
+    sum = P::Add(P::Load(in + j), sum);
+  }
+  return P::Sum(sum);
+}
+
+// The number of packets of a row that the kernels accumulate in registers at
+// once. Wider rows are split into tiles of columns of this many packets.
+constexpr FeatureIndexT kMaxTilePackets = 8;
+
+template <typename P, FeatureIndexT F>
+constexpr FeatureIndexT TilePackets() {
+  return F / P::kWidth < kMaxTilePackets ? F / P::kWidth : kMaxTilePackets;
+}
+
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void MatrixMatrixProduct(
+    const T* in1, const T* in2, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  constexpr FeatureIndexT kTilePackets = TilePackets<P, F>();
+  constexpr FeatureIndexT kTileWidth = kTilePackets * P::kWidth;
+  static_assert(F % kTileWidth == 0, "Rows must be whole tiles.");
+  // Each row of the output is a linear combination of the rows of in2, which
+  // is accumulated in registers one tile at a time. The tile of in2 is reused
+  // by all the rows of the output.
+  for (FeatureIndexT column = 0; column < F; column += kTileWidth) {
+    for (FeatureIndexT i = 0; i < F; ++i) {
+      typename P::Reg row[kTilePackets];
+      for (FeatureIndexT p = 0; p < kTilePackets; ++p) {
+        row[p] = P::Zero();
+      }
+      for (FeatureIndexT k = 0; k < F; ++k) {
+        const typename P::Reg coefficient = P::Set1(in1[i * F + k]);
+        const T* in2_tile = in2 + k * F + column;
+        for (FeatureIndexT p = 0; p < kTilePackets; ++p) {
+          row[p] = P::MulAdd(
+              coefficient, P::Load(in2_tile + p * P::kWidth), row[p]);
+        }
+      }
+      for (FeatureIndexT p = 0; p < kTilePackets; ++p) {
+        P::Store(row[p], out + i * F + column + p * P::kWidth);
+      }
+    }
+  }
+}
+
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void VectorOuterProduct(
+    const T* in1, const T* in2, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    const typename P::Reg coefficient = P::Set1(in1[i]);
+    for (FeatureIndexT j = 0; j < F; j += P::kWidth) {
+      P::Store(P::Mul(coefficient, P::Load(in2 + j)), out + i * F + j);
+    }
+  }
+}
+
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void MatrixVectorProduct(
+    const T* in1, const T* in2, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  // Four rows at a time, to hide the latency of the multiply-adds.
+  for (FeatureIndexT i = 0; i < F; i += 4) {
+    const T* row = in1 + i * F;
+    typename P::Reg sum0 = P::Zero();
+    typename P::Reg sum1 = P::Zero();
+    typename P::Reg sum2 = P::Zero();
+    typename P::Reg sum3 = P::Zero();
+    for (FeatureIndexT j = 0; j < F; j += P::kWidth) {
+      const typename P::Reg x = P::Load(in2 + j);
+      sum0 = P::MulAdd(P::Load(row + j), x, sum0);
+      sum1 = P::MulAdd(P::Load(row + F + j), x, sum1);
+      sum2 = P::MulAdd(P::Load(row + 2 * F + j), x, sum2);
+      sum3 = P::MulAdd(P::Load(row + 3 * F + j), x, sum3);
+    }
+    out[i] = P::Sum(sum0);
+    out[i + 1] = P::Sum(sum1);
+    out[i + 2] = P::Sum(sum2);
+    out[i + 3] = P::Sum(sum3);
+  }
+}
+
+// Computes in1^T * in2 without transposing in1, with the same arithmetic as
+// MatrixVectorProduct on the transpose, so that the results are identical.
+// There, lane l of the accumulator of out[j] sums the products of the elements
+// i = l (mod the packet width) of column j and of in2, in order. Here, these
+// are accumulated down a strip of columns, one accumulator per lane, and then
+// regrouped into a packet for the same final sum.
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void MatrixTransposeVectorProduct(
+    const T* in1, const T* in2, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  constexpr FeatureIndexT W = P::kWidth;
+  for (FeatureIndexT j = 0; j < F; j += W) {
+    typename P::Reg sums[W];
+    for (FeatureIndexT l = 0; l < W; ++l) {
+      sums[l] = P::Zero();
+    }
+    for (FeatureIndexT i = 0; i < F; i += W) {
+      for (FeatureIndexT l = 0; l < W; ++l) {
+        sums[l] = P::MulAdd(
+            P::Load(in1 + (i + l) * F + j), P::Set1(in2[i + l]), sums[l]);
+      }
+    }
+    T partial_sums[W][W];
+    for (FeatureIndexT l = 0; l < W; ++l) {
+      P::Store(sums[l], partial_sums[l]);
+    }
+    for (FeatureIndexT c = 0; c < W; ++c) {
+      T lanes[W];
+      for (FeatureIndexT l = 0; l < W; ++l) {
+        lanes[l] = partial_sums[l][c];
+      }
+      out[j + c] = P::Sum(P::Load(lanes));
+    }
+  }
+}
+
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void MatrixRowNorm(const T* in, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    const T* row = in + i * F;
+    out[i] = Sqrt(Dot<P, T, F>(row, row));
+  }
+}
+
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void MatrixColumnNorm(const T* in, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  constexpr FeatureIndexT kTilePackets = TilePackets<P, F>();
+  constexpr FeatureIndexT kTileWidth = kTilePackets * P::kWidth;
+  static_assert(F % kTileWidth == 0, "Rows must be whole tiles.");
+  for (FeatureIndexT column = 0; column < F; column += kTileWidth) {
+    typename P::Reg squared_norms[kTilePackets];
+    for (FeatureIndexT p = 0; p < kTilePackets; ++p) {
+      squared_norms[p] = P::Zero();
+    }
+    for (FeatureIndexT i = 0; i < F; ++i) {
+      for (FeatureIndexT p = 0; p < kTilePackets; ++p) {
+        const typename P::Reg x =
+            P::Load(in + i * F + column + p * P::kWidth);
+        squared_norms[p] = P::MulAdd(x, x, squared_norms[p]);
+      }
+    }
+    for (FeatureIndexT p = 0; p < kTilePackets; ++p) {
+      P::Store(P::Sqrt(squared_norms[p]), out + column + p * P::kWidth);
+    }
+  }
+}
+
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void MatrixRowMean(const T* in, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    out[i] = Sum<P, T, F>(in + i * F) / static_cast<T>(F);
+  }
+}
+
+template <typename T, FeatureIndexT F>
+AUTOML_ZERO_SIMD_FUNCTION void MatrixRowStDev(const T* in, T* out) {
+  typedef typename WidestPacket<T, F>::Type P;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    const T* row = in + i * F;
+    const T mean = Sum<P, T, F>(row) / static_cast<T>(F);
+    out[i] = Sqrt(Dot<P, T, F>(row, row) / static_cast<T>(F) - mean * mean);
+  }
+}
+
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> MakeSimdKernels() {
+  SimdKernels<T, F> kernels;
+  kernels.matrix_matrix_product = &MatrixMatrixProduct<T, F>;
+  kernels.vector_outer_product = &VectorOuterProduct<T, F>;
+  kernels.matrix_vector_product = &MatrixVectorProduct<T, F>;
+  kernels.matrix_transpose_vector_product =
+      &MatrixTransposeVectorProduct<T, F>;
+  kernels.matrix_row_norm = &MatrixRowNorm<T, F>;
+  kernels.matrix_column_norm = &MatrixColumnNorm<T, F>;
+  kernels.matrix_row_mean = &MatrixRowMean<T, F>;
+  kernels.matrix_row_st_dev = &MatrixRowStDev<T, F>;
+  return kernels;
+}
+
+}  // namespace AUTOML_ZERO_SIMD_NAMESPACE
+
+namespace simd_internal {
+
+template <typename T, FeatureIndexT F>
+SimdKernels<T, F> AUTOML_ZERO_SIMD_KERNELS_GETTER() {
+  return AUTOML_ZERO_SIMD_NAMESPACE::MakeSimdKernels<T, F>();
+}
+
+template SimdKernels<float, 4> AUTOML_ZERO_SIMD_KERNELS_GETTER<float, 4>();
+template SimdKernels<float, 8> AUTOML_ZERO_SIMD_KERNELS_GETTER<float, 8>();
+template SimdKernels<float, 16> AUTOML_ZERO_SIMD_KERNELS_GETTER<float, 16>();
+template SimdKernels<float, 32> AUTOML_ZERO_SIMD_KERNELS_GETTER<float, 32>();
+template SimdKernels<float, 64> AUTOML_ZERO_SIMD_KERNELS_GETTER<float, 64>();
+template SimdKernels<float, 128> AUTOML_ZERO_SIMD_KERNELS_GETTER<float, 128>();
+template SimdKernels<double, 4> AUTOML_ZERO_SIMD_KERNELS_GETTER<double, 4>();
+template SimdKernels<double, 8> AUTOML_ZERO_SIMD_KERNELS_GETTER<double, 8>();
+template SimdKernels<double, 16> AUTOML_ZERO_SIMD_KERNELS_GETTER<double, 16>();
+template SimdKernels<double, 32> AUTOML_ZERO_SIMD_KERNELS_GETTER<double, 32>();
+template SimdKernels<double, 64> AUTOML_ZERO_SIMD_KERNELS_GETTER<double, 64>();
+template SimdKernels<double, 128>
+    AUTOML_ZERO_SIMD_KERNELS_GETTER<double, 128>();
+
+}  // namespace simd_internal
+
+}  // namespace automl_zero
+
+#undef AUTOML_ZERO_SIMD_FUNCTION
+
+#endif  // AUTOML_ZERO_SIMD_KERNELS_IMPL_H_
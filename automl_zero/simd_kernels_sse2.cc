@@ -0,0 +1,29 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The SSE2 variant of the SIMD kernels: 128-bit registers, which every x86-64
+// CPU has.
+
+#include "simd_kernels.h"
+
+#if AUTOML_ZERO_X86_SIMD_KERNELS
+
+#define AUTOML_ZERO_SIMD_NAMESPACE sse2
+#define AUTOML_ZERO_SIMD_TARGET_ATTRIBUTE
+#define AUTOML_ZERO_SIMD_MAX_BITS 128
+#define AUTOML_ZERO_SIMD_FMA 0
+#define AUTOML_ZERO_SIMD_KERNELS_GETTER Sse2Kernels
+#include "simd_kernels_impl.h"
+
+#endif  // AUTOML_ZERO_X86_SIMD_KERNELS
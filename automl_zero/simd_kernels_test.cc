@@ -0,0 +1,130 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simd_kernels.h"
+
+#include <random>
+
+#include "definitions.h"
+#include "gtest/gtest.h"
+#include "Eigen/Core"
+
+namespace automl_zero {
+
+using ::std::mt19937;  // NOLINT
+
+// Relative to the size of the results.
+constexpr double kFloatTolerance = 0.0001;
+constexpr double kDoubleTolerance = 0.0000000001;
+
+template <typename T, FeatureIndexT F>
+using TestVector = ::Eigen::Matrix<T, F, 1>;
+template <typename T, FeatureIndexT F>
+using TestMatrix = ::Eigen::Matrix<T, F, F, ::Eigen::RowMajor>;
+
+template <typename T, typename Derived1, typename Derived2>
+void ExpectNear(const ::Eigen::MatrixBase<Derived1>& actual,
+                const ::Eigen::MatrixBase<Derived2>& expected) {
+  const double tolerance =
+      sizeof(T) == sizeof(float) ? kFloatTolerance : kDoubleTolerance;
+  EXPECT_LE((actual - expected).norm(), tolerance * (1.0 + expected.norm()));
+}
+
+// Compares the kernels of an instruction set against Eigen.
+template <typename T, FeatureIndexT F>
+void ExpectKernelsMatchEigen(const SimdInstructionSet instruction_set) {
+  const SimdKernels<T, F> kernels = GetSimdKernels<T, F>(instruction_set);
+  mt19937 bit_gen(F);
+  std::uniform_real_distribution<T> distribution(-1.0, 1.0);
+  TestMatrix<T, F> matrix1, matrix2;
+  TestVector<T, F> vector1, vector2;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    vector1(i) = distribution(bit_gen);
+    vector2(i) = distribution(bit_gen);
+    for (FeatureIndexT j = 0; j < F; ++j) {
+      matrix1(i, j) = distribution(bit_gen);
+      matrix2(i, j) = distribution(bit_gen);
+    }
+  }
+
+  TestMatrix<T, F> matrix_out;
+  kernels.matrix_matrix_product(
+      matrix1.data(), matrix2.data(), matrix_out.data());
+  ExpectNear<T>(matrix_out, matrix1 * matrix2);
+  kernels.vector_outer_product(
+      vector1.data(), vector2.data(), matrix_out.data());
+  ExpectNear<T>(matrix_out, vector1 * vector2.transpose());
+
+  TestVector<T, F> vector_out;
+  kernels.matrix_vector_product(
+      matrix1.data(), vector1.data(), vector_out.data());
+  ExpectNear<T>(vector_out, matrix1 * vector1);
+  kernels.matrix_transpose_vector_product(
+      matrix1.data(), vector1.data(), vector_out.data());
+  ExpectNear<T>(vector_out, matrix1.transpose() * vector1);
+  const TestMatrix<T, F> transposed = matrix1.transpose();
+  TestVector<T, F> expected_out;
+  kernels.matrix_vector_product(
+      transposed.data(), vector1.data(), expected_out.data());
+  EXPECT_EQ(vector_out, expected_out);
+  kernels.matrix_row_norm(matrix1.data(), vector_out.data());
+  ExpectNear<T>(vector_out, matrix1.rowwise().norm());
+  kernels.matrix_column_norm(matrix1.data(), vector_out.data());
+  ExpectNear<T>(vector_out, matrix1.colwise().norm().transpose());
+  kernels.matrix_row_mean(matrix1.data(), vector_out.data());
+  ExpectNear<T>(vector_out, matrix1.rowwise().mean());
+  kernels.matrix_row_st_dev(matrix1.data(), vector_out.data());
+  TestVector<T, F> expected_st_dev;
+  for (FeatureIndexT i = 0; i < F; ++i) {
+    const T mean = matrix1.row(i).mean();
+    expected_st_dev(i) =
+        sqrt(matrix1.row(i).squaredNorm() / static_cast<T>(F) - mean * mean);
+  }
+  ExpectNear<T>(vector_out, expected_st_dev);
+}
+
+template <typename T>
+void ExpectAllKernelsMatchEigen() {
+  for (const SimdInstructionSet instruction_set :
+       {kGenericInstructions, kSse2Instructions, kAvx2Instructions,
+        kAvx512Instructions}) {
+    if (!SimdInstructionSetSupported(instruction_set)) continue;
+    SCOPED_TRACE(instruction_set);
+    ExpectKernelsMatchEigen<T, 4>(instruction_set);
+    ExpectKernelsMatchEigen<T, 8>(instruction_set);
+    ExpectKernelsMatchEigen<T, 16>(instruction_set);
+    ExpectKernelsMatchEigen<T, 32>(instruction_set);
+    ExpectKernelsMatchEigen<T, 64>(instruction_set);
+    ExpectKernelsMatchEigen<T, 128>(instruction_set);
+  }
+}
+
+TEST(SimdKernelsTest, FloatKernelsMatchEigen) {
+  ExpectAllKernelsMatchEigen<float>();
+}
+
+TEST(SimdKernelsTest, DoubleKernelsMatchEigen) {
+  ExpectAllKernelsMatchEigen<double>();
+}
+
+TEST(SimdKernelsTest, ActiveKernelsUseTheDetectedInstructionSet) {
+  const SimdInstructionSet instruction_set = DetectSimdInstructionSet();
+  EXPECT_TRUE(SimdInstructionSetSupported(instruction_set));
+  typedef SimdKernels<double, 16> Kernels;
+  const Kernels kernels = GetSimdKernels<double, 16>(instruction_set);
+  EXPECT_EQ(Kernels::kActive.matrix_matrix_product,
+            kernels.matrix_matrix_product);
+}
+
+}  // namespace automl_zero
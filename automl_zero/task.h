@@ -76,6 +76,9 @@ class TaskInterface {
   virtual IntegerT NumTrainEpochs() const = 0;
   virtual IntegerT MaxTrainExamples() const = 0;
   virtual IntegerT ValidSteps() const = 0;
+
+  // Returns the number of examples predict and learn see at a time.
+  virtual IntegerT BatchSize() const = 0;
 };
 
 template <FeatureIndexT F>
@@ -122,9 +125,10 @@ class Task : public TaskInterface {
  public:
   explicit Task(const size_t index, const EvalType eval_type,
                 const IntegerT num_train_epochs, std::mt19937* bit_gen,
-                TaskBuffer<F>* buffer)
+                TaskBuffer<F>* buffer, const IntegerT batch_size = 1)
       : index_(index),
         eval_type_(eval_type),
+        batch_size_(batch_size),
         train_features_(std::move(buffer->train_features_)),
         train_labels_(std::move(buffer->train_labels_)),
         train_epochs_(
@@ -136,6 +140,8 @@ class Task : public TaskInterface {
     buffer->Consume();
     CHECK_EQ(train_features_.size(), train_labels_.size());
     CHECK_EQ(valid_features_.size(), valid_labels_.size());
+    CHECK_GE(batch_size_, 1);
+    CHECK_LE(batch_size_, F) << "A mini-batch must fit in a matrix.";
   }
 
   Task(const Task&) = delete;
@@ -144,6 +150,7 @@ class Task : public TaskInterface {
   Task(Task&& other)
       : index_(other.index_),
         eval_type_(other.eval_type_),
+        batch_size_(other.batch_size_),
         train_features_(std::move(other.train_features_)),
         train_labels_(std::move(other.train_labels_)),
         train_epochs_(std::move(other.train_epochs_)),
@@ -154,6 +161,7 @@ class Task : public TaskInterface {
   Task& operator=(Task&& other) {
     this->index_ = other.index_;
     this->eval_type_ = other.eval_type_;
+    this->batch_size_ = other.batch_size_;
     this->train_features_ = std::move(other.train_features_);
     this->train_labels_ = std::move(other.train_labels_);
     this->train_epochs_ = std::move(other.train_epochs_);
@@ -205,6 +213,7 @@ class Task : public TaskInterface {
   IntegerT ValidSteps() const override {
     return valid_features_.size();
   }
+  IntegerT BatchSize() const override {return batch_size_;}
 
   // Iterate.
   TaskIterator<F> TrainIterator() const {
@@ -223,6 +232,10 @@ class Task : public TaskInterface {
 
   const EvalType eval_type_;
 
+  // The number of examples predict and learn see at a time. See batch_size in
+  // task.proto.
+  const IntegerT batch_size_;
+
  private:
   FRIEND_TEST(FillTasksTest, WorksCorrectly);
   FRIEND_TEST(FillTaskWithZerosTest, WorksCorrectly);
@@ -311,6 +324,12 @@ class TaskIterator {
     return current_epoch_ >= epochs_->size();
   }
 
+  // The number of examples left before Done, including the current one.
+  IntegerT NumRemaining() const {
+    return (static_cast<IntegerT>(epochs_->size()) - current_epoch_) *
+        static_cast<IntegerT>(features_->size()) - current_example_;
+  }
+
   void Next() {
     CHECK_LE(current_epoch_, epochs_->size());
     ++current_example_;
@@ -24,7 +24,7 @@ using test_only::GenerateTask;
 
 template<FeatureIndexT F>
 IntegerT CountOccurrences(
-    const vector<double>& element, const vector<Vector<F>>& container) {
+    const vector<Scalar>& element, const vector<Vector<F>>& container) {
   IntegerT count = 0;
   CHECK_EQ(element.size(), F);
   Vector<F> eigen_element(element.data());
@@ -95,26 +95,13 @@ void FillTasksFromTaskSpec(
 
     const IntegerT task_index = return_tasks->size();
     switch (task_spec.features_size()) {
-      case 2:
-        return_tasks->push_back(CreateTask<2>(task_index, param_seed,
-                                                    data_seed, task_spec));
-        break;
-      case 4:
-        return_tasks->push_back(CreateTask<4>(task_index, param_seed,
-                                                    data_seed, task_spec));
-        break;
-      case 8:
-        return_tasks->push_back(CreateTask<8>(task_index, param_seed,
-                                                    data_seed, task_spec));
-        break;
-      case 16:
-        return_tasks->push_back(CreateTask<16>(task_index, param_seed,
-                                                     data_seed, task_spec));
-        break;
-      case 32:
-        return_tasks->push_back(CreateTask<32>(task_index, param_seed,
-                                                     data_seed, task_spec));
+#define AUTOML_ZERO_CREATE_TASK_CASE(F) \
+      case F: \
+        return_tasks->push_back( \
+            CreateTask<F>(task_index, param_seed, data_seed, task_spec)); \
         break;
+      AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(AUTOML_ZERO_CREATE_TASK_CASE)
+#undef AUTOML_ZERO_CREATE_TASK_CASE
       default:
         LOG(FATAL) << "Unsupported features size: "
                    << task_spec.features_size() << std::endl;
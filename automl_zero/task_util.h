@@ -278,7 +278,9 @@ struct ScalarLinearRegressionTaskCreator {
 
     // Create a Algorithm and memory deterministically.
     Algorithm algorithm = generator.LinearModel(0.0);
-    Memory<F> memory;
+    // On the heap, as it is too large for the stack with large features sizes.
+    const std::unique_ptr<Memory<F>> memory_owned(new Memory<F>());
+    Memory<F>& memory = *memory_owned;
     memory.Wipe();
     weights_gen.FillGaussian<F>(
         0.0, 1.0, &memory.vector_[Generator::LINEAR_ALGORITHMWeightsAddress]);
@@ -315,7 +317,9 @@ struct Scalar2LayerNnRegressionTaskCreator {
 
     // Create a Algorithm and memory deterministically.
     Algorithm algorithm = generator.UnitTestNeuralNetNoBiasNoGradient(0.0);
-    Memory<F> memory;
+    // On the heap, as it is too large for the stack with large features sizes.
+    const std::unique_ptr<Memory<F>> memory_owned(new Memory<F>());
+    Memory<F>& memory = *memory_owned;
     memory.Wipe();
     weights_gen.FillGaussian<F>(
         0.0, 1.0, &memory.matrix_[
@@ -535,7 +539,7 @@ std::unique_ptr<Task<F>> CreateTask(const IntegerT task_index,
   CHECK(task_spec.has_eval_type());
   return std::unique_ptr<Task<F>>(new Task<F>(task_index, task_spec.eval_type(),
                                    task_spec.num_train_epochs(), &data_bit_gen,
-                                   &buffer));
+                                   &buffer, task_spec.batch_size()));
 }
 
 // Randomizes all the seeds given a base seed. See "internal workflow" comment
@@ -59,7 +59,7 @@ bool ScalarEq(const Scalar& scalar1, const Scalar scalar2) {
 
 template <FeatureIndexT F>
 bool VectorEq(const Vector<F>& vector1,
-              const ::std::vector<double>& vector2) {
+              const ::std::vector<Scalar>& vector2) {
   Map<const Vector<F>> vector2_eigen(vector2.data());
   return (vector1 - vector2_eigen).norm() < kDataTolerance;
 }
@@ -151,6 +151,30 @@ TEST(FillTasksTest, WorksCorrectly) {
   EXPECT_EQ(tasks[1]->index_, 1);
 }
 
+TEST(FillTasksTest, FillsEveryRegisteredFeaturesSize) {
+  vector<FeatureIndexT> features_sizes;
+#define AUTOML_ZERO_ADD_FEATURES_SIZE(F) features_sizes.push_back(F);
+  AUTOML_ZERO_FOR_EACH_FEATURES_SIZE(AUTOML_ZERO_ADD_FEATURES_SIZE)
+#undef AUTOML_ZERO_ADD_FEATURES_SIZE
+  TaskCollection task_collection;
+  for (const FeatureIndexT features_size : features_sizes) {
+    TaskSpec* task = task_collection.add_tasks();
+    task->set_features_size(features_size);
+    task->set_num_train_examples(kNumTrainExamples);
+    task->set_num_valid_examples(kNumValidExamples);
+    task->set_num_tasks(1);
+    task->set_eval_type(RMS_ERROR);
+    task->mutable_scalar_2layer_nn_regression_task();
+  }
+  vector<unique_ptr<TaskInterface>> tasks;
+  FillTasks(task_collection, &tasks);
+  ASSERT_EQ(tasks.size(), features_sizes.size());
+  for (IntegerT i = 0; i < tasks.size(); ++i) {
+    EXPECT_EQ(tasks[i]->FeaturesSize(), features_sizes[i]);
+    EXPECT_EQ(tasks[i]->MaxTrainExamples(), kNumTrainExamples);
+  }
+}
+
 TEST(FillTaskTest, FillsEvalType) {
   std::string task_spec_string =
       StrCat("scalar_linear_regression_task {} "
@@ -28,6 +28,14 @@
 
 namespace automl_zero {
 
+// How far fitnesses may be from those computed in double precision. Scalar
+// is float in the single-precision build (see definitions.h).
+#ifdef SINGLE_PRECISION
+constexpr double kPrecisionFitnessTolerance = 0.000001;
+#else
+constexpr double kPrecisionFitnessTolerance = 0.0000001;
+#endif
+
 namespace internal {
 
 template <class PrintableTypeT>
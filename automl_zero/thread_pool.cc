@@ -0,0 +1,130 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_pool.h"
+
+namespace automl_zero {
+
+using ::std::function;  // NOLINT
+using ::std::lock_guard;  // NOLINT
+using ::std::mutex;  // NOLINT
+using ::std::unique_lock;  // NOLINT
+
+ThreadPool::ThreadPool(const IntegerT num_threads)
+    : num_threads_(num_threads),
+      function_(nullptr),
+      loop_index_(0),
+      num_unfinished_iterations_(0),
+      stopping_(false) {
+  CHECK_GE(num_threads, 1);
+  for (IntegerT i = 0; i < num_threads_; ++i) {
+    queues_.emplace_back(new Queue());
+  }
+  // The thread calling ParallelFor is thread 0.
+  for (IntegerT i = 1; i < num_threads_; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> guard(lock_);
+    stopping_ = true;
+  }
+  loop_started_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::ParallelFor(const IntegerT num_iterations,
+                             const function<void(IntegerT)>& function) {
+  if (num_iterations == 0) return;
+  {
+    lock_guard<mutex> guard(lock_);
+    CHECK_EQ(num_unfinished_iterations_, 0);
+    function_ = &function;
+    num_unfinished_iterations_ = num_iterations;
+    ++loop_index_;
+  }
+  // Contiguous iterations go to the same thread, as neighbouring tasks tend
+  // to take similar times.
+  for (IntegerT thread_index = 0; thread_index < num_threads_;
+       ++thread_index) {
+    Queue* queue = queues_[thread_index].get();
+    lock_guard<mutex> guard(queue->lock);
+    for (IntegerT i = num_iterations * thread_index / num_threads_;
+         i < num_iterations * (thread_index + 1) / num_threads_; ++i) {
+      queue->iterations.push_back(i);
+    }
+  }
+  loop_started_.notify_all();
+
+  while (RunOneIteration(0)) {}
+  unique_lock<mutex> guard(lock_);
+  loop_finished_.wait(guard, [this]() {
+    return num_unfinished_iterations_ == 0;
+  });
+  function_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(const IntegerT thread_index) {
+  IntegerT last_loop_index = 0;
+  while (true) {
+    {
+      unique_lock<mutex> guard(lock_);
+      loop_started_.wait(guard, [this, last_loop_index]() {
+        return stopping_ || loop_index_ != last_loop_index;
+      });
+      if (stopping_) return;
+      last_loop_index = loop_index_;
+    }
+    while (RunOneIteration(thread_index)) {}
+  }
+}
+
+bool ThreadPool::RunOneIteration(const IntegerT thread_index) {
+  IntegerT iteration = -1;
+  {
+    Queue* queue = queues_[thread_index].get();
+    lock_guard<mutex> guard(queue->lock);
+    if (!queue->iterations.empty()) {
+      iteration = queue->iterations.front();
+      queue->iterations.pop_front();
+    }
+  }
+  for (IntegerT offset = 1; iteration < 0 && offset < num_threads_;
+       ++offset) {
+    Queue* victim = queues_[(thread_index + offset) % num_threads_].get();
+    lock_guard<mutex> guard(victim->lock);
+    if (!victim->iterations.empty()) {
+      iteration = victim->iterations.back();
+      victim->iterations.pop_back();
+    }
+  }
+  if (iteration < 0) return false;
+
+  // The iteration was queued after function_ was set, and function_ is only
+  // reset once all the iterations finished.
+  (*function_)(iteration);
+  bool finished;
+  {
+    lock_guard<mutex> guard(lock_);
+    finished = --num_unfinished_iterations_ == 0;
+  }
+  if (finished) loop_finished_.notify_all();
+  return true;
+}
+
+}  // namespace automl_zero
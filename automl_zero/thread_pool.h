@@ -0,0 +1,83 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef AUTOML_ZERO_THREAD_POOL_H_
+#define AUTOML_ZERO_THREAD_POOL_H_
+
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "definitions.h"
+
+namespace automl_zero {
+
+// A fixed set of threads that run the iterations of parallel loops. The
+// iterations of a loop are dealt to one queue per thread. Each thread takes
+// iterations from the front of its own queue and, once it is empty, steals
+// them from the back of the other queues, so that the threads stay busy when
+// the iterations take different times.
+class ThreadPool {
+ public:
+  // The thread calling ParallelFor counts as one of the num_threads threads.
+  explicit ThreadPool(IntegerT num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+
+  IntegerT NumThreads() const {return num_threads_;}
+
+  // Calls `function` once for each iteration in [0, num_iterations), in any
+  // order and on any of the threads, and returns when all the calls have
+  // returned. Must not be called from `function` or from several threads at
+  // once.
+  void ParallelFor(IntegerT num_iterations,
+                   const std::function<void(IntegerT)>& function);
+
+ private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<IntegerT> iterations;
+  };
+
+  void WorkerLoop(IntegerT thread_index);
+
+  // Runs one iteration of the current loop, from the given thread's queue or
+  // stolen from another one. Returns false if there was none left.
+  bool RunOneIteration(IntegerT thread_index);
+
+  const IntegerT num_threads_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // Guards the fields below.
+  std::mutex lock_;
+  std::condition_variable loop_started_;
+  std::condition_variable loop_finished_;
+  // The body of the current loop. Set before the iterations are queued.
+  const std::function<void(IntegerT)>* function_;
+  // Counts the loops, so that the threads can tell a new one started.
+  IntegerT loop_index_;
+  IntegerT num_unfinished_iterations_;
+  bool stopping_;
+};
+
+}  // namespace automl_zero
+
+#endif  // AUTOML_ZERO_THREAD_POOL_H_
@@ -0,0 +1,89 @@
+// Copyright 2024 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <mutex>  // NOLINT(build/c++11)
+#include <set>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "definitions.h"
+#include "gtest/gtest.h"
+
+namespace automl_zero {
+
+using ::std::vector;  // NOLINT
+
+TEST(ThreadPoolTest, RunsEachIterationOnce) {
+  for (const IntegerT num_threads : {1, 2, 4}) {
+    ThreadPool thread_pool(num_threads);
+    EXPECT_EQ(thread_pool.NumThreads(), num_threads);
+    // Also fewer iterations than threads, and none.
+    for (const IntegerT num_iterations : {0, 1, 3, 100}) {
+      vector<std::atomic<IntegerT>> num_calls(num_iterations);
+      for (std::atomic<IntegerT>& count : num_calls) count = 0;
+      thread_pool.ParallelFor(num_iterations, [&](const IntegerT i) {
+        ++num_calls[i];
+      });
+      for (const std::atomic<IntegerT>& count : num_calls) {
+        EXPECT_EQ(count.load(), 1);
+      }
+    }
+  }
+}
+
+TEST(ThreadPoolTest, WaitsForAllIterations) {
+  ThreadPool thread_pool(4);
+  std::atomic<IntegerT> num_finished(0);
+  thread_pool.ParallelFor(8, [&](const IntegerT i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10 * (i % 3)));
+    ++num_finished;
+  });
+  EXPECT_EQ(num_finished.load(), 8);
+}
+
+TEST(ThreadPoolTest, UsesSeveralThreads) {
+  ThreadPool thread_pool(4);
+  std::mutex lock;
+  std::set<std::thread::id> thread_ids;
+  // All the threads must be in an iteration at the same time to finish.
+  std::atomic<IntegerT> num_started(0);
+  thread_pool.ParallelFor(4, [&](const IntegerT i) {
+    ++num_started;
+    while (num_started.load() < 4) std::this_thread::yield();
+    std::lock_guard<std::mutex> guard(lock);
+    thread_ids.insert(std::this_thread::get_id());
+  });
+  EXPECT_EQ(thread_ids.size(), 4);
+}
+
+TEST(ThreadPoolTest, StealsFromBusyThreads) {
+  ThreadPool thread_pool(2);
+  // Thread 0 is dealt iterations 0 to 9 and is stuck in iteration 0 until the
+  // other thread has run all the others, its own and the stolen ones.
+  std::atomic<IntegerT> num_others_finished(0);
+  thread_pool.ParallelFor(20, [&](const IntegerT i) {
+    if (i == 0) {
+      while (num_others_finished.load() < 19) std::this_thread::yield();
+    } else {
+      ++num_others_finished;
+    }
+  });
+  EXPECT_EQ(num_others_finished.load(), 19);
+}
+
+}  // namespace automl_zero
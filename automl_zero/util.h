@@ -29,7 +29,7 @@ IntegerT Pow2(const IntegerT exp);
 size_t Pow2(const size_t exp);
 
 template<FeatureIndexT F>
-bool VectorEq(const Vector<F>& observed, const std::vector<double>& expected) {
+bool VectorEq(const Vector<F>& observed, const std::vector<Scalar>& expected) {
   if (expected.size() != F) {
     std::cout << "Wrong size. observed size = " << F
               << ", expected size = " << expected.size() << std::endl;